@@ -0,0 +1,123 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#if defined(ARDUINO_ARCH_SPRESENSE) && !defined(SUBCORE)
+
+#include "EnvelopeGenerator.h"
+
+static const int kTableBits = 6;
+static const int kTableSize = 1 << kTableBits;
+static const uint32_t kTableEnd = (uint32_t)kTableSize << 16;
+
+// (exp(5x) - 1) / (exp(5) - 1) in Q14, x = 0 to 1
+static const int16_t kExponentialCurve[kTableSize + 1] = {
+    0,     9,     19,    29,    41,    53,    66,    81,    96,    113,   132,   151,   173,   196,   221,   248,   277,
+    308,   342,   379,   419,   462,   509,   559,   614,   672,   736,   805,   879,   960,   1047,  1141,  1243,  1353,
+    1472,  1600,  1740,  1890,  2053,  2228,  2418,  2624,  2846,  3087,  3346,  3627,  3931,  4260,  4615,  4999,  5414,
+    5863,  6348,  6873,  7441,  8055,  8718,  9436,  10211, 11050, 11957, 12938, 13998, 15144, 16384};
+
+const int16_t EnvelopeGenerator::kLevelMax;
+
+EnvelopeGenerator::EnvelopeGenerator()
+    : attack_samples_(0),
+      release_samples_(0),
+      curve_(kCurveLinear),
+      phase_(kPhaseIdle),
+      pos_(0),
+      step_(0),
+      level_(0),
+      release_level_(0) {
+}
+
+void EnvelopeGenerator::setup(uint32_t attack_samples, uint32_t release_samples, Curve curve) {
+    attack_samples_ = attack_samples;
+    release_samples_ = release_samples;
+    curve_ = curve;
+}
+
+void EnvelopeGenerator::setRelease(uint32_t release_samples) {
+    release_samples_ = release_samples;
+}
+
+void EnvelopeGenerator::start() {
+    level_ = 0;
+    enter(kPhaseAttack, attack_samples_);
+}
+
+void EnvelopeGenerator::release() {
+    if (phase_ == kPhaseRelease || phase_ == kPhaseDone) {
+        return;
+    }
+    release_level_ = level_;
+    enter(kPhaseRelease, release_samples_);
+}
+
+int16_t EnvelopeGenerator::advance(uint32_t samples) {
+    if (phase_ != kPhaseAttack && phase_ != kPhaseRelease) {
+        return level_;
+    }
+    uint64_t pos = (uint64_t)pos_ + (uint64_t)step_ * samples;
+    if (pos >= kTableEnd) {
+        enter((phase_ == kPhaseAttack) ? kPhaseSustain : kPhaseDone, 0);
+        return level_;
+    }
+    pos_ = (uint32_t)pos;
+    // both phases run the curve backwards from its end, so attack rises fast and release falls fast
+    int16_t s = shape(kTableEnd - pos_);
+    if (phase_ == kPhaseAttack) {
+        level_ = kLevelMax - s;
+    } else {
+        level_ = (int16_t)(((int32_t)release_level_ * s) >> 14);
+    }
+    return level_;
+}
+
+int16_t EnvelopeGenerator::getLevel() const {
+    return level_;
+}
+
+EnvelopeGenerator::Phase EnvelopeGenerator::getPhase() const {
+    return phase_;
+}
+
+bool EnvelopeGenerator::isDone() const {
+    return phase_ == kPhaseDone;
+}
+
+void EnvelopeGenerator::enter(Phase phase, uint32_t samples) {
+    if (samples == 0) {
+        // nothing to ramp: settle at the end of the phase
+        if (phase == kPhaseAttack) {
+            phase = kPhaseSustain;
+        } else if (phase == kPhaseRelease) {
+            phase = kPhaseDone;
+        }
+    }
+    phase_ = phase;
+    pos_ = 0;
+    // round up so that the phase ends within the given samples
+    step_ = (samples > 0) ? (uint32_t)((kTableEnd + samples - 1) / samples) : 0;
+    if (phase_ == kPhaseSustain) {
+        level_ = kLevelMax;
+    } else if (phase_ == kPhaseDone) {
+        level_ = 0;
+    }
+}
+
+int16_t EnvelopeGenerator::shape(uint32_t pos) const {
+    if (curve_ == kCurveLinear) {
+        return (int16_t)(pos >> (16 + kTableBits - 14));
+    }
+    uint32_t index = pos >> 16;
+    if (index >= (uint32_t)kTableSize) {
+        return kExponentialCurve[kTableSize];
+    }
+    int32_t a = kExponentialCurve[index];
+    int32_t b = kExponentialCurve[index + 1];
+    return (int16_t)(a + (((b - a) * (int32_t)(pos & 0xFFFF)) >> 16));
+}
+
+#endif  // ARDUINO_ARCH_SPRESENSE
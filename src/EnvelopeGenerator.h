@@ -0,0 +1,118 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+/**
+ * @file EnvelopeGenerator.h
+ */
+#ifndef ENVELOPE_GENERATOR_H_
+#define ENVELOPE_GENERATOR_H_
+
+#include <stdint.h>
+
+/**
+ * @brief @~japanese アタックとリリースだけを持つ固定小数点のエンベロープです。
+ * @details @~japanese レベルは Q14 (16384 = 1.0) で表します。
+ * EnvelopeGenerator::advance() で進めたサンプル数に応じてレベルを返すので、
+ * ミックス時はブロックの先頭と末尾のレベルの間を線形に補間して掛けます。
+ * 指数カーブはあらかじめ計算したテーブルを補間して求めるので、サンプルごとの除算や浮動小数点演算はありません。
+ */
+class EnvelopeGenerator {
+public:
+    /**
+     * @brief @~japanese アタックとリリースのカーブです。
+     */
+    enum Curve {
+        kCurveLinear,       ///< @~japanese 直線
+        kCurveExponential,  ///< @~japanese 指数(アタックは速く立ち上がり、リリースは速く減衰して尾を引く)
+        kCurveMax = kCurveExponential
+    };
+
+    /**
+     * @brief @~japanese エンベロープの段階です。
+     */
+    enum Phase {
+        kPhaseIdle,
+        kPhaseAttack,
+        kPhaseSustain,
+        kPhaseRelease,
+        kPhaseDone
+    };
+
+    /**
+     * @brief @~japanese 最大レベル (Q14) です。
+     */
+    static const int16_t kLevelMax = 0x4000;
+
+    /**
+     * @brief @~japanese EnvelopeGenerator オブジェクトを生成します。
+     */
+    EnvelopeGenerator();
+
+    /**
+     * @brief @~japanese アタックとリリースの長さとカーブを設定します。次の EnvelopeGenerator::start() から有効になります。
+     * @param[in] attack_samples @~japanese アタックの長さ [sample] (0 で即座に最大レベル)
+     * @param[in] release_samples @~japanese リリースの長さ [sample] (0 で即座に無音)
+     * @param[in] curve @~japanese カーブ
+     */
+    void setup(uint32_t attack_samples, uint32_t release_samples, Curve curve);
+
+    /**
+     * @brief @~japanese リリースの長さだけを変更します。次の EnvelopeGenerator::release() から有効になります。
+     * @param[in] release_samples @~japanese リリースの長さ [sample] (0 で即座に無音)
+     */
+    void setRelease(uint32_t release_samples);
+
+    /**
+     * @brief @~japanese レベル 0 からアタックを開始します。
+     */
+    void start();
+
+    /**
+     * @brief @~japanese 現在のレベルからリリースを開始します。
+     */
+    void release();
+
+    /**
+     * @brief @~japanese エンベロープを進めます。
+     * @param[in] samples @~japanese 進めるサンプル数
+     * @return Q14 level after the samples
+     */
+    int16_t advance(uint32_t samples);
+
+    /**
+     * @brief @~japanese 現在のレベルを取得します。
+     * @return Q14 level
+     */
+    int16_t getLevel() const;
+
+    /**
+     * @brief @~japanese 現在の段階を取得します。
+     * @return phase
+     */
+    Phase getPhase() const;
+
+    /**
+     * @brief @~japanese リリースが終わったかを取得します。
+     * @retval true @~japanese リリースが終わった
+     * @retval false @~japanese リリースが終わっていない
+     */
+    bool isDone() const;
+
+private:
+    uint32_t attack_samples_;
+    uint32_t release_samples_;
+    Curve curve_;
+    Phase phase_;
+    uint32_t pos_;   // Q16 position in the curve table
+    uint32_t step_;  // Q16 table steps per sample
+    int16_t level_;
+    int16_t release_level_;
+
+    void enter(Phase phase, uint32_t samples);
+    int16_t shape(uint32_t pos) const;
+};
+
+#endif  // ENVELOPE_GENERATOR_H_
@@ -0,0 +1,172 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#if defined(ARDUINO_ARCH_SPRESENSE) && !defined(SUBCORE)
+
+#include "FilePool.h"
+
+// #define DEBUG (1)
+
+// clang-format off
+#define nop(...) do {} while (0)
+// clang-format on
+#ifdef DEBUG
+#define trace_printf nop
+#define debug_printf printf
+#define error_printf printf
+#else  // DEBUG
+#define trace_printf nop
+#define debug_printf nop
+#define error_printf printf
+#endif  // DEBUG
+
+static const char kClassName[] = "FilePool";
+
+const int FilePool::kDefaultCapacity;
+
+FilePool::FilePool(int capacity, int max_in_use)
+    : capacity_((capacity > 0) ? capacity : 1), handles_(), clock_(0), open_count_(0), hit_count_(0), eviction_count_(0) {
+    // every handle in use and the idle ones kept open fit in the larger of the two
+    handles_.resize((max_in_use > capacity_) ? max_in_use : capacity_);
+    for (auto& e : handles_) {
+        e.open = false;
+        e.in_use = false;
+        e.stamp = 0;
+    }
+}
+
+FilePool::~FilePool() {
+    for (auto& e : handles_) {
+        if (e.open) {
+            e.file.close();
+        }
+    }
+}
+
+File* FilePool::acquire(const String& path) {
+    trace_printf("[%s::%s] (\"%s\")\n", kClassName, __func__, path.c_str());
+    // the most recently released handle first
+    Handle* hit = nullptr;
+    for (auto& e : handles_) {
+        if (e.open && !e.in_use && e.path == path && (hit == nullptr || e.stamp > hit->stamp)) {
+            hit = &e;
+        }
+    }
+    if (hit != nullptr) {
+        hit->in_use = true;
+        hit_count_++;
+        return &hit->file;
+    }
+
+    // a closed handle first, then the least recently released one
+    Handle* handle = nullptr;
+    for (auto& e : handles_) {
+        if (!e.open) {
+            handle = &e;
+            break;
+        }
+    }
+    if (handle == nullptr) {
+        handle = findLeastRecentlyUsed();
+    }
+    if (handle == nullptr) {
+        error_printf("[%s::%s] error: all %d handles are in use\n", kClassName, __func__, (int)handles_.size());
+        return nullptr;
+    }
+    if (handle->open) {
+        close(handle);
+        eviction_count_++;
+    }
+    handle->file = File(path.c_str());
+    if (!handle->file) {
+        return nullptr;
+    }
+    handle->path = path;
+    handle->open = true;
+    handle->in_use = true;
+    open_count_++;
+    evict();
+    debug_printf("[%s::%s] open \"%s\" (%d handles)\n", kClassName, __func__, path.c_str(), getHandleCount());
+    return &handle->file;
+}
+
+void FilePool::release(File* file) {
+    if (file == nullptr) {
+        return;
+    }
+    for (auto& e : handles_) {
+        if (&e.file == file && e.in_use) {
+            e.in_use = false;
+            e.stamp = ++clock_;
+            evict();
+            return;
+        }
+    }
+    error_printf("[%s::%s] error: unknown handle %p\n", kClassName, __func__, file);
+}
+
+void FilePool::clear() {
+    for (auto& e : handles_) {
+        if (e.open && !e.in_use) {
+            close(&e);
+        }
+    }
+}
+
+int FilePool::getHandleCount() {
+    int count = 0;
+    for (const auto& e : handles_) {
+        count += e.open ? 1 : 0;
+    }
+    return count;
+}
+
+uint32_t FilePool::getOpenCount() {
+    return open_count_;
+}
+
+uint32_t FilePool::getHitCount() {
+    return hit_count_;
+}
+
+uint32_t FilePool::getEvictionCount() {
+    return eviction_count_;
+}
+
+void FilePool::resetCounters() {
+    open_count_ = 0;
+    hit_count_ = 0;
+    eviction_count_ = 0;
+}
+
+FilePool::Handle* FilePool::findLeastRecentlyUsed() {
+    Handle* victim = nullptr;
+    for (auto& e : handles_) {
+        if (e.open && !e.in_use && (victim == nullptr || e.stamp < victim->stamp)) {
+            victim = &e;
+        }
+    }
+    return victim;
+}
+
+void FilePool::close(Handle* handle) {
+    debug_printf("[%s::%s] close \"%s\"\n", kClassName, __func__, handle->path.c_str());
+    handle->file.close();
+    handle->open = false;
+}
+
+void FilePool::evict() {
+    for (int count = getHandleCount(); count > capacity_; count--) {
+        Handle* victim = findLeastRecentlyUsed();
+        if (victim == nullptr) {
+            break;
+        }
+        close(victim);
+        eviction_count_++;
+    }
+}
+
+#endif  // ARDUINO_ARCH_SPRESENSE
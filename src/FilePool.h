@@ -0,0 +1,115 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+/**
+ * @file FilePool.h
+ */
+#ifndef FILE_POOL_H_
+#define FILE_POOL_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <Arduino.h>
+#include <File.h>
+
+/**
+ * @brief @~japanese 音声ファイルのハンドルを開いたまま再利用します。
+ * @details @~japanese ノートごとにファイルを開き直すと、そのたびにパスの解決とディレクトリの探索が発生します。
+ * FilePool は使い終わったハンドルを閉じずに保持して、同じパスを次に開くときに再利用します。
+ * 1つのハンドルは同時に1つのボイスだけが使うので、ボイスごとに独立した読み出し位置を持ちます。
+ * 開いているハンドルが上限を超えると、使われていないハンドルを最も古く使われたものから閉じます。
+ * ハンドルの管理領域は生成時に確保し、閉じたハンドルの領域を次のファイルに再利用するので、
+ * ファイルを開き直すときも FilePool 自身はヒープを確保しません (ファイルを開く処理そのものはファイルシステムが確保します)。
+ */
+class FilePool {
+public:
+    /**
+     * @brief @~japanese 開いたままにするハンドル数の上限の初期値です。
+     */
+    static const int kDefaultCapacity = 8;
+
+    /**
+     * @brief @~japanese FilePool オブジェクトを生成します。
+     * @param[in] capacity @~japanese 開いたままにするハンドル数の上限 (使用中のハンドルはこの数を超えても閉じません)
+     * @param[in] max_in_use @~japanese 同時に使用するハンドル数の上限 (これを超えると FilePool::acquire() は失敗します)
+     */
+    explicit FilePool(int capacity = kDefaultCapacity, int max_in_use = kDefaultCapacity);
+
+    ~FilePool();
+
+    /**
+     * @brief @~japanese ファイルのハンドルを取得します。
+     * @details @~japanese 同じパスの使われていないハンドルがあれば再利用し、なければファイルを開きます。
+     * 読み出し位置は前の使用者のままなので、使う前に seek してください。
+     * @param[in] path @~japanese ファイルパス
+     * @return @~japanese ハンドル (開けなかった場合と、同時に使用するハンドル数の上限に達している場合は nullptr)
+     */
+    File* acquire(const String& path);
+
+    /**
+     * @brief @~japanese 使い終わったハンドルを返却します。ハンドルは閉じずに再利用に備えます。
+     * @param[in] file @~japanese FilePool::acquire() で取得したハンドル (nullptr は無視します)
+     */
+    void release(File* file);
+
+    /**
+     * @brief @~japanese 使われていないハンドルをすべて閉じます。
+     */
+    void clear();
+
+    /**
+     * @brief @~japanese 開いているハンドル数を取得します。
+     * @return number of handles
+     */
+    int getHandleCount();
+
+    /**
+     * @brief @~japanese ファイルを開いた回数を取得します。
+     * @return open count
+     */
+    uint32_t getOpenCount();
+
+    /**
+     * @brief @~japanese 開いたままのハンドルを再利用した回数を取得します。
+     * @return hit count
+     */
+    uint32_t getHitCount();
+
+    /**
+     * @brief @~japanese 上限を超えたためにハンドルを閉じた回数を取得します。
+     * @return eviction count
+     */
+    uint32_t getEvictionCount();
+
+    /**
+     * @brief @~japanese 回数をクリアします。
+     */
+    void resetCounters();
+
+private:
+    struct Handle {
+        String path;     // kept when closed, so that the next path reuses its buffer
+        File file;
+        bool open;
+        bool in_use;
+        uint32_t stamp;  // when released, to find the least recently used
+    };
+
+    int capacity_;
+    std::vector<Handle> handles_;  // allocated once; handed-out pointers stay valid
+    uint32_t clock_;
+    uint32_t open_count_;
+    uint32_t hit_count_;
+    uint32_t eviction_count_;
+
+    Handle* findLeastRecentlyUsed();
+    void close(Handle* handle);
+    void evict();
+};
+
+#endif  // FILE_POOL_H_
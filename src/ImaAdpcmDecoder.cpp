@@ -0,0 +1,210 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#if defined(ARDUINO_ARCH_SPRESENSE) && !defined(SUBCORE)
+
+#include "ImaAdpcmDecoder.h"
+
+// #define DEBUG (1)
+
+// clang-format off
+#define nop(...) do {} while (0)
+// clang-format on
+#ifdef DEBUG
+#define trace_printf nop
+#define debug_printf printf
+#define error_printf printf
+#else  // DEBUG
+#define trace_printf nop
+#define debug_printf nop
+#define error_printf printf
+#endif  // DEBUG
+
+static const char kClassName[] = "ImaAdpcmDecoder";
+
+// header of a block: int16_t predictor, uint8_t step index, reserved byte per channel
+static const int kHeaderSize = 4;
+// then 4 bytes (8 samples) of each channel in turn
+static const int kGroupSize = 4;
+static const int kGroupFrames = 8;
+static const int kMaxIndex = 88;
+
+static const int8_t kIndexTable[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+static const int16_t kStepTable[kMaxIndex + 1] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,    19,    21,    23,    25,    28,    31,    34,    37,
+    41,    45,    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,   130,   143,   157,   173,   190,   209,
+    230,   253,   279,   307,   337,   371,   408,   449,   494,   544,   598,   658,   724,   796,   876,   963,   1060,  1166,
+    1282,  1411,  1552,  1707,  1878,  2066,  2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,  5894,  6484,
+    7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+static inline int16_t decodeNibble(uint8_t nibble, int32_t* predictor, int32_t* index) {
+    int32_t step = kStepTable[*index];
+    int32_t diff = step >> 3;
+    if (nibble & 1) {
+        diff += step >> 2;
+    }
+    if (nibble & 2) {
+        diff += step >> 1;
+    }
+    if (nibble & 4) {
+        diff += step;
+    }
+    int32_t p = (nibble & 8) ? *predictor - diff : *predictor + diff;
+    p = (p < -32768) ? -32768 : ((p > 32767) ? 32767 : p);
+    int32_t i = *index + kIndexTable[nibble];
+    *index = (i < 0) ? 0 : ((i > kMaxIndex) ? kMaxIndex : i);
+    *predictor = p;
+    return (int16_t)p;
+}
+
+const int ImaAdpcmDecoder::kMaxChannels;
+const uint32_t ImaAdpcmDecoder::kNoBlock;
+
+uint32_t ImaAdpcmDecoder::getFramesPerBlock(int channels, uint16_t block_align) {
+    if (channels < 1 || kMaxChannels < channels) {
+        return 0;
+    }
+    int header = kHeaderSize * channels;
+    int group = kGroupSize * channels;
+    if (block_align <= header || (block_align - header) % group != 0) {
+        return 0;
+    }
+    return 1 + (block_align - header) / group * kGroupFrames;
+}
+
+ImaAdpcmDecoder::ImaAdpcmDecoder()
+    : block_(nullptr),
+      size_(0),
+      channels_(0),
+      frames_(0),
+      pos_(0),
+      predictor_(),
+      index_(),
+      buffer_(nullptr),
+      buffer_size_(0),
+      block_index_(kNoBlock),
+      block_reads_(0) {
+}
+
+void ImaAdpcmDecoder::setBlockBuffer(uint8_t* buffer, size_t size) {
+    buffer_ = buffer;
+    buffer_size_ = size;
+    reset();
+}
+
+void ImaAdpcmDecoder::reset() {
+    block_ = nullptr;
+    frames_ = 0;
+    pos_ = 0;
+    block_index_ = kNoBlock;
+}
+
+bool ImaAdpcmDecoder::start(const uint8_t* block, size_t size, int channels) {
+    if (block == nullptr || channels < 1 || kMaxChannels < channels || size < (size_t)(kHeaderSize * channels)) {
+        reset();
+        return false;
+    }
+    block_ = block;
+    size_ = size;
+    channels_ = channels;
+    // a short last block ends at its last whole group
+    frames_ = 1 + (uint32_t)((size - kHeaderSize * channels) / (kGroupSize * channels)) * kGroupFrames;
+    pos_ = 0;
+    for (int c = 0; c < channels; c++) {
+        const uint8_t* h = &block[kHeaderSize * c];
+        predictor_[c] = (int16_t)(h[0] | (h[1] << 8));
+        index_[c] = (h[2] <= kMaxIndex) ? h[2] : kMaxIndex;
+    }
+    return true;
+}
+
+size_t ImaAdpcmDecoder::decode(int16_t* dst, size_t frames) {
+    size_t n = (frames < frames_ - pos_) ? frames : frames_ - pos_;
+    const uint8_t* data = &block_[kHeaderSize * channels_];
+    for (size_t i = 0; i < n; i++, pos_++) {
+        int16_t s[kMaxChannels];
+        if (pos_ == 0) {
+            // the header holds the first sample
+            for (int c = 0; c < channels_; c++) {
+                s[c] = (int16_t)predictor_[c];
+            }
+        } else {
+            uint32_t k = pos_ - 1;
+            const uint8_t* group = &data[(k / kGroupFrames) * kGroupSize * channels_ + (k % kGroupFrames) / 2];
+            int shift = (k & 1) ? 4 : 0;
+            for (int c = 0; c < channels_; c++) {
+                s[c] = decodeNibble((group[kGroupSize * c] >> shift) & 0x0F, &predictor_[c], &index_[c]);
+            }
+        }
+        dst[i * 2 + 0] = s[0];
+        dst[i * 2 + 1] = s[channels_ - 1];
+    }
+    return n;
+}
+
+size_t ImaAdpcmDecoder::skip(size_t frames) {
+    int16_t scratch[kGroupFrames * 2];
+    size_t done = 0;
+    while (done < frames) {
+        size_t n = (frames - done < (size_t)kGroupFrames) ? frames - done : kGroupFrames;
+        n = decode(scratch, n);
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+uint32_t ImaAdpcmDecoder::getPosition() const {
+    return pos_;
+}
+
+uint32_t ImaAdpcmDecoder::getFrameCount() const {
+    return frames_;
+}
+
+size_t ImaAdpcmDecoder::read(File* file, const SampleFormat& format, uint32_t frame, int16_t* dst, size_t frames) {
+    if (file == nullptr || format.frames_per_block == 0) {
+        return 0;
+    }
+    // the seek table is the block arithmetic: every block starts from its own header
+    uint32_t block = frame / format.frames_per_block;
+    uint32_t in_block = frame % format.frames_per_block;
+    if (block != block_index_ || in_block < pos_) {
+        uint32_t offset = block * format.block_align;
+        if (offset >= format.data_size) {
+            return 0;
+        }
+        size_t size = (format.data_size - offset < format.block_align) ? format.data_size - offset : format.block_align;
+        if (buffer_ == nullptr || buffer_size_ < size) {
+            error_printf("[%s::%s] error: block of %d bytes does not fit\n", kClassName, __func__, (int)size);
+            return 0;
+        }
+        if (file->position() != format.data_offset + offset) {
+            file->seek(format.data_offset + offset);
+        }
+        int ret = file->read(buffer_, size);
+        block_reads_++;
+        if (ret <= 0 || !start(buffer_, (size_t)ret, format.channels)) {
+            error_printf("[%s::%s] error: read error at %d\n", kClassName, __func__, (int)(format.data_offset + offset));
+            return 0;
+        }
+        block_index_ = block;
+    }
+    size_t skip_frames = in_block - pos_;
+    if (skip(skip_frames) != skip_frames) {
+        return 0;
+    }
+    return decode(dst, frames);
+}
+
+uint32_t ImaAdpcmDecoder::getBlockReadCount() const {
+    return block_reads_;
+}
+
+#endif  // ARDUINO_ARCH_SPRESENSE
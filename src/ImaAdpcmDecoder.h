@@ -0,0 +1,130 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+/**
+ * @file ImaAdpcmDecoder.h
+ */
+#ifndef IMA_ADPCM_DECODER_H_
+#define IMA_ADPCM_DECODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <File.h>
+
+#include "SampleFormat.h"
+
+/**
+ * @brief @~japanese WAVファイルの IMA ADPCM (4:1) の音声データを、ブロック単位で少しずつ復号します。
+ * @details @~japanese IMA ADPCM のブロックは先頭に予測値とステップ番号を持つので、ブロックの先頭からは単独で復号できます。
+ * ImaAdpcmDecoder::read() は読み込んだブロックと復号の途中の状態を保持するので、
+ * 同じブロックの続きはファイルを読み直さずに復号を続けます。
+ * ブロックの途中へのシークは、ブロックの先頭から復号して読み飛ばします。
+ * 出力は 1ch の場合も 2ch (interleaved) です。
+ */
+class ImaAdpcmDecoder {
+public:
+    /**
+     * @brief @~japanese 扱えるチャンネル数の上限です。
+     */
+    static const int kMaxChannels = 2;
+
+    /**
+     * @brief @~japanese 1ブロックから復号できるフレーム数を計算します。
+     * @param[in] channels @~japanese チャンネル数
+     * @param[in] block_align @~japanese ブロックのバイト数
+     * @return @~japanese フレーム数 (扱えない形式の場合は 0)
+     */
+    static uint32_t getFramesPerBlock(int channels, uint16_t block_align);
+
+    /**
+     * @brief @~japanese ImaAdpcmDecoder オブジェクトを生成します。
+     */
+    ImaAdpcmDecoder();
+
+    /**
+     * @brief @~japanese ImaAdpcmDecoder::read() がファイルから読んだブロックを置くバッファを設定します。
+     * @param[in] buffer @~japanese バッファ (ImaAdpcmDecoder の破棄まで有効なこと)
+     * @param[in] size @~japanese バッファのバイト数 (ブロックのバイト数以上)
+     */
+    void setBlockBuffer(uint8_t* buffer, size_t size);
+
+    /**
+     * @brief @~japanese 読み込んだブロックを忘れます。別のファイルを読む前に呼び出します。
+     */
+    void reset();
+
+    /**
+     * @brief @~japanese メモリ上のブロックの復号を始めます。
+     * @param[in] block @~japanese ブロックの先頭 (復号が終わるまで有効なこと)
+     * @param[in] size @~japanese ブロックのバイト数 (最後のブロックは短いことがあります)
+     * @param[in] channels @~japanese チャンネル数
+     * @retval true success
+     * @retval false the block is too short or channels is not supported
+     */
+    bool start(const uint8_t* block, size_t size, int channels);
+
+    /**
+     * @brief @~japanese ブロックの続きを復号します。ブロックの終わりで止まります。
+     * @param[out] dst @~japanese 出力 (interleaved, 2 channels)
+     * @param[in] frames @~japanese 復号するフレーム数
+     * @return @~japanese 復号したフレーム数
+     */
+    size_t decode(int16_t* dst, size_t frames);
+
+    /**
+     * @brief @~japanese ブロックの続きを出力せずに復号します。
+     * @param[in] frames @~japanese 読み飛ばすフレーム数
+     * @return @~japanese 読み飛ばしたフレーム数
+     */
+    size_t skip(size_t frames);
+
+    /**
+     * @brief @~japanese ブロック内の次に復号するフレームの番号を取得します。
+     * @return frame index in the block
+     */
+    uint32_t getPosition() const;
+
+    /**
+     * @brief @~japanese 復号中のブロックのフレーム数を取得します。
+     * @return frames in the block
+     */
+    uint32_t getFrameCount() const;
+
+    /**
+     * @brief @~japanese ファイルの音声データを、指定したフレームから復号します。1回の呼び出しでは1ブロックの終わりまでです。
+     * @param[in] file @~japanese 音声ファイル
+     * @param[in] format @~japanese 音声データの形式 (SampleFormat::kCodecImaAdpcm)
+     * @param[in] frame @~japanese 音声データの先頭からのフレーム番号
+     * @param[out] dst @~japanese 出力 (interleaved, 2 channels)
+     * @param[in] frames @~japanese 復号するフレーム数
+     * @return @~japanese 復号したフレーム数 (0: 音声データの終わり、または読み込みエラー)
+     */
+    size_t read(File* file, const SampleFormat& format, uint32_t frame, int16_t* dst, size_t frames);
+
+    /**
+     * @brief @~japanese ImaAdpcmDecoder::read() がファイルからブロックを読んだ回数を取得します。
+     * @return number of block reads
+     */
+    uint32_t getBlockReadCount() const;
+
+private:
+    const uint8_t* block_;
+    size_t size_;
+    int channels_;
+    uint32_t frames_;  // frames in block_
+    uint32_t pos_;     // next frame to decode in block_
+    int32_t predictor_[kMaxChannels];
+    int32_t index_[kMaxChannels];
+    uint8_t* buffer_;
+    size_t buffer_size_;
+    uint32_t block_index_;  // block held in buffer_, kNoBlock if none
+    uint32_t block_reads_;
+
+    static const uint32_t kNoBlock = 0xFFFFFFFF;
+};
+
+#endif  // IMA_ADPCM_DECODER_H_
@@ -0,0 +1,100 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#if defined(ARDUINO_ARCH_SPRESENSE) && !defined(SUBCORE)
+
+#include "LatencyController.h"
+
+// refill = preload * kRefillScale + kRefillMargin, so that the default preload keeps the former refill of 10 frames
+static const int kRefillScale = 2;
+static const int kRefillMargin = 4;
+static const int kMinRefillFrames = 2;
+
+const int LatencyController::kDefaultPreloadFrames;
+const int LatencyController::kMinPreloadFrames;
+const uint32_t LatencyController::kCooldownFrames;
+const uint32_t LatencyController::kMaxCooldownFrames;
+
+LatencyController::LatencyController(uint32_t frame_us, int max_frames)
+    : frame_us_(frame_us),
+      max_frames_(max_frames),
+      fixed_frames_(0),
+      floor_frames_(kDefaultPreloadFrames),
+      peak_read_us_(0),
+      last_underruns_(0),
+      last_change_frame_(0),
+      cooldown_frames_(kCooldownFrames),
+      started_(false) {
+}
+
+void LatencyController::reportRead(uint32_t elapsed_us) {
+    // follow a new peak at once and forget it slowly (1/64 per read, rounded up so that it reaches 0)
+    peak_read_us_ -= (peak_read_us_ + 63) >> 6;
+    if (elapsed_us > peak_read_us_) {
+        peak_read_us_ = elapsed_us;
+    }
+}
+
+void LatencyController::update(uint32_t underruns, uint32_t rendered_frames) {
+    if (!started_) {
+        last_underruns_ = underruns;
+        last_change_frame_ = rendered_frames;
+        started_ = true;
+        return;
+    }
+    if (underruns != last_underruns_) {
+        // back off quickly and wait longer before trying a shorter latency again
+        floor_frames_ = (floor_frames_ + 1 < max_frames_) ? floor_frames_ + 1 : max_frames_ - 1;
+        cooldown_frames_ = (cooldown_frames_ * 2 < kMaxCooldownFrames) ? cooldown_frames_ * 2 : kMaxCooldownFrames;
+        last_underruns_ = underruns;
+        last_change_frame_ = rendered_frames;
+    } else if (rendered_frames - last_change_frame_ >= cooldown_frames_) {
+        if (floor_frames_ > kMinPreloadFrames) {
+            floor_frames_--;
+        }
+        last_change_frame_ = rendered_frames;
+    }
+}
+
+int LatencyController::getPreloadFrames() {
+    if (fixed_frames_ > 0) {
+        return fixed_frames_;
+    }
+    // cover the longest read seen recently plus the frame being mixed
+    int jitter_frames = (int)((peak_read_us_ + frame_us_ - 1) / frame_us_) + 1;
+    int frames = (floor_frames_ > jitter_frames) ? floor_frames_ : jitter_frames;
+    return (frames < max_frames_) ? frames : max_frames_ - 1;
+}
+
+int LatencyController::getRefillFrames() {
+    int frames = getPreloadFrames() * kRefillScale + kRefillMargin;
+    frames = (frames < max_frames_) ? frames : max_frames_;
+    return (frames > kMinRefillFrames) ? frames : kMinRefillFrames;
+}
+
+int LatencyController::getTargetLatency() {
+    return (int)((uint32_t)getPreloadFrames() * frame_us_ / 1000);
+}
+
+bool LatencyController::setTargetLatency(int latency_ms) {
+    if (latency_ms < 0) {
+        return false;
+    }
+    if (latency_ms == 0) {
+        fixed_frames_ = 0;
+        return true;
+    }
+    int frames = (int)(((uint32_t)latency_ms * 1000 + frame_us_ - 1) / frame_us_);
+    frames = (frames > kMinPreloadFrames) ? frames : kMinPreloadFrames;
+    fixed_frames_ = (frames < max_frames_) ? frames : max_frames_ - 1;
+    return true;
+}
+
+uint32_t LatencyController::getPeakReadTime() {
+    return peak_read_us_;
+}
+
+#endif  // ARDUINO_ARCH_SPRESENSE
@@ -0,0 +1,115 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+/**
+ * @file LatencyController.h
+ */
+#ifndef LATENCY_CONTROLLER_H_
+#define LATENCY_CONTROLLER_H_
+
+#include <stdint.h>
+
+/**
+ * @brief @~japanese 発音開始時の先読み量と、更新ごとの補充量を実行時に調整します。
+ * @details @~japanese 先読み量はノートオンから発音までの遅延になるので、少ないほど応答が良くなりますが、
+ * ストレージの読み出しが遅れるとアンダーランします。
+ * LatencyController はストレージの読み出し時間の揺らぎと PcmRenderer で起きたアンダーランを観測して、
+ * アンダーランが起きない範囲で最小の先読み量を選びます。
+ * - アンダーランを観測したら先読み量を1フレーム増やし、次に減らすまでの待ち時間を2倍にします。
+ * - 待ち時間の間アンダーランがなければ、先読み量を1フレーム減らします。
+ * - 読み出し時間のピークが長いほど、先読み量の下限を引き上げます。
+ *
+ * PcmRenderer が OutputMixer に先送りするフレーム数と、チャンネルごとのキャッシュサイズは調整しません。
+ * 前者は発音前の PcmRenderer::begin() で決まり、実行中に変えると出力が途切れるためです。
+ * 後者は生成時に確保するメモリで、先読み量の上限になります。
+ */
+class LatencyController {
+public:
+    /**
+     * @brief @~japanese 先読み量の初期値 [frame] です。
+     */
+    static const int kDefaultPreloadFrames = 3;
+
+    /**
+     * @brief @~japanese 先読み量の下限 [frame] です。
+     */
+    static const int kMinPreloadFrames = 1;
+
+    /**
+     * @brief @~japanese 先読み量を減らすまでの待ち時間の初期値 [frame] です。
+     */
+    static const uint32_t kCooldownFrames = 2000;
+
+    /**
+     * @brief @~japanese 先読み量を減らすまでの待ち時間の上限 [frame] です。
+     */
+    static const uint32_t kMaxCooldownFrames = 64000;
+
+    /**
+     * @brief @~japanese LatencyController オブジェクトを生成します。
+     * @param[in] frame_us @~japanese 1フレームの時間 [us]
+     * @param[in] max_frames @~japanese 音声出力チャンネルのキャッシュに入るフレーム数
+     */
+    LatencyController(uint32_t frame_us, int max_frames);
+
+    /**
+     * @brief @~japanese ストレージから1フレームを読み出した時間を通知します。
+     * @param[in] elapsed_us @~japanese 読み出し時間 [us]
+     */
+    void reportRead(uint32_t elapsed_us);
+
+    /**
+     * @brief @~japanese アンダーランの累計と出力済みフレーム数から先読み量を更新します。
+     * @param[in] underruns @~japanese アンダーランの累計 (PcmRenderer::getUnderrunCount())
+     * @param[in] rendered_frames @~japanese 出力済みフレーム数
+     */
+    void update(uint32_t underruns, uint32_t rendered_frames);
+
+    /**
+     * @brief @~japanese 発音開始時に先読みするフレーム数を取得します。
+     * @return preload frames
+     */
+    int getPreloadFrames();
+
+    /**
+     * @brief @~japanese 更新ごとに補充するフレーム数の上限を取得します。
+     * @return refill frames
+     */
+    int getRefillFrames();
+
+    /**
+     * @brief @~japanese 先読み量を時間で取得します。
+     * @return target latency [ms]
+     */
+    int getTargetLatency();
+
+    /**
+     * @brief @~japanese 先読み量を時間で固定します。
+     * @param[in] latency_ms @~japanese 先読み量 [ms] (0 で自動調整に戻します)
+     * @retval true Success
+     * @retval false Invalid value
+     */
+    bool setTargetLatency(int latency_ms);
+
+    /**
+     * @brief @~japanese 観測した読み出し時間のピークを取得します。
+     * @return peak read time [us]
+     */
+    uint32_t getPeakReadTime();
+
+private:
+    uint32_t frame_us_;
+    int max_frames_;
+    int fixed_frames_;
+    int floor_frames_;
+    uint32_t peak_read_us_;
+    uint32_t last_underruns_;
+    uint32_t last_change_frame_;
+    uint32_t cooldown_frames_;
+    bool started_;
+};
+
+#endif  // LATENCY_CONTROLLER_H_
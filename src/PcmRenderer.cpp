@@ -18,9 +18,8 @@
 #include <MemoryUtil.h>
 #include <arch/board/cxd56_audio.h>
 
-#define ARM_MATH_CM4
-#define __FPU_PRESENT 1U
-#include <cmsis/arm_math.h>
+#include "mix_kernel.h"
+#include "PcmWriter.h"
 
 // #define DEBUG (1)
 
@@ -39,8 +38,12 @@
 
 static const char kClassName[] = "PcmRenderer";
 
+// These two size the OutputMixer queue, not the storage side that LatencyController adapts.
+// The queue is filled with dummy frames in begin() before any note exists, and refilling it at run time
+// would put a gap in the output, so they stay fixed; the preload of the sinks comes on top of them.
 static const int kPreLoadFrames = 3;  //< Mixer starts when data is sent 3 frames or more
-static const uint8_t kUnderflowThreshold = 2;
+// keep the queue one frame short of the dummy frames before sending a frame that a channel could not fill
+static const uint8_t kUnderflowThreshold = kPreLoadFrames - 1;
 
 /**
  * @brief singleton of OutputMixer
@@ -95,6 +98,8 @@ static void pcmProcDoneCallback(int32_t identifier, bool is_end) {
     }
 }
 
+const int PcmRenderer::kMaxChannel;
+
 PcmRenderer::PcmRenderer(int sample_rate, int bit_depth, int channels, int samples_per_frame, size_t cache_capacity, int mix_channels)
     : sample_rate_(sample_rate),
       bit_depth_(bit_depth),
@@ -103,19 +108,37 @@ PcmRenderer::PcmRenderer(int sample_rate, int bit_depth, int channels, int sampl
       request_count_(0),
       response_count_(0),
       frames_(0),
+      underrun_count_(0),
       capacity_(cache_capacity),
-      mix_channels_((mix_channels < PcmRenderer::kMaxChannel) ? mix_channels : PcmRenderer::kMaxChannel),
-      states_(),
-      cache_(),
-      wp_(),
-      rp_() {
+      mix_channels_(constrain(mix_channels, 0, PcmRenderer::kMaxChannel)),
+      slab_(nullptr),
+      slots_(nullptr),
+      writer_(nullptr),
+      frame_(nullptr),
+      attack_samples_(samples_per_frame),
+      release_samples_(samples_per_frame),
+      curve_(EnvelopeGenerator::kCurveLinear),
+      bus_(nullptr),
+      master_gain_(MIX_GAIN_UNITY),
+      committed_size_(0),
+      copied_size_(0) {
     trace_printf("[%s::%s] (%d, %d, %d, %d, %d, %d)\n", kClassName, __func__, sample_rate, bit_depth, channels, samples_per_frame, (int)cache_capacity,
                  mix_channels);
+    // allocate caches of all channels from one contiguous slab
+    slab_ = new uint8_t[capacity_ * mix_channels_];
+    slots_ = new Channel[mix_channels_];
+    bus_ = new int32_t[samples_per_frame_ * channels_];
     for (int i = 0; i < mix_channels_; i++) {
-        states_[i] = kStateUnallocated;
-        cache_[i] = new uint8_t[capacity_];
-        wp_[i] = 0;
-        rp_[i] = 0;
+        slots_[i].state.store(kStateUnallocated, std::memory_order_relaxed);
+        slots_[i].fade_in = false;
+        slots_[i].gain = Gain{MIX_GAIN_UNITY, MIX_GAIN_UNITY};
+        slots_[i].target_gain.store(packGain(slots_[i].gain), std::memory_order_relaxed);
+        slots_[i].cache = &slab_[capacity_ * i];
+        slots_[i].wp.store(0, std::memory_order_relaxed);
+        slots_[i].rp.store(0, std::memory_order_relaxed);
+    }
+    for (int w = 0; w < kActiveWords; w++) {
+        active_[w].store(0, std::memory_order_relaxed);
     }
 }
 
@@ -124,10 +147,14 @@ PcmRenderer::~PcmRenderer() {
     if (g_renderer == this) {
         g_renderer = nullptr;
     }
-    for (int i = 0; i < mix_channels_; i++) {
-        delete[] cache_[i];
-        cache_[i] = nullptr;
-    }
+    delete[] frame_;
+    frame_ = nullptr;
+    delete[] bus_;
+    bus_ = nullptr;
+    delete[] slots_;
+    slots_ = nullptr;
+    delete[] slab_;
+    slab_ = nullptr;
 }
 
 void PcmRenderer::begin() {
@@ -182,6 +209,19 @@ void PcmRenderer::begin() {
             error_printf("[%s::%s] error: failed OutputMixer::sendData => %d\n", kClassName, __func__, err);
             continue;
         }
+        // count the dummy frames too, or their responses make request_count_ - response_count_ wrap around
+        request_count_++;
+    }
+}
+
+void PcmRenderer::begin(PcmWriter *writer) {
+    trace_printf("[%s::%s] (%p)\n", kClassName, __func__, writer);
+    const int bytes_per_sample = (bit_depth_ / 8) * channels_;
+    const size_t frame_size = bytes_per_sample * samples_per_frame_;
+
+    writer_ = writer;
+    if (frame_ == nullptr) {
+        frame_ = new uint8_t[frame_size];
     }
 }
 
@@ -195,18 +235,45 @@ bool PcmRenderer::render() {
     const int bytes_per_sample = (bit_depth_ / 8) * channels_;
     const size_t frame_size = bytes_per_sample * samples_per_frame_;
 
+    // take one snapshot of the active channels so that every channel in this frame is mixed with the same size
+    uint32_t active[kActiveWords];
+    for (int w = 0; w < kActiveWords; w++) {
+        active[w] = active_[w].load(std::memory_order_acquire);
+    }
+
+    // only the playing channels decide the frame size; ending channels are mixed as far as they have data
     size_t read_size = frame_size;
-    for (int i = 0; i < mix_channels_; i++) {
-        if (states_[i] != kStateUnallocated) {
-            read_size = (read_size < getReadableSize(i) ? read_size : getReadableSize(i));
+    bool playing = false;
+    for (int w = 0; w < kActiveWords; w++) {
+        for (uint32_t bits = active[w]; bits != 0; bits &= bits - 1) {
+            int i = w * kActiveWordBits + __builtin_ctz(bits);
+            if (slots_[i].state.load(std::memory_order_acquire) == kStateAllocated) {
+                read_size = (read_size < getReadableSize(i) ? read_size : getReadableSize(i));
+                playing = true;
+            }
         }
     }
+
+    if (writer_ != nullptr) {
+        // offline: there is no deadline to wait for, so always output one frame
+        if (playing && read_size < frame_size) {
+            underrun_count_.fetch_add(1, std::memory_order_relaxed);
+        }
+        mixFrame(active, frame_, read_size);
+        frames_++;
+        return writer_->write(frame_, frame_size) == frame_size;
+    }
+
     if (read_size < frame_size) {
         // if underflow is near, continue to sendData
         if (request_count_ - response_count_ > kUnderflowThreshold) {
             // retry after
             return false;
         }
+        if (playing) {
+            // a playing channel could not fill this frame
+            underrun_count_.fetch_add(1, std::memory_order_relaxed);
+        }
     }
 
     err_t err = ERR_OK;
@@ -228,41 +295,7 @@ bool PcmRenderer::render() {
 
     uint8_t *raw = reinterpret_cast<uint8_t *>(pcm.mh.getPa());
     // trace_printf("[%s::%s] readable=%d, framesize=%d, valid\n", kClassName, __func__, (int)read_size, (int)frame_size);
-    memset(raw, 0x00, frame_size);
-    for (int i = 0; i < mix_channels_; i++) {
-        if (states_[i] == kStateUnallocated) {
-            continue;
-        }
-        read_size = (read_size < getReadableSize(i) ? read_size : getReadableSize(i));
-        if (bit_depth_ == 16) {
-            size_t frame_sample_size = frame_size / 2;
-            int16_t *dst = reinterpret_cast<int16_t *>(raw);
-            int16_t src[frame_sample_size];
-            read(i, src, read_size);
-            if (states_[i] == kStateAllocated) {
-                for (size_t j = 0; j < frame_sample_size; j += 2) {
-                    *((uint32_t *)&dst[j]) = __QADD16(*((uint32_t *)&dst[j]), *((uint32_t *)&src[j]));
-                }
-            } else if (states_[i] == kStateDeallocating) {
-                // fade-out
-                trace_printf("[%d]:Deallocate\n", i);
-                for (size_t j = 0; j < frame_sample_size; j++) {
-                    src[j] = (int16_t)(src[j] * (float)(frame_sample_size - j) / (frame_sample_size));
-                }
-
-                for (size_t j = 0; j < frame_sample_size; j += 2) {
-                    *((uint32_t *)&dst[j]) = __QADD16(*((uint32_t *)&dst[j]), *((uint32_t *)&src[j]));
-                }
-                states_[i] = kStateDeallocated;
-            }
-        }
-        if (states_[i] == kStateDeallocating) {
-            states_[i] = kStateDeallocated;
-        }
-        if (states_[i] == kStateDeallocated && getReadableSize(i) == 0) {
-            states_[i] = kStateUnallocated;
-        }
-    }
+    mixFrame(active, raw, read_size);
 
     err = g_mixer->sendData(OutputMixer0, pcmProcDoneCallback, pcm);
     if (err != OUTPUTMIXER_ECODE_OK) {
@@ -274,6 +307,78 @@ bool PcmRenderer::render() {
     return true;
 }
 
+uint64_t PcmRenderer::getRenderedSamples() {
+    return (uint64_t)frames_ * samples_per_frame_;
+}
+
+uint32_t PcmRenderer::getUnderrunCount() {
+    return underrun_count_.load(std::memory_order_relaxed);
+}
+
+void PcmRenderer::mixFrame(const uint32_t *active, uint8_t *raw, size_t read_size) {
+    const int bytes_per_sample = (bit_depth_ / 8) * channels_;
+    const size_t frame_size = bytes_per_sample * samples_per_frame_;
+    const size_t samples = samples_per_frame_ * channels_;
+    memset(bus_, 0x00, samples * sizeof(bus_[0]));
+    for (int w = 0; w < kActiveWords; w++) {
+        for (uint32_t bits = active[w]; bits != 0; bits &= bits - 1) {
+            int i = w * kActiveWordBits + __builtin_ctz(bits);
+            Channel &c = slots_[i];
+            // act on one snapshot of the state; deallocateChannel() may change it while mixing
+            State state = c.state.load(std::memory_order_acquire);
+            if (state == kStateAllocating) {
+                // nothing is committed yet; data committed after the snapshot is mixed from the next frame
+                continue;
+            }
+            size_t size = (read_size < getReadableSize(i) ? read_size : getReadableSize(i));
+            bool released = true;
+            if (bit_depth_ == 16) {
+                int32_t *dst = bus_;
+                const Gain silence = {0, 0};
+                if (state == kStateAllocated) {
+                    // ramp to the latest gain over one block
+                    Gain target = unpackGain(c.target_gain.load(std::memory_order_relaxed));
+                    if (mixEnvelope(i, dst, size, c.gain, target) > 0) {
+                        c.fade_in = false;
+                        c.gain = target;
+                    }
+                    released = false;
+                } else if (state == kStateDeallocating && c.fade_in) {
+                    // released before it was heard: play the attack for this block and release it from the next one
+                    mixEnvelope(i, dst, size, c.gain, c.gain);
+                    c.fade_in = false;
+                    released = getReadableSize(i) == 0;
+                } else if (state == kStateDeallocating) {
+                    // release until the envelope or the written data ends
+                    trace_printf("[%d]:Deallocate\n", i);
+                    c.env.release();
+                    mixEnvelope(i, dst, size, c.gain, c.gain);
+                    released = c.env.isDone() || getReadableSize(i) == 0;
+                } else if (state == kStateDeallocated) {
+                    mixChannel(i, nullptr, size, silence, silence);
+                }
+            }
+            if (state == kStateDeallocating && released) {
+                // the release is done: drop the rest so that the channel can be reused from the next frame
+                c.rp.store(c.wp.load(std::memory_order_acquire), std::memory_order_release);
+                state = kStateDeallocated;
+                c.state.store(state, std::memory_order_release);
+            }
+            if (state == kStateDeallocated && getReadableSize(i) == 0) {
+                // hand the channel back to the producer: it must not see Unallocated while the bit is still set
+                deactivate(i);
+                c.state.store(kStateUnallocated, std::memory_order_release);
+            }
+        }
+    }
+    // apply the master gain once and soft-clip the whole mix
+    if (bit_depth_ == 16) {
+        mixLimit16(reinterpret_cast<int16_t *>(raw), bus_, samples, master_gain_.load(std::memory_order_relaxed));
+    } else {
+        memset(raw, 0x00, frame_size);
+    }
+}
+
 #if 0
 void PcmRenderer::onError(const ErrorAttentionParam *attparam) {
     error_printf("[%s::%s] error: OutputMixer(error_code=%d,%d)\n", kClassName, __func__, attparam->error_code, AS_ATTENTION_CODE_WARNING);
@@ -304,12 +409,61 @@ size_t PcmRenderer::getCapacity() {
     return capacity_;
 }
 
+void PcmRenderer::setMasterGain(int16_t gain) {
+    trace_printf("[%s::%s] (%d)\n", kClassName, __func__, gain);
+    master_gain_.store(gain, std::memory_order_relaxed);
+}
+
+int16_t PcmRenderer::getMasterGain() {
+    return master_gain_.load(std::memory_order_relaxed);
+}
+
+void PcmRenderer::setChannelGain(int ch, int16_t left, int16_t right) {
+    // trace_printf("[%s::%s] (%d, %d, %d)\n", kClassName, __func__, ch, left, right);
+    if (ch < 0 || mix_channels_ <= ch) {
+        return;
+    }
+    slots_[ch].target_gain.store(packGain(Gain{left, right}), std::memory_order_relaxed);
+}
+
+int PcmRenderer::getChannelCount() {
+    return mix_channels_;
+}
+
+int PcmRenderer::getActiveChannelCount() {
+    int count = 0;
+    for (int w = 0; w < kActiveWords; w++) {
+        count += __builtin_popcount(active_[w].load(std::memory_order_acquire));
+    }
+    return count;
+}
+
+void PcmRenderer::setEnvelope(int attack_ms, int release_ms, EnvelopeGenerator::Curve curve) {
+    trace_printf("[%s::%s] (%d, %d, %d)\n", kClassName, __func__, attack_ms, release_ms, curve);
+    attack_samples_ = convertMsToSamples(attack_ms, samples_per_frame_);
+    release_samples_ = convertMsToSamples(release_ms, samples_per_frame_);
+    curve_ = curve;
+}
+
 int PcmRenderer::allocateChannel() {
-    trace_printf("[%s::%s] ()\n", kClassName, __func__);
+    return allocateChannel(-1, -1);
+}
+
+int PcmRenderer::allocateChannel(int attack_ms, int release_ms) {
+    trace_printf("[%s::%s] (%d, %d)\n", kClassName, __func__, attack_ms, release_ms);
     for (int i = 0; i < mix_channels_; i++) {
-        if (states_[i] == kStateUnallocated) {
-            wp_[i] = rp_[i] = 0;
-            states_[i] = kStateAllocating;
+        Channel &c = slots_[i];
+        if (c.state.load(std::memory_order_acquire) == kStateUnallocated) {
+            // the consumer does not touch an inactive channel, so the ring can be reset here
+            c.wp.store(0, std::memory_order_relaxed);
+            c.rp.store(0, std::memory_order_relaxed);
+            c.fade_in = true;
+            c.env.setup(convertMsToSamples(attack_ms, attack_samples_), convertMsToSamples(release_ms, release_samples_), curve_);
+            c.env.start();
+            c.gain = Gain{MIX_GAIN_UNITY, MIX_GAIN_UNITY};
+            c.target_gain.store(packGain(c.gain), std::memory_order_relaxed);
+            c.state.store(kStateAllocating, std::memory_order_relaxed);
+            activate(i);
             debug_printf("[%s::%s] allocated %d\n", kClassName, __func__, i);
             return i;
         }
@@ -318,10 +472,22 @@ int PcmRenderer::allocateChannel() {
 }
 
 void PcmRenderer::deallocateChannel(int ch) {
-    trace_printf("[%s::%s] (%d)\n", kClassName, __func__, ch);
+    deallocateChannel(ch, -1);
+}
+
+void PcmRenderer::deallocateChannel(int ch, int release_ms) {
+    trace_printf("[%s::%s] (%d, %d)\n", kClassName, __func__, ch, release_ms);
     if (0 <= ch && ch < mix_channels_) {
-        states_[ch] = kStateDeallocating;
-        trace_printf("[%d]:Deallocating\n", ch);
+        Channel &c = slots_[ch];
+        State state = c.state.load(std::memory_order_acquire);
+        if (state == kStateAllocating || state == kStateAllocated) {
+            if (release_ms >= 0) {
+                // the consumer reads the release length only after it sees the state below
+                c.env.setRelease(convertMsToSamples(release_ms, release_samples_));
+            }
+            c.state.store(kStateDeallocating, std::memory_order_release);
+            trace_printf("[%d]:Deallocating\n", ch);
+        }
     }
 }
 
@@ -330,10 +496,13 @@ size_t PcmRenderer::getWritableSize(int ch) {
     if (ch < 0 || mix_channels_ <= ch) {
         return 0;
     }
-    if (rp_[ch] <= wp_[ch]) {
-        return ((capacity_ - wp_[ch]) + rp_[ch]) - 1;
+    const Channel &c = slots_[ch];
+    size_t wp = c.wp.load(std::memory_order_relaxed);
+    size_t rp = c.rp.load(std::memory_order_acquire);
+    if (rp <= wp) {
+        return ((capacity_ - wp) + rp) - 1;
     } else {
-        return (rp_[ch] - wp_[ch]) - 1;
+        return (rp - wp) - 1;
     }
 }
 
@@ -342,55 +511,97 @@ size_t PcmRenderer::getReadableSize(int ch) {
     if (ch < 0 || mix_channels_ <= ch) {
         return 0;
     }
-    if (rp_[ch] <= wp_[ch]) {
-        return wp_[ch] - rp_[ch];
+    const Channel &c = slots_[ch];
+    size_t wp = c.wp.load(std::memory_order_acquire);
+    size_t rp = c.rp.load(std::memory_order_acquire);
+    if (rp <= wp) {
+        return wp - rp;
     } else {
-        return (capacity_ - rp_[ch]) + wp_[ch];
+        return (capacity_ - rp) + wp;
     }
 }
 
 void PcmRenderer::clear(int ch) {
     debug_printf("[%s::%s] deprecated\n", kClassName, __func__);
-    wp_[ch] = rp_[ch] = 0;
+    if (ch < 0 || mix_channels_ <= ch) {
+        return;
+    }
+    slots_[ch].wp.store(0, std::memory_order_relaxed);
+    slots_[ch].rp.store(0, std::memory_order_release);
 }
 
 size_t PcmRenderer::write(int ch, void *src, size_t request_size) {
     // trace_printf("[%s::%s] (%p, %d)\n", kClassName, __func__, src, request_size);
     // debug_printf("[%s::%s] request_size=%d, readable_size=%d, writable_size=%d\n", kClassName, __func__, request_size, getReadableSize(), getWritableSize());
-    if (ch < 0 || mix_channels_ <= ch) {
+    if (bit_depth_ != 16 || request_size == 0) {
         return 0;
     }
-    size_t writable_size = getWritableSize(ch);
-    if (writable_size < request_size) {
+    uint8_t *ptr1 = nullptr;
+    uint8_t *ptr2 = nullptr;
+    size_t len1 = 0;
+    size_t len2 = 0;
+    if (acquireWriteRegion(ch, &ptr1, &len1, &ptr2, &len2) < request_size) {
         return 0;
     }
 
-    if (bit_depth_ == 16) {
-        size_t frame_sample_size = request_size / 2;
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(src);
+    size_t s = (request_size < len1) ? request_size : len1;
+    memcpy(ptr1, &p[0], s);
+    memcpy(ptr2, &p[s], request_size - s);
+    copied_size_ += request_size;
+    return commitWrite(ch, request_size);
+}
 
-        int16_t dst[frame_sample_size];
-        memcpy(dst, src, request_size);
-        if (states_[ch] == kStateAllocating) {
-            for (size_t i = 0; i < frame_sample_size; i++) {
-                dst[i] = (int16_t)(dst[i] * ((float)i / (frame_sample_size)));
-            }
-            states_[ch] = kStateAllocated;
+size_t PcmRenderer::acquireWriteRegion(int ch, uint8_t **ptr1, size_t *len1, uint8_t **ptr2, size_t *len2) {
+    size_t writable_size = getWritableSize(ch);
+    size_t size1 = 0;
+    *ptr1 = nullptr;
+    if (ptr2) {
+        *ptr2 = nullptr;
+    }
+    if (writable_size > 0) {
+        Channel &c = slots_[ch];
+        size_t wp = c.wp.load(std::memory_order_relaxed);
+        size1 = (wp + writable_size > capacity_) ? capacity_ - wp : writable_size;
+        *ptr1 = &c.cache[wp];
+        if (ptr2) {
+            *ptr2 = &c.cache[0];
         }
-        trace_printf("[%d]:Allocate\n", ch);
+    }
+    *len1 = size1;
+    if (len2) {
+        *len2 = writable_size - size1;
+    }
+    return writable_size;
+}
 
-        uint8_t *p = reinterpret_cast<uint8_t *>(dst);
-        if (wp_[ch] + request_size >= capacity_) {
-            size_t s = capacity_ - wp_[ch];
-            memcpy(&cache_[ch][wp_[ch]], &p[0], s);
-            memcpy(&cache_[ch][0], &p[s], request_size - s);
-            wp_[ch] = request_size - s;
-        } else {
-            memcpy(&cache_[ch][wp_[ch]], p, request_size);
-            wp_[ch] += request_size;
-        }
+size_t PcmRenderer::commitWrite(int ch, size_t size) {
+    // trace_printf("[%s::%s] (%d, %d)\n", kClassName, __func__, ch, (int)size);
+    if (size == 0 || getWritableSize(ch) < size) {
+        return 0;
     }
 
-    return request_size;
+    Channel &c = slots_[ch];
+    if (c.state.load(std::memory_order_relaxed) == kStateAllocating) {
+        // published together with the data by the release store of wp below
+        c.state.store(kStateAllocated, std::memory_order_relaxed);
+        trace_printf("[%d]:Allocate\n", ch);
+    }
+    size_t wp = c.wp.load(std::memory_order_relaxed) + size;
+    if (wp >= capacity_) {
+        wp -= capacity_;
+    }
+    c.wp.store(wp, std::memory_order_release);
+    committed_size_ += size;
+    return size;
+}
+
+size_t PcmRenderer::getCommittedSize() {
+    return committed_size_;
+}
+
+size_t PcmRenderer::getCopiedSize() {
+    return copied_size_;
 }
 
 size_t PcmRenderer::read(int ch, void *dst, size_t request_size) {
@@ -403,17 +614,99 @@ size_t PcmRenderer::read(int ch, void *dst, size_t request_size) {
     if (readable_size < request_size) {
         return 0;
     }
+    Channel &c = slots_[ch];
     uint8_t *p = reinterpret_cast<uint8_t *>(dst);
-    if (rp_[ch] + request_size >= capacity_) {
-        size_t s = capacity_ - rp_[ch];
-        memcpy(&p[0], &cache_[ch][rp_[ch]], s);
-        memcpy(&p[s], &cache_[ch][0], request_size - s);
-        rp_[ch] = request_size - s;
+    size_t rp = c.rp.load(std::memory_order_relaxed);
+    if (rp + request_size >= capacity_) {
+        size_t s = capacity_ - rp;
+        memcpy(&p[0], &c.cache[rp], s);
+        memcpy(&p[s], &c.cache[0], request_size - s);
+        rp = request_size - s;
     } else {
-        memcpy(p, &cache_[ch][rp_[ch]], request_size);
-        rp_[ch] += request_size;
+        memcpy(p, &c.cache[rp], request_size);
+        rp += request_size;
     }
+    c.rp.store(rp, std::memory_order_release);
     return request_size;
 }
 
+size_t PcmRenderer::mixEnvelope(int ch, int32_t *dst, size_t size, const Gain &gain_from, const Gain &gain_to) {
+    // the envelope moves once per block, and mixChannel() ramps the gain linearly in between
+    Channel &c = slots_[ch];
+    const int bytes_per_sample = (bit_depth_ / 8) * channels_;
+    int32_t level_from = c.env.getLevel();
+    int32_t level_to = c.env.advance(size / bytes_per_sample);
+    Gain from = {(int16_t)((gain_from.left * level_from) >> 14), (int16_t)((gain_from.right * level_from) >> 14)};
+    Gain to = {(int16_t)((gain_to.left * level_to) >> 14), (int16_t)((gain_to.right * level_to) >> 14)};
+    return mixChannel(ch, dst, size, from, to);
+}
+
+uint32_t PcmRenderer::convertMsToSamples(int ms, uint32_t default_samples) {
+    if (ms < 0) {
+        return default_samples;
+    }
+    return (uint32_t)(((uint64_t)ms * sample_rate_) / 1000);
+}
+
+size_t PcmRenderer::mixChannel(int ch, int32_t *dst, size_t size, const Gain &gain_from, const Gain &gain_to) {
+    Channel &c = slots_[ch];
+    const int bytes_per_sample = (bit_depth_ / 8) * channels_;
+    size_t frames = size / bytes_per_sample;
+    size = frames * bytes_per_sample;
+    if (size == 0) {
+        return 0;
+    }
+
+    // mix directly from the ring buffer: [rp, capacity) and [0, rest)
+    size_t rp = c.rp.load(std::memory_order_relaxed);
+    size_t size1 = (rp + size > capacity_) ? capacity_ - rp : size;
+    size_t size2 = size - size1;
+    const int16_t *seg1 = reinterpret_cast<const int16_t *>(&c.cache[rp]);
+    const int16_t *seg2 = reinterpret_cast<const int16_t *>(&c.cache[0]);
+    if (dst != nullptr) {
+        bool unity = (gain_from.left == MIX_GAIN_UNITY && gain_from.right == MIX_GAIN_UNITY &&  //
+                      gain_to.left == MIX_GAIN_UNITY && gain_to.right == MIX_GAIN_UNITY);
+        if (unity) {
+            mixAccumulate32(dst, seg1, size1 / sizeof(int16_t));
+            mixAccumulate32(&dst[size1 / sizeof(int16_t)], seg2, size2 / sizeof(int16_t));
+        } else {
+            size_t frames1 = size1 / bytes_per_sample;
+            Gain gain_mid = {
+                (int16_t)(gain_from.left + ((int32_t)(gain_to.left - gain_from.left) * (int32_t)frames1) / (int32_t)frames),
+                (int16_t)(gain_from.right + ((int32_t)(gain_to.right - gain_from.right) * (int32_t)frames1) / (int32_t)frames)};
+            int32_t *dst2 = &dst[size1 / sizeof(int16_t)];
+            if (channels_ == 2) {
+                mixAccumulatePan32(dst, seg1, frames1, gain_from.left, gain_mid.left, gain_from.right, gain_mid.right);
+                mixAccumulatePan32(dst2, seg2, frames - frames1, gain_mid.left, gain_to.left, gain_mid.right, gain_to.right);
+            } else {
+                mixAccumulateRamp32(dst, seg1, frames1, channels_, gain_from.left, gain_mid.left);
+                mixAccumulateRamp32(dst2, seg2, frames - frames1, channels_, gain_mid.left, gain_to.left);
+            }
+        }
+    }
+    rp = (size2 > 0) ? size2 : rp + size1;
+    if (rp >= capacity_) {
+        rp -= capacity_;
+    }
+    // release the consumed region to the producer
+    c.rp.store(rp, std::memory_order_release);
+    return size;
+}
+
+uint32_t PcmRenderer::packGain(const Gain &gain) {
+    return (uint32_t)(uint16_t)gain.left | ((uint32_t)(uint16_t)gain.right << 16);
+}
+
+PcmRenderer::Gain PcmRenderer::unpackGain(uint32_t packed) {
+    return Gain{(int16_t)(packed & 0xFFFF), (int16_t)(packed >> 16)};
+}
+
+void PcmRenderer::activate(int ch) {
+    active_[ch / kActiveWordBits].fetch_or(1U << (ch % kActiveWordBits), std::memory_order_release);
+}
+
+void PcmRenderer::deactivate(int ch) {
+    active_[ch / kActiveWordBits].fetch_and(~(1U << (ch % kActiveWordBits)), std::memory_order_release);
+}
+
 #endif  // ARDUINO_ARCH_SPRESENSE
@@ -10,8 +10,14 @@
 #ifndef PCM_RENDERER_H_
 #define PCM_RENDERER_H_
 
+#include <atomic>
+
 #include <OutputMixer.h>
 
+#include "EnvelopeGenerator.h"
+
+class PcmWriter;
+
 /**
  * @brief @~japanese 音声出力のラッパークラスです。簡易的なミキサー機能を備えます。
  * @details @~japanese 音声を出力するには、まず PcmRenderer::begin() で音声出力処理を開始します。
@@ -21,6 +27,21 @@
  * 複数の音を同時に出したい場合は PcmRenderer::allocateChannel() を必要な回数実行して、
  * それぞれの音声出力チャンネルにそれぞれの音声データを PcmRenderer::write() で書き込みます。
  * PcmRenderer::render() を実行すると、有効な音声出力チャンネルの音声データをミックスした音声が出力されます。
+ * ミックスは32bitで加算し、最後にマスターゲインとソフトクリップを一度だけ掛けるので、結果は加算の順序に依存しません。
+ *
+ * 各音声出力チャンネルのキャッシュは single-producer/single-consumer のロックフリーなリングバッファです。
+ * allocateChannel(), deallocateChannel(), getWritableSize(), write() は書き込み側の1スレッドから、
+ * render(), read() は読み出し側の1スレッド(OutputMixer のコールバック)から呼び出してください。
+ * この条件を守れば、書き込み側を別スレッドで動かしてもロックは不要です。
+ *
+ * PcmRenderer::acquireWriteRegion() でリングバッファの空き領域を直接取得して、そこへ File::read() などで書き込み、
+ * PcmRenderer::commitWrite() で確定すると、中間バッファを経由せずに音声データを渡せます。
+ * 割り当て直後のアタックと解放時のリリースは EnvelopeGenerator でミックス時に掛けるので、書き込んだデータは加工されません。
+ * 長さとカーブは PcmRenderer::setEnvelope() で設定し、既定では1フレームの直線です。
+ *
+ * PcmRenderer::begin(PcmWriter*) で開始するとオフラインレンダリングになります。
+ * OutputMixer を使わず、 PcmRenderer::render() を呼び出すたびに1フレームをミックスして PcmWriter に書き込むので、
+ * 実時間に縛られずにCPUの速度で音声を生成できます。経過時間は PcmRenderer::getRenderedSamples() で得られる仮想的なサンプル時刻で数えます。
  * @code {.cpp}
  * #include <PcmRenderer.h>
  *
@@ -60,11 +81,15 @@ public:
      * @startuml
      * [*] -> Unallocated
      * Unallocated --> Allocating: allocateChannel()
-     * Allocating --> Allocated: render()
+     * Allocating --> Allocated: write(), commitWrite()
+     * Allocating --> Deallocating: deallocateChannel()
      * Allocated --> Allocated: render()
      * Allocated --> Deallocating: deallocateChannel()
-     * Deallocating --> Unallocated: render()
+     * Deallocating --> Deallocated: render()
+     * Deallocated --> Unallocated: render()
      * @enduml
+     * @details @~japanese Unallocated, Allocating, Allocated からの遷移は書き込み側だけが、
+     * Deallocating, Deallocated からの遷移は読み出し側だけが行います。
      */
     enum State {
         kStateUnallocated,
@@ -77,9 +102,9 @@ public:
         kStatePause = kStateDeallocated
     };
     /**
-     * @brief @~japanese 最大音声チャンネル数を指定します。この値が4のとき最大4和音の出力ができます。
+     * @brief @~japanese 音声チャンネル数の上限です。コンストラクタの mix_channels にはこの値以下を指定します。
      */
-    static const int kMaxChannel = 4;
+    static const int kMaxChannel = 64;
 
     /**
      * @brief @~japanese PcmRenderer オブジェクトを生成します。
@@ -89,6 +114,8 @@ public:
      * @param[in] samples_per_frame Audio samples per frame
      * @param[in] cache_capacity Cache capacity
      * @param[in] mix_channels Mixing channel number (PcmRenderer::kMaxChannel or less)
+     * @details @~japanese 各音声チャンネルのキャッシュは cache_capacity * mix_channels バイトの連続領域から割り当てます。
+     * PcmRenderer::render() の処理量は mix_channels ではなく、使用中の音声チャンネル数に比例します。
      * @see PcmRenderer::kMaxChannel
      */
     PcmRenderer(int sample_rate, int bit_depth, int channels, int samples_per_frame, size_t cache_capacity, int mix_channels);
@@ -100,6 +127,15 @@ public:
      */
     void begin();
 
+    /**
+     * @brief @~japanese オフラインレンダリングを開始します。
+     * @details @~japanese OutputMixer は使いません。 PcmRenderer::render() を呼び出すたびに、
+     * 1フレーム分の音声データをミックスして writer に書き込みます。
+     * 読み出せるデータが1フレームに満たない音声出力チャンネルがあっても、待たずに無音で補います。
+     * @param[in] writer @~japanese 出力先
+     */
+    void begin(PcmWriter *writer);
+
     /**
      * @brief @~japanese 出力音量を設定します。
      *
@@ -110,6 +146,20 @@ public:
      */
     void setVolume(int master, int player0, int player1);
 
+    /**
+     * @brief @~japanese ミックスバスに掛けるマスターゲインを設定します。
+     * @details @~japanese すべての音声出力チャンネルを加算した後に一度だけ掛けて、ソフトクリップしてから出力します。
+     * PcmRenderer::setVolume() と違い、ソフトクリップの前に効くので同時発音数を増やす時の音割れ対策に使えます。
+     * @param[in] gain Q14 gain (16384 = 1.0)
+     */
+    void setMasterGain(int16_t gain);
+
+    /**
+     * @brief @~japanese ミックスバスに掛けるマスターゲインを取得します。
+     * @return Q14 gain (16384 = 1.0)
+     */
+    int16_t getMasterGain();
+
     /**
      * @brief @~japanese PcmRenderer::write() で書き込まれた音声データをミックスして出力します。
      * @retval true Success
@@ -117,6 +167,18 @@ public:
      */
     bool render();
 
+    /**
+     * @brief @~japanese これまでに出力したサンプル数を取得します。オフラインレンダリングの仮想的な時刻に使います。
+     * @return Rendered samples per channel
+     */
+    uint64_t getRenderedSamples();
+
+    /**
+     * @brief @~japanese 発音中のチャンネルのデータが1フレームに足りなかった回数を取得します。
+     * @return Number of underruns
+     */
+    uint32_t getUnderrunCount();
+
 #if 0
     void onError(const ErrorAttentionParam *attparam);
 #endif
@@ -132,19 +194,71 @@ public:
 
     size_t getCapacity();
 
+    /**
+     * @brief @~japanese 音声出力チャンネル数を取得します。
+     * @return Mixing channel number
+     */
+    int getChannelCount();
+
+    /**
+     * @brief @~japanese 使用中の音声出力チャンネル数を取得します。
+     * @return Active channel number
+     */
+    int getActiveChannelCount();
+
+    /**
+     * @brief @~japanese 音声出力チャンネルのゲインを左右別々に設定します。
+     * @details @~japanese ゲインは次にミックスするブロックの間に直線的に変化するので、ジッパーノイズは出ません。
+     * チャンネルを割り当てた直後のゲインは 1.0 です。モノラル出力では left だけを使います。
+     * @param[in] ch Channel number
+     * @param[in] left Q14 gain of the left channel (16384 = 1.0)
+     * @param[in] right Q14 gain of the right channel (16384 = 1.0)
+     */
+    void setChannelGain(int ch, int16_t left, int16_t right);
+
+    /**
+     * @brief @~japanese これから割り当てる音声出力チャンネルのアタックとリリースを設定します。
+     * @param[in] attack_ms @~japanese アタックの長さ [ms] (負の値で1フレーム)
+     * @param[in] release_ms @~japanese リリースの長さ [ms] (負の値で1フレーム)
+     * @param[in] curve @~japanese カーブ
+     */
+    void setEnvelope(int attack_ms, int release_ms, EnvelopeGenerator::Curve curve = EnvelopeGenerator::kCurveLinear);
+
     /**
      * @brief @~japanese 音声出力チャンネルを有効化してユーザーに割り当てます。
+     * @details @~japanese アタックとリリースは PcmRenderer::setEnvelope() の設定を使います。
      * @retval <0 Fail
      * @retval >=0 allocated channel number
      */
     int allocateChannel();
 
+    /**
+     * @brief @~japanese アタックとリリースの長さを指定して、音声出力チャンネルを有効化してユーザーに割り当てます。
+     * @param[in] attack_ms @~japanese アタックの長さ [ms] (負の値で PcmRenderer::setEnvelope() の設定)
+     * @param[in] release_ms @~japanese リリースの長さ [ms] (負の値で PcmRenderer::setEnvelope() の設定)
+     * @retval <0 Fail
+     * @retval >=0 allocated channel number
+     */
+    int allocateChannel(int attack_ms, int release_ms);
+
     /**
      * @brief @~japanese 音声出力チャンネルを解放します。
+     * @details @~japanese 次にミックスするブロックからリリースを掛け、リリースが終わったら残りの音声データは捨てます。
+     * 書き込み済みの音声データがリリースより短ければ、そこで終わります。
+     * リリースが終わったブロックの PcmRenderer::render() が終われば、チャンネルは再び割り当てられます。
      * @param[in] ch Channel number
      */
     void deallocateChannel(int ch);
 
+    /**
+     * @brief @~japanese リリースの長さを指定して、音声出力チャンネルを解放します。
+     * @details @~japanese 割り当て時に指定したリリースより短くフェードアウトさせたい時(チョークなど)に使います。
+     * すでに解放したチャンネルのリリースは変わりません。
+     * @param[in] ch Channel number
+     * @param[in] release_ms @~japanese リリースの長さ [ms] (負の値で割り当て時の設定)
+     */
+    void deallocateChannel(int ch, int release_ms);
+
     /**
      * @brief @~japanese 音声出力チャンネルに書き込めるデータサイズを取得します。
      * @param[in] ch Channel number
@@ -161,6 +275,7 @@ public:
 
     /**
      * @brief @~japanese 音声出力チャンネルをクリアします。
+     * @details @~japanese 書き込み位置と読み出し位置の両方を変更するため、読み出し側が動作していない時だけ呼び出してください。
      * @param[in] ch Channel number
      */
     void clear(int ch);
@@ -174,6 +289,40 @@ public:
      */
     size_t write(int ch, void *src, size_t request_size);
 
+    /**
+     * @brief @~japanese 音声出力チャンネルの書き込み可能な領域を取得します。
+     * @details @~japanese リングバッファの折り返しがあるため、領域は最大2つに分かれます。
+     * 取得した領域にデータを書き込んだら PcmRenderer::commitWrite() で書き込んだサイズを確定します。
+     * @param[in] ch Channel number
+     * @param[out] ptr1 First region address
+     * @param[out] len1 First region size
+     * @param[out] ptr2 Second region address (may be nullptr)
+     * @param[out] len2 Second region size (may be nullptr)
+     * @return Writable size (len1 + len2)
+     */
+    size_t acquireWriteRegion(int ch, uint8_t **ptr1, size_t *len1, uint8_t **ptr2, size_t *len2);
+
+    /**
+     * @brief @~japanese PcmRenderer::acquireWriteRegion() で取得した領域に書き込んだデータを確定します。
+     * @param[in] ch Channel number
+     * @param[in] size Written size
+     * @return Committed size
+     */
+    size_t commitWrite(int ch, size_t size);
+
+    /**
+     * @brief @~japanese 全チャンネルに確定された音声データの累計サイズを取得します。
+     * @return Committed size [byte]
+     */
+    size_t getCommittedSize();
+
+    /**
+     * @brief @~japanese PcmRenderer::write() がコピーした音声データの累計サイズを取得します。
+     * @details @~japanese PcmRenderer::acquireWriteRegion() と PcmRenderer::commitWrite() で書き込んだデータは含みません。
+     * @return Copied size [byte]
+     */
+    size_t getCopiedSize();
+
     /**
      * @brief @~japanese 音声出力チャンネルから音声データを読み出します。
      * @param[in] ch Channel number
@@ -184,6 +333,25 @@ public:
     size_t read(int ch, void *dst, size_t request_size);
 
 private:
+    static const int kActiveWordBits = 32;
+    static const int kActiveWords = (kMaxChannel + kActiveWordBits - 1) / kActiveWordBits;
+
+    struct Gain {
+        int16_t left;
+        int16_t right;
+    };
+
+    struct Channel {
+        std::atomic<State> state;
+        bool fade_in;                       // set before activation, cleared by the consumer once a block is mixed
+        EnvelopeGenerator env;              // started before activation, then owned by the consumer
+        Gain gain;                          // current gain, owned by the consumer after activation
+        std::atomic<uint32_t> target_gain;  // packed Gain, written by the producer
+        uint8_t *cache;
+        std::atomic<size_t> wp;  // written only by the producer
+        std::atomic<size_t> rp;  // written only by the consumer
+    };
+
     // data description
     int sample_rate_;
     int bit_depth_;
@@ -195,13 +363,39 @@ private:
     unsigned long response_count_;
 
     // cache buffer
-    unsigned int frames_;
+    std::atomic<unsigned int> frames_;
+    std::atomic<uint32_t> underrun_count_;
     size_t capacity_;
     int mix_channels_;
-    State states_[kMaxChannel];
-    uint8_t *cache_[kMaxChannel];
-    size_t wp_[kMaxChannel];
-    size_t rp_[kMaxChannel];
+    uint8_t *slab_;
+    Channel *slots_;
+    std::atomic<uint32_t> active_[kActiveWords];
+
+    // offline rendering
+    PcmWriter *writer_;
+    uint8_t *frame_;
+
+    // envelope of the channels to allocate (producer side)
+    uint32_t attack_samples_;
+    uint32_t release_samples_;
+    EnvelopeGenerator::Curve curve_;
+
+    // mixing bus
+    int32_t *bus_;
+    std::atomic<int16_t> master_gain_;
+
+    // statistics (producer side)
+    size_t committed_size_;
+    size_t copied_size_;
+
+    void mixFrame(const uint32_t *active, uint8_t *raw, size_t read_size);
+    size_t mixChannel(int ch, int32_t *dst, size_t size, const Gain &gain_from, const Gain &gain_to);
+    size_t mixEnvelope(int ch, int32_t *dst, size_t size, const Gain &gain_from, const Gain &gain_to);
+    uint32_t convertMsToSamples(int ms, uint32_t default_samples);
+    static uint32_t packGain(const Gain &gain);
+    static Gain unpackGain(uint32_t packed);
+    void activate(int ch);
+    void deactivate(int ch);
 };
 
 #endif  // PCM_RENDERER_H_
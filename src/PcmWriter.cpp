@@ -0,0 +1,34 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#if defined(ARDUINO_ARCH_SPRESENSE) && !defined(SUBCORE)
+
+#include "PcmWriter.h"
+
+#include <string.h>
+
+PcmBufferWriter::PcmBufferWriter(void* buffer, size_t capacity) : buffer_(static_cast<uint8_t*>(buffer)), capacity_(capacity), size_(0) {
+}
+
+size_t PcmBufferWriter::write(const void* pcm, size_t size) {
+    if (buffer_ == nullptr || pcm == nullptr) {
+        return 0;
+    }
+    size_t write_size = (size < capacity_ - size_) ? size : capacity_ - size_;
+    memcpy(&buffer_[size_], pcm, write_size);
+    size_ += write_size;
+    return write_size;
+}
+
+size_t PcmBufferWriter::getSize() {
+    return size_;
+}
+
+void PcmBufferWriter::rewind() {
+    size_ = 0;
+}
+
+#endif  // ARDUINO_ARCH_SPRESENSE
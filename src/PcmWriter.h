@@ -0,0 +1,67 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+/**
+ * @file PcmWriter.h
+ */
+#ifndef PCM_WRITER_H_
+#define PCM_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief @~japanese オフラインレンダリングの出力先のインターフェースです。
+ * @details @~japanese PcmRenderer::begin(PcmWriter*) で指定すると、 PcmRenderer::render() でミックスした音声データを
+ * OutputMixer ではなくこのオブジェクトに書き込みます。
+ * @see PcmBufferWriter, WavWriter
+ */
+class PcmWriter {
+public:
+    virtual ~PcmWriter() {
+    }
+
+    /**
+     * @brief @~japanese 音声データを書き込みます。
+     * @param[in] pcm PCM data address
+     * @param[in] size PCM data size
+     * @return Written size
+     */
+    virtual size_t write(const void* pcm, size_t size) = 0;
+};
+
+/**
+ * @brief @~japanese 呼び出し元が用意したメモリに音声データを書き込みます。
+ */
+class PcmBufferWriter : public PcmWriter {
+public:
+    /**
+     * @brief @~japanese PcmBufferWriter オブジェクトを生成します。
+     * @param[out] buffer @~japanese 書き込み先のメモリ
+     * @param[in] capacity @~japanese 書き込み先のメモリのサイズ
+     */
+    PcmBufferWriter(void* buffer, size_t capacity);
+
+    size_t write(const void* pcm, size_t size) override;
+
+    /**
+     * @brief @~japanese 書き込んだデータサイズを取得します。
+     * @return Written size
+     */
+    size_t getSize();
+
+    /**
+     * @brief @~japanese 書き込み位置を先頭に戻します。
+     */
+    void rewind();
+
+private:
+    uint8_t* buffer_;
+    size_t capacity_;
+    size_t size_;
+};
+
+#endif  // PCM_WRITER_H_
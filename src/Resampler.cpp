@@ -0,0 +1,163 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#if defined(ARDUINO_ARCH_SPRESENSE) && !defined(SUBCORE)
+
+#include "Resampler.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "mix_kernel.h"
+
+static const int kPhases = 1 << MIX_RESAMPLE_PHASE_BITS;
+static const int kLinearTaps = 2;
+static const int kCubicTaps = 4;
+static const int kSincTaps = 8;
+static const int32_t kCoefUnity = 0x4000;  // Q14
+
+// coefficient tables shared by all voices, taps per phase; tap j weighs the input frame at (j - taps / 2 + 1) from the output position
+alignas(4) static int16_t s_linear_table[kPhases * kLinearTaps];
+alignas(4) static int16_t s_cubic_table[kPhases * kCubicTaps];
+alignas(4) static int16_t s_sinc_table[kPhases * kSincTaps];
+static bool s_tables_ready = false;
+
+// rounds the weights to Q14 and moves the rounding error to the largest one, so that a constant input keeps its level
+static void storeWeights(int16_t* dst, const float* weights, int taps) {
+    int32_t sum = 0;
+    int largest = 0;
+    for (int j = 0; j < taps; j++) {
+        dst[j] = (int16_t)lroundf(weights[j] * kCoefUnity);
+        sum += dst[j];
+        largest = (fabsf(weights[j]) > fabsf(weights[largest])) ? j : largest;
+    }
+    dst[largest] += (int16_t)(kCoefUnity - sum);
+}
+
+static void buildTables() {
+    if (s_tables_ready) {
+        return;
+    }
+    const float kPi = 3.14159265f;
+    float w[kSincTaps];
+    for (int p = 0; p < kPhases; p++) {
+        float t = (float)p / kPhases;
+
+        w[0] = 1.0f - t;
+        w[1] = t;
+        storeWeights(&s_linear_table[p * kLinearTaps], w, kLinearTaps);
+
+        // Catmull-Rom spline through the frames at -1, 0, 1 and 2
+        w[0] = 0.5f * (-t * t * t + 2.0f * t * t - t);
+        w[1] = 0.5f * (3.0f * t * t * t - 5.0f * t * t + 2.0f);
+        w[2] = 0.5f * (-3.0f * t * t * t + 4.0f * t * t + t);
+        w[3] = 0.5f * (t * t * t - t * t);
+        storeWeights(&s_cubic_table[p * kCubicTaps], w, kCubicTaps);
+
+        // sinc through the frames at -3 to 4, tapered to zero at +-4 by the Blackman window
+        for (int j = 0; j < kSincTaps; j++) {
+            float x = (float)(j - (kSincTaps / 2 - 1)) - t;
+            float sinc = (x == 0.0f) ? 1.0f : sinf(kPi * x) / (kPi * x);
+            float window = 0.42f + 0.5f * cosf(kPi * x / (kSincTaps / 2)) + 0.08f * cosf(2.0f * kPi * x / (kSincTaps / 2));
+            w[j] = sinc * window;
+        }
+        storeWeights(&s_sinc_table[p * kSincTaps], w, kSincTaps);
+    }
+    s_tables_ready = true;
+}
+
+const uint32_t Resampler::kUnityStep;
+const uint32_t Resampler::kMinStep;
+const uint32_t Resampler::kMaxStep;
+const size_t Resampler::kBufferFrames;
+
+Resampler::Resampler() : table_(nullptr), taps_(0), step_(kUnityStep), pos_(0), fill_(0) {
+    buildTables();
+    reset(kUnityStep, kInterpolationLinear);
+}
+
+void Resampler::reset(uint32_t step, Interpolation interpolation) {
+    if (interpolation == kInterpolationSinc) {
+        table_ = s_sinc_table;
+        taps_ = kSincTaps;
+    } else if (interpolation == kInterpolationCubic) {
+        table_ = s_cubic_table;
+        taps_ = kCubicTaps;
+    } else {
+        table_ = s_linear_table;
+        taps_ = kLinearTaps;
+    }
+    step_ = (step < kMinStep) ? kMinStep : ((step > kMaxStep) ? kMaxStep : step);
+    pos_ = 0;
+    // silence before the first frame, so that the first output frame is centered on it
+    fill_ = taps_ / 2 - 1;
+    memset(buffer_, 0, fill_ * 2 * sizeof(int16_t));
+}
+
+uint32_t Resampler::getStep() const {
+    return step_;
+}
+
+size_t Resampler::getRequiredFrames(size_t frames) const {
+    if (frames == 0) {
+        return 0;
+    }
+    uint64_t last = (uint64_t)pos_ + (uint64_t)step_ * (frames - 1);
+    size_t required = (size_t)(last >> 16) + taps_;
+    return (required > fill_) ? required - fill_ : 0;
+}
+
+int16_t* Resampler::getWritePointer(size_t* frames) {
+    if (frames != nullptr) {
+        *frames = kBufferFrames - fill_;
+    }
+    return &buffer_[fill_ * 2];
+}
+
+void Resampler::commitWrite(size_t frames) {
+    fill_ += (frames < kBufferFrames - fill_) ? frames : kBufferFrames - fill_;
+}
+
+void Resampler::flush() {
+    size_t frames = (size_t)(taps_ / 2);
+    frames = (frames < kBufferFrames - fill_) ? frames : kBufferFrames - fill_;
+    memset(&buffer_[fill_ * 2], 0, frames * 2 * sizeof(int16_t));
+    fill_ += frames;
+}
+
+size_t Resampler::read(int16_t* dst, size_t frames) {
+    if (fill_ < (size_t)taps_ || (pos_ >> 16) > fill_ - taps_) {
+        return 0;
+    }
+    // output frames whose taps are all in the buffer
+    uint32_t end = (uint32_t)(fill_ - taps_ + 1) << 16;
+    size_t available = (end - pos_ - 1) / step_ + 1;
+    frames = (frames < available) ? frames : available;
+    pos_ = mixResample16(dst, buffer_, frames, pos_, step_, table_, taps_);
+
+    // drop the frames that no output frame uses anymore
+    size_t drop = pos_ >> 16;
+    drop = (drop < fill_) ? drop : fill_;
+    memmove(buffer_, &buffer_[drop * 2], (fill_ - drop) * 2 * sizeof(int16_t));
+    fill_ -= drop;
+    pos_ -= (uint32_t)drop << 16;
+    return frames;
+}
+
+uint32_t Resampler::convertCentsToStep(int32_t cents) {
+    if (cents == 0) {
+        return kUnityStep;
+    }
+    float step = (float)kUnityStep * powf(2.0f, (float)cents / 1200.0f);
+    if (step < (float)kMinStep) {
+        return kMinStep;
+    } else if (step > (float)kMaxStep) {
+        return kMaxStep;
+    }
+    return (uint32_t)lroundf(step);
+}
+
+#endif  // ARDUINO_ARCH_SPRESENSE
@@ -0,0 +1,121 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+/**
+ * @file Resampler.h
+ */
+#ifndef RESAMPLER_H_
+#define RESAMPLER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief @~japanese ステレオ16bitの音声データを再生速度を変えて読み出す部品です。ピッチを変えた再生に使います。
+ * @details @~japanese 呼び出し側は Resampler::getWritePointer() の領域に元の音声データを書き込んで Resampler::commitWrite() で確定し、
+ * Resampler::read() で変換後のデータを取り出します。元の音声データは任意の長さに分けて書き込めます。
+ * 補間は固定小数点の係数表 (位相 256 分割) で行い、係数表は全オブジェクトで共有します。
+ */
+class Resampler {
+public:
+    /**
+     * @brief @~japanese 補間方法です。
+     */
+    enum Interpolation {
+        kInterpolationLinear,  ///< @~japanese 2点の直線補間
+        kInterpolationCubic,   ///< @~japanese 4点の3次補間 (Catmull-Rom)
+        kInterpolationSinc,    ///< @~japanese 8点の窓付きsinc補間 (Blackman窓)
+        kInterpolationMax = kInterpolationSinc
+    };
+
+    /**
+     * @brief @~japanese 元の速度で読み出す時の1出力フレームあたりの入力フレーム数 (Q16) です。
+     */
+    static const uint32_t kUnityStep = 0x10000;
+
+    /**
+     * @brief @~japanese 1出力フレームあたりの入力フレーム数 (Q16) の下限です (4オクターブ下)。
+     */
+    static const uint32_t kMinStep = kUnityStep / 16;
+
+    /**
+     * @brief @~japanese 1出力フレームあたりの入力フレーム数 (Q16) の上限です (2オクターブ上)。
+     */
+    static const uint32_t kMaxStep = kUnityStep * 4;
+
+    /**
+     * @brief @~japanese 入力バッファのフレーム数です。
+     */
+    static const size_t kBufferFrames = 256;
+
+    /**
+     * @brief @~japanese Resampler オブジェクトを生成します。
+     */
+    Resampler();
+
+    /**
+     * @brief @~japanese 入力バッファを空にして、読み出しを最初からやり直します。
+     * @param[in] step @~japanese 1出力フレームあたりの入力フレーム数 (Q16)
+     * @param[in] interpolation @~japanese 補間方法
+     */
+    void reset(uint32_t step, Interpolation interpolation);
+
+    /**
+     * @brief @~japanese 1出力フレームあたりの入力フレーム数を取得します。
+     * @return step (Q16)
+     */
+    uint32_t getStep() const;
+
+    /**
+     * @brief @~japanese 指定したフレーム数を出力するために、あと何フレームの入力が必要かを取得します。
+     * @param[in] frames @~japanese 出力フレーム数
+     * @return @~japanese 入力フレーム数 (入力バッファの空きを超えることがあります)
+     */
+    size_t getRequiredFrames(size_t frames) const;
+
+    /**
+     * @brief @~japanese 入力バッファの書き込み先を取得します。
+     * @param[out] frames @~japanese 書き込めるフレーム数
+     * @return @~japanese 書き込み先 (interleaved, 2 channels)
+     */
+    int16_t* getWritePointer(size_t* frames);
+
+    /**
+     * @brief @~japanese 入力バッファへの書き込みを確定します。
+     * @param[in] frames @~japanese 書き込んだフレーム数
+     */
+    void commitWrite(size_t frames);
+
+    /**
+     * @brief @~japanese 入力の終わりに無音を足して、最後のフレームまで出力できるようにします。
+     */
+    void flush();
+
+    /**
+     * @brief @~japanese 変換後のデータを取り出します。
+     * @param[out] dst @~japanese 取り出し先 (interleaved, 2 channels)
+     * @param[in] frames @~japanese 取り出すフレーム数
+     * @return @~japanese 取り出したフレーム数 (frames 未満の場合は入力が足りない)
+     */
+    size_t read(int16_t* dst, size_t frames);
+
+    /**
+     * @brief @~japanese 半音の100分の1 (セント) 単位のピッチの変化を、1出力フレームあたりの入力フレーム数に変換します。
+     * @param[in] cents @~japanese ピッチの変化 [cent]
+     * @return step (Q16, kMinStep から kMaxStep の範囲)
+     */
+    static uint32_t convertCentsToStep(int32_t cents);
+
+private:
+    const int16_t* table_;
+    int taps_;
+    uint32_t step_;
+    uint32_t pos_;  // Q16 position of the first tap of the next output frame in buffer_
+    size_t fill_;   // frames written to buffer_
+    alignas(4) int16_t buffer_[kBufferFrames * 2];
+};
+
+#endif  // RESAMPLER_H_
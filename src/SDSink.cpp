@@ -36,16 +36,16 @@ const int kPbBitDepth = 16;
 const int kPbChannelCount = 2;
 const int kPbSampleCount = 240;
 const int kPbBlockSize = kPbSampleCount * (kPbBitDepth / 8) * kPbChannelCount;
-const int kPbCacheSize = (24 * 1024);
+const int kPbCacheSize = (24 * 1024);  // per channel, allocated once; the most that LatencyController can preload
+const size_t kSectorSize = 512;  // reads end on a sector boundary
+const uint32_t kPbFrameUs = 1000000 / (kPbSampleFrq / kPbSampleCount);
+const int kPbBytePerMs = kPbSampleFrq / 1000 * (kPbBitDepth / 8) * kPbChannelCount;
 
 const int kDefaultOffset = 0;
 const int kVolumeMin = -1020;
 const int kVolumeMax = 120;
 const int kDefaultVolume = 0;
 
-// cache parameter
-const int kLoadFrames = 10;
-
 const static int kUnallocatedChannel = -1;
 const static int kDeallocatedChannel = -2;
 
@@ -54,16 +54,28 @@ static uint32_t msToByte(int ms) {
     return kPbBytePerSec * ms / 1000;
 }
 
-SDSink::SDSink(const SDSink::Item* table, size_t table_length)
+const int SDSink::kStealReserve;
+const int SDSink::kMaxPolyphony;
+const size_t SDSink::kDefaultReadSize;
+const size_t SDSink::kMaxReadSize;
+
+SDSink::SDSink(const SDSink::Item* table, size_t table_length, int polyphony, int steal_reserve)
     : NullFilter(),
       units_(),
-      renderer_(kPbSampleFrq, kPbBitDepth, kPbChannelCount, kPbSampleCount, kPbCacheSize, 4),
+      renderer_(kPbSampleFrq, kPbBitDepth, kPbChannelCount, kPbSampleCount, kPbCacheSize,
+                constrain(polyphony, 1, kMaxPolyphony) + constrain(steal_reserve, 0, kStealReserve)),
+      polyphony_(constrain(polyphony, 1, kMaxPolyphony)),
+      stealer_(),
+      latency_(kPbFrameUs, kPbCacheSize / kPbBlockSize),
+      files_(FilePool::kDefaultCapacity, constrain(polyphony, 1, kMaxPolyphony) + constrain(steal_reserve, 0, kStealReserve)),
+      read_size_(kDefaultReadSize),
       offset_(kDefaultOffset),
       loop_(false),
       volume_(kDefaultVolume) {
     for (size_t i = 0; i < sizeof(units_) / sizeof(units_[0]); i++) {
         units_[i].offset = 0;
         units_[i].end = 0;
+        units_[i].file = nullptr;
         units_[i].render_ch = kDeallocatedChannel;
     }
     for (size_t i = 0; i < table_length; i++) {
@@ -79,9 +91,8 @@ SDSink::~SDSink() {
             renderer_.deallocateChannel(units_[i].render_ch);
             units_[i].render_ch = kDeallocatedChannel;
         }
-        if (units_[i].file) {
-            units_[i].file.close();
-        }
+        files_.release(units_[i].file);
+        units_[i].file = nullptr;
     }
 }
 
@@ -114,6 +125,11 @@ bool SDSink::begin() {
         WavReader wav_reader = WavReader(file);
         units_[i].offset = wav_reader.getPcmOffset();
         units_[i].end = units_[i].offset + wav_reader.getPcmSize();
+        SampleFormat format = wav_reader.getSampleFormat();
+        if (!format.isPassThrough() || format.sample_rate != (uint32_t)kPbSampleFrq) {
+            error_printf("[%s::%s] error: \"%s\" is not 48kHz, 16bit, 2ch PCM, not supported\n", kClassName, __func__, units_[i].path.c_str());
+            units_[i].end = units_[i].offset;
+        }
         file.close();
     }
 
@@ -122,36 +138,17 @@ bool SDSink::begin() {
 }
 
 void SDSink::update() {
+    latency_.update(renderer_.getUnderrunCount(), (uint32_t)(renderer_.getRenderedSamples() / kPbSampleCount));
+    int frames = latency_.getRefillFrames();
     for (size_t i = 0; i < sizeof(units_) / sizeof(units_[0]); i++) {
-        if (units_[i].render_ch < 0) {
-            continue;
-        }
-        for (int j = 0; j < kLoadFrames; j++) {
-            // end of file
-            if (units_[i].file.position() >= units_[i].file.size()) {
-                if (loop_) {
-                    units_[i].file.seek(units_[i].offset + msToByte(offset_));
-                } else {
-                    renderer_.deallocateChannel(units_[i].render_ch);
-                    units_[i].render_ch = kDeallocatedChannel;
-                    units_[i].file.close();
-                    break;
-                }
-            }
-
-            // output
-            if (renderer_.getWritableSize(units_[i].render_ch) < kPbBlockSize) {
-                break;
-            }
-            size_t read_size = units_[i].end - units_[i].file.position();
-            read_size = (read_size < kPbBlockSize) ? read_size : kPbBlockSize;
-            uint8_t buffer[read_size];
-            units_[i].file.read(buffer, read_size);
-            renderer_.write(units_[i].render_ch, buffer, read_size);
-        }
+        continuePlayback(i, frames);
     }
 }
 
+void SDSink::setReadSize(size_t bytes) {
+    read_size_ = constrain(bytes / kSectorSize * kSectorSize, kSectorSize, kMaxReadSize);
+}
+
 bool SDSink::isAvailable(int param_id) {
     if (param_id == PARAMID_OFFSET) {
         return true;
@@ -159,6 +156,18 @@ bool SDSink::isAvailable(int param_id) {
         return true;
     } else if (param_id == Filter::PARAMID_OUTPUT_LEVEL) {
         return true;
+    } else if (param_id == Filter::PARAMID_VOICE_STEALING) {
+        return true;
+    } else if (param_id == Filter::PARAMID_STOLEN_VOICES) {
+        return true;
+    } else if (param_id == Filter::PARAMID_DROPPED_VOICES) {
+        return true;
+    } else if (param_id == Filter::PARAMID_TARGET_LATENCY) {
+        return true;
+    } else if (param_id == Filter::PARAMID_BUFFER_FILL) {
+        return true;
+    } else if (param_id == Filter::PARAMID_FILE_OPENS || param_id == Filter::PARAMID_FILE_HITS || param_id == Filter::PARAMID_FILE_EVICTIONS) {
+        return true;
     }
     return NullFilter::isAvailable(param_id);
 }
@@ -170,6 +179,22 @@ intptr_t SDSink::getParam(int param_id) {
         return loop_;
     } else if (param_id == Filter::PARAMID_OUTPUT_LEVEL) {
         return volume_;
+    } else if (param_id == Filter::PARAMID_VOICE_STEALING) {
+        return stealer_.getPolicy();
+    } else if (param_id == Filter::PARAMID_STOLEN_VOICES) {
+        return stealer_.getStolenCount();
+    } else if (param_id == Filter::PARAMID_DROPPED_VOICES) {
+        return stealer_.getDroppedCount();
+    } else if (param_id == Filter::PARAMID_TARGET_LATENCY) {
+        return latency_.getTargetLatency();
+    } else if (param_id == Filter::PARAMID_BUFFER_FILL) {
+        return getBufferFill();
+    } else if (param_id == Filter::PARAMID_FILE_OPENS) {
+        return files_.getOpenCount();
+    } else if (param_id == Filter::PARAMID_FILE_HITS) {
+        return files_.getHitCount();
+    } else if (param_id == Filter::PARAMID_FILE_EVICTIONS) {
+        return files_.getEvictionCount();
     }
     return NullFilter::getParam(param_id);
 }
@@ -185,6 +210,22 @@ bool SDSink::setParam(int param_id, intptr_t value) {
         volume_ = constrain(value, kVolumeMin, kVolumeMax);
         renderer_.setVolume(volume_, 0, 0);
         return true;
+    } else if (param_id == Filter::PARAMID_VOICE_STEALING) {
+        return stealer_.setPolicy(value);
+    } else if (param_id == Filter::PARAMID_STOLEN_VOICES || param_id == Filter::PARAMID_DROPPED_VOICES) {
+        if (value != 0) {
+            return false;
+        }
+        stealer_.resetCounters();
+        return true;
+    } else if (param_id == Filter::PARAMID_TARGET_LATENCY) {
+        return latency_.setTargetLatency(value);
+    } else if (param_id == Filter::PARAMID_FILE_OPENS || param_id == Filter::PARAMID_FILE_HITS || param_id == Filter::PARAMID_FILE_EVICTIONS) {
+        if (value != 0) {
+            return false;
+        }
+        files_.resetCounters();
+        return true;
     }
     return NullFilter::setParam(param_id, value);
 }
@@ -200,16 +241,7 @@ bool SDSink::sendNoteOff(uint8_t note, uint8_t /*velocity*/, uint8_t /*channel*/
         return false;
     }
 
-    if (units_[note].render_ch >= 0) {
-        renderer_.deallocateChannel(units_[note].render_ch);
-        units_[note].render_ch = kDeallocatedChannel;
-        units_[note].file.close();
-    } else if (units_[note].render_ch == kUnallocatedChannel) {
-        if (units_[note].file) {
-            units_[note].render_ch = kDeallocatedChannel;
-            units_[note].file.close();
-        }
-    }
+    stopPlayback(note);
     return true;
 }
 
@@ -225,28 +257,46 @@ bool SDSink::sendNoteOn(uint8_t note, uint8_t velocity, uint8_t channel) {
         return false;
     }
 
+    if (units_[note].end <= units_[note].offset) {
+        error_printf("[%s::%s] no playable data\n", kClassName, __func__);
+        return false;
+    }
+
     if (velocity == 0) {
         return sendNoteOff(note, velocity, channel);
     }
 
-    if (units_[note].render_ch >= 0) {
-        renderer_.deallocateChannel(units_[note].render_ch);
-        units_[note].render_ch = kDeallocatedChannel;
-        units_[note].file.close();
-    } else if (units_[note].render_ch == kUnallocatedChannel) {
-        units_[note].render_ch = kDeallocatedChannel;
-        units_[note].file.close();
+    // retrigger
+    stopPlayback(note);
+
+    if (stealer_.getActiveCount() >= polyphony_) {
+        // fade the victim out in the next frame and play the new note on a reserve channel meanwhile;
+        // without a free reserve channel the new note could not start anyway, so keep the victim
+        int victim = (renderer_.getActiveChannelCount() < renderer_.getChannelCount()) ? stealer_.steal(note, channel) : -1;
+        if (victim >= 0) {
+            debug_printf("[%s::%s] steal note:%d\n", kClassName, __func__, victim);
+            stopPlayback(victim);
+        } else {
+            debug_printf("[%s::%s] drop note:%d\n", kClassName, __func__, note);
+            stealer_.drop();
+            return true;
+        }
     }
 
-    units_[note].file = File(units_[note].path.c_str());
-    if (units_[note].file) {
-        units_[note].file.seek(units_[note].offset + msToByte(offset_));
+    units_[note].file = files_.acquire(units_[note].path);
+    if (units_[note].file != nullptr) {
+        units_[note].file->seek(units_[note].offset + msToByte(offset_));
         int render_channel = renderer_.allocateChannel();
         units_[note].render_ch = (render_channel < 0) ? kUnallocatedChannel : render_channel;
         if (units_[note].render_ch == kUnallocatedChannel) {
             error_printf("[%s::%s] cannot allocate channel\n", kClassName, __func__);
+            stealer_.drop();
+            units_[note].render_ch = kDeallocatedChannel;
+            files_.release(units_[note].file);
+            units_[note].file = nullptr;
         } else {
-            update();
+            stealer_.start(note, note, channel, velocity);
+            continuePlayback(note, latency_.getPreloadFrames());
         }
     }
     return true;
@@ -255,17 +305,93 @@ bool SDSink::sendNoteOn(uint8_t note, uint8_t velocity, uint8_t channel) {
 bool SDSink::sendControlChange(uint8_t ctrl_num, uint8_t /*value*/, uint8_t /*channel*/) {
     if (0x7B <= ctrl_num && ctrl_num <= 0x7F) {
         debug_printf("[%s::%s] All Note Off\n", kClassName, __func__);
-        for (auto& e : units_) {
-            if (e.path.length() == 0) {
+        for (size_t i = 0; i < sizeof(units_) / sizeof(units_[0]); i++) {
+            if (units_[i].path.length() == 0) {
                 continue;
             }
-            renderer_.deallocateChannel(e.render_ch);
-            e.render_ch = kDeallocatedChannel;
-            e.file.close();
+            stopPlayback(i);
         }
     }
 
     return true;
 }
 
+void SDSink::continuePlayback(uint8_t note, int frames) {
+    if (units_[note].render_ch < 0) {
+        return;
+    }
+    // frames is what this call must refill; a read goes further when the buffer has room for a whole read_size_
+    size_t budget = (size_t)frames * kPbBlockSize;
+    size_t done = 0;
+    while (done < budget) {
+        // end of file
+        if (units_[note].file->position() >= units_[note].file->size()) {
+            if (loop_) {
+                units_[note].file->seek(units_[note].offset + msToByte(offset_));
+            } else {
+                stopPlayback(note);
+                break;
+            }
+        }
+
+        // output: read from the file straight into the ring buffer
+        uint8_t *ptr1 = nullptr;
+        uint8_t *ptr2 = nullptr;
+        size_t len1 = 0;
+        size_t len2 = 0;
+        size_t space = renderer_.acquireWriteRegion(units_[note].render_ch, &ptr1, &len1, &ptr2, &len2);
+        if (space < kPbBlockSize) {
+            break;
+        }
+        uint32_t pos = units_[note].file->position();
+        size_t read_size = units_[note].end - pos;
+        read_size = (read_size < read_size_) ? read_size : read_size_;
+        if (space < read_size) {
+            // wait for room for a whole read, unless the channel would run dry before the next call
+            if (renderer_.getReadableSize(units_[note].render_ch) >= budget) {
+                break;
+            }
+            read_size = space;
+        }
+        if (pos + read_size < units_[note].end && (pos + read_size) / kSectorSize * kSectorSize > pos) {
+            read_size = (pos + read_size) / kSectorSize * kSectorSize - pos;
+        }
+        size_t size1 = (read_size < len1) ? read_size : len1;
+        uint32_t start_us = micros();
+        int ret1 = units_[note].file->read(ptr1, size1);
+        int ret2 = (ret1 == (int)size1 && size1 < read_size) ? units_[note].file->read(ptr2, read_size - size1) : 0;
+        latency_.reportRead((uint32_t)micros() - start_us);
+        size_t size = (size_t)((ret1 > 0) ? ret1 : 0) + (size_t)((ret2 > 0) ? ret2 : 0);
+        renderer_.commitWrite(units_[note].render_ch, size);
+        if (size == 0) {
+            break;
+        }
+        done += size;
+    }
+}
+
+int SDSink::getBufferFill() {
+    size_t fill = 0;
+    bool found = false;
+    for (size_t i = 0; i < sizeof(units_) / sizeof(units_[0]); i++) {
+        if (units_[i].render_ch < 0) {
+            continue;
+        }
+        size_t size = renderer_.getReadableSize(units_[i].render_ch);
+        fill = (!found || size < fill) ? size : fill;
+        found = true;
+    }
+    return (int)(fill / kPbBytePerMs);
+}
+
+void SDSink::stopPlayback(uint8_t note) {
+    if (units_[note].render_ch >= 0) {
+        renderer_.deallocateChannel(units_[note].render_ch);
+    }
+    units_[note].render_ch = kDeallocatedChannel;
+    files_.release(units_[note].file);
+    units_[note].file = nullptr;
+    stealer_.stop(note);
+}
+
 #endif  // ARDUINO_ARCH_SPRESENSE
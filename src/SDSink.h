@@ -18,7 +18,10 @@
 
 #include <File.h>
 
+#include "FilePool.h"
+#include "LatencyController.h"
 #include "PcmRenderer.h"
+#include "VoiceStealer.h"
 #include "YuruInstrumentFilter.h"
 
 /**
@@ -37,6 +40,33 @@ public:
         PARAMID_LOOP
     };
 
+    /**
+     * @brief @~japanese 同時発音数の初期値です。
+     */
+    static const int kDefaultPolyphony = 4;
+
+    /**
+     * @brief @~japanese ボイスを盗む時に新しいノートに割り当てる予備の音声出力チャンネル数の初期値と上限です。
+     * @details @~japanese 予備のチャンネルも同時発音数のチャンネルと同じく 24 KiB のキャッシュを確保するので、
+     * 初期値では 48 KiB のRAMを追加で使います。RAMが足りない場合は SDSink の生成時に減らしてください。
+     */
+    static const int kStealReserve = 2;
+
+    /**
+     * @brief @~japanese 同時発音数の上限です。
+     */
+    static const int kMaxPolyphony = PcmRenderer::kMaxChannel - kStealReserve;
+
+    /**
+     * @brief @~japanese 音声ファイルを1回に読み込むサイズ [byte] の初期値です。
+     */
+    static const size_t kDefaultReadSize = 4096;
+
+    /**
+     * @brief @~japanese 音声ファイルを1回に読み込むサイズ [byte] の上限です。
+     */
+    static const size_t kMaxReadSize = 16384;
+
     struct Item {
         uint8_t note;
         String path;
@@ -46,7 +76,7 @@ public:
         String path;
         uint32_t offset;
         uint32_t end;
-        File file;
+        File* file;  // FilePool handle, nullptr if not opened
         int render_ch;
     };
 
@@ -54,14 +84,30 @@ public:
      * @brief @~japanese SDSink オブジェクトを生成します。
      * @param[in] table @~japanese 音源テーブル
      * @param[in] table_length @~japanese 音源テーブルの要素数
+     * @param[in] polyphony @~japanese 同時発音数 (SDSink::kMaxPolyphony 以下)
+     * @param[in] steal_reserve @~japanese 予備の音声出力チャンネル数 (0 から SDSink::kStealReserve まで)
+     * @details @~japanese 同時発音数を超えるノートを受けると、 Filter::PARAMID_VOICE_STEALING で選んだボイスをフェードアウトさせて、
+     * 予備の音声出力チャンネルで新しいノートを鳴らします。
+     * 予備のチャンネルがすべてフェードアウト中の場合は、ボイスを盗まずに新しいノートを捨てます。
+     * 予備を 0 にすると、同時発音数を超えるノートは常に捨てます。
      */
-    SDSink(const Item *table, size_t table_length);
+    SDSink(const Item *table, size_t table_length, int polyphony = kDefaultPolyphony, int steal_reserve = kStealReserve);
 
     ~SDSink();
 
     bool begin() override;
     void update() override;
 
+    /**
+     * @brief @~japanese 音声ファイルを1回に読み込むサイズを設定します。
+     * @details @~japanese 音声出力チャンネルのバッファにこのサイズの空きができるまで読み込みを待ち、まとめて読み込みます。
+     * 読み込みの終わりは512 byte (セクタ) の境界に揃えるので、2回目以降の読み込みはセクタの途中から始まりません。
+     * ただしバッファの残りが SDSink::update() 1回分の補充量より少ない場合は、空きの分だけすぐに読み込みます。
+     * 1回の読み込みのオーバーヘッドが大きいSDカードでは 8192 から 16384 、小さいフラッシュメモリでは初期値の 4096 が目安です。
+     * @param[in] bytes @~japanese 1回に読み込むサイズ [byte] (512 byte の倍数に切り下げて、 512 から SDSink::kMaxReadSize の範囲に丸めます)
+     */
+    void setReadSize(size_t bytes);
+
     bool isAvailable(int param_id) override;
     intptr_t getParam(int param_id) override;
     bool setParam(int param_id, intptr_t value) override;
@@ -73,9 +119,18 @@ public:
 private:
     PlaybackUnit units_[128];
     PcmRenderer renderer_;
+    int polyphony_;
+    VoiceStealer stealer_;
+    LatencyController latency_;
+    FilePool files_;
+    size_t read_size_;
     uint32_t offset_;
     bool loop_;
     int volume_;
+
+    void continuePlayback(uint8_t note, int frames);
+    int getBufferFill();
+    void stopPlayback(uint8_t note);
 };
 
 #endif  // SD_SINK_H_
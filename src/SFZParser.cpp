@@ -219,6 +219,7 @@ void SFZParser::parse(File sfz_file, const String& sfz_file_path, SFZHandler* ha
                 File include_file = File(path.c_str());
                 if (include_file) {
                     debug_printf("[%s::%s] parsing '%s'\n", kClassName, __func__, path.c_str());
+                    handler->includeFile(path);
                     parse(include_file, sfz_file_path, handler);
                     include_file.close();
                 } else {
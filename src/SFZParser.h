@@ -77,6 +77,11 @@ public:
      * @brief @~japanese Opcode代入文の通知を受けます。
      */
     virtual void opcode(const String& opcode, const String& value) = 0;
+    /**
+     * @brief @~japanese #include で読み込むファイルの通知を受けます。
+     */
+    virtual void includeFile(const String& /*path*/) {
+    }
 };
 
 /**
@@ -10,7 +10,9 @@
 
 #include <errno.h>
 #include <limits.h>
+#include <math.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <vector>
 
@@ -53,16 +55,41 @@ const int kPbSampleFrq = 48000;
 const int kPbBitDepth = 16;
 const int kPbChannelCount = 2;
 const int kPbSampleCount = 240;
-const int kPbBlockSize = kPbSampleCount * (kPbBitDepth / 8) * kPbChannelCount;
-const int kPbCacheSize = (24 * 1024);
-
-// cache parameter
-const int kPreloadFrames = 3;
-const int kLoadFrames = 10;
+const int kPbSampleSize = (kPbBitDepth / 8) * kPbChannelCount;
+const int kPbBlockSize = kPbSampleCount * kPbSampleSize;
+const int kPbCacheSize = (24 * 1024);  // per channel, allocated once; the most that LatencyController can preload
+const uint32_t kPbFrameUs = 1000000 / (kPbSampleFrq / kPbSampleCount);
+const int kPbBytePerMs = kPbSampleFrq / 1000 * (kPbBitDepth / 8) * kPbChannelCount;
+
+// region index: candidates per (key, velocity band), and per key for regions spanning many bands
+const int kIndexVelocityShift = 4;
+const int kIndexVelocityBands = 128 >> kIndexVelocityShift;
+const int kIndexBandBuckets = 128 * kIndexVelocityBands;
+const int kIndexBuckets = kIndexBandBuckets + 128;
+const int kIndexMaxBandsPerRegion = 4;
+
+// instrument cache: "<sfz path>.bin"
+const char kInstrumentCacheSuffix[] = ".bin";
+const uint32_t kInstrumentCacheMagic = 0x435A4653;  // "SFZC"
+const uint32_t kInstrumentCacheVersion = 7;
+const size_t kHashChunkSize = 512;
+const uint32_t kSampleHeaderHashSize = 512;  // a sample is checked by its size and the hash of its header
+
+// choke groups
+const uint16_t kNoChokeGroup = 0xFFFF;
+const size_t kMaxChokeRules = UINT8_MAX;  // Region::choke_id is 1-based in a byte
 
 const static int kUnallocatedChannel = -1;
 const static int kDeallocatedChannel = -2;
 
+// gain parameters (Q14)
+const int32_t kGainUnity = 0x4000;
+const int32_t kGainMax = 0x7FFF;
+const uint8_t kCCVolume = 0x07;
+const uint8_t kCCPan = 0x0A;
+const uint8_t kDefaultCCVolume = 127;  // no attenuation until CC#7 is received
+const uint8_t kDefaultCCPan = 64;
+
 static SFZSink::Header convertHeaderToEnum(const String& str) {
     if (str == "global") {
         return SFZSink::kGlobal;
@@ -196,6 +223,28 @@ static bool parseQ16(const String& str, uint32_t* out) {
     return true;
 }
 
+static int32_t roundQ16(uint32_t value) {
+    return ((int32_t)value + 0x8000) >> 16;
+}
+
+static int32_t convertDecibelToGain(int32_t q16_db) {
+    float gain = kGainUnity * powf(10.0f, (float)q16_db / 65536.0f / 20.0f);
+    return (gain < (float)kGainMax) ? (int32_t)lroundf(gain) : kGainMax;
+}
+
+// (value / 127)^2 in Q14
+static int32_t convertMidiToGain(uint8_t value) {
+    return ((int32_t)value * value * kGainUnity) / (127 * 127);
+}
+
+// Q16 seconds to milliseconds; unspecified times keep the short fade of PcmRenderer against clicks
+static int32_t convertEnvelopeTime(const SFZSink::OpcodeContainer& container, SFZSink::Opcode opcode) {
+    if (!(container.specified & (1ULL << opcode))) {
+        return -1;
+    }
+    return (int32_t)(((uint64_t)container.opcode[opcode] * 1000 + 0x8000) >> 16);
+}
+
 static bool parseNotename(const String& str, uint32_t* out) {
     const unsigned char kBasenote[] = {69, 71, 60, 62, 64, 65, 67};
 
@@ -231,27 +280,100 @@ static bool parseNotename(const String& str, uint32_t* out) {
     return false;
 }
 
-static SFZSink::Region buildRegion(const SFZSink::OpcodeContainer& container) {
-    const int kSampleSize = (kPbBitDepth / 8) * kPbChannelCount;
+// opcode specs sorted by opcode_str in strcmp() order for the binary search in findOpcodeSpecs().
+// an opcode may have several entries (key sets both lokey and hikey); they are adjacent.
+// clang-format off
+static constexpr OpcodeSpec kOpcodeSpecs[] = {
+//   opcode_str         opcode_enum                     min                       max                    parser
+    {"amp_veltrack",    SFZSink::kOpcodeAmpVeltrack,    (uint32_t)(-100 * 65536), 100 * 65536,           parseQ16     },
+    {"ampeg_attack",    SFZSink::kOpcodeAmpegAttack,    0,                        100 * 65536,           parseQ16     },
+    {"ampeg_release",   SFZSink::kOpcodeAmpegRelease,   0,                        100 * 65536,           parseQ16     },
+    {"count",           SFZSink::kOpcodeCount,          0,                        UINT32_MAX,            parseUint32  },
+    {"default_path",    SFZSink::kOpcodeDefaultPath,    0,                        0,                     nullptr      },
+    {"end",             SFZSink::kOpcodeEnd,            0,                        UINT32_MAX,            parseUint32  },
+    {"group",           SFZSink::kOpcodeGroup,          0,                        UINT32_MAX,            parseUint32  },
+    {"hicc0",           SFZSink::kOpcodeHiCC0,          0,                        127,                   parseUint32  },
+    {"hicc32",          SFZSink::kOpcodeHiCC32,         0,                        127,                   parseUint32  },
+    {"hichan",          SFZSink::kOpcodeHichan,         1,                        16,                    parseUint32  },
+    {"hikey",           SFZSink::kOpcodeHikey,          NOTE_NUMBER_MIN,          NOTE_NUMBER_MAX,       parseNotename},
+    {"hiprog",          SFZSink::kOpcodeHiProg,         0,                        127,                   parseUint32  },
+    {"hirand",          SFZSink::kOpcodeHirand,         0x00000000,               0x00010000,            parseQ16     }, //< not supported
+    {"hivel",           SFZSink::kOpcodeHivel,          0,                        127,                   parseUint32  },
+    {"key",             SFZSink::kOpcodeHikey,          NOTE_NUMBER_MIN,          NOTE_NUMBER_MAX,       parseNotename},
+    {"key",             SFZSink::kOpcodeLokey,          NOTE_NUMBER_MIN,          NOTE_NUMBER_MAX,       parseNotename},
+    {"key",             SFZSink::kOpcodePitchKeycenter, NOTE_NUMBER_MIN,          NOTE_NUMBER_MAX,       parseNotename},
+    {"locc0",           SFZSink::kOpcodeLoCC0,          0,                        127,                   parseUint32  },
+    {"locc32",          SFZSink::kOpcodeLoCC32,         0,                        127,                   parseUint32  },
+    {"lochan",          SFZSink::kOpcodeLochan,         1,                        16,                    parseUint32  },
+    {"lokey",           SFZSink::kOpcodeLokey,          NOTE_NUMBER_MIN,          NOTE_NUMBER_MAX,       parseNotename},
+    {"loop_end",        SFZSink::kOpcodeLoopEnd,        0,                        UINT32_MAX,            parseUint32  },
+    {"loop_mode",       SFZSink::kOpcodeLoopMode,       SFZSink::kNoLoop,         SFZSink::kLoopSustain, parseLoopmode},
+    {"loop_start",      SFZSink::kOpcodeLoopStart,      0,                        UINT32_MAX,            parseUint32  },
+    {"loopend",         SFZSink::kOpcodeLoopEnd,        0,                        UINT32_MAX,            parseUint32  },
+    {"loopmode",        SFZSink::kOpcodeLoopMode,       SFZSink::kNoLoop,         SFZSink::kLoopSustain, parseLoopmode},
+    {"loopstart",       SFZSink::kOpcodeLoopStart,      0,                        UINT32_MAX,            parseUint32  },
+    {"loprog",          SFZSink::kOpcodeLoProg,         0,                        127,                   parseUint32  },
+    {"lorand",          SFZSink::kOpcodeLorand,         0x00000000,               0x00010000,            parseQ16     }, //< not supported
+    {"lovel",           SFZSink::kOpcodeLovel,          0,                        127,                   parseUint32  },
+    {"off_by",          SFZSink::kOpcodeOffBy,          0,                        UINT32_MAX,            parseUint32  },
+    {"offset",          SFZSink::kOpcodeOffset,         0,                        UINT32_MAX,            parseUint32  },
+    {"pan",             SFZSink::kOpcodePan,            (uint32_t)(-100 * 65536), 100 * 65536,           parseQ16     },
+    {"pitch_keycenter", SFZSink::kOpcodePitchKeycenter, NOTE_NUMBER_MIN,          NOTE_NUMBER_MAX,       parseNotename},
+    {"sample",          SFZSink::kOpcodeSample,         0,                        0,                     nullptr      },
+    {"seq_length",      SFZSink::kOpcodeSeqLength,      1,                        100,                   parseUint32  }, //< not supported
+    {"seq_position",    SFZSink::kOpcodeSeqPosition,    1,                        100,                   parseUint32  }, //< not supported
+    {"sw_default",      SFZSink::kOpcodeSwDefault,      NOTE_NUMBER_MIN,          NOTE_NUMBER_MAX,       parseNotename},
+    {"sw_hikey",        SFZSink::kOpcodeSwHikey,        NOTE_NUMBER_MIN,          NOTE_NUMBER_MAX,       parseNotename},
+    {"sw_last",         SFZSink::kOpcodeSwLast,         NOTE_NUMBER_MIN,          NOTE_NUMBER_MAX,       parseNotename},
+    {"sw_lokey",        SFZSink::kOpcodeSwLokey,        NOTE_NUMBER_MIN,          NOTE_NUMBER_MAX,       parseNotename},
+    {"transpose",       SFZSink::kOpcodeTranspose,      (uint32_t)(-127 * 65536), 127 * 65536,           parseQ16     },
+    {"tune",            SFZSink::kOpcodeTune,           (uint32_t)(-100 * 65536), 100 * 65536,           parseQ16     },
+    {"volume",          SFZSink::kOpcodeVolume,         (uint32_t)(-144 * 65536), 6 * 65536,             parseQ16     }
+};
+// clang-format on
+static const size_t kOpcodeSpecCount = sizeof(kOpcodeSpecs) / sizeof(kOpcodeSpecs[0]);
 
-    SFZSink::Region region;
+static constexpr int compareOpcodeStr(const char* a, const char* b) {
+    return (*a != *b || *a == '\0') ? (int)(unsigned char)*a - (int)(unsigned char)*b : compareOpcodeStr(a + 1, b + 1);
+}
 
-    region.sample = normalizePath(container.sample);
-    region.pcm_offset = 0;
-    region.pcm_size = 0;
-    File file = File(region.sample.c_str());
-    if (!file) {
-        error_printf("[%s::%s] cannot open \"%s\"\n", kClassName, __func__, region.sample.c_str());
+static constexpr bool isOpcodeTableSorted(const OpcodeSpec* specs, size_t count) {
+    return count < 2 || (compareOpcodeStr(specs[0].opcode_str, specs[1].opcode_str) <= 0 && isOpcodeTableSorted(specs + 1, count - 1));
+}
+
+static_assert(isOpcodeTableSorted(kOpcodeSpecs, sizeof(kOpcodeSpecs) / sizeof(kOpcodeSpecs[0])), "kOpcodeSpecs must be sorted by opcode_str");
+
+// returns the first spec of the opcode and the number of its entries
+static const OpcodeSpec* findOpcodeSpecs(const char* opcode, size_t* count) {
+    size_t lo = 0;
+    size_t hi = kOpcodeSpecCount;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (strcmp(kOpcodeSpecs[mid].opcode_str, opcode) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
     }
-    if (file.isDirectory()) {
-        error_printf("[%s::%s] \"%s\" is directory\n", kClassName, __func__, region.sample.c_str());
-    } else {
-        WavReader wav = WavReader(file);
-        region.pcm_offset = wav.getPcmOffset();
-        region.pcm_size = wav.getPcmSize();
+    size_t n = 0;
+    while (lo + n < kOpcodeSpecCount && strcmp(kOpcodeSpecs[lo + n].opcode_str, opcode) == 0) {
+        n++;
     }
-    file.close();
+    *count = n;
+    return &kOpcodeSpecs[lo];
+}
+
+static SFZSink::Region buildRegion(const SFZSink::OpcodeContainer& container, const SFZSink::SampleInfo& info) {
+    const int kSampleSize = (kPbBitDepth / 8) * kPbChannelCount;
+
+    SFZSink::Region region;
+
+    region.sample_id = container.sample_id;
+    region.pcm_offset = info.pcm_offset;
+    region.pcm_size = info.pcm_size;
     region.silence = container.silence;
+    region.choke_id = 0;
+    region.head_id = -1;
 
     size_t pcm_samples = region.pcm_size / kSampleSize;
 
@@ -268,10 +390,22 @@ static SFZSink::Region buildRegion(const SFZSink::OpcodeContainer& container) {
     region.hicc0 = container.opcode[SFZSink::kOpcodeHiCC0];
     region.locc32 = container.opcode[SFZSink::kOpcodeLoCC32];
     region.hicc32 = container.opcode[SFZSink::kOpcodeHiCC32];
+    region.gain = convertDecibelToGain(container.opcode[SFZSink::kOpcodeVolume]);
+    region.pan = roundQ16(container.opcode[SFZSink::kOpcodePan]);
+    region.amp_veltrack = roundQ16(container.opcode[SFZSink::kOpcodeAmpVeltrack]);
+    // SFZ defaults pitch_keycenter to 60, but an instrument without it keeps every key at the pitch of its sample as before
+    if (container.specified & (1ULL << SFZSink::kOpcodePitchKeycenter)) {
+        region.pitch_keycenter = container.opcode[SFZSink::kOpcodePitchKeycenter];
+    } else {
+        region.pitch_keycenter = SFZSink::kNoPitchKeycenter;
+    }
+    region.tune = roundQ16(container.opcode[SFZSink::kOpcodeTranspose]) * 100 + roundQ16(container.opcode[SFZSink::kOpcodeTune]);
+    region.ampeg_attack = convertEnvelopeTime(container, SFZSink::kOpcodeAmpegAttack);
+    region.ampeg_release = convertEnvelopeTime(container, SFZSink::kOpcodeAmpegRelease);
     size_t offset_samples = (pcm_samples < container.opcode[SFZSink::kOpcodeOffset]) ? pcm_samples : container.opcode[SFZSink::kOpcodeOffset];
     region.offset = region.pcm_offset + offset_samples * kSampleSize;
     if (pcm_samples > 0) {
-        if (container.specified & (1U << SFZSink::kOpcodeEnd)) {
+        if (container.specified & (1ULL << SFZSink::kOpcodeEnd)) {
             size_t end_samples = (pcm_samples - 1 < container.opcode[SFZSink::kOpcodeEnd]) ? pcm_samples - 1 : container.opcode[SFZSink::kOpcodeEnd];
             region.end = region.pcm_offset + (end_samples + 1) * kSampleSize;
         } else {
@@ -281,7 +415,7 @@ static SFZSink::Region buildRegion(const SFZSink::OpcodeContainer& container) {
         region.end = 0;
     }
     region.count = container.opcode[SFZSink::kOpcodeCount];
-    if (container.specified & (1U << SFZSink::kOpcodeCount)) {
+    if (container.specified & (1ULL << SFZSink::kOpcodeCount)) {
         region.loop_mode = SFZSink::kOneShot;
     } else {
         region.loop_mode = (SFZSink::LoopMode)container.opcode[SFZSink::kOpcodeLoopMode];
@@ -290,7 +424,7 @@ static SFZSink::Region buildRegion(const SFZSink::OpcodeContainer& container) {
     region.loop_start = region.pcm_offset + loop_start_samples * kSampleSize;
     region.loop_start = (region.offset > region.loop_start) ? region.offset : region.loop_start;
     if (pcm_samples > 0) {
-        if (container.specified & (1U << SFZSink::kOpcodeLoopEnd)) {
+        if (container.specified & (1ULL << SFZSink::kOpcodeLoopEnd)) {
             size_t loop_end_samples =
                 (pcm_samples - 1 < container.opcode[SFZSink::kOpcodeLoopEnd]) ? pcm_samples - 1 : container.opcode[SFZSink::kOpcodeLoopEnd];
             region.loop_end = region.pcm_offset + (loop_end_samples + 1) * kSampleSize;
@@ -305,13 +439,158 @@ static SFZSink::Region buildRegion(const SFZSink::OpcodeContainer& container) {
     return region;
 }
 
-SFZSink::SFZSink(const String& sfz_path)
+// FNV-1a over the first limit bytes of the file
+static bool hashFile(const String& path, uint32_t* size, uint32_t* hash, uint32_t limit = UINT32_MAX) {
+    File file = File(path.c_str());
+    if (!file) {
+        return false;
+    }
+    uint8_t buf[kHashChunkSize];
+    uint32_t h = 2166136261U;
+    *size = file.size();
+    for (uint32_t done = 0; done < limit;) {
+        int ret = file.read(buf, (limit - done < sizeof(buf)) ? limit - done : sizeof(buf));
+        if (ret <= 0) {
+            break;
+        }
+        for (int i = 0; i < ret; i++) {
+            h = (h ^ buf[i]) * 16777619U;
+        }
+        done += ret;
+    }
+    file.close();
+    *hash = h;
+    return true;
+}
+
+// the single list of the region fields stored in the instrument cache; runtime fields (head_*) are not stored
+template <typename F>
+static void visitRegionFields(SFZSink::Region* r, F& f) {
+    f(&r->lochan);
+    f(&r->hichan);
+    f(&r->lokey);
+    f(&r->hikey);
+    f(&r->lovel);
+    f(&r->hivel);
+    f(&r->loprog);
+    f(&r->hiprog);
+    f(&r->locc0);
+    f(&r->hicc0);
+    f(&r->locc32);
+    f(&r->hicc32);
+    f(&r->sw_last);
+    f(&r->sample_id);
+    f(&r->pan);
+    f(&r->amp_veltrack);
+    f(&r->choke_id);
+    f(&r->pitch_keycenter);
+    f(&r->tune);
+    f(&r->gain);
+    f(&r->ampeg_attack);
+    f(&r->ampeg_release);
+    f(&r->offset);
+    f(&r->end);
+    f(&r->count);
+    f(&r->loop_mode);
+    f(&r->loop_start);
+    f(&r->loop_end);
+    f(&r->pcm_offset);
+    f(&r->pcm_size);
+    f(&r->silence);
+}
+
+class CacheWriter {
+public:
+    std::vector<uint8_t> data;
+
+    template <typename T>
+    void operator()(const T* value) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(value);
+        data.insert(data.end(), p, p + sizeof(T));
+    }
+    void putString(const String& str) {
+        uint32_t length = str.length();
+        (*this)(&length);
+        data.insert(data.end(), str.c_str(), str.c_str() + length);
+    }
+};
+
+class CacheReader {
+public:
+    CacheReader(const uint8_t* data, size_t size) : p_(data), end_(data + size), ok_(true) {
+    }
+
+    template <typename T>
+    void operator()(T* value) {
+        if (!ok_ || (size_t)(end_ - p_) < sizeof(T)) {
+            ok_ = false;
+            return;
+        }
+        memcpy(value, p_, sizeof(T));
+        p_ += sizeof(T);
+    }
+    void getString(String* str) {
+        uint32_t length = 0;
+        (*this)(&length);
+        if (!ok_ || (size_t)(end_ - p_) < length) {
+            ok_ = false;
+            return;
+        }
+        std::vector<char> buf(p_, p_ + length);
+        buf.push_back('\0');
+        *str = buf.data();
+        p_ += length;
+    }
+    bool ok() const {
+        return ok_;
+    }
+
+private:
+    const uint8_t* p_;
+    const uint8_t* end_;
+    bool ok_;
+};
+
+class FieldSize {
+public:
+    uint32_t size = 0;
+
+    template <typename T>
+    void operator()(const T* /*value*/) {
+        size += sizeof(T);
+    }
+};
+
+const int SFZSink::kStealReserve;
+const int SFZSink::kMaxPolyphony;
+const int SFZSink::kDefaultHeadCacheMs;
+const int SFZSink::kChokeReleaseMs;
+const size_t SFZSink::kMaxReadSize;
+const uint8_t SFZSink::kNoPitchKeycenter;
+
+SFZSink::SFZSink(const String& sfz_path, int polyphony, int steal_reserve)
     : NullFilter(),
       SFZHandler(),
       sfz_path_(sfz_path),
       regions_(),
+      index_offsets_(),
+      index_regions_(),
       playback_units_(),
-      renderer_(kPbSampleFrq, kPbBitDepth, kPbChannelCount, kPbSampleCount, kPbCacheSize, 4),
+      active_voices_(-1),
+      active_tail_(-1),
+      free_voices_(-1),
+      renderer_(kPbSampleFrq, kPbBitDepth, kPbChannelCount, kPbSampleCount, kPbCacheSize,
+                constrain(polyphony, 1, kMaxPolyphony) + constrain(steal_reserve, 0, kStealReserve)),
+      writer_(nullptr),
+      polyphony_(constrain(polyphony, 1, kMaxPolyphony)),
+      stealer_(),
+      latency_(kPbFrameUs, kPbCacheSize / kPbBlockSize),
+      files_(FilePool::kDefaultCapacity, constrain(polyphony, 1, kMaxPolyphony) + constrain(steal_reserve, 0, kStealReserve)),
+      streamer_(constrain(polyphony, 1, kMaxPolyphony) + constrain(steal_reserve, 0, kStealReserve)),
+      background_streaming_(false),
+      head_cache_(),
+      head_ms_(kDefaultHeadCacheMs),
+      interpolation_(Resampler::kInterpolationCubic),
       bank_(),
       volume_(0),
       prog_num_(0),
@@ -322,9 +601,22 @@ SFZSink::SFZSink(const String& sfz_path)
       group_id_(0),
       regions_in_group_(-1),
       default_path_(""),
+      sample_infos_(),
+      sample_formats_(),
+      choke_groups_(),
+      choke_rules_(),
+      choke_heads_(),
+      choked_count_(0),
+      sources_(),
+      use_cache_(false),
+      cache_loaded_(false),
       sw_lokey_(NOTE_NUMBER_MIN),
       sw_hikey_(NOTE_NUMBER_MAX),
       sw_last_(INVALID_NOTE_NUMBER) {
+    for (size_t i = 0; i < sizeof(controls_) / sizeof(controls_[0]); i++) {
+        controls_[i].volume = kDefaultCCVolume;
+        controls_[i].pan = kDefaultCCPan;
+    }
 }
 
 SFZSink::~SFZSink() {
@@ -353,8 +645,17 @@ bool SFZSink::begin() {
         error_printf("[%s::%s] error: cannot open \"%s\"\n", kClassName, __func__, sfz_path_.c_str());
         ret = false;
     } else {
-        SFZParser parser;
-        parser.parse(file, sfz_path_, this);
+        String cache_path = sfz_path_ + kInstrumentCacheSuffix;
+        cache_loaded_ = use_cache_ && loadInstrumentCache(cache_path);
+        if (!cache_loaded_) {
+            sources_.clear();
+            sources_.push_back(sfz_path_);
+            SFZParser parser;
+            parser.parse(file, sfz_path_, this);
+            if (use_cache_) {
+                saveInstrumentCache(cache_path);
+            }
+        }
         file.close();
         debug_printf("[%s::%s] regions: %d\n", kClassName, __func__, (int)regions_.size());
 #if DEBUG
@@ -364,7 +665,7 @@ bool SFZSink::begin() {
                 "lc=%d,hc=%d lk=%d,hk=%d,sl=%d lv=%d, hv=%d, lp=%d, hp=%d, lc0=%d, hc0=%d, lc32=%d, hc32=%d, o=%d,e=%d lm=%d,c=%d ls=%d,le=%d\n",
                 kClassName, __func__,                                       // [file::class]
                 (int)(i + 1), (int)regions_.size(),                         // i/N
-                regions_[i].sample.c_str(),                                 // sample
+                getSamplePath(regions_[i].sample_id).c_str(),               // sample
                 regions_[i].lochan, regions_[i].hichan,                     // lochan,hichan
                 regions_[i].lokey, regions_[i].hikey, regions_[i].sw_last,  // lokey,hikey,sw_last
                 regions_[i].lovel, regions_[i].hivel,                       // lovel,hivel
@@ -378,16 +679,97 @@ bool SFZSink::begin() {
 #endif
     }
 
+    loadSampleHeads();
+    initVoices();
+
+    // the decoders of compressed samples get their block buffers now, not at note-on
+    size_t max_block_size = 0;
+    for (const auto& e : sample_formats_) {
+        if (e.codec == SampleFormat::kCodecImaAdpcm && e.block_align > max_block_size) {
+            max_block_size = e.block_align;
+        }
+    }
+    streamer_.setMaxBlockSize(max_block_size);
+    // the I/O buffers are for the regions that stream; a kit of short samples in the head cache needs none
+    bool streaming = false;
+    for (const auto& e : regions_) {
+        streaming = streaming || !isHeadOnly(e, getHeadSize(&e));
+    }
+    if (!streaming) {
+        debug_printf("[%s::%s] no region streams\n", kClassName, __func__);
+        streamer_.end();
+    } else if (!streamer_.begin(background_streaming_)) {
+        error_printf("[%s::%s] error: cannot start background streaming\n", kClassName, __func__);
+        streamer_.begin(false);
+        ret = false;
+    }
+
     debug_printf("[%s::%s] start playback\n", kClassName, __func__);
-    renderer_.begin();
+    if (writer_ != nullptr) {
+        renderer_.begin(writer_);
+    } else {
+        renderer_.begin();
+    }
 
     return ret;
 }
 
+void SFZSink::setPcmWriter(PcmWriter* writer) {
+    writer_ = writer;
+}
+
+void SFZSink::setInstrumentCache(bool enable) {
+    use_cache_ = enable;
+}
+
+bool SFZSink::isLoadedFromCache() {
+    return cache_loaded_;
+}
+
+void SFZSink::setHeadCache(size_t budget_bytes, int head_ms) {
+    head_cache_.setBudget(budget_bytes);
+    head_ms_ = (head_ms > 0) ? head_ms : kDefaultHeadCacheMs;
+}
+
+void SFZSink::setBackgroundStreaming(bool enable) {
+    background_streaming_ = enable;
+}
+
+size_t SFZSink::getStreamBufferSize() {
+    return streamer_.getBufferSize();
+}
+
+void SFZSink::setReadSize(size_t bytes) {
+    streamer_.setChunkSize(constrain(bytes, SampleStreamer::kSectorSize, kMaxReadSize));
+}
+
 void SFZSink::update() {
     NullFilter::update();
-    for (auto& e : playback_units_) {
-        continuePlayback(&e, kLoadFrames);
+    latency_.update(renderer_.getUnderrunCount(), (uint32_t)(renderer_.getRenderedSamples() / kPbSampleCount));
+    int frames = latency_.getRefillFrames();
+    for (int i = active_voices_; i >= 0;) {
+        PlaybackUnit& e = playback_units_[i];
+        i = e.next;  // stopPlayback() moves e to the free list
+        // open the stream while the cached head is playing
+        if (e.render_ch >= 0 && !e.draining && !e.streaming && !isHeadOnly(*e.region, e.head_size) && !openStream(&e)) {
+            error_printf("[%s::%s] error: file open error \"%s\"\n", kClassName, __func__, getSamplePath(e.region->sample_id).c_str());
+            stopPlayback(&e);
+        }
+        // a short last frame would hold back the other voices; the release mixes it
+        if (e.render_ch >= 0 && e.draining && renderer_.getReadableSize(e.render_ch) < (size_t)kPbBlockSize) {
+            stopPlayback(&e);
+        }
+        continuePlayback(&e, frames);
+        if (e.render_ch >= 0) {
+            streamer_.setQueuedSize(getVoiceIndex(&e), renderer_.getReadableSize(e.render_ch));
+        }
+    }
+    uint32_t peak_us = 0;
+    if (streamer_.takePeakReadTime(&peak_us)) {
+        latency_.reportRead(peak_us);
+    }
+    if (writer_ != nullptr) {
+        renderer_.render();
     }
 }
 
@@ -401,6 +783,22 @@ bool SFZSink::isAvailable(int param_id) {
         return true;
     } else if (param_id == SFZSink::PARAMID_SW_HIKEY) {
         return true;
+    } else if (param_id == Filter::PARAMID_VOICE_STEALING) {
+        return true;
+    } else if (param_id == Filter::PARAMID_STOLEN_VOICES) {
+        return true;
+    } else if (param_id == Filter::PARAMID_DROPPED_VOICES) {
+        return true;
+    } else if (param_id == Filter::PARAMID_TARGET_LATENCY) {
+        return true;
+    } else if (param_id == Filter::PARAMID_BUFFER_FILL) {
+        return true;
+    } else if (param_id == Filter::PARAMID_FILE_OPENS || param_id == Filter::PARAMID_FILE_HITS || param_id == Filter::PARAMID_FILE_EVICTIONS) {
+        return true;
+    } else if (param_id == Filter::PARAMID_CHOKED_VOICES) {
+        return true;
+    } else if (param_id == Filter::PARAMID_INTERPOLATION) {
+        return true;
     }
     return NullFilter::isAvailable(param_id);
 }
@@ -415,6 +813,26 @@ intptr_t SFZSink::getParam(int param_id) {
         return sw_lokey_;
     } else if (param_id == SFZSink::PARAMID_SW_HIKEY) {
         return sw_hikey_;
+    } else if (param_id == Filter::PARAMID_VOICE_STEALING) {
+        return stealer_.getPolicy();
+    } else if (param_id == Filter::PARAMID_STOLEN_VOICES) {
+        return stealer_.getStolenCount();
+    } else if (param_id == Filter::PARAMID_DROPPED_VOICES) {
+        return stealer_.getDroppedCount();
+    } else if (param_id == Filter::PARAMID_TARGET_LATENCY) {
+        return latency_.getTargetLatency();
+    } else if (param_id == Filter::PARAMID_BUFFER_FILL) {
+        return getBufferFill();
+    } else if (param_id == Filter::PARAMID_FILE_OPENS) {
+        return files_.getOpenCount();
+    } else if (param_id == Filter::PARAMID_FILE_HITS) {
+        return files_.getHitCount();
+    } else if (param_id == Filter::PARAMID_FILE_EVICTIONS) {
+        return files_.getEvictionCount();
+    } else if (param_id == Filter::PARAMID_CHOKED_VOICES) {
+        return choked_count_;
+    } else if (param_id == Filter::PARAMID_INTERPOLATION) {
+        return interpolation_;
     }
     return NullFilter::getParam(param_id);
 }
@@ -428,6 +846,35 @@ bool SFZSink::setParam(int param_id, intptr_t value) {
     } else if (param_id == SFZSink::PARAMID_SW_LAST) {
         sw_last_ = (uint8_t)value;
         return true;
+    } else if (param_id == Filter::PARAMID_VOICE_STEALING) {
+        return stealer_.setPolicy(value);
+    } else if (param_id == Filter::PARAMID_STOLEN_VOICES || param_id == Filter::PARAMID_DROPPED_VOICES) {
+        if (value != 0) {
+            return false;
+        }
+        stealer_.resetCounters();
+        return true;
+    } else if (param_id == Filter::PARAMID_TARGET_LATENCY) {
+        return latency_.setTargetLatency(value);
+    } else if (param_id == Filter::PARAMID_FILE_OPENS || param_id == Filter::PARAMID_FILE_HITS || param_id == Filter::PARAMID_FILE_EVICTIONS) {
+        if (value != 0) {
+            return false;
+        }
+        files_.resetCounters();
+        return true;
+    } else if (param_id == Filter::PARAMID_CHOKED_VOICES) {
+        if (value != 0) {
+            return false;
+        }
+        choked_count_ = 0;
+        return true;
+    } else if (param_id == Filter::PARAMID_INTERPOLATION) {
+        if (value < 0 || Resampler::kInterpolationMax < value) {
+            return false;
+        }
+        // applies from the next note on
+        interpolation_ = (Resampler::Interpolation)value;
+        return true;
     }
 
     return NullFilter::setParam(param_id, value);
@@ -435,20 +882,22 @@ bool SFZSink::setParam(int param_id, intptr_t value) {
 
 bool SFZSink::sendNoteOff(uint8_t note, uint8_t /*velocity*/, uint8_t channel) {
     debug_printf("[%s::%s] (%d, %d, %d)\n", kClassName, __func__, note, velocity, channel);
-    for (auto& e : playback_units_) {
-        if (e.render_ch == kDeallocatedChannel) {
+    for (int i = active_voices_; i >= 0;) {
+        PlaybackUnit& e = playback_units_[i];
+        i = e.next;
+        if (e.channel != channel) {
             continue;
         }
-        if (e.channel != channel) {
+        if (e.note != note) {
             continue;
         }
         if (e.region->loop_mode == kOneShot) {
+            // keeps playing to the end, but may be stolen first
+            stealer_.release(getVoiceIndex(&e));
             continue;
         }
-        if (e.note == note) {
-            stopPlayback(&e);
-            break;
-        }
+        stopPlayback(&e);
+        break;
     }
     return true;
 }
@@ -467,44 +916,24 @@ bool SFZSink::sendNoteOn(uint8_t note, uint8_t velocity, uint8_t channel) {
         sw_last_ = note;
     }
 
-    for (const auto& e : playback_units_) {
-        if (e.channel == channel && e.region->loop_mode == kOneShot) {
-            debug_printf("[%s::%s] playing one_shot\n", kClassName, __func__);
-            return true;
-        }
-    }
-
-    Region* region = nullptr;
-    for (auto& e : regions_) {
-        if (e.sw_last != INVALID_NOTE_NUMBER && e.sw_last != sw_last_) {
-            continue;
-        }
-        if (channel < e.lochan || e.hichan < channel) {
-            continue;
-        }
-        if (note < e.lokey || e.hikey < note) {
-            continue;
-        }
-        if (velocity < e.lovel || e.hivel < velocity) {
-            continue;
-        }
-        if (bank_.msb < e.locc0 || e.hicc0 < bank_.msb) {
-            continue;
-        }
-        if (bank_.lsb < e.locc32 || e.hicc32 < bank_.lsb) {
-            continue;
-        }
-        if (prog_num_ < e.loprog || e.hiprog < prog_num_) {
-            continue;
-        }
-        region = &e;
-        break;
-    }
+    int region_id = findRegion(note, velocity, channel);
+    Region* region = (region_id < 0) ? nullptr : &regions_[region_id];
     if (region == nullptr) {
         error_printf("[%s::%s] no match region for note=%d,channel=%d\n", kClassName, __func__, note, channel);
         return false;
     }
 
+    // a region in a choke group always plays, since it may be the one that turns the one_shot off
+    if (region->choke_id == 0 || choke_rules_[region->choke_id - 1].group == kNoChokeGroup) {
+        for (int i = active_voices_; i >= 0; i = playback_units_[i].next) {
+            const PlaybackUnit& e = playback_units_[i];
+            if (e.channel == channel && e.region->loop_mode == kOneShot) {
+                debug_printf("[%s::%s] playing one_shot\n", kClassName, __func__);
+                return true;
+            }
+        }
+    }
+
     startPlayback(note, velocity, channel, region);
 
     return true;
@@ -515,9 +944,23 @@ bool SFZSink::sendControlChange(uint8_t ctrl_num, uint8_t value, uint8_t channel
         bank_.msb = value;
     } else if (ctrl_num == 0x20) {
         bank_.lsb = value;
+    } else if ((ctrl_num == kCCVolume || ctrl_num == kCCPan) && 1 <= channel && channel <= 16) {
+        if (ctrl_num == kCCVolume) {
+            controls_[channel - 1].volume = value;
+        } else {
+            controls_[channel - 1].pan = value;
+        }
+        for (int i = active_voices_; i >= 0; i = playback_units_[i].next) {
+            PlaybackUnit& e = playback_units_[i];
+            if (e.channel == channel) {
+                updateGain(&e);
+            }
+        }
     } else if (0x7B <= ctrl_num && ctrl_num <= 0x7F) {
         debug_printf("[%s::%s] All Note Off\n", kClassName, __func__);
-        for (auto& e : playback_units_) {
+        for (int i = active_voices_; i >= 0;) {
+            PlaybackUnit& e = playback_units_[i];
+            i = e.next;
             if (e.channel == channel) {
                 stopPlayback(&e);
             }
@@ -540,6 +983,24 @@ size_t SFZSink::getNumberOfRegions() {
     return regions_.size();
 }
 
+size_t SFZSink::getNumberOfSamples() {
+    return samples_.size();
+}
+
+const String& SFZSink::getSamplePath(uint16_t sample_id) {
+    static const String kEmpty = "";
+    return (sample_id < samples_.size()) ? samples_[sample_id] : kEmpty;
+}
+
+uint32_t SFZSink::getHeadSize(const Region* region) {
+    if (region == nullptr || region->head_id < 0) {
+        return 0;
+    }
+    uint32_t size = getHeadBytes(*region);
+    uint32_t cached = head_cache_.getSize(region->head_id);
+    return (cached < size) ? cached : size;
+}
+
 const SFZSink::Region* SFZSink::getRegion(size_t id) {
     if (id < regions_.size()) {
         return &regions_[id];
@@ -561,10 +1022,12 @@ uint8_t SFZSink::getSwLast() {
 
 void SFZSink::startSfz() {
     regions_.clear();
+    index_offsets_.clear();
+    index_regions_.clear();
     {
         global_.is_valid = true;
         global_.group_id = 0;
-        global_.sample = "";
+        global_.sample_id = kNoSample;
         global_.silence = false;
         global_.specified = 0;
         global_.opcode[kOpcodeSample] = 0;
@@ -596,11 +1059,25 @@ void SFZSink::startSfz() {
         global_.opcode[kOpcodeHiCC0] = 127;
         global_.opcode[kOpcodeLoCC32] = 0;
         global_.opcode[kOpcodeHiCC32] = 127;
+        global_.opcode[kOpcodeVolume] = 0;
+        global_.opcode[kOpcodePan] = 0;
+        global_.opcode[kOpcodeAmpVeltrack] = 100 << 16;
+        global_.opcode[kOpcodeAmpegAttack] = 0;
+        global_.opcode[kOpcodeAmpegRelease] = 0;
+        global_.opcode[kOpcodePitchKeycenter] = 60;
+        global_.opcode[kOpcodeTranspose] = 0;
+        global_.opcode[kOpcodeTune] = 0;
     }
     group_ = global_;
     region_ = group_;
 
     default_path_ = "";
+    samples_.clear();
+    sample_ids_.clear();
+    sample_infos_.clear();
+    sample_formats_.clear();
+    choke_groups_.clear();
+    choke_rules_.clear();
     sw_lokey_ = NOTE_NUMBER_MIN;
     sw_hikey_ = NOTE_NUMBER_MAX;
     sw_last_ = INVALID_NOTE_NUMBER;
@@ -611,6 +1088,11 @@ void SFZSink::startSfz() {
 
 void SFZSink::endSfz() {
     trace_printf("[%s::%s] ()\n", kClassName, __func__);
+    buildRegionIndex();
+    choke_heads_.assign(choke_groups_.size(), -1);
+    // the path lookup and the headers are needed only while parsing
+    std::map<String, uint16_t>().swap(sample_ids_);
+    std::vector<SampleInfo>().swap(sample_infos_);
 }
 
 void SFZSink::startHeader(const String& header) {
@@ -621,7 +1103,7 @@ void SFZSink::startHeader(const String& header) {
     if (header_ != kRegion) {
         if (regions_in_group_ == 0) {
             if (region_.is_valid) {
-                regions_.push_back(buildRegion(group_));
+                addRegion(group_);
             }
         }
     }
@@ -655,71 +1137,34 @@ void SFZSink::endHeader(const String& /*header*/) {
         group_ = region_;
     } else if (header_ == kRegion) {
         if (region_.is_valid) {
-            regions_.push_back(buildRegion(region_));
+            addRegion(region_);
         }
     }
 
     header_ = kInvalidHeader;
 }
 
+void SFZSink::includeFile(const String& path) {
+    sources_.push_back(path);
+}
+
 void SFZSink::opcode(const String& opcode, const String& value) {
     trace_printf("[%s::%s] (\"%s\", \"%s\")\n", kClassName, __func__, opcode.c_str(), value.c_str());
-    // clang-format off
-    const  OpcodeSpec opcode_spec[] = {
-    //   opcode_str      opcode_enum         min              max              parser
-        {"sample",       kOpcodeSample,      0,               0,               nullptr      },
-        {"lochan",       kOpcodeLochan,      1,               16,              parseUint32  },
-        {"hichan",       kOpcodeHichan,      1,               16,              parseUint32  },
-        {"hikey",        kOpcodeHikey,       NOTE_NUMBER_MIN, NOTE_NUMBER_MAX, parseNotename},
-        {"lokey",        kOpcodeLokey,       NOTE_NUMBER_MIN, NOTE_NUMBER_MAX, parseNotename},
-        {"key",          kOpcodeHikey,       NOTE_NUMBER_MIN, NOTE_NUMBER_MAX, parseNotename},
-        {"key",          kOpcodeLokey,       NOTE_NUMBER_MIN, NOTE_NUMBER_MAX, parseNotename},
-        {"lovel",        kOpcodeLovel,       0,               127,             parseUint32  },
-        {"hivel",        kOpcodeHivel,       0,               127,             parseUint32  },
-        {"lorand",       kOpcodeLorand,      0x00000000,      0x00010000,      parseQ16     }, //< not supported
-        {"hirand",       kOpcodeHirand,      0x00000000,      0x00010000,      parseQ16     }, //< not supported
-        {"seq_length",   kOpcodeSeqLength,   1,               100,             parseUint32  }, //< not supported
-        {"seq_position", kOpcodeSeqPosition, 1,               100,             parseUint32  }, //< not supported
-        {"group",        kOpcodeGroup,       0,               UINT32_MAX,      parseUint32  }, //< not supported
-        {"off_by",       kOpcodeOffBy,       0,               UINT32_MAX,      parseUint32  }, //< not supported
-        {"offset",       kOpcodeOffset,      0,               UINT32_MAX,      parseUint32  },
-        {"end",          kOpcodeEnd,         0,               UINT32_MAX,      parseUint32  },
-        {"count",        kOpcodeCount,       0,               UINT32_MAX,      parseUint32  },
-        {"loop_mode",    kOpcodeLoopMode,    kNoLoop,         kLoopSustain,    parseLoopmode},
-        {"loop_start",   kOpcodeLoopStart,   0,               UINT32_MAX,      parseUint32  },
-        {"loop_end",     kOpcodeLoopEnd,     0,               UINT32_MAX,      parseUint32  },
-        {"loopmode",     kOpcodeLoopMode,    kNoLoop,         kLoopSustain,    parseLoopmode},
-        {"loopstart",    kOpcodeLoopStart,   0,               UINT32_MAX,      parseUint32  },
-        {"loopend",      kOpcodeLoopEnd,     0,               UINT32_MAX,      parseUint32  },
-        {"sw_last",      kOpcodeSwLast,      NOTE_NUMBER_MIN, NOTE_NUMBER_MAX, parseNotename},
-        {"sw_lokey",     kOpcodeSwLokey,     NOTE_NUMBER_MIN, NOTE_NUMBER_MAX, parseNotename},
-        {"sw_hikey",     kOpcodeSwHikey,     NOTE_NUMBER_MIN, NOTE_NUMBER_MAX, parseNotename},
-        {"default_path", kOpcodeDefaultPath, 0,               0,               nullptr      },
-        {"sw_default",   kOpcodeSwDefault,   NOTE_NUMBER_MIN, NOTE_NUMBER_MAX, parseNotename},
-        {"loprog",       kOpcodeLoProg,      0,               127,             parseUint32  },
-        {"hiprog",       kOpcodeHiProg,      0,               127,             parseUint32  },
-        {"locc0",        kOpcodeLoCC0,       0,               127,             parseUint32  },
-        {"hicc0",        kOpcodeHiCC0,       0,               127,             parseUint32  },
-        {"locc32",       kOpcodeLoCC32,      0,               127,             parseUint32  },
-        {"hicc32",       kOpcodeHiCC32,      0,               127,             parseUint32  }
-    };
-    // clang-format on
 
     // find opcode spec
-    for (size_t i = 0; i < sizeof(opcode_spec) / sizeof(opcode_spec[0]); i++) {
-        const OpcodeSpec* spec = &opcode_spec[i];
-        if (opcode != opcode_spec[i].opcode_str) {
-            continue;
-        }
+    size_t count = 0;
+    const OpcodeSpec* specs = findOpcodeSpecs(opcode.c_str(), &count);
+    for (size_t i = 0; i < count; i++) {
+        const OpcodeSpec* spec = &specs[i];
 
         if (spec->opcode_enum == kOpcodeSample) {
             String sfz_dir = getFolderPath(sfz_path_);
             String sample_prefix = joinPath(sfz_dir, default_path_);
             String sample_path = sample_prefix + value;
             sample_path.replace("\\", "/");
-            region_.sample = normalizePath(sample_path);
-            if (!Storage.exists(region_.sample)) {
-                error_printf("[%s::%s] no such file \"%s\"\n", kClassName, __func__, region_.sample.c_str());
+            region_.sample_id = internSample(normalizePath(sample_path));
+            if (region_.sample_id == kNoSample || !sample_infos_[region_.sample_id].exists) {
+                error_printf("[%s::%s] no such file \"%s\"\n", kClassName, __func__, getSamplePath(region_.sample_id).c_str());
                 region_.is_valid = false;
             }
         } else if (spec->opcode_enum == kOpcodeDefaultPath) {
@@ -737,7 +1182,10 @@ void SFZSink::opcode(const String& opcode, const String& value) {
                 region_.is_valid = false;
                 continue;
             }
-            if (int_value < spec->min || spec->max < int_value) {
+            bool in_range = (spec->parser == parseQ16)
+                                ? ((int32_t)spec->min <= (int32_t)int_value && (int32_t)int_value <= (int32_t)spec->max)
+                                : (spec->min <= int_value && int_value <= spec->max);
+            if (!in_range) {
                 error_printf("[%s::%s] out of range '%s=%s'\n", kClassName, __func__, opcode.c_str(), value.c_str());
                 region_.is_valid = false;
                 continue;
@@ -751,102 +1199,886 @@ void SFZSink::opcode(const String& opcode, const String& value) {
                 sw_last_ = int_value;
             }
         }
-        region_.specified |= (1U << spec->opcode_enum);
+        region_.specified |= (1ULL << spec->opcode_enum);
+    }
+}
+
+int SFZSink::findRegion(uint8_t note, uint8_t velocity, uint8_t channel) {
+    if (index_offsets_.empty() || note > NOTE_NUMBER_MAX || velocity > 127) {
+        return scanRegion(note, velocity, channel);
+    }
+    int found = -1;
+    size_t bucket = note * kIndexVelocityBands + (velocity >> kIndexVelocityShift);
+    for (uint32_t i = index_offsets_[bucket]; i < index_offsets_[bucket + 1]; i++) {
+        if (matchRegion(regions_[index_regions_[i]], note, velocity, channel)) {
+            found = index_regions_[i];
+            break;
+        }
+    }
+    // a region of the key bucket wins only if it comes first in the file
+    bucket = kIndexBandBuckets + note;
+    for (uint32_t i = index_offsets_[bucket]; i < index_offsets_[bucket + 1]; i++) {
+        uint16_t id = index_regions_[i];
+        if (found >= 0 && found < id) {
+            break;
+        }
+        if (matchRegion(regions_[id], note, velocity, channel)) {
+            found = id;
+            break;
+        }
     }
+    return found;
 }
 
-SFZSink::PlaybackUnit* SFZSink::startPlayback(uint8_t note, uint8_t /*velocity*/, uint8_t channel, Region* region) {
+int SFZSink::scanRegion(uint8_t note, uint8_t velocity, uint8_t channel) {
+    for (size_t i = 0; i < regions_.size(); i++) {
+        if (matchRegion(regions_[i], note, velocity, channel)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void SFZSink::addRegion(const OpcodeContainer& container) {
+    const SampleInfo& info = (container.sample_id < sample_infos_.size()) ? sample_infos_[container.sample_id] : SampleInfo();
+    regions_.push_back(buildRegion(container, info));
+    regions_.back().choke_id = internChokeRule(container.opcode[kOpcodeGroup], container.opcode[kOpcodeOffBy]);
+}
+
+uint16_t SFZSink::internSample(const String& path) {
+    // regions often share a sample (key switches, velocity layers), so every file is checked and parsed once per load
+    auto it = sample_ids_.find(path);
+    if (it != sample_ids_.end()) {
+        return it->second;
+    }
+    if (samples_.size() >= kNoSample) {
+        error_printf("[%s::%s] error: too many samples\n", kClassName, __func__);
+        return kNoSample;
+    }
+    uint16_t sample_id = (uint16_t)samples_.size();
+    samples_.push_back(path);
+    sample_ids_[path] = sample_id;
+    sample_infos_.push_back(loadSampleInfo(path));
+    sample_formats_.push_back(sample_infos_.back().format);
+    return sample_id;
+}
+
+uint8_t SFZSink::internChokeRule(uint32_t group, uint32_t off_by) {
+    // group=0 and off_by=0 are the defaults of every region and take no part in chokes
+    if (group == 0 && off_by == 0) {
+        return 0;
+    }
+    ChokeRule rule;
+    rule.group = (group != 0) ? internChokeGroup(group) : kNoChokeGroup;
+    rule.off_by = (off_by != 0) ? internChokeGroup(off_by) : kNoChokeGroup;
+    for (size_t i = 0; i < choke_rules_.size(); i++) {
+        if (choke_rules_[i].group == rule.group && choke_rules_[i].off_by == rule.off_by) {
+            return (uint8_t)(i + 1);
+        }
+    }
+    if (choke_rules_.size() >= kMaxChokeRules) {
+        error_printf("[%s::%s] error: too many group/off_by pairs\n", kClassName, __func__);
+        return 0;
+    }
+    choke_rules_.push_back(rule);
+    return (uint8_t)choke_rules_.size();
+}
+
+uint16_t SFZSink::internChokeGroup(uint32_t group) {
+    for (size_t i = 0; i < choke_groups_.size(); i++) {
+        if (choke_groups_[i] == group) {
+            return (uint16_t)i;
+        }
+    }
+    choke_groups_.push_back(group);
+    return (uint16_t)(choke_groups_.size() - 1);
+}
+
+SFZSink::SampleInfo SFZSink::loadSampleInfo(const String& path) {
+    SampleInfo info;
+    info.exists = Storage.exists(path);
+    info.is_file = false;
+    info.is_wave = false;
+    info.pcm_offset = 0;
+    info.pcm_size = 0;
+    memset(&info.format, 0, sizeof(info.format));
+    File file = File(path.c_str());
+    if (!file) {
+        error_printf("[%s::%s] cannot open \"%s\"\n", kClassName, __func__, path.c_str());
+    }
+    if (file.isDirectory()) {
+        error_printf("[%s::%s] \"%s\" is directory\n", kClassName, __func__, path.c_str());
+    } else {
+        WavReader wav = WavReader(file);
+        info.is_file = (bool)file;
+        info.is_wave = wav.isWaveFile();
+        info.pcm_offset = wav.getPcmOffset();
+        info.pcm_size = wav.getPcmSize();
+        info.format = wav.getSampleFormat();
+        if (!info.format.isPassThrough()) {
+            // regions address the decoded or converted PCM, see SampleFormat
+            info.pcm_offset = 0;
+            info.pcm_size = wav.getFrameCount() * kPbSampleSize;
+        }
+    }
+    file.close();
+    return info;
+}
+
+const SampleFormat* SFZSink::getSampleFormat(uint16_t sample_id) {
+    if (sample_id >= sample_formats_.size()) {
+        return nullptr;
+    }
+    // nullptr for 48kHz, 16bit, 2ch PCM and for a sample that could not be opened
+    const SampleFormat& format = sample_formats_[sample_id];
+    if (format.channels == 0 || (format.isPassThrough() && format.sample_rate == (uint32_t)kPbSampleFrq)) {
+        return nullptr;
+    }
+    return &format;
+}
+
+bool SFZSink::loadInstrumentCache(const String& cache_path) {
+    File file = File(cache_path.c_str());
+    if (!file) {
+        return false;
+    }
+    // one sequential read of the whole image
+    std::vector<uint8_t> image(file.size());
+    int ret = (image.size() > 0) ? file.read(image.data(), image.size()) : 0;
+    file.close();
+    if (ret != (int)image.size()) {
+        return false;
+    }
+
+    CacheReader reader(image.data(), image.size());
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint32_t region_size = 0;
+    reader(&magic);
+    reader(&version);
+    reader(&region_size);
+    Region dummy;
+    FieldSize field_size;
+    visitRegionFields(&dummy, field_size);
+    if (!reader.ok() || magic != kInstrumentCacheMagic || version != kInstrumentCacheVersion || region_size != field_size.size) {
+        debug_printf("[%s::%s] unknown cache format\n", kClassName, __func__);
+        return false;
+    }
+
+    // stale if any source has changed
+    uint32_t source_count = 0;
+    reader(&source_count);
+    std::vector<String> sources;
+    for (uint32_t i = 0; i < source_count && reader.ok(); i++) {
+        String path;
+        uint32_t size = 0;
+        uint32_t hash = 0;
+        reader.getString(&path);
+        reader(&size);
+        reader(&hash);
+        uint32_t actual_size = 0;
+        uint32_t actual_hash = 0;
+        if (!reader.ok() || (i == 0 && path != sfz_path_) || !hashFile(path, &actual_size, &actual_hash) || size != actual_size ||
+            hash != actual_hash) {
+            debug_printf("[%s::%s] stale cache \"%s\"\n", kClassName, __func__, path.c_str());
+            return false;
+        }
+        sources.push_back(path);
+    }
+
+    uint8_t sw_lokey = 0;
+    uint8_t sw_hikey = 0;
+    uint8_t sw_last = 0;
+    reader(&sw_lokey);
+    reader(&sw_hikey);
+    reader(&sw_last);
+    uint32_t sample_count = 0;
+    reader(&sample_count);
+    std::vector<String> samples;
+    for (uint32_t i = 0; i < sample_count && reader.ok(); i++) {
+        String sample;
+        uint32_t size = 0;
+        uint32_t hash = 0;
+        reader.getString(&sample);
+        reader(&size);
+        reader(&hash);
+        // a replaced sample has another header, so its cached offset, size and format no longer apply
+        uint32_t actual_size = 0;
+        uint32_t actual_hash = 0;
+        hashFile(sample, &actual_size, &actual_hash, kSampleHeaderHashSize);
+        if (reader.ok() && (size != actual_size || hash != actual_hash)) {
+            debug_printf("[%s::%s] stale cache \"%s\"\n", kClassName, __func__, sample.c_str());
+            return false;
+        }
+        samples.push_back(sample);
+    }
+    std::vector<SampleFormat> sample_formats;
+    for (uint32_t i = 0; i < sample_count && reader.ok(); i++) {
+        SampleFormat format;
+        reader(&format.codec);
+        reader(&format.channels);
+        reader(&format.block_align);
+        reader(&format.frames_per_block);
+        reader(&format.data_offset);
+        reader(&format.data_size);
+        reader(&format.sample_rate);
+        if (format.codec > SampleFormat::kCodecMax) {
+            return false;
+        }
+        sample_formats.push_back(format);
+    }
+    uint32_t choke_group_count = 0;
+    reader(&choke_group_count);
+    std::vector<uint32_t> choke_groups;
+    for (uint32_t i = 0; i < choke_group_count && reader.ok(); i++) {
+        uint32_t group = 0;
+        reader(&group);
+        choke_groups.push_back(group);
+    }
+    uint32_t choke_rule_count = 0;
+    reader(&choke_rule_count);
+    std::vector<ChokeRule> choke_rules;
+    for (uint32_t i = 0; i < choke_rule_count && reader.ok(); i++) {
+        ChokeRule rule;
+        reader(&rule.group);
+        reader(&rule.off_by);
+        if ((rule.group != kNoChokeGroup && rule.group >= choke_groups.size()) || (rule.off_by != kNoChokeGroup && rule.off_by >= choke_groups.size())) {
+            return false;
+        }
+        choke_rules.push_back(rule);
+    }
+    uint32_t region_count = 0;
+    reader(&region_count);
+    std::vector<Region> regions;
+    for (uint32_t i = 0; i < region_count && reader.ok(); i++) {
+        Region region;
+        visitRegionFields(&region, reader);
+        if ((region.sample_id != kNoSample && region.sample_id >= samples.size()) || region.choke_id > choke_rules.size()) {
+            return false;
+        }
+        region.head_id = -1;
+        regions.push_back(region);
+    }
+    if (!reader.ok()) {
+        error_printf("[%s::%s] error: broken cache \"%s\"\n", kClassName, __func__, cache_path.c_str());
+        return false;
+    }
+
+    startSfz();
+    regions_.swap(regions);
+    samples_.swap(samples);
+    sample_formats_.swap(sample_formats);
+    choke_groups_.swap(choke_groups);
+    choke_rules_.swap(choke_rules);
+    sources_.swap(sources);
+    sw_lokey_ = sw_lokey;
+    sw_hikey_ = sw_hikey;
+    sw_last_ = sw_last;
+    endSfz();
+    debug_printf("[%s::%s] %d regions from \"%s\"\n", kClassName, __func__, (int)regions_.size(), cache_path.c_str());
+    return true;
+}
+
+bool SFZSink::saveInstrumentCache(const String& cache_path) {
+    CacheWriter writer;
+    Region dummy;
+    FieldSize field_size;
+    visitRegionFields(&dummy, field_size);
+    writer(&kInstrumentCacheMagic);
+    writer(&kInstrumentCacheVersion);
+    writer(&field_size.size);
+
+    uint32_t source_count = sources_.size();
+    writer(&source_count);
+    for (const auto& e : sources_) {
+        uint32_t size = 0;
+        uint32_t hash = 0;
+        if (!hashFile(e, &size, &hash)) {
+            return false;
+        }
+        writer.putString(e);
+        writer(&size);
+        writer(&hash);
+    }
+
+    writer(&sw_lokey_);
+    writer(&sw_hikey_);
+    writer(&sw_last_);
+    uint32_t sample_count = samples_.size();
+    writer(&sample_count);
+    for (const auto& e : samples_) {
+        // 0 for a missing sample, so that the cache goes stale when it appears
+        uint32_t size = 0;
+        uint32_t hash = 0;
+        hashFile(e, &size, &hash, kSampleHeaderHashSize);
+        writer.putString(e);
+        writer(&size);
+        writer(&hash);
+    }
+    for (const auto& e : sample_formats_) {
+        writer(&e.codec);
+        writer(&e.channels);
+        writer(&e.block_align);
+        writer(&e.frames_per_block);
+        writer(&e.data_offset);
+        writer(&e.data_size);
+        writer(&e.sample_rate);
+    }
+    uint32_t choke_group_count = choke_groups_.size();
+    writer(&choke_group_count);
+    for (const auto& e : choke_groups_) {
+        writer(&e);
+    }
+    uint32_t choke_rule_count = choke_rules_.size();
+    writer(&choke_rule_count);
+    for (const auto& e : choke_rules_) {
+        writer(&e.group);
+        writer(&e.off_by);
+    }
+    uint32_t region_count = regions_.size();
+    writer(&region_count);
+    for (auto& e : regions_) {
+        visitRegionFields(&e, writer);
+    }
+
+    if (Storage.exists(cache_path)) {
+        Storage.remove(cache_path);
+    }
+    File file = File(cache_path.c_str(), FILE_WRITE);
+    if (!file) {
+        error_printf("[%s::%s] error: cannot create \"%s\"\n", kClassName, __func__, cache_path.c_str());
+        return false;
+    }
+    size_t ret = file.write(writer.data.data(), writer.data.size());
+    file.close();
+    if (ret != writer.data.size()) {
+        error_printf("[%s::%s] error: cannot write \"%s\"\n", kClassName, __func__, cache_path.c_str());
+        Storage.remove(cache_path);
+        return false;
+    }
+    debug_printf("[%s::%s] %d regions to \"%s\" (%d bytes)\n", kClassName, __func__, (int)regions_.size(), cache_path.c_str(),
+                 (int)writer.data.size());
+    return true;
+}
+
+void SFZSink::buildRegionIndex() {
+    index_offsets_.clear();
+    index_regions_.clear();
+    if (regions_.size() > UINT16_MAX) {
+        debug_printf("[%s::%s] too many regions to index: %d\n", kClassName, __func__, (int)regions_.size());
+        return;
+    }
+
+    // count the candidates of each bucket, then fill them in file order
+    index_offsets_.assign(kIndexBuckets + 1, 0);
+    std::vector<uint32_t> next;
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            for (int b = 0; b < kIndexBuckets; b++) {
+                index_offsets_[b + 1] += index_offsets_[b];
+            }
+            index_regions_.resize(index_offsets_[kIndexBuckets]);
+            next.assign(index_offsets_.begin(), index_offsets_.end() - 1);
+        }
+        for (size_t i = 0; i < regions_.size(); i++) {
+            const Region& r = regions_[i];
+            if (r.lokey > r.hikey || r.lovel > r.hivel) {
+                continue;
+            }
+            int lo_band = r.lovel >> kIndexVelocityShift;
+            int hi_band = r.hivel >> kIndexVelocityShift;
+            // a wide velocity range is one entry per key, checked against the velocity at note-on
+            bool by_key = hi_band - lo_band + 1 > kIndexMaxBandsPerRegion;
+            if (by_key) {
+                hi_band = lo_band;
+            }
+            for (int key = r.lokey; key <= r.hikey; key++) {
+                for (int band = lo_band; band <= hi_band; band++) {
+                    size_t bucket = by_key ? kIndexBandBuckets + key : key * kIndexVelocityBands + band;
+                    if (pass == 0) {
+                        index_offsets_[bucket + 1]++;
+                    } else {
+                        index_regions_[next[bucket]++] = i;
+                    }
+                }
+            }
+        }
+    }
+    debug_printf("[%s::%s] indexed %d entries, %d by key\n", kClassName, __func__, (int)index_regions_.size(),
+                 (int)(index_regions_.size() - index_offsets_[kIndexBandBuckets]));
+}
+
+bool SFZSink::matchRegion(const Region& region, uint8_t note, uint8_t velocity, uint8_t channel) {
+    if (region.sw_last != INVALID_NOTE_NUMBER && region.sw_last != sw_last_) {
+        return false;
+    }
+    if (channel < region.lochan || region.hichan < channel) {
+        return false;
+    }
+    if (note < region.lokey || region.hikey < note) {
+        return false;
+    }
+    if (velocity < region.lovel || region.hivel < velocity) {
+        return false;
+    }
+    if (bank_.msb < region.locc0 || region.hicc0 < bank_.msb) {
+        return false;
+    }
+    if (bank_.lsb < region.locc32 || region.hicc32 < bank_.lsb) {
+        return false;
+    }
+    if (prog_num_ < region.loprog || region.hiprog < prog_num_) {
+        return false;
+    }
+    return true;
+}
+
+SFZSink::PlaybackUnit* SFZSink::startPlayback(uint8_t note, uint8_t velocity, uint8_t channel, Region* region) {
     trace_printf("[%s::%s] (%d,%d,%d,%p))\n", kClassName, __func__, note, velocity, channel, region);
     PlaybackUnit* unit = nullptr;
     if (region == nullptr) {
         error_printf("[%s::%s] error: region is null\n", kClassName, __func__);
         return unit;
     }
-    for (auto& e : playback_units_) {
-        if (e.render_ch == kDeallocatedChannel) {
-            unit = &e;
-            break;
+    // off_by: silence the voices that this group turns off before counting the voices to steal
+    if (region->choke_id > 0 && choke_rules_[region->choke_id - 1].group != kNoChokeGroup) {
+        chokeGroup(choke_rules_[region->choke_id - 1].group);
+    }
+    if (stealer_.getActiveCount() >= polyphony_) {
+        // fade the victim out in the next frame and play the new note on a reserve channel meanwhile;
+        // without a free reserve channel the new note could not start anyway, so keep the victim
+        int victim = (renderer_.getActiveChannelCount() < renderer_.getChannelCount()) ? stealer_.steal(note, channel) : -1;
+        if (victim >= 0) {
+            debug_printf("[%s::%s] steal voice %d (note=%d)\n", kClassName, __func__, victim, playback_units_[victim].note);
+            stopPlayback(&playback_units_[victim]);
+        } else {
+            debug_printf("[%s::%s] drop note=%d\n", kClassName, __func__, note);
+            stealer_.drop();
+            return unit;
         }
     }
+    unit = allocateVoice();
     if (unit == nullptr) {
-        playback_units_.push_back(PlaybackUnit());
-        PlaybackUnit& e = playback_units_.back();
-        unit = &e;
-        unit->render_ch = kDeallocatedChannel;
-    }
-    unit->file = File(region->sample.c_str());
-    if (unit->file) {
-        unit->file.seek(region->offset);
+        error_printf("[%s::%s] error: no free voice\n", kClassName, __func__);
+        stealer_.drop();
+        return unit;
+    }
+    unit->region = region;
+    unit->streaming = false;
+    unit->draining = false;
+    unit->head_size = getHeadSize(region);
+    unit->head_pos = 0;
+    unit->position = region->offset + unit->head_size;
+    // the sample plays at its own pitch unless the region names the key it was recorded at
+    int32_t cents = region->tune;
+    if (region->pitch_keycenter != kNoPitchKeycenter) {
+        cents += ((int32_t)note - region->pitch_keycenter) * 100;
+    }
+    unit->step = Resampler::convertCentsToStep(cents);
+    // a sample recorded at another rate plays at the same pitch through the same resampler
+    const SampleFormat* format = getSampleFormat(region->sample_id);
+    if (format != nullptr && format->sample_rate != 0 && format->sample_rate != (uint32_t)kPbSampleFrq) {
+        uint32_t step = (uint32_t)((uint64_t)unit->step * format->sample_rate / kPbSampleFrq);
+        unit->step = (step < Resampler::kMinStep) ? Resampler::kMinStep : ((step > Resampler::kMaxStep) ? Resampler::kMaxStep : step);
+    }
+    if (unit->step != Resampler::kUnityStep) {
+        unit->resampler.reset(unit->step, interpolation_);
+    }
+    // a cached head starts at once; its stream is opened by the next update()
+    if (region->head_id >= 0 || openStream(unit)) {
         unit->note = note;
         unit->channel = channel;
-        int render_channel = renderer_.allocateChannel();
+        unit->velocity = velocity;
+        int render_channel = renderer_.allocateChannel(region->ampeg_attack, region->ampeg_release);
         unit->render_ch = (render_channel < 0) ? kUnallocatedChannel : render_channel;
-        unit->region = region;
         unit->loop = 0;
 
         if (unit->render_ch == kUnallocatedChannel) {
             error_printf("[%s::%s] cannot allocate channel\n", kClassName, __func__);
+            stealer_.drop();
+            unit->render_ch = kDeallocatedChannel;
+            closeStream(unit);
+            freeVoice(unit);
+            unit = nullptr;
         } else {
-            continuePlayback(unit, kPreloadFrames);
+            stealer_.start(getVoiceIndex(unit), note, channel, 0);
+            linkChoke(unit);
+            updateGain(unit);
+            continuePlayback(unit, latency_.getPreloadFrames());
         }
     } else {
-        error_printf("[%s::%s] error: file open error \"%s\"\n", kClassName, __func__, region->sample.c_str());
+        error_printf("[%s::%s] error: file open error \"%s\"\n", kClassName, __func__, getSamplePath(region->sample_id).c_str());
+        freeVoice(unit);
+        unit = nullptr;
     }
     return unit;
 }
 
+bool SFZSink::openStream(PlaybackUnit* unit) {
+    const Region* region = unit->region;
+    unit->file = files_.acquire(getSamplePath(region->sample_id));
+    if (unit->file == nullptr) {
+        return false;
+    }
+    unit->position = region->offset + unit->head_size;
+    // voices of the same sample share what the streamer has read, as in a drum roll
+    if (!streamer_.open(getVoiceIndex(unit), unit->file, unit->position, region->loop_start, region->loop_end, region->loop_mode != kNoLoop,
+                       getSampleFormat(region->sample_id), region->sample_id)) {
+        files_.release(unit->file);
+        unit->file = nullptr;
+        return false;
+    }
+    unit->streaming = true;
+    return true;
+}
+
+void SFZSink::closeStream(PlaybackUnit* unit) {
+    if (unit->streaming) {
+        streamer_.close(getVoiceIndex(unit));
+    }
+    files_.release(unit->file);
+    unit->file = nullptr;
+    unit->streaming = false;
+}
+
+bool SFZSink::isHeadOnly(const Region& region, uint32_t head_size) {
+    // the cached head holds all that a voice plays, and a loop would go back to the file
+    if (region.loop_mode != kNoLoop && !(region.loop_mode == kOneShot && region.count <= 1)) {
+        return false;
+    }
+    return region.loop_end > region.offset && head_size >= region.loop_end - region.offset;
+}
+
+uint32_t SFZSink::getHeadBytes(const Region& region) {
+    // whole blocks, and never across the loop end
+    uint32_t head_bytes = (head_ms_ * kPbBytePerMs + kPbBlockSize - 1) / kPbBlockSize * kPbBlockSize;
+    if (region.loop_end <= region.offset) {
+        return 0;
+    }
+    return (region.loop_end - region.offset < head_bytes) ? region.loop_end - region.offset : head_bytes;
+}
+
+void SFZSink::loadSampleHeads() {
+    head_cache_.clear();
+    if (head_cache_.getBudget() == 0) {
+        return;
+    }
+    for (auto& e : regions_) {
+        if (e.silence || e.loop_end <= e.offset) {
+            continue;
+        }
+        int head_id = head_cache_.load(getSamplePath(e.sample_id), e.offset, getHeadBytes(e), getSampleFormat(e.sample_id));
+        e.head_id = (head_id <= INT16_MAX) ? head_id : -1;
+    }
+    debug_printf("[%s::%s] %d heads, %d/%d bytes\n", kClassName, __func__, head_cache_.getEntryCount(), (int)head_cache_.getUsedSize(),
+                 (int)head_cache_.getBudget());
+}
+
 void SFZSink::continuePlayback(PlaybackUnit* unit, int frames) {
     if (unit == nullptr) {
         return;
     }
-    if (unit->render_ch < 0) {
+    if (unit->render_ch < 0 || unit->draining) {
         return;
     }
+    int render_ch = unit->render_ch;
     for (int i = 0; i < frames; i++) {
+        // output PCM: read or resample the sample straight into the ring buffer
+        uint8_t* ptr1 = nullptr;
+        uint8_t* ptr2 = nullptr;
+        size_t len1 = 0;
+        size_t len2 = 0;
+        if (renderer_.acquireWriteRegion(render_ch, &ptr1, &len1, &ptr2, &len2) < kPbBlockSize) {
+            break;
+        }
+        trace_printf("[%s::%s] %d %d,%d\n", kClassName, __func__, render_ch, (int)renderer_.getReadableSize(render_ch),
+                     (int)renderer_.getWritableSize(render_ch));
+        size_t size1 = (kPbBlockSize < len1) ? kPbBlockSize : len1;
+        size_t size = 0;
+        if (unit->step == Resampler::kUnityStep) {
+            size = readSample(unit, ptr1, size1);
+            if (size == size1 && size1 < kPbBlockSize) {
+                size += readSample(unit, ptr2, kPbBlockSize - size1);
+            }
+        } else {
+            size = resampleSample(unit, (int16_t*)ptr1, size1 / kPbSampleSize) * kPbSampleSize;
+            if (size == size1 && size1 < kPbBlockSize) {
+                size += resampleSample(unit, (int16_t*)ptr2, (kPbBlockSize - size1) / kPbSampleSize) * kPbSampleSize;
+            }
+        }
+        if (unit->render_ch != render_ch) {
+            // stopped by an error
+            break;
+        }
+        renderer_.commitWrite(render_ch, size);
+        if (size < kPbBlockSize) {
+            // the end of the sample, or not streamed yet; retry in the next update()
+            break;
+        }
+    }
+}
+
+size_t SFZSink::readSample(PlaybackUnit* unit, uint8_t* dst, size_t size) {
+    size_t done = 0;
+    while (done < size && unit->render_ch >= 0 && !unit->draining) {
+        const Region* region = unit->region;
+        bool from_head = unit->head_pos < unit->head_size;
+        if (!from_head && !unit->streaming && !isHeadOnly(*region, unit->head_size) && !openStream(unit)) {
+            error_printf("[%s::%s] error: file open error \"%s\"\n", kClassName, __func__, getSamplePath(region->sample_id).c_str());
+            stopPlayback(unit);
+            break;
+        }
+        uint32_t position = from_head ? region->offset + unit->head_pos : unit->position;
+
         // end of pcm
-        if (unit->region->loop_mode == kNoLoop) {
-            if (unit->file.position() >= unit->region->end) {
+        if (region->loop_mode == kNoLoop) {
+            if (position >= region->end) {
                 debug_printf("[%s::%s] no_loop end\n", kClassName, __func__);
-                stopPlayback(unit);
+                finishPlayback(unit);
                 break;
             }
         } else {
-            if (unit->file.position() >= unit->region->loop_end) {
+            if (position >= region->loop_end) {
+                // the streamer wraps at the same position
                 unit->loop++;
-                unit->file.seek(unit->region->loop_start);
+                unit->position = region->loop_start;
+                position = region->loop_start;
             }
         }
 
         // one_shot
-        if (unit->region->loop_mode == kOneShot) {
-            if (unit->loop >= unit->region->count) {
+        if (region->loop_mode == kOneShot) {
+            if (unit->loop >= region->count) {
                 debug_printf("[%s::%s] one_shot end\n", kClassName, __func__);
-                stopPlayback(unit);
+                finishPlayback(unit);
                 break;
             }
         }
 
-        // output PCM
-        if (renderer_.getWritableSize(unit->render_ch) < kPbBlockSize) {
+        size_t read_size = (position < region->loop_end) ? region->loop_end - position : 0;
+        read_size = (read_size < size - done) ? read_size : size - done;
+        if (read_size == 0) {
+            // no_loop ends at loop_end when it comes before end
+            finishPlayback(unit);
+            break;
+        }
+        if (from_head) {
+            // copy from RAM; the head never crosses the loop end
+            size_t head_rest = unit->head_size - unit->head_pos;
+            read_size = (read_size < head_rest) ? read_size : head_rest;
+            memcpy(&dst[done], head_cache_.getData(region->head_id) + unit->head_pos, read_size);
+            unit->head_pos += read_size;
+            done += read_size;
+            continue;
+        }
+        size_t ret = streamer_.read(getVoiceIndex(unit), &dst[done], read_size);
+        unit->position += ret;
+        done += ret;
+        if (ret < read_size) {
+            // not streamed yet
             break;
         }
-        trace_printf("[%s::%s] %d %d,%d\n", kClassName, __func__, unit->render_ch, (int)renderer_.getReadableSize(unit->render_ch),
-                     (int)renderer_.getWritableSize(unit->render_ch));
-        size_t read_size = unit->region->loop_end - unit->file.position();
-        read_size = (read_size < kPbBlockSize) ? read_size : kPbBlockSize;
-        uint8_t buffer[read_size];
-        unit->file.read(buffer, read_size);
-        renderer_.write(unit->render_ch, buffer, read_size);
     }
+    return done;
 }
 
-void SFZSink::stopPlayback(PlaybackUnit* unit) {
-    if (unit == nullptr) {
+size_t SFZSink::resampleSample(PlaybackUnit* unit, int16_t* dst, size_t frames) {
+    // the resampler holds only the sample frames that the current block needs
+    Resampler& resampler = unit->resampler;
+    size_t done = 0;
+    while (done < frames) {
+        done += resampler.read(&dst[done * kPbChannelCount], frames - done);
+        if (done == frames || unit->render_ch < 0 || unit->draining) {
+            break;
+        }
+        size_t writable = 0;
+        int16_t* src = resampler.getWritePointer(&writable);
+        size_t required = resampler.getRequiredFrames(frames - done);
+        required = (required < writable) ? required : writable;
+        if (required == 0) {
+            break;
+        }
+        size_t ret = readSample(unit, (uint8_t*)src, required * kPbSampleSize) / kPbSampleSize;
+        resampler.commitWrite(ret);
+        if (ret < required) {
+            if (unit->draining) {
+                // play the last frames through the end of the filter
+                resampler.flush();
+                done += resampler.read(&dst[done * kPbChannelCount], frames - done);
+            }
+            break;
+        }
+    }
+    return done;
+}
+
+int SFZSink::getBufferFill() {
+    size_t fill = 0;
+    bool found = false;
+    for (int i = active_voices_; i >= 0; i = playback_units_[i].next) {
+        const PlaybackUnit& e = playback_units_[i];
+        if (e.render_ch < 0) {
+            continue;
+        }
+        size_t size = renderer_.getReadableSize(e.render_ch);
+        fill = (!found || size < fill) ? size : fill;
+        found = true;
+    }
+    return (int)(fill / kPbBytePerMs);
+}
+
+void SFZSink::stopPlayback(PlaybackUnit* unit, int release_ms) {
+    if (unit == nullptr || unit->render_ch == kDeallocatedChannel) {
         return;
     }
-    renderer_.deallocateChannel(unit->render_ch);
+    renderer_.deallocateChannel(unit->render_ch, release_ms);
     unit->render_ch = kDeallocatedChannel;
-    unit->file.close();
+    unit->draining = false;
+    closeStream(unit);
+    unlinkChoke(unit);
+    stealer_.stop(getVoiceIndex(unit));
+    freeVoice(unit);
+}
+
+void SFZSink::finishPlayback(PlaybackUnit* unit) {
+    // the written data is still to be played: keep the channel, and the voice in its choke list, until update() sees it drained
+    closeStream(unit);
+    unit->draining = true;
+}
+
+void SFZSink::linkChoke(PlaybackUnit* unit) {
+    if (unit->region->choke_id == 0) {
+        return;
+    }
+    uint16_t off_by = choke_rules_[unit->region->choke_id - 1].off_by;
+    if (off_by == kNoChokeGroup) {
+        return;
+    }
+    // push front
+    int index = getVoiceIndex(unit);
+    unit->choke_list = off_by;
+    unit->choke_prev = -1;
+    unit->choke_next = choke_heads_[off_by];
+    if (unit->choke_next >= 0) {
+        playback_units_[unit->choke_next].choke_prev = index;
+    }
+    choke_heads_[off_by] = index;
+}
+
+void SFZSink::unlinkChoke(PlaybackUnit* unit) {
+    if (unit->choke_list < 0) {
+        return;
+    }
+    if (unit->choke_prev >= 0) {
+        playback_units_[unit->choke_prev].choke_next = unit->choke_next;
+    } else {
+        choke_heads_[unit->choke_list] = unit->choke_next;
+    }
+    if (unit->choke_next >= 0) {
+        playback_units_[unit->choke_next].choke_prev = unit->choke_prev;
+    }
+    unit->choke_list = -1;
+}
+
+void SFZSink::chokeGroup(int choke_group) {
+    // only the voices in the list are visited; stopPlayback() unlinks each of them
+    int index = choke_heads_[choke_group];
+    while (index >= 0) {
+        PlaybackUnit* unit = &playback_units_[index];
+        index = unit->choke_next;
+        debug_printf("[%s::%s] choke voice %d (note=%d)\n", kClassName, __func__, getVoiceIndex(unit), unit->note);
+        stopPlayback(unit, kChokeReleaseMs);
+        choked_count_++;
+    }
+}
+
+void SFZSink::updateGain(PlaybackUnit* unit) {
+    if (unit == nullptr || unit->render_ch < 0) {
+        return;
+    }
+    const Region* region = unit->region;
+    const ChannelControl& control = controls_[(unit->channel - 1) & 0x0F];
+
+    // amp_veltrack: 100% follows the velocity curve, 0% ignores velocity, -100% inverts it
+    int32_t curve = convertMidiToGain(unit->velocity);
+    int32_t veltrack = region->amp_veltrack;
+    int32_t velocity_gain = (veltrack >= 0) ? kGainUnity - veltrack * (kGainUnity - curve) / 100 : kGainUnity + veltrack * curve / 100;
+
+    int32_t gain = region->gain;
+    gain = (gain * velocity_gain) >> 14;
+    gain = (gain * convertMidiToGain(control.volume)) >> 14;
+
+    // constant-power pan law normalized so that center stays at unity
+    int32_t pan = region->pan + ((int32_t)control.pan - kDefaultCCPan) * 100 / 63;
+    pan = constrain(pan, -100, 100);
+    float theta = (float)(pan + 100) / 200.0f * (float)M_PI_2;
+    int32_t left = (int32_t)lroundf(gain * (float)M_SQRT2 * cosf(theta));
+    int32_t right = (int32_t)lroundf(gain * (float)M_SQRT2 * sinf(theta));
+    left = constrain(left, 0, kGainMax);
+    right = constrain(right, 0, kGainMax);
+    renderer_.setChannelGain(unit->render_ch, (int16_t)left, (int16_t)right);
+    stealer_.setLevel(getVoiceIndex(unit), left + right);
+}
+
+void SFZSink::initVoices() {
+    // every voice is allocated here, so that note-on and note-off allocate nothing themselves and a PlaybackUnit never moves;
+    // only opening a file on a FilePool miss lets the file system allocate
+    int voices = renderer_.getChannelCount();
+    playback_units_.assign(voices, PlaybackUnit());
+    for (int i = 0; i < voices; i++) {
+        PlaybackUnit& e = playback_units_[i];
+        e.render_ch = kDeallocatedChannel;
+        e.file = nullptr;
+        e.streaming = false;
+        e.draining = false;
+        e.choke_list = -1;
+        e.prev = -1;
+        e.next = (i + 1 < voices) ? i + 1 : -1;
+    }
+    active_voices_ = -1;
+    active_tail_ = -1;
+    free_voices_ = (voices > 0) ? 0 : -1;
+    stealer_.reserve(voices);
+}
+
+SFZSink::PlaybackUnit* SFZSink::allocateVoice() {
+    if (free_voices_ < 0) {
+        return nullptr;
+    }
+    int index = free_voices_;
+    PlaybackUnit* unit = &playback_units_[index];
+    free_voices_ = unit->next;
+    // push back of the active list, so that the list walks from the oldest voice as note-off expects
+    unit->prev = active_tail_;
+    unit->next = -1;
+    if (active_tail_ >= 0) {
+        playback_units_[active_tail_].next = index;
+    } else {
+        active_voices_ = index;
+    }
+    active_tail_ = index;
+    return unit;
+}
+
+void SFZSink::freeVoice(PlaybackUnit* unit) {
+    int index = getVoiceIndex(unit);
+    if (unit->prev >= 0) {
+        playback_units_[unit->prev].next = unit->next;
+    } else {
+        active_voices_ = unit->next;
+    }
+    if (unit->next >= 0) {
+        playback_units_[unit->next].prev = unit->prev;
+    } else {
+        active_tail_ = unit->prev;
+    }
+    unit->prev = -1;
+    unit->next = free_voices_;
+    free_voices_ = index;
+}
+
+int SFZSink::getVoiceIndex(const PlaybackUnit* unit) {
+    return (int)(unit - playback_units_.data());
 }
 
 #endif  // ARDUINO_ARCH_SPRESENSE
@@ -10,6 +10,7 @@
 #ifndef SFZ_SINK_H_
 #define SFZ_SINK_H_
 
+#include <map>
 #include <vector>
 
 #include <Arduino.h>
@@ -17,7 +18,15 @@
 #include <File.h>
 
 #include "SFZParser.h"
+#include "FilePool.h"
+#include "LatencyController.h"
 #include "PcmRenderer.h"
+#include "PcmWriter.h"
+#include "Resampler.h"
+#include "SampleFormat.h"
+#include "SampleHeadCache.h"
+#include "SampleStreamer.h"
+#include "VoiceStealer.h"
 #include "YuruInstrumentFilter.h"
 
 /**
@@ -31,6 +40,38 @@ public:
         PARAMID_SW_HIKEY
     };
 
+    /**
+     * @brief @~japanese 同時発音数の初期値です。
+     */
+    static const int kDefaultPolyphony = 4;
+
+    /**
+     * @brief @~japanese ボイスを盗む時に新しいノートに割り当てる予備の音声出力チャンネル数の初期値と上限です。
+     * @details @~japanese 予備のチャンネルも同時発音数のチャンネルと同じく 24 KiB のキャッシュを確保するので、
+     * 初期値では 48 KiB のRAMを追加で使います。RAMが足りない場合は SFZSink の生成時に減らしてください。
+     */
+    static const int kStealReserve = 2;
+
+    /**
+     * @brief @~japanese 同時発音数の上限です。
+     */
+    static const int kMaxPolyphony = PcmRenderer::kMaxChannel - kStealReserve;
+
+    /**
+     * @brief @~japanese RAMに読み込んでおく各regionの先頭部分の長さ [ms] の初期値です。
+     */
+    static const int kDefaultHeadCacheMs = 50;
+
+    /**
+     * @brief @~japanese off_by で止めるボイスのリリースの長さ [ms] です。
+     */
+    static const int kChokeReleaseMs = 6;
+
+    /**
+     * @brief @~japanese 音声ファイルを1回に読み込むサイズ [byte] の上限です。
+     */
+    static const size_t kMaxReadSize = 16384;
+
     enum Header { kInvalidHeader, kGlobal, kGroup, kControl, kRegion };
     enum Opcode {
         kOpcodeSample,
@@ -63,15 +104,33 @@ public:
         kOpcodeHiCC0,
         kOpcodeLoCC32,
         kOpcodeHiCC32,
+        kOpcodeVolume,
+        kOpcodePan,
+        kOpcodeAmpVeltrack,
+        kOpcodeAmpegAttack,
+        kOpcodeAmpegRelease,
+        kOpcodePitchKeycenter,
+        kOpcodeTranspose,
+        kOpcodeTune,
         kOpcodeMax
     };
-    enum LoopMode { kInvalidLoopMode, kNoLoop, kOneShot, kLoopContinuous, kLoopSustain };
+    enum LoopMode : uint8_t { kInvalidLoopMode, kNoLoop, kOneShot, kLoopContinuous, kLoopSustain };
+
+    /**
+     * @brief @~japanese 音声ファイルを指定していないことを表すサンプルIDです。
+     */
+    static const uint16_t kNoSample = 0xFFFF;
+
+    /**
+     * @brief @~japanese pitch_keycenter を指定していないことを表す値です。この場合はノート番号によらず元のピッチで再生します。
+     */
+    static const uint8_t kNoPitchKeycenter = 0xFF;
 
     /**
      * @brief @~japanese SFZファイルから読み出したregionデータを格納する構造体です。
      */
     struct Region {
-        String sample;
+        // fields read by the note-on lookup come first
         uint8_t lochan;
         uint8_t hichan;
         uint8_t lokey;
@@ -85,15 +144,37 @@ public:
         uint8_t locc32;
         uint8_t hicc32;
         uint8_t sw_last;
+        LoopMode loop_mode;
+        bool silence;
+        int8_t pan;               // -100 to 100
+        int8_t amp_veltrack;      // -100 to 100 [%]
+        uint8_t choke_id;         // 1 + index of the choke rules (group, off_by), 0: neither is specified
+        uint8_t pitch_keycenter;  // SFZSink::kNoPitchKeycenter: every key plays the sample at its own pitch
+        uint16_t sample_id;       // index of SFZSink::getSamplePath(), SFZSink::kNoSample if not specified
+        int16_t gain;             // Q14 linear gain converted from volume [dB]
+        int16_t head_id;          // SampleHeadCache entry, -1: not cached
+        int16_t tune;             // transpose and tune [cent]
+        int32_t ampeg_attack;     // [ms], -1: PcmRenderer default
+        int32_t ampeg_release;    // [ms], -1: PcmRenderer default
         uint32_t offset;
         uint32_t end;
         uint32_t count;
-        LoopMode loop_mode;
         uint32_t loop_start;
         uint32_t loop_end;
-        size_t pcm_offset;
-        size_t pcm_size;
-        bool silence;
+        uint32_t pcm_offset;
+        uint32_t pcm_size;
+    };
+
+    /**
+     * @brief @~japanese 音声ファイルごとのヘッダ情報を格納する構造体です。SFZファイルの読み込み中に1ファイルにつき1回だけ取得します。
+     */
+    struct SampleInfo {
+        bool exists;
+        bool is_file;       // opened and not a directory
+        bool is_wave;       // false: raw PCM
+        size_t pcm_offset;  // 0 unless 16bit 2ch
+        size_t pcm_size;    // converted size unless 16bit 2ch
+        SampleFormat format;
     };
 
     /**
@@ -102,9 +183,9 @@ public:
     struct OpcodeContainer {
         bool is_valid;
         uint32_t group_id;
-        String sample;
+        uint16_t sample_id;
         bool silence;
-        unsigned long specified;
+        uint64_t specified;
         uint32_t opcode[kOpcodeMax];
     };
 
@@ -112,9 +193,22 @@ public:
         uint8_t note;
         uint8_t channel;
         int render_ch;
+        uint8_t velocity;
         Region* region;
-        File file;
+        File* file;  // FilePool handle, nullptr if not opened
+        bool streaming;      // file is open and streamed by SampleStreamer from the end of the cached head
+        uint32_t head_size;  // bytes of the cached head from the offset, SFZSink::getHeadSize()
+        uint32_t head_pos;   // bytes played from the cached head
+        uint32_t position;   // next byte of the stream to play
+        bool draining;       // the whole sample is written and the channel plays the rest
         uint32_t loop;
+        uint32_t step;  // Q16 sample frames per output frame, Resampler::kUnityStep: copied as is
+        Resampler resampler;
+        int choke_list;  // choke group whose note-on turns this voice off, -1 if none
+        int choke_prev;  // neighbor voices in the list
+        int choke_next;
+        int prev;  // neighbor voices in the active list; next is also the link of the free list
+        int next;
     };
 
     struct CCParamStore {
@@ -122,17 +216,95 @@ public:
         uint8_t lsb;
     };
 
+    /**
+     * @brief @~japanese MIDIチャンネルごとのボリューム(CC#7)とパン(CC#10)の値です。
+     */
+    struct ChannelControl {
+        uint8_t volume;
+        uint8_t pan;
+    };
+
     /**
      * @brief @~japanese SFZSink オブジェクトを生成します。
      * @param[in] sfz_path @~japanese SFZファイルパス
+     * @param[in] polyphony @~japanese 同時発音数 (SFZSink::kMaxPolyphony 以下)
+     * @param[in] steal_reserve @~japanese 予備の音声出力チャンネル数 (0 から SFZSink::kStealReserve まで)
+     * @details @~japanese 同時発音数を超えるノートを受けると、 Filter::PARAMID_VOICE_STEALING で選んだボイスをフェードアウトさせて、
+     * 予備の音声出力チャンネルで新しいノートを鳴らします。
+     * 予備のチャンネルがすべてフェードアウト中の場合は、ボイスを盗まずに新しいノートを捨てます。
+     * 予備を 0 にすると、同時発音数を超えるノートは常に捨てます。
      */
-    SFZSink(const String& sfz_path);
+    SFZSink(const String& sfz_path, int polyphony = kDefaultPolyphony, int steal_reserve = kStealReserve);
 
     ~SFZSink();
 
     bool begin() override;
     void update() override;
 
+    /**
+     * @brief @~japanese オフラインレンダリングの出力先を設定します。 SFZSink::begin() の前に呼び出してください。
+     * @details @~japanese 音声を OutputMixer ではなく writer に出力します。 SFZSink::update() を1回呼び出すたびに、
+     * 音声データを読み込んでから1フレーム(240サンプル, 5ミリ秒)をレンダリングします。
+     * @param[in] writer @~japanese 出力先 (nullptr で OutputMixer に出力します)
+     * @see PcmRenderer::begin(PcmWriter*)
+     */
+    void setPcmWriter(PcmWriter* writer);
+
+    /**
+     * @brief @~japanese 各regionの音声の先頭部分をRAMに読み込んでおきます。 SFZSink::begin() の前に呼び出してください。
+     * @details @~japanese ノートオンではRAMから再生を始めて、次の SFZSink::update() で開いたファイルの続きに引き継ぐので、
+     * ファイルのオープンとシークを待たずに発音できます。同じ音声ファイルと offset のregionは先頭部分を共有します。
+     * 予算に入りきらないregionは、これまで通りノートオンでファイルを開きます。
+     * @param[in] budget_bytes @~japanese 先頭部分の合計サイズの上限 [byte] (0 で無効)
+     * @param[in] head_ms @~japanese 各regionの先頭部分の長さ [ms]
+     */
+    void setHeadCache(size_t budget_bytes, int head_ms = kDefaultHeadCacheMs);
+
+    /**
+     * @brief @~japanese 音声ファイルを専用のI/Oスレッドで先読みします。 SFZSink::begin() の前に呼び出してください。
+     * @details @~japanese SFZSink::update() はI/Oスレッドが読み込み済みのデータを取り出すだけになり、
+     * ストレージの読み出しが遅れてもノートイベントの処理を止めません。
+     * I/Oスレッドは再生中のボイスのうち、データが最も早く途切れるボイスから読み込みます。
+     * ノートオン直後のデータはI/Oスレッドの読み込みを待つので、 SFZSink::setHeadCache() と組み合わせて使ってください。
+     * @param[in] enable @~japanese true でI/Oスレッドを使います (false で SFZSink::update() の中で読み込みます)
+     * @see SampleStreamer
+     */
+    void setBackgroundStreaming(bool enable);
+
+    /**
+     * @brief @~japanese 音声ファイルの読み込みに使うバッファのサイズを取得します。
+     * @details @~japanese すべてのregionがメモリに読み込んだ先頭だけで鳴る場合は、 SFZSink::begin() でバッファを確保しません。
+     * @return @~japanese サイズ [byte]
+     */
+    size_t getStreamBufferSize();
+
+    /**
+     * @brief @~japanese 音声ファイルを1回に読み込むサイズを設定します。 SFZSink::begin() の前に呼び出してください。
+     * @details @~japanese 512 byte (セクタ) の倍数にすると、読み込みの終わりをセクタ境界に揃えるので、
+     * 2回目以降の読み込みはセクタの途中から始まりません。大きくするほど読み込み回数は減りますが、ボイスごとにこの2倍のRAMを使います。
+     * 1回の読み込みのオーバーヘッドが大きいSDカードでは 8192 から 16384 、小さいフラッシュメモリでは初期値の 4096 が目安です。
+     * @param[in] bytes @~japanese 1回に読み込むサイズ [byte] (SampleStreamer::kSectorSize から SFZSink::kMaxReadSize の範囲に丸めます)
+     * @see SampleStreamer::setChunkSize()
+     */
+    void setReadSize(size_t bytes);
+
+    /**
+     * @brief @~japanese SFZファイルの解析結果をバイナリのキャッシュファイルに保存して、次回の SFZSink::begin() で再利用します。
+     * SFZSink::begin() の前に呼び出してください。
+     * @details @~japanese キャッシュファイルはSFZファイルと同じフォルダに、SFZファイル名に ".bin" を付けた名前で作成します。
+     * SFZファイルと #include したファイルのサイズとハッシュ、音声ファイルのサイズとヘッダのハッシュが一致する場合だけキャッシュを読み込み、
+     * 一致しない場合はSFZファイルを解析してキャッシュを作り直します。
+     * @param[in] enable @~japanese true でキャッシュを使います
+     */
+    void setInstrumentCache(bool enable);
+
+    /**
+     * @brief @~japanese 直前の SFZSink::begin() でキャッシュから読み込んだかを取得します。
+     * @retval true @~japanese キャッシュから読み込んだ
+     * @retval false @~japanese SFZファイルを解析した
+     */
+    bool isLoadedFromCache();
+
     bool isAvailable(int param_id) override;
     intptr_t getParam(int param_id) override;
     bool setParam(int param_id, intptr_t value) override;
@@ -148,6 +320,12 @@ public:
      */
     size_t getNumberOfRegions();
 
+    /**
+     * @brief @~japanese SFZファイルで指定した音声ファイルの数を取得します。
+     * @return number of unique samples
+     */
+    size_t getNumberOfSamples();
+
     /**
      * @brief @~japanese regionを取得します。
      * @param[in] id region index
@@ -155,6 +333,44 @@ public:
      */
     const Region* getRegion(size_t id);
 
+    /**
+     * @brief @~japanese 音声ファイルのパスを取得します。regionは音声ファイルのパスを共有の表に登録して、その番号を持ちます。
+     * @param[in] sample_id @~japanese サンプルID ( SFZSink::Region::sample_id )
+     * @return @~japanese 音声ファイルのパス (SFZSink::kNoSample の場合は空文字列)
+     */
+    const String& getSamplePath(uint16_t sample_id);
+
+    /**
+     * @brief @~japanese regionの先頭のうち、メモリに読み込んである長さを取得します。ノートオンからこの長さはファイルを読まずに再生します。
+     * @details @~japanese 読み込んだ先頭は同じ音声ファイルと offset のregionで共有するので、ループの終わりまでに切り詰めた長さを返します。
+     * @param[in] region @~japanese region
+     * @return @~japanese 長さ [byte] (読み込んでいない場合は 0)
+     */
+    uint32_t getHeadSize(const Region* region);
+
+    /**
+     * @brief @~japanese ノートオンで鳴らすregionを探します。
+     * @details @~japanese SFZファイルの読み込み後に作る (ノート番号, ベロシティ帯) ごとの候補リストから探すので、
+     * region数が多くても候補だけを調べます。ベロシティの範囲が広いregionはノート番号ごとの候補リストに入れて、ベロシティは探すときに調べます。結果は SFZSink::scanRegion() と同じく、条件に合う最初のregionです。
+     * @param[in] note @~japanese ノート番号
+     * @param[in] velocity @~japanese ベロシティ
+     * @param[in] channel @~japanese MIDIチャンネル
+     * @retval >=0 region index
+     * @retval <0 no match region
+     */
+    int findRegion(uint8_t note, uint8_t velocity, uint8_t channel);
+
+    /**
+     * @brief @~japanese ノートオンで鳴らすregionを、全regionを先頭から調べて探します。
+     * @details @~japanese SFZSink::findRegion() の検証と比較のための実装です。
+     * @param[in] note @~japanese ノート番号
+     * @param[in] velocity @~japanese ベロシティ
+     * @param[in] channel @~japanese MIDIチャンネル
+     * @retval >=0 region index
+     * @retval <0 no match region
+     */
+    int scanRegion(uint8_t note, uint8_t velocity, uint8_t channel);
+
     /**
      * @brief @~japanese sw_lokey値を取得します。
      * @return sw_lokey value
@@ -178,14 +394,31 @@ public:
     void startHeader(const String& header) override;
     void endHeader(const String& header) override;
     void opcode(const String& opcode, const String& value) override;
+    void includeFile(const String& path) override;
 
 private:
     // for play
     String sfz_path_;
     std::vector<Region> regions_;
-    std::vector<PlaybackUnit> playback_units_;
+    std::vector<uint32_t> index_offsets_;  // CSR offsets per (key, velocity band), then per key, empty if not indexed
+    std::vector<uint16_t> index_regions_;  // region indices per bucket in file order
+    std::vector<PlaybackUnit> playback_units_;  // voice slab sized in begin(), never reallocated while playing
+    int active_voices_;                         // first (oldest) playing voice, -1 if none
+    int active_tail_;                           // last (newest) playing voice, -1 if none
+    int free_voices_;                           // first idle voice, -1 if none
     PcmRenderer renderer_;
+    PcmWriter* writer_;
+    int polyphony_;
+    VoiceStealer stealer_;
+    LatencyController latency_;
+    FilePool files_;
+    SampleStreamer streamer_;  // after files_, so that the I/O thread stops before the files close
+    bool background_streaming_;
+    SampleHeadCache head_cache_;
+    int head_ms_;
+    Resampler::Interpolation interpolation_;
     CCParamStore bank_;
+    ChannelControl controls_[16];
     int volume_;
 
     uint8_t prog_num_;
@@ -198,13 +431,56 @@ private:
     uint32_t group_id_;
     int regions_in_group_;
     String default_path_;
+    std::vector<String> samples_;               // interned sample paths, indexed by sample_id
+    std::map<String, uint16_t> sample_ids_;     // for parse
+    std::vector<SampleInfo> sample_infos_;      // for parse, indexed by sample_id
+    std::vector<SampleFormat> sample_formats_;  // indexed by sample_id
+    // choke groups: group and off_by numbers are mapped to dense indices so that a voice list per group is an array lookup
+    struct ChokeRule {
+        uint16_t group;   // index of choke_groups_, kNoChokeGroup if not specified
+        uint16_t off_by;  // index of choke_groups_, kNoChokeGroup if not specified
+    };
+    std::vector<uint32_t> choke_groups_;  // group numbers used by group or off_by
+    std::vector<ChokeRule> choke_rules_;  // indexed by Region::choke_id - 1
+    std::vector<int> choke_heads_;        // per choke group: first voice that its note-on turns off, -1 if none
+    uint32_t choked_count_;
+    std::vector<String> sources_;  // the sfz file and the files it includes
+    bool use_cache_;
+    bool cache_loaded_;
     uint8_t sw_lokey_;
     uint8_t sw_hikey_;
     uint8_t sw_last_;
 
+    void addRegion(const OpcodeContainer& container);
+    uint16_t internSample(const String& path);
+    uint8_t internChokeRule(uint32_t group, uint32_t off_by);
+    uint16_t internChokeGroup(uint32_t group);
+    SampleInfo loadSampleInfo(const String& path);
+    const SampleFormat* getSampleFormat(uint16_t sample_id);
+    bool loadInstrumentCache(const String& cache_path);
+    bool saveInstrumentCache(const String& cache_path);
+    void buildRegionIndex();
+    bool matchRegion(const Region& region, uint8_t note, uint8_t velocity, uint8_t channel);
     PlaybackUnit* startPlayback(uint8_t note, uint8_t velocity, uint8_t channel, Region* region);
+    bool openStream(PlaybackUnit* unit);
+    void closeStream(PlaybackUnit* unit);
+    bool isHeadOnly(const Region& region, uint32_t head_size);
+    uint32_t getHeadBytes(const Region& region);
+    void loadSampleHeads();
     void continuePlayback(PlaybackUnit* unit, int frames);
-    void stopPlayback(PlaybackUnit* unit);
+    size_t readSample(PlaybackUnit* unit, uint8_t* dst, size_t size);
+    size_t resampleSample(PlaybackUnit* unit, int16_t* dst, size_t frames);
+    int getBufferFill();
+    void stopPlayback(PlaybackUnit* unit, int release_ms = -1);
+    void finishPlayback(PlaybackUnit* unit);
+    void linkChoke(PlaybackUnit* unit);
+    void unlinkChoke(PlaybackUnit* unit);
+    void chokeGroup(int choke_group);
+    void updateGain(PlaybackUnit* unit);
+    void initVoices();
+    PlaybackUnit* allocateVoice();
+    void freeVoice(PlaybackUnit* unit);
+    int getVoiceIndex(const PlaybackUnit* unit);
 };
 
 #endif  // SFZ_SINK_H_
@@ -0,0 +1,80 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+/**
+ * @file SampleFormat.h
+ */
+#ifndef SAMPLE_FORMAT_H_
+#define SAMPLE_FORMAT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mix_kernel.h"
+
+/**
+ * @brief @~japanese 音声ファイルの音声データの符号化形式です。
+ * @details @~japanese 16bit, 2ch のPCM以外の音声データは、変換後の 16bit, 2ch のPCMのバイト位置 (先頭が 0) で扱います。
+ * 例えば IMA ADPCM やモノラルの音声データの 100 フレーム目は、ファイル内の位置によらず位置 400 です。
+ * サンプリング周波数は変換しません。 48kHz 以外の音声データは再生時にリサンプルします。
+ */
+struct SampleFormat {
+    /**
+     * @brief @~japanese 符号化方式です。
+     */
+    enum Codec : uint8_t {
+        kCodecPcm,       ///< @~japanese 16bit のPCM (2ch はファイルのバイト位置のまま読み出す)
+        kCodecImaAdpcm,  ///< @~japanese 4bit の IMA ADPCM (WAVE_FORMAT_IMA_ADPCM)
+        kCodecPcm24,     ///< @~japanese 24bit のPCM (ディザを加えて 16bit に変換する)
+        kCodecFloat,     ///< @~japanese 32bit 浮動小数点数のPCM (ディザを加えて 16bit に変換する)
+        kCodecMax = kCodecFloat
+    };
+
+    Codec codec;
+    uint8_t channels;           // channels in the file
+    uint16_t block_align;       // bytes per encoded block (per frame if not compressed)
+    uint32_t frames_per_block;  // frames decoded from a whole block
+    uint32_t data_offset;       // file offset of the first block
+    uint32_t data_size;         // encoded bytes
+    uint32_t sample_rate;       // frames per second
+
+    /**
+     * @brief @~japanese ファイルのバイト位置のまま 16bit, 2ch のPCMとして読み出せるかを取得します。
+     * @retval true 16bit, 2ch PCM
+     * @retval false @~japanese 変換または復号が必要
+     */
+    bool isPassThrough() const {
+        return codec == kCodecPcm && channels == 2;
+    }
+
+    /**
+     * @brief @~japanese 1フレームごとに変換する形式 (圧縮していない 16bit, 2ch 以外のPCM) かを取得します。
+     * @retval true @~japanese SampleFormat::convert() で変換する
+     * @retval false @~japanese 変換しない、またはブロック単位で復号する
+     */
+    bool isConverted() const {
+        return !isPassThrough() && codec != kCodecImaAdpcm;
+    }
+
+    /**
+     * @brief @~japanese ファイルの音声データを 16bit, 2ch のPCMに変換します。 SampleFormat::isConverted() の形式だけを扱います。
+     * @param[out] dst @~japanese 出力 (interleaved, 2 channels)
+     * @param[in] src @~japanese ファイルの音声データ (block_align バイトのフレームの並び)
+     * @param[in] frames @~japanese フレーム数
+     * @param[in,out] dither @~japanese ディザの状態
+     */
+    void convert(int16_t* dst, const uint8_t* src, size_t frames, uint32_t* dither) const {
+        if (codec == kCodecPcm24) {
+            mixConvert24(dst, src, frames, channels, dither);
+        } else if (codec == kCodecFloat) {
+            mixConvertFloat(dst, src, frames, channels, dither);
+        } else {
+            mixUpmix16(dst, reinterpret_cast<const int16_t*>(src), frames);
+        }
+    }
+};
+
+#endif  // SAMPLE_FORMAT_H_
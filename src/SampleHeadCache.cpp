@@ -0,0 +1,178 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#if defined(ARDUINO_ARCH_SPRESENSE) && !defined(SUBCORE)
+
+#include "SampleHeadCache.h"
+
+#include <string.h>
+
+#include <File.h>
+
+#include "ImaAdpcmDecoder.h"
+
+// #define DEBUG (1)
+
+// clang-format off
+#define nop(...) do {} while (0)
+// clang-format on
+#ifdef DEBUG
+#define trace_printf nop
+#define debug_printf printf
+#define error_printf printf
+#else  // DEBUG
+#define trace_printf nop
+#define debug_printf nop
+#define error_printf printf
+#endif  // DEBUG
+
+static const char kClassName[] = "SampleHeadCache";
+
+static const uint32_t kFrameSize = 4;     // decoded frame: 16bit, 2ch
+static const size_t kDecodeFrames = 256;  // frames decoded at a time on the stack
+static const size_t kMaxFrameBytes = 8;   // converted frame in the file: 32bit float, 2ch
+
+SampleHeadCache::SampleHeadCache() : pool_(nullptr), budget_(0), used_(0), entries_(), lookup_() {
+}
+
+SampleHeadCache::~SampleHeadCache() {
+    delete[] pool_;
+}
+
+void SampleHeadCache::setBudget(size_t bytes) {
+    trace_printf("[%s::%s] (%d)\n", kClassName, __func__, (int)bytes);
+    clear();
+    delete[] pool_;
+    pool_ = nullptr;
+    budget_ = bytes;
+}
+
+size_t SampleHeadCache::getBudget() {
+    return budget_;
+}
+
+size_t SampleHeadCache::getUsedSize() {
+    return used_;
+}
+
+int SampleHeadCache::getEntryCount() {
+    return (int)entries_.size();
+}
+
+void SampleHeadCache::clear() {
+    used_ = 0;
+    entries_.clear();
+    lookup_.clear();
+}
+
+int SampleHeadCache::load(const String& path, uint32_t offset, uint32_t size, const SampleFormat* format) {
+    trace_printf("[%s::%s] (\"%s\", %d, %d)\n", kClassName, __func__, path.c_str(), (int)offset, (int)size);
+    auto key = std::make_pair(path, offset);
+    auto it = lookup_.find(key);
+    if (it != lookup_.end()) {
+        return it->second;
+    }
+    if (size == 0 || budget_ - used_ < size) {
+        return -1;
+    }
+    if (pool_ == nullptr) {
+        // one block for all entries, so that the heads do not fragment the heap
+        pool_ = new uint8_t[budget_];
+    }
+
+    File file(path.c_str());
+    if (!file) {
+        error_printf("[%s::%s] error: cannot open \"%s\"\n", kClassName, __func__, path.c_str());
+        return -1;
+    }
+    int ret = 0;
+    if (format != nullptr && !format->isPassThrough()) {
+        ret = decode(&file, *format, offset, &pool_[used_], size);
+    } else {
+        file.seek(offset);
+        ret = file.read(&pool_[used_], size);
+    }
+    file.close();
+    if (ret <= 0) {
+        error_printf("[%s::%s] error: cannot read \"%s\"\n", kClassName, __func__, path.c_str());
+        return -1;
+    }
+
+    int id = (int)entries_.size();
+    entries_.push_back(Entry{used_, (uint32_t)ret});
+    lookup_[key] = id;
+    used_ += ret;
+    debug_printf("[%s::%s] \"%s\"@%d: %d bytes, %d/%d used\n", kClassName, __func__, path.c_str(), (int)offset, ret, (int)used_, (int)budget_);
+    return id;
+}
+
+int SampleHeadCache::decode(File* file, const SampleFormat& format, uint32_t offset, uint8_t* dst, uint32_t size) {
+    if (format.isConverted()) {
+        return convert(file, format, offset, dst, size);
+    }
+    std::vector<uint8_t> block(format.block_align);
+    ImaAdpcmDecoder decoder;
+    decoder.setBlockBuffer(block.data(), block.size());
+    int16_t frames[kDecodeFrames * 2];
+    uint32_t frame = offset / kFrameSize;
+    uint32_t done = 0;
+    while (done + kFrameSize <= size) {
+        size_t request = (size - done) / kFrameSize;
+        size_t n = decoder.read(file, format, frame, frames, (request < kDecodeFrames) ? request : kDecodeFrames);
+        if (n == 0) {
+            break;
+        }
+        memcpy(&dst[done], frames, n * kFrameSize);
+        frame += n;
+        done += n * kFrameSize;
+    }
+    return (done > 0) ? (int)done : -1;
+}
+
+int SampleHeadCache::convert(File* file, const SampleFormat& format, uint32_t offset, uint8_t* dst, uint32_t size) {
+    if (format.block_align == 0 || format.block_align > kMaxFrameBytes) {
+        return -1;
+    }
+    uint8_t raw[kDecodeFrames * kMaxFrameBytes];
+    uint32_t dither = 0;
+    uint32_t frame = offset / kFrameSize;
+    uint32_t frame_count = format.data_size / format.block_align;
+    uint32_t done = 0;
+    file->seek(format.data_offset + frame * format.block_align);
+    while (done + kFrameSize <= size && frame < frame_count) {
+        size_t n = (size - done) / kFrameSize;
+        n = (n < kDecodeFrames) ? n : kDecodeFrames;
+        n = (n < frame_count - frame) ? n : frame_count - frame;
+        int ret = file->read(raw, n * format.block_align);
+        if (ret <= 0) {
+            break;
+        }
+        n = (size_t)ret / format.block_align;
+        if (n == 0) {
+            break;
+        }
+        format.convert((int16_t*)&dst[done], raw, n, &dither);
+        frame += n;
+        done += n * kFrameSize;
+    }
+    return (done > 0) ? (int)done : -1;
+}
+
+const uint8_t* SampleHeadCache::getData(int id) {
+    if (id < 0 || (int)entries_.size() <= id) {
+        return nullptr;
+    }
+    return &pool_[entries_[id].pool_offset];
+}
+
+uint32_t SampleHeadCache::getSize(int id) {
+    if (id < 0 || (int)entries_.size() <= id) {
+        return 0;
+    }
+    return entries_[id].size;
+}
+
+#endif  // ARDUINO_ARCH_SPRESENSE
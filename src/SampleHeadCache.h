@@ -0,0 +1,114 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+/**
+ * @file SampleHeadCache.h
+ */
+#ifndef SAMPLE_HEAD_CACHE_H_
+#define SAMPLE_HEAD_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <Arduino.h>
+
+#include "SampleFormat.h"
+
+class File;
+
+/**
+ * @brief @~japanese 音声ファイルの先頭部分を RAM に保持します。
+ * @details @~japanese ノートオン直後はこのキャッシュから再生し、その間にファイルを開くことで、
+ * ファイルのオープンとシークを待たずに発音できます。
+ * 先頭部分は (ファイルパス, オフセット) ごとに1つだけ読み込むので、同じ音声を使う複数のregionで共有します。
+ * 全体のサイズは SampleHeadCache::setBudget() で指定した予算以内に収めます。
+ */
+class SampleHeadCache {
+public:
+    /**
+     * @brief @~japanese SampleHeadCache オブジェクトを生成します。予算は 0 (無効) です。
+     */
+    SampleHeadCache();
+
+    ~SampleHeadCache();
+
+    /**
+     * @brief @~japanese キャッシュの予算を設定します。読み込み済みの内容は破棄します。
+     * @param[in] bytes @~japanese 予算 [byte] (0 で無効)
+     */
+    void setBudget(size_t bytes);
+
+    /**
+     * @brief @~japanese キャッシュの予算を取得します。
+     * @return budget [byte]
+     */
+    size_t getBudget();
+
+    /**
+     * @brief @~japanese 使用中のサイズを取得します。
+     * @return used size [byte]
+     */
+    size_t getUsedSize();
+
+    /**
+     * @brief @~japanese 読み込み済みの先頭部分の数を取得します。
+     * @return number of entries
+     */
+    int getEntryCount();
+
+    /**
+     * @brief @~japanese 読み込み済みの内容を破棄します。予算は変わりません。
+     */
+    void clear();
+
+    /**
+     * @brief @~japanese 音声ファイルの先頭部分を読み込みます。
+     * @details @~japanese 同じファイルパスとオフセットを読み込み済みなら、読み直さずにそのエントリを返します。
+     * そのときのサイズは最初に読み込んだときのサイズです。
+     * @param[in] path @~japanese ファイルパス
+     * @param[in] offset @~japanese 読み込みを始めるファイル上の位置 [byte]
+     * @param[in] size @~japanese 読み込むサイズ [byte]
+     * @param[in] format @~japanese 16bit, 2ch のPCM以外の音声ファイルの形式 (nullptr: 16bit, 2ch PCM)。変換したPCMを保持し、 offset と size は変換後のPCMのバイト位置です
+     * @retval >=0 entry id
+     * @retval <0 @~japanese 予算不足か読み込み失敗
+     */
+    int load(const String& path, uint32_t offset, uint32_t size, const SampleFormat* format = nullptr);
+
+    /**
+     * @brief @~japanese エントリのデータを取得します。
+     * @param[in] id entry id
+     * @return data (nullptr if invalid)
+     */
+    const uint8_t* getData(int id);
+
+    /**
+     * @brief @~japanese エントリのサイズを取得します。
+     * @param[in] id entry id
+     * @return size [byte] (0 if invalid)
+     */
+    uint32_t getSize(int id);
+
+private:
+    struct Entry {
+        size_t pool_offset;
+        uint32_t size;
+    };
+
+    uint8_t* pool_;
+    size_t budget_;
+    size_t used_;
+    std::vector<Entry> entries_;
+    std::map<std::pair<String, uint32_t>, int> lookup_;
+
+    int decode(File* file, const SampleFormat& format, uint32_t offset, uint8_t* dst, uint32_t size);
+    int convert(File* file, const SampleFormat& format, uint32_t offset, uint8_t* dst, uint32_t size);
+};
+
+#endif  // SAMPLE_HEAD_CACHE_H_
@@ -0,0 +1,532 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#if defined(ARDUINO_ARCH_SPRESENSE) && !defined(SUBCORE)
+
+#include "SampleStreamer.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include <Arduino.h>
+
+// #define DEBUG (1)
+
+// clang-format off
+#define nop(...) do {} while (0)
+// clang-format on
+#ifdef DEBUG
+#define trace_printf nop
+#define debug_printf printf
+#define error_printf printf
+#else  // DEBUG
+#define trace_printf nop
+#define debug_printf nop
+#define error_printf printf
+#endif  // DEBUG
+
+static const char kClassName[] = "SampleStreamer";
+
+static const size_t kIoThreadStackSize = 4096;
+static const uint32_t kFrameSize = 4;  // decoded or converted frame: 16bit, 2ch
+
+const size_t SampleStreamer::kDefaultChunkSize;
+const size_t SampleStreamer::kSectorSize;
+
+SampleStreamer::SampleStreamer(int slots, size_t chunk_size)
+    : chunk_size_((chunk_size > 0) ? chunk_size : kDefaultChunkSize),
+      slots_((slots > 0) ? slots : 1),
+      buffer_(),
+      blocks_(),
+      stamp_(0),
+      max_block_size_(0),
+      block_buffer_(),
+      decoders_((slots > 0) ? slots : 1),
+      thread_(),
+      background_(false),
+      stop_(true),
+      peak_read_us_(0),
+      peak_read_count_(0),
+      read_count_(0),
+      starve_count_(0),
+      share_count_(0) {
+    pthread_mutex_init(&mutex_, nullptr);
+    pthread_cond_init(&request_cond_, nullptr);
+    pthread_cond_init(&done_cond_, nullptr);
+    for (auto& e : slots_) {
+        memset(&e, 0, sizeof(e));
+    }
+}
+
+SampleStreamer::~SampleStreamer() {
+    end();
+    pthread_cond_destroy(&done_cond_);
+    pthread_cond_destroy(&request_cond_);
+    pthread_mutex_destroy(&mutex_);
+}
+
+bool SampleStreamer::begin(bool background) {
+    end();
+    // every slot refers to 2 blocks at most, so a block is left for every read; unused ones keep what they read for other streams
+    buffer_.assign(slots_.size() * 2 * chunk_size_, 0);
+    blocks_.assign(slots_.size() * 2, Block{-1, 0, 0, 0, 0, false});
+    stamp_ = 0;
+    for (size_t i = 0; i < slots_.size(); i++) {
+        memset(&slots_[i], 0, sizeof(slots_[i]));
+        slots_[i].chunks[0].block = -1;
+        slots_[i].chunks[1].block = -1;
+    }
+    block_buffer_.assign(slots_.size() * max_block_size_, 0);
+    for (size_t i = 0; i < decoders_.size(); i++) {
+        decoders_[i].setBlockBuffer((max_block_size_ > 0) ? &block_buffer_[i * max_block_size_] : nullptr, max_block_size_);
+    }
+    stop_ = false;
+    background_ = false;
+    if (!background) {
+        return true;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    size_t stack_size = kIoThreadStackSize;
+#ifdef PTHREAD_STACK_MIN
+    stack_size = (stack_size < (size_t)PTHREAD_STACK_MIN) ? (size_t)PTHREAD_STACK_MIN : stack_size;
+#endif  // PTHREAD_STACK_MIN
+    pthread_attr_setstacksize(&attr, stack_size);
+    int ret = pthread_create(&thread_, &attr, run, this);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        error_printf("[%s::%s] error: cannot create I/O thread (%d)\n", kClassName, __func__, ret);
+        return false;
+    }
+    background_ = true;
+    debug_printf("[%s::%s] I/O thread started, %d slots x %d bytes\n", kClassName, __func__, (int)slots_.size(), (int)(2 * chunk_size_));
+    return true;
+}
+
+void SampleStreamer::end() {
+    pthread_mutex_lock(&mutex_);
+    stop_ = true;
+    pthread_cond_broadcast(&request_cond_);
+    pthread_mutex_unlock(&mutex_);
+    if (background_) {
+        pthread_join(thread_, nullptr);
+        background_ = false;
+    }
+    for (auto& e : slots_) {
+        e.file = nullptr;
+        releaseChunks(&e);
+    }
+    // give the memory back; begin() allocates it again
+    std::vector<uint8_t>().swap(buffer_);
+    std::vector<Block>().swap(blocks_);
+    std::vector<uint8_t>().swap(block_buffer_);
+    for (auto& e : decoders_) {
+        e.setBlockBuffer(nullptr, 0);
+    }
+}
+
+bool SampleStreamer::isBackground() {
+    return background_;
+}
+
+void SampleStreamer::setChunkSize(size_t chunk_size) {
+    chunk_size_ = (chunk_size > 0) ? chunk_size : kDefaultChunkSize;
+}
+
+size_t SampleStreamer::getChunkSize() {
+    return chunk_size_;
+}
+
+void SampleStreamer::setMaxBlockSize(size_t bytes) {
+    max_block_size_ = bytes;
+}
+
+bool SampleStreamer::open(int slot, File* file, uint32_t start, uint32_t loop_start, uint32_t loop_end, bool loop, const SampleFormat* format,
+                          int source) {
+    if (slot < 0 || (int)slots_.size() <= slot || file == nullptr || buffer_.empty()) {
+        return false;
+    }
+    bool compressed = (format != nullptr && format->codec == SampleFormat::kCodecImaAdpcm);
+    bool converted = (format != nullptr && format->isConverted());
+    if (compressed && format->block_align > max_block_size_) {
+        error_printf("[%s::%s] error: unsupported block size %d\n", kClassName, __func__, (int)format->block_align);
+        return false;
+    }
+    if (converted && (format->block_align == 0 || format->block_align > chunk_size_)) {
+        error_printf("[%s::%s] error: unsupported frame size %d\n", kClassName, __func__, (int)format->block_align);
+        return false;
+    }
+    pthread_mutex_lock(&mutex_);
+    Slot& s = slots_[slot];
+    while (s.busy) {
+        pthread_cond_wait(&done_cond_, &mutex_);
+    }
+    releaseChunks(&s);
+    s.file = file;
+    s.source = (source >= 0) ? source : -1;
+    s.pos = start;
+    s.loop_start = loop_start;
+    s.loop_end = loop_end;
+    s.loop = loop;
+    s.compressed = compressed;
+    s.converted = converted;
+    if (compressed || converted) {
+        s.format = *format;
+        decoders_[slot].reset();
+    }
+    s.dither = 0;
+    s.eof = false;
+    s.queued_size = 0;
+    s.head = 0;
+    pthread_cond_signal(&request_cond_);
+    pthread_mutex_unlock(&mutex_);
+    return true;
+}
+
+void SampleStreamer::close(int slot) {
+    if (slot < 0 || (int)slots_.size() <= slot) {
+        return;
+    }
+    pthread_mutex_lock(&mutex_);
+    Slot& s = slots_[slot];
+    // the caller may release the file as soon as this returns
+    while (s.busy) {
+        pthread_cond_wait(&done_cond_, &mutex_);
+    }
+    s.file = nullptr;
+    releaseChunks(&s);
+    pthread_mutex_unlock(&mutex_);
+}
+
+size_t SampleStreamer::read(int slot, uint8_t* dst, size_t size) {
+    if (slot < 0 || (int)slots_.size() <= slot) {
+        return 0;
+    }
+    pthread_mutex_lock(&mutex_);
+    Slot& s = slots_[slot];
+    size_t done = 0;
+    while (done < size) {
+        if (s.filled == 0) {
+            if (!background_ && s.file != nullptr && !s.eof) {
+                fill(slot);
+                continue;
+            }
+            break;
+        }
+        Chunk& c = s.chunks[s.head];
+        if (s.converted) {
+            // the conversion takes the place of the copy
+            size_t frames = (size - done) / kFrameSize;
+            size_t chunk_frames = (c.size - c.pos) / s.format.block_align;
+            frames = (frames < chunk_frames) ? frames : chunk_frames;
+            if (frames == 0) {
+                break;
+            }
+            s.format.convert((int16_t*)&dst[done], &c.data[c.pos], frames, &s.dither);
+            c.pos += frames * s.format.block_align;
+            done += frames * kFrameSize;
+        } else {
+            size_t n = (size - done < c.size - c.pos) ? size - done : c.size - c.pos;
+            memcpy(&dst[done], &c.data[c.pos], n);
+            c.pos += n;
+            done += n;
+        }
+        if (c.pos == c.size) {
+            releaseBlock(&c);
+            s.head ^= 1;
+            s.filled--;
+            pthread_cond_signal(&request_cond_);
+        }
+    }
+    if (done < size && s.file != nullptr && !s.eof) {
+        starve_count_++;
+    }
+    pthread_mutex_unlock(&mutex_);
+    return done;
+}
+
+size_t SampleStreamer::getAvailable(int slot) {
+    if (slot < 0 || (int)slots_.size() <= slot) {
+        return 0;
+    }
+    pthread_mutex_lock(&mutex_);
+    size_t size = getBufferedSize(slots_[slot]);
+    pthread_mutex_unlock(&mutex_);
+    return size;
+}
+
+void SampleStreamer::setQueuedSize(int slot, size_t queued_size) {
+    if (slot < 0 || (int)slots_.size() <= slot) {
+        return;
+    }
+    pthread_mutex_lock(&mutex_);
+    slots_[slot].queued_size = queued_size;
+    pthread_mutex_unlock(&mutex_);
+}
+
+bool SampleStreamer::service() {
+    pthread_mutex_lock(&mutex_);
+    int slot = pickSlot();
+    if (slot >= 0) {
+        fill(slot);
+    }
+    pthread_mutex_unlock(&mutex_);
+    return slot >= 0;
+}
+
+bool SampleStreamer::takePeakReadTime(uint32_t* peak_us) {
+    pthread_mutex_lock(&mutex_);
+    bool ret = peak_read_count_ > 0;
+    if (peak_us != nullptr) {
+        *peak_us = peak_read_us_;
+    }
+    peak_read_us_ = 0;
+    peak_read_count_ = 0;
+    pthread_mutex_unlock(&mutex_);
+    return ret;
+}
+
+uint32_t SampleStreamer::getReadCount() {
+    pthread_mutex_lock(&mutex_);
+    uint32_t ret = read_count_;
+    pthread_mutex_unlock(&mutex_);
+    return ret;
+}
+
+uint32_t SampleStreamer::getStarveCount() {
+    pthread_mutex_lock(&mutex_);
+    uint32_t ret = starve_count_;
+    pthread_mutex_unlock(&mutex_);
+    return ret;
+}
+
+uint32_t SampleStreamer::getShareCount() {
+    pthread_mutex_lock(&mutex_);
+    uint32_t ret = share_count_;
+    pthread_mutex_unlock(&mutex_);
+    return ret;
+}
+
+size_t SampleStreamer::getBufferSize() {
+    return buffer_.size() + block_buffer_.size();
+}
+
+void* SampleStreamer::run(void* arg) {
+    SampleStreamer* self = (SampleStreamer*)arg;
+    pthread_mutex_lock(&self->mutex_);
+    while (!self->stop_) {
+        int slot = self->pickSlot();
+        if (slot < 0) {
+            pthread_cond_wait(&self->request_cond_, &self->mutex_);
+            continue;
+        }
+        self->fill(slot);
+    }
+    pthread_mutex_unlock(&self->mutex_);
+    return nullptr;
+}
+
+int SampleStreamer::pickSlot() {
+    // earliest deadline first: the stream with the least data left downstream and in its buffers runs dry first
+    int found = -1;
+    size_t found_size = 0;
+    for (size_t i = 0; i < slots_.size(); i++) {
+        const Slot& s = slots_[i];
+        if (s.file == nullptr || s.eof || s.busy || s.filled >= 2) {
+            continue;
+        }
+        size_t size = s.queued_size + getBufferedSize(s);
+        if (found < 0 || size < found_size) {
+            found = (int)i;
+            found_size = size;
+        }
+    }
+    return found;
+}
+
+void SampleStreamer::fill(int slot) {
+    // called with the lock held; the lock is released during the file access
+    Slot& s = slots_[slot];
+    if (s.pos >= s.loop_end) {
+        if (!s.loop || s.loop_start >= s.loop_end) {
+            s.eof = true;
+            return;
+        }
+        s.pos = s.loop_start;
+    }
+    // a chunk never crosses the loop end, so a read is at most one seek and one read
+    Chunk& c = s.chunks[(s.head + s.filled) % 2];
+    File* file = s.file;
+    uint32_t pos = s.pos;
+    size_t size = (s.loop_end - pos < chunk_size_) ? s.loop_end - pos : chunk_size_;
+    uint32_t file_pos = pos;
+    if (s.converted) {
+        // size and file_pos are in file frames, pos stays in converted frames
+        size_t frames = (s.loop_end - pos) / kFrameSize;
+        size_t chunk_frames = chunk_size_ / s.format.block_align;
+        size = ((frames < chunk_frames) ? frames : chunk_frames) * s.format.block_align;
+        file_pos = s.format.data_offset + pos / kFrameSize * s.format.block_align;
+    }
+    size_t unit = s.converted ? s.format.block_align : 1;
+    if (!s.compressed && chunk_size_ % kSectorSize == 0 && size == chunk_size_ / unit * unit) {
+        // end a whole chunk on a multiple of the chunk size, which is a sector boundary too,
+        // so that the following reads start on one, touch no extra sector and line up with other streams of the file
+        size_t aligned = (file_pos + size) / chunk_size_ * chunk_size_ - file_pos;
+        aligned -= aligned % unit;
+        size = (aligned > 0) ? aligned : size;
+    }
+
+    // another stream of the same file may have read this range already
+    int source = s.compressed ? -1 : s.source;
+    int block = findBlock(source, file_pos, size);
+    if (block >= 0) {
+        useBlock(&c, block, file_pos);
+        share_count_++;
+        c.size = size;
+        c.pos = 0;
+        s.filled++;
+        s.pos = pos + (s.converted ? (uint32_t)size / s.format.block_align * kFrameSize : (uint32_t)size);
+        return;
+    }
+    block = allocateBlock(source, file_pos);
+    if (block < 0) {
+        error_printf("[%s::%s] error: no free chunk\n", kClassName, __func__);
+        s.eof = true;
+        return;
+    }
+    useBlock(&c, block, file_pos);
+    s.busy = true;
+    pthread_mutex_unlock(&mutex_);
+
+    uint32_t start_us = micros();
+    int ret = 0;
+    if (s.compressed) {
+        ret = decode(slot, pos, c.data, size);
+    } else if (size > 0) {
+        if (file->position() != file_pos) {
+            file->seek(file_pos);
+        }
+        ret = file->read(c.data, size);
+        if (s.converted && ret > 0) {
+            ret -= ret % s.format.block_align;
+        }
+    }
+    uint32_t elapsed_us = (uint32_t)micros() - start_us;
+
+    pthread_mutex_lock(&mutex_);
+    s.busy = false;
+    read_count_++;
+    peak_read_count_++;
+    peak_read_us_ = (elapsed_us > peak_read_us_) ? elapsed_us : peak_read_us_;
+    if (ret <= 0) {
+        error_printf("[%s::%s] error: read error at %d\n", kClassName, __func__, (int)pos);
+        s.eof = true;
+        releaseBlock(&c);
+    } else {
+        blocks_[block].size = (uint32_t)ret;
+        blocks_[block].loading = false;
+        c.size = (size_t)ret;
+        c.pos = 0;
+        s.filled++;
+        s.pos = pos + (s.converted ? (uint32_t)ret / s.format.block_align * kFrameSize : (uint32_t)ret);
+    }
+    pthread_cond_broadcast(&done_cond_);
+}
+
+int SampleStreamer::findBlock(int source, uint32_t file_pos, size_t size) {
+    if (source < 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < blocks_.size(); i++) {
+        const Block& b = blocks_[i];
+        if (b.source == source && !b.loading && b.start <= file_pos && file_pos + size <= b.start + b.size) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int SampleStreamer::allocateBlock(int source, uint32_t start) {
+    // an empty block, or else the least recently used one that no chunk refers to;
+    // there is always one, as a slot refers to 2 blocks at most
+    int found = -1;
+    for (size_t i = 0; i < blocks_.size(); i++) {
+        const Block& b = blocks_[i];
+        if (b.refs > 0) {
+            continue;
+        }
+        if (found < 0 || (b.source < 0 && blocks_[found].source >= 0) ||
+            ((b.source < 0) == (blocks_[found].source < 0) && (int32_t)(b.stamp - blocks_[found].stamp) < 0)) {
+            found = (int)i;
+        }
+    }
+    if (found >= 0) {
+        Block& b = blocks_[found];
+        b.source = source;
+        b.start = start;
+        b.size = 0;
+        b.loading = true;
+    }
+    return found;
+}
+
+void SampleStreamer::useBlock(Chunk* chunk, int block, uint32_t file_pos) {
+    Block& b = blocks_[block];
+    b.refs++;
+    b.stamp = ++stamp_;
+    chunk->block = block;
+    chunk->data = &buffer_[block * chunk_size_ + (file_pos - b.start)];
+}
+
+void SampleStreamer::releaseBlock(Chunk* chunk) {
+    if (chunk->block < 0) {
+        return;
+    }
+    Block& b = blocks_[chunk->block];
+    b.refs--;
+    if (b.loading) {
+        // a failed read leaves nothing to share
+        b.source = -1;
+        b.loading = false;
+    }
+    chunk->block = -1;
+    chunk->data = nullptr;
+}
+
+void SampleStreamer::releaseChunks(Slot* slot) {
+    for (int i = 0; i < slot->filled; i++) {
+        releaseBlock(&slot->chunks[(slot->head + i) % 2]);
+    }
+    slot->filled = 0;
+}
+
+int SampleStreamer::decode(int slot, uint32_t pos, uint8_t* dst, size_t size) {
+    // called outside the lock while the slot is busy; the decoder keeps its block, so the next chunk usually continues it without a read
+    Slot& s = slots_[slot];
+    uint32_t frame = pos / kFrameSize;
+    size_t frames = size / kFrameSize;
+    size_t done = 0;
+    while (done < frames) {
+        size_t n = decoders_[slot].read(s.file, s.format, frame + done, (int16_t*)&dst[done * kFrameSize], frames - done);
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+    return (done > 0) ? (int)(done * kFrameSize) : -1;
+}
+
+size_t SampleStreamer::getBufferedSize(const Slot& slot) {
+    size_t size = 0;
+    for (int i = 0; i < slot.filled; i++) {
+        const Chunk& c = slot.chunks[(slot.head + i) % 2];
+        size += slot.converted ? (c.size - c.pos) / slot.format.block_align * kFrameSize : c.size - c.pos;
+    }
+    return size;
+}
+
+#endif  // ARDUINO_ARCH_SPRESENSE
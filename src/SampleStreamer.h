@@ -0,0 +1,256 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+/**
+ * @file SampleStreamer.h
+ */
+#ifndef SAMPLE_STREAMER_H_
+#define SAMPLE_STREAMER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <pthread.h>
+
+#include <vector>
+
+#include <File.h>
+
+#include "ImaAdpcmDecoder.h"
+#include "SampleFormat.h"
+
+/**
+ * @brief @~japanese ボイスごとの音声ファイルを先読みするストリーミング部品です。
+ * @details @~japanese ボイスごとに2つのチャンクを持つダブルバッファで、片方を再生に使う間にもう片方へファイルを読み込みます。
+ * バックグラウンド動作では専用のI/Oスレッドが読み込みを担当するので、ストレージの読み出しが遅れても
+ * メインループはノートイベントの処理と読み込み済みデータの取り出しだけで済みます。
+ * I/Oスレッドは、出力先に溜まっているデータとダブルバッファの残りの合計が最も少ない(最も早く途切れる)ボイスから読み込みます。
+ * バックグラウンド動作でない場合は、 SampleStreamer::read() でデータが足りない時にその場で読み込みます。
+ * 1回の読み込みはチャンク単位で、チャンクサイズが SampleStreamer::kSectorSize の倍数ならセクタ境界に揃えます。
+ * 同じ音声ファイルを読むストリーム (source が同じストリーム) は、読み込んだチャンクを参照カウント付きで共有します。
+ * 再生し終わったチャンクも別の読み込みに使うまで残しておくので、同じ音を連打したときや同じ音を重ねたときは、
+ * 後から始まったストリームは先に始まったストリームが読み込んだチャンクを使い、ストレージから読み直しません。
+ * IMA ADPCM の音声ファイルは読み込みと同時に復号するので、チャンクには 16bit, 2ch のPCMが入ります。
+ * モノラル、 24bit、 32bit浮動小数点数のPCMはファイルのままチャンクに読み込み、 SampleStreamer::read() の取り出しと同時に 16bit, 2ch に変換します。
+ */
+class SampleStreamer {
+public:
+    /**
+     * @brief @~japanese 1回に読み込むサイズ [byte] の初期値です。
+     */
+    static const size_t kDefaultChunkSize = 4096;
+
+    /**
+     * @brief @~japanese ストレージのセクタサイズ [byte] です。
+     * @details @~japanese 1回に読み込むサイズがこの倍数のとき、読み込みの終わりをセクタ境界に揃えます。
+     * 最初の読み込みだけが短くなり、それ以降の読み込みはセクタ境界から始まります。
+     */
+    static const size_t kSectorSize = 512;
+
+    /**
+     * @brief @~japanese SampleStreamer オブジェクトを生成します。
+     * @param[in] slots @~japanese 同時に開くストリームの数 (ボイス数)
+     * @param[in] chunk_size @~japanese 1回に読み込むサイズ [byte]
+     */
+    explicit SampleStreamer(int slots, size_t chunk_size = kDefaultChunkSize);
+
+    ~SampleStreamer();
+
+    /**
+     * @brief @~japanese バッファを確保して、ストリーミングを開始します。
+     * @param[in] background @~japanese true でI/Oスレッドを起動します
+     * @retval true Success
+     * @retval false @~japanese I/Oスレッドを起動できなかった
+     */
+    bool begin(bool background);
+
+    /**
+     * @brief @~japanese I/Oスレッドを停止して、すべてのストリームを閉じます。
+     */
+    void end();
+
+    /**
+     * @brief @~japanese バックグラウンドで動作しているかを取得します。
+     * @retval true @~japanese I/Oスレッドが読み込んでいる
+     * @retval false @~japanese SampleStreamer::read() の中で読み込んでいる
+     */
+    bool isBackground();
+
+    /**
+     * @brief @~japanese 1回に読み込むサイズを設定します。 SampleStreamer::begin() の前に呼び出します。
+     * @param[in] chunk_size @~japanese 1回に読み込むサイズ [byte] (0: SampleStreamer::kDefaultChunkSize)
+     */
+    void setChunkSize(size_t chunk_size);
+
+    /**
+     * @brief @~japanese 1回に読み込むサイズを取得します。
+     * @return chunk size [byte]
+     */
+    size_t getChunkSize();
+
+    /**
+     * @brief @~japanese 圧縮した音声ファイルの1ブロックの最大サイズを設定します。 SampleStreamer::begin() の前に呼び出します。
+     * @param[in] bytes @~japanese ブロックの最大サイズ [byte] (0: 圧縮した音声ファイルを開かない)
+     */
+    void setMaxBlockSize(size_t bytes);
+
+    /**
+     * @brief @~japanese ストリームを開きます。開いている間、 file はI/Oスレッドが使います。
+     * @param[in] slot @~japanese スロット番号
+     * @param[in] file @~japanese 読み込むファイル (呼び出し側が SampleStreamer::close() の後まで保持します)
+     * @param[in] start @~japanese 読み込みを始める位置 [byte]
+     * @param[in] loop_start @~japanese ループの開始位置 [byte]
+     * @param[in] loop_end @~japanese 読み込みを終える位置、またはループの終了位置 [byte]
+     * @param[in] loop @~japanese true で loop_end に達したら loop_start に戻ります
+     * @param[in] format @~japanese 16bit, 2ch のPCM以外の音声ファイルの形式 (nullptr: 16bit, 2ch PCM)。位置は変換後のPCMのバイト位置です (SampleFormat 参照)
+     * @param[in] source @~japanese 音声ファイルの番号。同じ番号のストリームは読み込んだチャンクを共有します (負の値: 共有しない)。
+     * IMA ADPCM のストリームは共有しません
+     * @retval true Success
+     * @retval false @~japanese スロット番号が不正、またはブロックが大きすぎる
+     */
+    bool open(int slot, File* file, uint32_t start, uint32_t loop_start, uint32_t loop_end, bool loop, const SampleFormat* format = nullptr,
+              int source = -1);
+
+    /**
+     * @brief @~japanese ストリームを閉じます。読み込み中の場合は読み込みが終わるまで待ちます。
+     * @param[in] slot @~japanese スロット番号
+     */
+    void close(int slot);
+
+    /**
+     * @brief @~japanese 読み込み済みのデータを取り出します。バックグラウンド動作では待たずに返ります。
+     * @param[in] slot @~japanese スロット番号
+     * @param[out] dst @~japanese 取り出し先
+     * @param[in] size @~japanese 取り出すサイズ [byte]
+     * @return @~japanese 取り出したサイズ [byte] (size 未満の場合は読み込みが追いついていないか、ストリームの終わり)
+     */
+    size_t read(int slot, uint8_t* dst, size_t size);
+
+    /**
+     * @brief @~japanese 読み込み済みのデータのサイズを取得します。
+     * @param[in] slot @~japanese スロット番号
+     * @return available size [byte]
+     */
+    size_t getAvailable(int slot);
+
+    /**
+     * @brief @~japanese 出力先に溜まっているデータのサイズを通知します。I/Oスレッドが読み込む順番の決定に使います。
+     * @param[in] slot @~japanese スロット番号
+     * @param[in] queued_size @~japanese 出力先に溜まっているデータのサイズ [byte]
+     */
+    void setQueuedSize(int slot, size_t queued_size);
+
+    /**
+     * @brief @~japanese 最も早く途切れるストリームを1チャンク読み込みます。I/Oスレッドと同じ処理を呼び出し元で実行します。
+     * @retval true @~japanese 読み込んだ
+     * @retval false @~japanese 読み込むストリームがない
+     */
+    bool service();
+
+    /**
+     * @brief @~japanese 前回の呼び出しから後の読み込み時間のピークを取得して、クリアします。
+     * @param[out] peak_us @~japanese 読み込み時間のピーク [us]
+     * @retval true @~japanese 前回の呼び出しから後に読み込んだ
+     * @retval false @~japanese 読み込んでいない
+     */
+    bool takePeakReadTime(uint32_t* peak_us);
+
+    /**
+     * @brief @~japanese 読み込み回数を取得します。
+     * @return read count
+     */
+    uint32_t getReadCount();
+
+    /**
+     * @brief @~japanese SampleStreamer::read() で要求したサイズに足りなかった回数を取得します。ストリームの終わりは数えません。
+     * @return starve count
+     */
+    uint32_t getStarveCount();
+
+    /**
+     * @brief @~japanese ストレージから読み込まずに、ほかのストリームが読み込んだチャンクを使った回数を取得します。
+     * @return share count
+     */
+    uint32_t getShareCount();
+
+    /**
+     * @brief @~japanese SampleStreamer::begin() で確保したバッファのサイズを取得します。
+     * @details @~japanese ストリームごとに2チャンク分 (初期値で 8 KiB) と、圧縮された音声ファイルのデコード用のブロックです。
+     * SampleStreamer::end() で解放します。
+     * @return buffer size [byte]
+     */
+    size_t getBufferSize();
+
+private:
+    struct Chunk {
+        uint8_t* data;  // in the block
+        size_t size;
+        size_t pos;
+        int block;  // referred block, -1 if none
+    };
+
+    // chunk_size_ bytes of buffer_ holding [start, start + size) of the file of a source
+    struct Block {
+        int source;  // -1 if not shared
+        uint32_t start;
+        uint32_t size;
+        int refs;        // chunks referring to this block
+        uint32_t stamp;  // last use, the least recent one is reused first
+        bool loading;    // being read, not to be shared yet
+    };
+
+    struct Slot {
+        File* file;
+        int source;    // blocks are shared among the slots of the same source
+        uint32_t pos;  // next file position to read
+        uint32_t loop_start;
+        uint32_t loop_end;
+        bool loop;
+        bool compressed;  // decoded by decoders_[slot] with format
+        bool converted;   // chunks hold file frames, converted with format on read
+        SampleFormat format;
+        uint32_t dither;  // dither state of the conversion
+        bool eof;
+        bool busy;  // a chunk is being filled outside the lock
+        size_t queued_size;
+        int head;    // chunk being consumed
+        int filled;  // number of filled chunks from head
+        Chunk chunks[2];
+    };
+
+    size_t chunk_size_;
+    std::vector<Slot> slots_;
+    std::vector<uint8_t> buffer_;
+    std::vector<Block> blocks_;
+    uint32_t stamp_;
+    size_t max_block_size_;
+    std::vector<uint8_t> block_buffer_;      // one block per slot for the decoders
+    std::vector<ImaAdpcmDecoder> decoders_;  // indexed by slot
+    pthread_mutex_t mutex_;
+    pthread_cond_t request_cond_;  // signaled when a chunk becomes free or a stream opens
+    pthread_cond_t done_cond_;     // signaled when a read completes
+    pthread_t thread_;
+    bool background_;
+    bool stop_;
+    uint32_t peak_read_us_;
+    uint32_t peak_read_count_;  // reads since the last takePeakReadTime()
+    uint32_t read_count_;
+    uint32_t starve_count_;
+    uint32_t share_count_;
+
+    static void* run(void* arg);
+    int pickSlot();
+    void fill(int slot);
+    int findBlock(int source, uint32_t file_pos, size_t size);
+    int allocateBlock(int source, uint32_t start);
+    void useBlock(Chunk* chunk, int block, uint32_t file_pos);
+    void releaseBlock(Chunk* chunk);
+    void releaseChunks(Slot* slot);
+    int decode(int slot, uint32_t pos, uint8_t* dst, size_t size);
+    size_t getBufferedSize(const Slot& slot);
+};
+
+#endif  // SAMPLE_STREAMER_H_
@@ -0,0 +1,152 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#if defined(ARDUINO_ARCH_SPRESENSE) && !defined(SUBCORE)
+
+#include "VoiceStealer.h"
+
+VoiceStealer::VoiceStealer(Policy policy) : policy_(policy), voices_(), serial_(0), stolen_(0), dropped_(0) {
+}
+
+VoiceStealer::Policy VoiceStealer::getPolicy() {
+    return policy_;
+}
+
+bool VoiceStealer::setPolicy(int policy) {
+    if (policy < kStealOldest || kPolicyMax < policy) {
+        return false;
+    }
+    policy_ = (Policy)policy;
+    return true;
+}
+
+void VoiceStealer::reserve(int voices) {
+    if (voices > 0 && (size_t)voices > voices_.size()) {
+        voices_.resize(voices, Voice{false, false, 0, 0, 0, 0});
+    }
+}
+
+void VoiceStealer::start(int voice, uint8_t note, uint8_t channel, int32_t level) {
+    if (voice < 0) {
+        return;
+    }
+    if ((size_t)voice >= voices_.size()) {
+        voices_.resize(voice + 1, Voice{false, false, 0, 0, 0, 0});
+    }
+    Voice& v = voices_[voice];
+    v.active = true;
+    v.released = false;
+    v.note = note;
+    v.channel = channel;
+    v.level = level;
+    v.serial = serial_++;
+}
+
+void VoiceStealer::setLevel(int voice, int32_t level) {
+    Voice* v = getVoice(voice);
+    if (v != nullptr) {
+        v->level = level;
+    }
+}
+
+void VoiceStealer::release(int voice) {
+    Voice* v = getVoice(voice);
+    if (v != nullptr) {
+        v->released = true;
+    }
+}
+
+void VoiceStealer::stop(int voice) {
+    Voice* v = getVoice(voice);
+    if (v != nullptr) {
+        v->active = false;
+    }
+}
+
+int VoiceStealer::getActiveCount() {
+    int count = 0;
+    for (const auto& v : voices_) {
+        count += v.active ? 1 : 0;
+    }
+    return count;
+}
+
+int VoiceStealer::steal(uint8_t note, uint8_t channel) {
+    int victim = -1;
+    if (policy_ == kStealQuietest) {
+        for (size_t i = 0; i < voices_.size(); i++) {
+            const Voice& v = voices_[i];
+            if (!v.active) {
+                continue;
+            }
+            // the older one wins a tie
+            if (victim < 0 || v.level < voices_[victim].level ||
+                (v.level == voices_[victim].level && (int32_t)(v.serial - voices_[victim].serial) < 0)) {
+                victim = i;
+            }
+        }
+    } else if (policy_ == kStealSameNote) {
+        for (size_t i = 0; i < voices_.size(); i++) {
+            const Voice& v = voices_[i];
+            if (v.active && v.note == note && v.channel == channel) {
+                victim = i;
+                break;
+            }
+        }
+    } else if (policy_ == kStealReleasedFirst) {
+        victim = findOldest(true);
+    } else if (policy_ == kStealNone) {
+        return -1;
+    }
+    if (victim < 0) {
+        victim = findOldest(false);
+    }
+    if (victim >= 0) {
+        stolen_++;
+    }
+    return victim;
+}
+
+void VoiceStealer::drop() {
+    dropped_++;
+}
+
+uint32_t VoiceStealer::getStolenCount() {
+    return stolen_;
+}
+
+uint32_t VoiceStealer::getDroppedCount() {
+    return dropped_;
+}
+
+void VoiceStealer::resetCounters() {
+    stolen_ = 0;
+    dropped_ = 0;
+}
+
+VoiceStealer::Voice* VoiceStealer::getVoice(int voice) {
+    if (voice < 0 || voices_.size() <= (size_t)voice) {
+        return nullptr;
+    }
+    return &voices_[voice];
+}
+
+int VoiceStealer::findOldest(bool released_only) {
+    int victim = -1;
+    for (size_t i = 0; i < voices_.size(); i++) {
+        const Voice& v = voices_[i];
+        if (!v.active || (released_only && !v.released)) {
+            continue;
+        }
+        // compare serials with wrap-around
+        if (victim < 0 || (int32_t)(v.serial - voices_[victim].serial) < 0) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+#endif  // ARDUINO_ARCH_SPRESENSE
@@ -0,0 +1,150 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+/**
+ * @file VoiceStealer.h
+ */
+#ifndef VOICE_STEALER_H_
+#define VOICE_STEALER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * @brief @~japanese 同時発音数を超えた時に、停止させる発音(ボイス)を選びます。
+ * @details @~japanese 楽器部品は発音の開始・リリース・停止を通知し、
+ * 発音数が上限に達した状態で新しいノートを受けたら VoiceStealer::steal() で停止させるボイスを選びます。
+ * ボイスは楽器部品が管理する再生単位の番号で識別します。
+ */
+class VoiceStealer {
+public:
+    /**
+     * @brief @~japanese 停止させるボイスの選び方です。
+     */
+    enum Policy {
+        kStealOldest,         ///< @~japanese 最も古いボイス
+        kStealQuietest,       ///< @~japanese 最もレベルの小さいボイス
+        kStealSameNote,       ///< @~japanese 同じチャンネル・同じノートのボイス(なければ最も古いボイス)
+        kStealReleasedFirst,  ///< @~japanese リリース中のボイス(なければ最も古いボイス)
+        kStealNone,           ///< @~japanese 停止させずに新しいノートを捨てる
+        kPolicyMax = kStealNone
+    };
+
+    /**
+     * @brief @~japanese VoiceStealer オブジェクトを生成します。
+     * @param[in] policy @~japanese 停止させるボイスの選び方
+     */
+    VoiceStealer(Policy policy = kStealOldest);
+
+    /**
+     * @brief @~japanese 停止させるボイスの選び方を取得します。
+     * @return policy
+     */
+    Policy getPolicy();
+
+    /**
+     * @brief @~japanese 停止させるボイスの選び方を設定します。
+     * @param[in] policy policy
+     * @retval true Success
+     * @retval false Invalid policy
+     */
+    bool setPolicy(int policy);
+
+    /**
+     * @brief @~japanese ボイス番号 0 から voices - 1 までの管理領域を確保します。確保した範囲では VoiceStealer::start() がメモリを確保しません。
+     * @param[in] voices @~japanese ボイス数
+     */
+    void reserve(int voices);
+
+    /**
+     * @brief @~japanese 発音の開始を通知します。
+     * @param[in] voice @~japanese ボイス番号
+     * @param[in] note @~japanese ノート番号
+     * @param[in] channel @~japanese MIDIチャンネル
+     * @param[in] level @~japanese ボイスのレベル(大小比較にだけ使います)
+     */
+    void start(int voice, uint8_t note, uint8_t channel, int32_t level);
+
+    /**
+     * @brief @~japanese ボイスのレベルを更新します。
+     * @param[in] voice @~japanese ボイス番号
+     * @param[in] level @~japanese ボイスのレベル
+     */
+    void setLevel(int voice, int32_t level);
+
+    /**
+     * @brief @~japanese ボイスがリリース中になったことを通知します。
+     * @param[in] voice @~japanese ボイス番号
+     */
+    void release(int voice);
+
+    /**
+     * @brief @~japanese 発音の停止を通知します。
+     * @param[in] voice @~japanese ボイス番号
+     */
+    void stop(int voice);
+
+    /**
+     * @brief @~japanese 発音中のボイス数を取得します。
+     * @return number of active voices
+     */
+    int getActiveCount();
+
+    /**
+     * @brief @~japanese 停止させるボイスを選び、盗んだボイス数を数えます。
+     * @details @~japanese 選ばれたボイスは呼び出し元が停止させて VoiceStealer::stop() を通知してください。
+     * @param[in] note @~japanese 新しいノートのノート番号
+     * @param[in] channel @~japanese 新しいノートのMIDIチャンネル
+     * @retval >=0 voice number to steal
+     * @retval <0 no voice to steal
+     */
+    int steal(uint8_t note, uint8_t channel);
+
+    /**
+     * @brief @~japanese 鳴らせなかったノートを数えます。
+     */
+    void drop();
+
+    /**
+     * @brief @~japanese 盗んだボイス数を取得します。
+     * @return number of stolen voices
+     */
+    uint32_t getStolenCount();
+
+    /**
+     * @brief @~japanese 鳴らせなかったノート数を取得します。
+     * @return number of dropped notes
+     */
+    uint32_t getDroppedCount();
+
+    /**
+     * @brief @~japanese 盗んだボイス数と鳴らせなかったノート数をクリアします。
+     */
+    void resetCounters();
+
+private:
+    struct Voice {
+        bool active;
+        bool released;
+        uint8_t note;
+        uint8_t channel;
+        int32_t level;
+        uint32_t serial;
+    };
+
+    Policy policy_;
+    std::vector<Voice> voices_;
+    uint32_t serial_;
+    uint32_t stolen_;
+    uint32_t dropped_;
+
+    Voice* getVoice(int voice);
+    int findOldest(bool released_only);
+};
+
+#endif  // VOICE_STEALER_H_
@@ -10,6 +10,8 @@
 
 #include <string.h>
 
+#include "ImaAdpcmDecoder.h"
+
 // #define DEBUG (1)
 
 // clang-format off
@@ -28,8 +30,16 @@
 static const char kClassName[] = "WavReader";
 
 const int kSampleFrq = 48000;
+const int kSampleFrqCd = 44100;  // resampled while playing
 const int kBitDepth = 16;
 const int kChannelCount = 2;
+const int kAdpcmBitDepth = 4;
+const uint16_t kFormatPcm = 0x0001;
+const uint16_t kFormatFloat = 0x0003;
+const uint16_t kFormatImaAdpcm = 0x0011;
+const uint16_t kFormatExtensible = 0xFFFE;
+const uint32_t kFmtSize = 16;            // up to bits_per_sample
+const uint32_t kFmtExtensibleSize = 26;  // up to the format code in the sub format GUID
 
 static uint32_t swap32(uint32_t v) {
     return (((v >> 0) & 0xFF) << 24) | (((v >> 8) & 0xFF) << 16) | (((v >> 16) & 0xFF) << 8) | (((v >> 24) & 0xFF) << 0);
@@ -65,7 +75,13 @@ WavReader::RIFFHeader::RIFFHeader() : data_len(0) {
 WavReader::WaveHeader::WaveHeader() : data_len(0), format(0), ch(0), samples_per_sec(0), avg_byte_per_sec(0), block_align(0), bits_per_sample(0), cb_size(0) {
 }
 
-WavReader::WavReader(File& file) : pos_(0), size_(0), wave_header_(WaveHeader()), is_wave_file_(false) {
+WavReader::WavReader(File& file) : pos_(0), size_(0), fact_frames_(0), format_(), wave_header_(WaveHeader()), is_wave_file_(false) {
+    // anything but a supported WAV file is read as 48kHz, 16bit, 2ch PCM
+    format_.codec = SampleFormat::kCodecPcm;
+    format_.channels = kChannelCount;
+    format_.block_align = kChannelCount * kBitDepth / 8;
+    format_.frames_per_block = 1;
+    format_.sample_rate = kSampleFrq;
     is_wave_file_ = load(file);
 }
 
@@ -79,6 +95,23 @@ bool WavReader::isWaveFile() {
     return is_wave_file_;
 }
 
+SampleFormat WavReader::getSampleFormat() {
+    SampleFormat format = format_;
+    format.data_offset = pos_;
+    format.data_size = size_;
+    return format;
+}
+
+uint32_t WavReader::getFrameCount() {
+    SampleFormat format = getSampleFormat();
+    if (format.codec != SampleFormat::kCodecImaAdpcm) {
+        return size_ / format.block_align;
+    }
+    uint32_t blocks = (size_ + format.block_align - 1) / format.block_align;
+    uint32_t frames = blocks * format.frames_per_block;
+    return (fact_frames_ != 0 && fact_frames_ < frames) ? fact_frames_ : frames;
+}
+
 bool WavReader::load(File& file) {
     if (!file) {
         error_printf("[%s::%s] error: %s invalid\n", kClassName, __func__, file.name());
@@ -107,7 +140,11 @@ bool WavReader::load(File& file) {
             size_ = data_len;
             break;
         }
-        file.seek(file.position() + data_len);
+        uint32_t chunk_end = file.position() + data_len;
+        if (memcmp(riff_chunk, "fact", kWaveChunkSize) == 0 && data_len >= sizeof(uint32_t)) {
+            fact_frames_ = getByte32LE(file);
+        }
+        file.seek(chunk_end);
         if (!file.available()) {
             return false;
         }
@@ -141,9 +178,35 @@ bool WavReader::parseHeader(File& file) {
         return false;
     }
 
-    if (!(wave_header_.samples_per_sec == kSampleFrq && wave_header_.ch == kChannelCount && wave_header_.bits_per_sample == kBitDepth)) {
+    if (!(wave_header_.samples_per_sec == kSampleFrq || wave_header_.samples_per_sec == kSampleFrqCd)) {
+        return false;
+    }
+    if (!(1 <= wave_header_.ch && wave_header_.ch <= kChannelCount)) {
         return false;
     }
+    // other than 16bit 2ch is converted or decoded while streaming, see SampleFormat
+    SampleFormat format = format_;
+    format.channels = (uint8_t)wave_header_.ch;
+    format.block_align = wave_header_.block_align;
+    format.sample_rate = wave_header_.samples_per_sec;
+    uint16_t bits = wave_header_.bits_per_sample;
+    if (wave_header_.format == kFormatImaAdpcm && bits == kAdpcmBitDepth) {
+        format.codec = SampleFormat::kCodecImaAdpcm;
+        format.frames_per_block = ImaAdpcmDecoder::getFramesPerBlock(wave_header_.ch, wave_header_.block_align);
+        if (format.frames_per_block == 0) {
+            return false;
+        }
+    } else if (wave_header_.format == kFormatPcm && (bits == kBitDepth || bits == 24)) {
+        format.codec = (bits == kBitDepth) ? SampleFormat::kCodecPcm : SampleFormat::kCodecPcm24;
+    } else if (wave_header_.format == kFormatFloat && bits == 32) {
+        format.codec = SampleFormat::kCodecFloat;
+    } else {
+        return false;
+    }
+    if (format.codec != SampleFormat::kCodecImaAdpcm && wave_header_.block_align != wave_header_.ch * bits / 8) {
+        return false;
+    }
+    format_ = format;
 
     return true;
 }
@@ -211,9 +274,20 @@ bool WavReader::parseWaveHeader(File& file, WaveHeader* waveh) {
     waveh->bits_per_sample = getByte16LE(file);
     debug_printf("[%s::%s] @ Bits per sample  = %d\n\n", kClassName, __func__, waveh->bits_per_sample);
 
+    // WAVE_FORMAT_EXTENSIBLE: the format code is the head of the sub format GUID
+    uint32_t parsed = kFmtSize;
+    if (waveh->format == kFormatExtensible && kFmtExtensibleSize <= waveh->data_len) {
+        waveh->cb_size = getByte16LE(file);
+        getByte16LE(file);  // valid bits per sample
+        getByte32LE(file);  // channel mask
+        waveh->format = getByte16LE(file);
+        parsed = kFmtExtensibleSize;
+        debug_printf("[%s::%s] @ Sub format       = %d\n", kClassName, __func__, waveh->format);
+    }
+
     // Eliminate other data in the subchunk because it is not needed
-    if (16 < waveh->data_len) {
-        file.seek(file.position() + (waveh->data_len - 16));
+    if (parsed < waveh->data_len) {
+        file.seek(file.position() + (waveh->data_len - parsed));
     }
 
     return true;
@@ -12,6 +12,8 @@
 #include <Arduino.h>
 #include <SDHCI.h>
 
+#include "SampleFormat.h"
+
 /**
  * @brief @~japanese WAVファイルまたはPCMファイルから、音声データ領域の情報を読み出します。
  */
@@ -42,6 +44,21 @@ public:
      */
     bool isWaveFile();
 
+    /**
+     * @brief @~japanese 音声データの符号化形式を取得します。
+     * @details @~japanese 16bit, 24bit, 32bit浮動小数点数のPCMと IMA ADPCM の、 48kHz または 44.1kHz の 1ch, 2ch のWAVファイルに対応します。
+     * それ以外の場合は、ファイル全体を 48kHz, 16bit, 2ch のPCMとして扱います。
+     * @return @~japanese 符号化形式 (data_offset, data_size は WavReader::getPcmOffset(), WavReader::getPcmSize() と同じ)
+     */
+    SampleFormat getSampleFormat();
+
+    /**
+     * @brief @~japanese 復号後のフレーム数を取得します。
+     * @details @~japanese IMA ADPCM の場合は fact チャンクのサンプル数、 fact チャンクがなければブロック数から計算します。
+     * @return @~japanese フレーム数
+     */
+    uint32_t getFrameCount();
+
 private:
     static const unsigned int kWaveChunkSize = 4;
 
@@ -67,6 +84,8 @@ private:
 
     uint32_t pos_;
     uint32_t size_;
+    uint32_t fact_frames_;  // frames in the fact chunk, 0 if none
+    SampleFormat format_;   // data_offset and data_size are not set
     WaveHeader wave_header_;
     bool is_wave_file_;
 
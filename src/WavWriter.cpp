@@ -0,0 +1,112 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#if defined(ARDUINO_ARCH_SPRESENSE) && !defined(SUBCORE)
+
+#include "WavWriter.h"
+
+#include <string.h>
+
+// #define DEBUG (1)
+
+// clang-format off
+#define nop(...) do {} while (0)
+// clang-format on
+#ifdef DEBUG
+#define trace_printf nop
+#define debug_printf printf
+#define error_printf printf
+#else  // DEBUG
+#define trace_printf nop
+#define debug_printf nop
+#define error_printf printf
+#endif  // DEBUG
+
+static const char kClassName[] = "WavWriter";
+
+static const uint16_t kFormatPcm = 1;
+
+static void setByte32LE(uint8_t* dst, uint32_t v) {
+    dst[0] = (v >> 0) & 0xFF;
+    dst[1] = (v >> 8) & 0xFF;
+    dst[2] = (v >> 16) & 0xFF;
+    dst[3] = (v >> 24) & 0xFF;
+}
+
+static void setByte16LE(uint8_t* dst, uint16_t v) {
+    dst[0] = (v >> 0) & 0xFF;
+    dst[1] = (v >> 8) & 0xFF;
+}
+
+const uint32_t WavWriter::kHeaderSize;
+
+WavWriter::WavWriter(File& file, int sample_rate, int bit_depth, int channels)
+    : file_(file), sample_rate_(sample_rate), bit_depth_(bit_depth), channels_(channels), size_(0) {
+}
+
+bool WavWriter::begin() {
+    size_ = 0;
+    return writeHeader();
+}
+
+size_t WavWriter::write(const void* pcm, size_t size) {
+    if (!file_) {
+        return 0;
+    }
+    size_t ret = file_.write(static_cast<const uint8_t*>(pcm), size);
+    size_ += ret;
+    return ret;
+}
+
+bool WavWriter::end() {
+    if (!file_) {
+        return false;
+    }
+    uint32_t pos = file_.position();
+    if (!file_.seek(0)) {
+        error_printf("[%s::%s] error: cannot seek \"%s\"\n", kClassName, __func__, file_.name());
+        return false;
+    }
+    bool ret = writeHeader();
+    file_.seek(pos);
+    file_.flush();
+    return ret;
+}
+
+uint32_t WavWriter::getPcmSize() {
+    return size_;
+}
+
+bool WavWriter::writeHeader() {
+    if (!file_) {
+        error_printf("[%s::%s] error: invalid file\n", kClassName, __func__);
+        return false;
+    }
+    const uint16_t block_align = (bit_depth_ / 8) * channels_;
+
+    uint8_t header[kHeaderSize];
+    memcpy(&header[0], "RIFF", 4);
+    setByte32LE(&header[4], kHeaderSize - 8 + size_);
+    memcpy(&header[8], "WAVE", 4);
+    memcpy(&header[12], "fmt ", 4);
+    setByte32LE(&header[16], 16);
+    setByte16LE(&header[20], kFormatPcm);
+    setByte16LE(&header[22], channels_);
+    setByte32LE(&header[24], sample_rate_);
+    setByte32LE(&header[28], sample_rate_ * block_align);
+    setByte16LE(&header[32], block_align);
+    setByte16LE(&header[34], bit_depth_);
+    memcpy(&header[36], "data", 4);
+    setByte32LE(&header[40], size_);
+
+    if (file_.write(header, sizeof(header)) != sizeof(header)) {
+        error_printf("[%s::%s] error: cannot write \"%s\"\n", kClassName, __func__, file_.name());
+        return false;
+    }
+    return true;
+}
+
+#endif  // ARDUINO_ARCH_SPRESENSE
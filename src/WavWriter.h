@@ -0,0 +1,67 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+/**
+ * @file WavWriter.h
+ */
+#ifndef WAV_WRITER_H_
+#define WAV_WRITER_H_
+#include <Arduino.h>
+#include <SDHCI.h>
+
+#include "PcmWriter.h"
+
+/**
+ * @brief @~japanese 音声データをWAVファイル(リニアPCM)に書き込みます。
+ * @details @~japanese WavWriter::begin() でヘッダを書き込み、 WavWriter::end() でヘッダのデータサイズを確定します。
+ * 出力ファイルは書き込みモードで開いておき、 WavWriter::end() の後に閉じてください。
+ */
+class WavWriter : public PcmWriter {
+public:
+    /**
+     * @brief @~japanese WavWriter オブジェクトを生成します。
+     * @param[in] file @~japanese 出力ファイル
+     * @param[in] sample_rate Sampling rate [Hz]
+     * @param[in] bit_depth Bit depth [bit]
+     * @param[in] channels Audio channel number
+     */
+    WavWriter(File& file, int sample_rate, int bit_depth, int channels);
+
+    /**
+     * @brief @~japanese WAVファイルのヘッダを書き込みます。
+     * @retval true Success
+     * @retval false Fail
+     */
+    bool begin();
+
+    size_t write(const void* pcm, size_t size) override;
+
+    /**
+     * @brief @~japanese WAVファイルのヘッダにデータサイズを書き込みます。
+     * @retval true Success
+     * @retval false Fail
+     */
+    bool end();
+
+    /**
+     * @brief @~japanese 書き込んだ音声データのサイズを取得します。
+     * @return @~japanese 音声データ領域のデータサイズ
+     */
+    uint32_t getPcmSize();
+
+private:
+    static const uint32_t kHeaderSize = 44;
+
+    File& file_;
+    int sample_rate_;
+    int bit_depth_;
+    int channels_;
+    uint32_t size_;
+
+    bool writeHeader();
+};
+
+#endif  // WAV_WRITER_H_
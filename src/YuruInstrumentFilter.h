@@ -71,7 +71,47 @@ public:
         /**
          * @brief [get, set] @~japanese 音声出力レベルを設定します。
          */
-        PARAMID_OUTPUT_LEVEL
+        PARAMID_OUTPUT_LEVEL,
+        /**
+         * @brief [get, set] @~japanese 同時発音数を超えた時に停止させるボイスの選び方 (VoiceStealer::Policy) を設定します。
+         */
+        PARAMID_VOICE_STEALING,
+        /**
+         * @brief [get, set] @~japanese 同時発音数を超えたために停止させたボイス数を取得します。0 を設定するとクリアします。
+         */
+        PARAMID_STOLEN_VOICES,
+        /**
+         * @brief [get, set] @~japanese 音声出力チャンネルが足りずに鳴らせなかったノート数を取得します。0 を設定するとクリアします。
+         */
+        PARAMID_DROPPED_VOICES,
+        /**
+         * @brief [get, set] @~japanese 発音開始時に先読みする量 [ms] を設定します。0 を設定すると読み出し時間とアンダーランから自動で調整します。
+         */
+        PARAMID_TARGET_LATENCY,
+        /**
+         * @brief [get] @~japanese 発音中のボイスのうち、最も少ない先読み済みデータ量 [ms] を取得します。
+         */
+        PARAMID_BUFFER_FILL,
+        /**
+         * @brief [get, set] @~japanese 音声ファイルを開いた回数を取得します。0 を設定すると PARAMID_FILE_HITS, PARAMID_FILE_EVICTIONS と共にクリアします。
+         */
+        PARAMID_FILE_OPENS,
+        /**
+         * @brief [get, set] @~japanese 開いたままの音声ファイルのハンドルを再利用した回数を取得します。0 を設定するとクリアします。
+         */
+        PARAMID_FILE_HITS,
+        /**
+         * @brief [get, set] @~japanese 開いたままにするハンドル数の上限を超えたために閉じたハンドル数を取得します。0 を設定するとクリアします。
+         */
+        PARAMID_FILE_EVICTIONS,
+        /**
+         * @brief [get, set] @~japanese 同じグループのノートオンで止めた(チョークした)ボイス数を取得します。0 を設定するとクリアします。
+         */
+        PARAMID_CHOKED_VOICES,
+        /**
+         * @brief [get, set] @~japanese ピッチを変えて再生する時の補間方法 (Resampler::Interpolation) を設定します。
+         */
+        PARAMID_INTERPOLATION
     };
 
     /**
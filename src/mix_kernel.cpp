@@ -0,0 +1,907 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include "mix_kernel.h"
+
+#include <string.h>
+
+// select backend at compile time
+#if defined(MIX_KERNEL_FORCE_SCALAR)
+#define MIX_KERNEL_SCALAR
+#elif defined(__ARM_FEATURE_MVE)
+#define MIX_KERNEL_HELIUM
+#include <arm_mve.h>
+#elif defined(__ARM_NEON)
+#define MIX_KERNEL_NEON
+#include <arm_neon.h>
+#elif defined(__AVX2__)
+#define MIX_KERNEL_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#define MIX_KERNEL_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_FEATURE_DSP) && defined(ARDUINO_ARCH_SPRESENSE)
+#define MIX_KERNEL_DSP
+#define ARM_MATH_CM4
+#define __FPU_PRESENT 1U
+#include <cmsis/arm_math.h>
+#else
+#define MIX_KERNEL_SCALAR
+#endif
+
+static const int32_t kResampleRound = 1 << 13;  //< rounds the Q14 sum of products
+static const uint32_t kResamplePhaseMask = (1 << MIX_RESAMPLE_PHASE_BITS) - 1;
+static const int32_t kLimitKnee = 24575;   //< start of the soft-clip curve
+static const int32_t kLimitRange = 16384;  //< input range of the curve, the output reaches 32767 at its end
+
+static const int32_t kDitherRound = 1 << 7;  //< rounds the 24bit value to 16bit
+static const float kFloatTo24 = 8388608.0f;  //< 1.0 in 24bit
+
+static inline int16_t saturate16(int32_t v) {
+    return (v > INT16_MAX) ? INT16_MAX : ((v < INT16_MIN) ? INT16_MIN : (int16_t)v);
+}
+
+static inline int16_t scale16(int16_t s, int32_t gain) {
+    return saturate16(((int32_t)s * gain) >> 14);
+}
+
+static inline int32_t rampStep(int16_t gain_from, int16_t gain_to, size_t frames) {
+    return (int32_t)(((int64_t)(gain_to - gain_from) * 65536) / (int64_t)frames);
+}
+
+static inline int32_t applyGain32(int32_t v, int16_t gain) {
+    return (int32_t)(((int64_t)v * gain) >> 14);
+}
+
+static inline int16_t softClip(int32_t x) {
+    int32_t a = (x < 0) ? -x : x;
+    int32_t t = a - kLimitKnee;
+    t = (t < 0) ? 0 : ((t > kLimitRange) ? kLimitRange : t);
+    int32_t y = a - ((t * t) >> 15);
+    return saturate16((x < 0) ? -y : y);
+}
+
+/**
+ * @brief ramp from the accumulated gain `acc` (Q14 << 16)
+ */
+static void rampScalar(int16_t* dst, const int16_t* src, size_t frames, int channels, int32_t acc, int32_t step) {
+    for (size_t k = 0; k < frames; k++) {
+        int32_t gain = acc >> 16;
+        for (int c = 0; c < channels; c++) {
+            *dst = saturate16(*dst + scale16(*src, gain));
+            dst++;
+            src++;
+        }
+        acc += step;
+    }
+}
+
+static void accumulateRampScalar(int32_t* bus, const int16_t* src, size_t frames, int channels, int32_t acc, int32_t step) {
+    for (size_t k = 0; k < frames; k++) {
+        int32_t gain = acc >> 16;
+        for (int c = 0; c < channels; c++) {
+            *bus += ((int32_t)*src * gain) >> 14;
+            bus++;
+            src++;
+        }
+        acc += step;
+    }
+}
+
+static void accumulatePanScalar(int32_t* bus, const int16_t* src, size_t frames, int32_t acc_l, int32_t step_l, int32_t acc_r, int32_t step_r) {
+    for (size_t k = 0; k < frames; k++) {
+        bus[0] += ((int32_t)src[0] * (acc_l >> 16)) >> 14;
+        bus[1] += ((int32_t)src[1] * (acc_r >> 16)) >> 14;
+        bus += 2;
+        src += 2;
+        acc_l += step_l;
+        acc_r += step_r;
+    }
+}
+
+void mixSaturate16Scalar(int16_t* dst, const int16_t* src, size_t samples) {
+    for (size_t i = 0; i < samples; i++) {
+        dst[i] = saturate16(dst[i] + src[i]);
+    }
+}
+
+void mixGain16Scalar(int16_t* dst, const int16_t* src, size_t samples, int16_t gain) {
+    for (size_t i = 0; i < samples; i++) {
+        dst[i] = saturate16(dst[i] + scale16(src[i], gain));
+    }
+}
+
+void mixRamp16Scalar(int16_t* dst, const int16_t* src, size_t frames, int channels, int16_t gain_from, int16_t gain_to) {
+    if (frames == 0) {
+        return;
+    }
+    rampScalar(dst, src, frames, channels, gain_from * 65536, rampStep(gain_from, gain_to, frames));
+}
+
+void mixAccumulate32Scalar(int32_t* bus, const int16_t* src, size_t samples) {
+    for (size_t i = 0; i < samples; i++) {
+        bus[i] += src[i];
+    }
+}
+
+void mixAccumulateRamp32Scalar(int32_t* bus, const int16_t* src, size_t frames, int channels, int16_t gain_from, int16_t gain_to) {
+    if (frames == 0) {
+        return;
+    }
+    accumulateRampScalar(bus, src, frames, channels, gain_from * 65536, rampStep(gain_from, gain_to, frames));
+}
+
+void mixAccumulatePan32Scalar(int32_t* bus, const int16_t* src, size_t frames, int16_t left_from, int16_t left_to, int16_t right_from, int16_t right_to) {
+    if (frames == 0) {
+        return;
+    }
+    accumulatePanScalar(bus, src, frames, left_from * 65536, rampStep(left_from, left_to, frames), right_from * 65536,
+                        rampStep(right_from, right_to, frames));
+}
+
+void mixLimit16Scalar(int16_t* dst, const int32_t* bus, size_t samples, int16_t gain) {
+    for (size_t i = 0; i < samples; i++) {
+        dst[i] = softClip(applyGain32(bus[i], gain));
+    }
+}
+
+uint32_t mixResample16Scalar(int16_t* dst, const int16_t* src, size_t frames, uint32_t pos, uint32_t step, const int16_t* table, int taps) {
+    for (size_t k = 0; k < frames; k++) {
+        const int16_t* s = &src[(pos >> 16) * 2];
+        const int16_t* c = &table[((pos >> (16 - MIX_RESAMPLE_PHASE_BITS)) & kResamplePhaseMask) * taps];
+        int32_t l = kResampleRound;
+        int32_t r = kResampleRound;
+        for (int j = 0; j < taps; j++) {
+            l += (int32_t)s[j * 2 + 0] * c[j];
+            r += (int32_t)s[j * 2 + 1] * c[j];
+        }
+        dst[0] = saturate16(l >> 14);
+        dst[1] = saturate16(r >> 14);
+        dst += 2;
+        pos += step;
+    }
+    return pos;
+}
+
+void mixUpmix16Scalar(int16_t* dst, const int16_t* src, size_t frames) {
+    for (size_t k = 0; k < frames; k++) {
+        dst[k * 2 + 0] = src[k];
+        dst[k * 2 + 1] = src[k];
+    }
+}
+
+// triangular dither of +-1 LSB at 16bit from two 8bit draws of one LCG step
+static inline int32_t ditherTpdf(uint32_t* state) {
+    *state = *state * 1664525U + 1013904223U;
+    return (int32_t)(*state >> 24) - (int32_t)((*state >> 16) & 0xFF);
+}
+
+static inline int16_t dither24(int32_t x, uint32_t* state) {
+    return saturate16((x + ditherTpdf(state) + kDitherRound) >> 8);
+}
+
+#if defined(MIX_KERNEL_HELIUM)
+
+const char* getMixKernelName() {
+    return "helium";
+}
+
+static inline int16x8_t scaleVector(int16x8_t s, int16x8_t g) {
+    int32x4_t pb = vshrq_n_s32(vmullbq_int_s16(s, g), 14);
+    int32x4_t pt = vshrq_n_s32(vmulltq_int_s16(s, g), 14);
+    return vqmovntq_s32(vqmovnbq_s32(vuninitializedq_s16(), pb), pt);
+}
+
+void mixSaturate16(int16_t* dst, const int16_t* src, size_t samples) {
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        vst1q_s16(&dst[i], vqaddq_s16(vld1q_s16(&dst[i]), vld1q_s16(&src[i])));
+    }
+    mixSaturate16Scalar(&dst[i], &src[i], samples - i);
+}
+
+void mixGain16(int16_t* dst, const int16_t* src, size_t samples, int16_t gain) {
+    int16x8_t g = vdupq_n_s16(gain);
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        vst1q_s16(&dst[i], vqaddq_s16(vld1q_s16(&dst[i]), scaleVector(vld1q_s16(&src[i]), g)));
+    }
+    mixGain16Scalar(&dst[i], &src[i], samples - i, gain);
+}
+
+void mixRamp16(int16_t* dst, const int16_t* src, size_t frames, int channels, int16_t gain_from, int16_t gain_to) {
+    if (frames == 0) {
+        return;
+    }
+    int32_t acc = gain_from * 65536;
+    int32_t step = rampStep(gain_from, gain_to, frames);
+    size_t k = 0;
+    if (channels == 2 && frames >= 4) {
+        const int32_t offsets[4] = {0, step, step * 2, step * 3};
+        int32x4_t accv = vaddq_s32(vdupq_n_s32(acc), vld1q_s32(offsets));
+        int32x4_t stepv = vdupq_n_s32(step * 4);
+        for (; k + 4 <= frames; k += 4) {
+            int32x4_t g32 = vshrq_n_s32(accv, 16);
+            int16x8_t g = vmovntq_s32(vmovnbq_s32(vuninitializedq_s16(), g32), g32);
+            vst1q_s16(&dst[k * 2], vqaddq_s16(vld1q_s16(&dst[k * 2]), scaleVector(vld1q_s16(&src[k * 2]), g)));
+            accv = vaddq_s32(accv, stepv);
+        }
+        acc += step * (int32_t)k;
+    }
+    rampScalar(&dst[k * channels], &src[k * channels], frames - k, channels, acc, step);
+}
+
+void mixAccumulate32(int32_t* bus, const int16_t* src, size_t samples) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        vst1q_s32(&bus[i], vaddq_s32(vld1q_s32(&bus[i]), vldrhq_s32(&src[i])));
+    }
+    mixAccumulate32Scalar(&bus[i], &src[i], samples - i);
+}
+
+void mixAccumulatePan32(int32_t* bus, const int16_t* src, size_t frames, int16_t left_from, int16_t left_to, int16_t right_from, int16_t right_to) {
+    if (frames == 0) {
+        return;
+    }
+    int32_t acc_l = left_from * 65536;
+    int32_t acc_r = right_from * 65536;
+    int32_t step_l = rampStep(left_from, left_to, frames);
+    int32_t step_r = rampStep(right_from, right_to, frames);
+    size_t k = 0;
+    if (frames >= 2) {
+        const int32_t start[4] = {acc_l, acc_r, acc_l + step_l, acc_r + step_r};
+        const int32_t step[4] = {step_l * 2, step_r * 2, step_l * 2, step_r * 2};
+        int32x4_t accv = vld1q_s32(start);
+        int32x4_t stepv = vld1q_s32(step);
+        for (; k + 2 <= frames; k += 2) {
+            int32x4_t p = vshrq_n_s32(vmulq_s32(vldrhq_s32(&src[k * 2]), vshrq_n_s32(accv, 16)), 14);
+            vst1q_s32(&bus[k * 2], vaddq_s32(vld1q_s32(&bus[k * 2]), p));
+            accv = vaddq_s32(accv, stepv);
+        }
+        acc_l += step_l * (int32_t)k;
+        acc_r += step_r * (int32_t)k;
+    }
+    accumulatePanScalar(&bus[k * 2], &src[k * 2], frames - k, acc_l, step_l, acc_r, step_r);
+}
+
+void mixLimit16(int16_t* dst, const int32_t* bus, size_t samples, int16_t gain) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        int32x4_t b = vld1q_s32(&bus[i]);
+        // (bus * gain) >> 14 without a 64-bit product
+        int32x4_t x = vaddq_s32(vmulq_n_s32(vshrq_n_s32(b, 14), gain), vshrq_n_s32(vmulq_n_s32(vandq_s32(b, vdupq_n_s32(0x3FFF)), gain), 14));
+        int32x4_t a = vabsq_s32(x);
+        int32x4_t t = vminq_s32(vmaxq_s32(vsubq_s32(a, vdupq_n_s32(kLimitKnee)), vdupq_n_s32(0)), vdupq_n_s32(kLimitRange));
+        int32x4_t y = vsubq_s32(a, vshrq_n_s32(vmulq_s32(t, t), 15));
+        int32x4_t sign = vshrq_n_s32(x, 31);
+        y = vsubq_s32(veorq_s32(y, sign), sign);
+        y = vminq_s32(vmaxq_s32(y, vdupq_n_s32(INT16_MIN)), vdupq_n_s32(INT16_MAX));
+        vstrhq_s32(&dst[i], y);
+    }
+    mixLimit16Scalar(&dst[i], &bus[i], samples - i, gain);
+}
+
+#elif defined(MIX_KERNEL_NEON)
+
+const char* getMixKernelName() {
+    return "neon";
+}
+
+static inline int16x8_t scaleVector(int16x8_t s, int16x4_t g_lo, int16x4_t g_hi) {
+    int32x4_t lo = vshrq_n_s32(vmull_s16(vget_low_s16(s), g_lo), 14);
+    int32x4_t hi = vshrq_n_s32(vmull_s16(vget_high_s16(s), g_hi), 14);
+    return vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi));
+}
+
+void mixSaturate16(int16_t* dst, const int16_t* src, size_t samples) {
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        vst1q_s16(&dst[i], vqaddq_s16(vld1q_s16(&dst[i]), vld1q_s16(&src[i])));
+    }
+    mixSaturate16Scalar(&dst[i], &src[i], samples - i);
+}
+
+void mixGain16(int16_t* dst, const int16_t* src, size_t samples, int16_t gain) {
+    int16x4_t g = vdup_n_s16(gain);
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        vst1q_s16(&dst[i], vqaddq_s16(vld1q_s16(&dst[i]), scaleVector(vld1q_s16(&src[i]), g, g)));
+    }
+    mixGain16Scalar(&dst[i], &src[i], samples - i, gain);
+}
+
+void mixRamp16(int16_t* dst, const int16_t* src, size_t frames, int channels, int16_t gain_from, int16_t gain_to) {
+    if (frames == 0) {
+        return;
+    }
+    int32_t acc = gain_from * 65536;
+    int32_t step = rampStep(gain_from, gain_to, frames);
+    size_t k = 0;
+    if (channels == 2 && frames >= 4) {
+        const int32_t offsets[4] = {0, step, step * 2, step * 3};
+        int32x4_t accv = vaddq_s32(vdupq_n_s32(acc), vld1q_s32(offsets));
+        int32x4_t stepv = vdupq_n_s32(step * 4);
+        for (; k + 4 <= frames; k += 4) {
+            int16x4_t g = vmovn_s32(vshrq_n_s32(accv, 16));
+            int16x4x2_t gg = vzip_s16(g, g);
+            vst1q_s16(&dst[k * 2], vqaddq_s16(vld1q_s16(&dst[k * 2]), scaleVector(vld1q_s16(&src[k * 2]), gg.val[0], gg.val[1])));
+            accv = vaddq_s32(accv, stepv);
+        }
+        acc += step * (int32_t)k;
+    }
+    rampScalar(&dst[k * channels], &src[k * channels], frames - k, channels, acc, step);
+}
+
+void mixAccumulate32(int32_t* bus, const int16_t* src, size_t samples) {
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        int16x8_t s = vld1q_s16(&src[i]);
+        vst1q_s32(&bus[i], vaddw_s16(vld1q_s32(&bus[i]), vget_low_s16(s)));
+        vst1q_s32(&bus[i + 4], vaddw_s16(vld1q_s32(&bus[i + 4]), vget_high_s16(s)));
+    }
+    mixAccumulate32Scalar(&bus[i], &src[i], samples - i);
+}
+
+void mixAccumulatePan32(int32_t* bus, const int16_t* src, size_t frames, int16_t left_from, int16_t left_to, int16_t right_from, int16_t right_to) {
+    if (frames == 0) {
+        return;
+    }
+    int32_t acc_l = left_from * 65536;
+    int32_t acc_r = right_from * 65536;
+    int32_t step_l = rampStep(left_from, left_to, frames);
+    int32_t step_r = rampStep(right_from, right_to, frames);
+    size_t k = 0;
+    if (frames >= 4) {
+        const int32_t start[8] = {acc_l, acc_r, acc_l + step_l, acc_r + step_r, acc_l + step_l * 2, acc_r + step_r * 2, acc_l + step_l * 3, acc_r + step_r * 3};
+        const int32_t step[4] = {step_l * 4, step_r * 4, step_l * 4, step_r * 4};
+        int32x4_t acc0 = vld1q_s32(&start[0]);
+        int32x4_t acc1 = vld1q_s32(&start[4]);
+        int32x4_t stepv = vld1q_s32(step);
+        for (; k + 4 <= frames; k += 4) {
+            int16x8_t s = vld1q_s16(&src[k * 2]);
+            int32x4_t lo = vshrq_n_s32(vmull_s16(vget_low_s16(s), vmovn_s32(vshrq_n_s32(acc0, 16))), 14);
+            int32x4_t hi = vshrq_n_s32(vmull_s16(vget_high_s16(s), vmovn_s32(vshrq_n_s32(acc1, 16))), 14);
+            vst1q_s32(&bus[k * 2], vaddq_s32(vld1q_s32(&bus[k * 2]), lo));
+            vst1q_s32(&bus[k * 2 + 4], vaddq_s32(vld1q_s32(&bus[k * 2 + 4]), hi));
+            acc0 = vaddq_s32(acc0, stepv);
+            acc1 = vaddq_s32(acc1, stepv);
+        }
+        acc_l += step_l * (int32_t)k;
+        acc_r += step_r * (int32_t)k;
+    }
+    accumulatePanScalar(&bus[k * 2], &src[k * 2], frames - k, acc_l, step_l, acc_r, step_r);
+}
+
+static inline int16x4_t limitVector(int32x4_t b, int16_t gain) {
+    // (bus * gain) >> 14 without a 64-bit product
+    int32x4_t x = vaddq_s32(vmulq_n_s32(vshrq_n_s32(b, 14), gain), vshrq_n_s32(vmulq_n_s32(vandq_s32(b, vdupq_n_s32(0x3FFF)), gain), 14));
+    int32x4_t a = vabsq_s32(x);
+    int32x4_t t = vminq_s32(vmaxq_s32(vsubq_s32(a, vdupq_n_s32(kLimitKnee)), vdupq_n_s32(0)), vdupq_n_s32(kLimitRange));
+    int32x4_t y = vsubq_s32(a, vshrq_n_s32(vmulq_s32(t, t), 15));
+    int32x4_t sign = vshrq_n_s32(x, 31);
+    return vqmovn_s32(vsubq_s32(veorq_s32(y, sign), sign));
+}
+
+void mixLimit16(int16_t* dst, const int32_t* bus, size_t samples, int16_t gain) {
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        vst1q_s16(&dst[i], vcombine_s16(limitVector(vld1q_s32(&bus[i]), gain), limitVector(vld1q_s32(&bus[i + 4]), gain)));
+    }
+    mixLimit16Scalar(&dst[i], &bus[i], samples - i, gain);
+}
+
+#elif defined(MIX_KERNEL_AVX2)
+
+const char* getMixKernelName() {
+    return "avx2";
+}
+
+static inline __m256i scaleVector(__m256i s, __m256i g) {
+    __m256i lo = _mm256_mullo_epi16(s, g);
+    __m256i hi = _mm256_mulhi_epi16(s, g);
+    __m256i p0 = _mm256_srai_epi32(_mm256_unpacklo_epi16(lo, hi), 14);
+    __m256i p1 = _mm256_srai_epi32(_mm256_unpackhi_epi16(lo, hi), 14);
+    return _mm256_packs_epi32(p0, p1);
+}
+
+void mixSaturate16(int16_t* dst, const int16_t* src, size_t samples) {
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&dst[i]));
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i]), _mm256_adds_epi16(d, s));
+    }
+    mixSaturate16Scalar(&dst[i], &src[i], samples - i);
+}
+
+void mixGain16(int16_t* dst, const int16_t* src, size_t samples, int16_t gain) {
+    __m256i g = _mm256_set1_epi16(gain);
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&dst[i]));
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i]), _mm256_adds_epi16(d, scaleVector(s, g)));
+    }
+    mixGain16Scalar(&dst[i], &src[i], samples - i, gain);
+}
+
+void mixRamp16(int16_t* dst, const int16_t* src, size_t frames, int channels, int16_t gain_from, int16_t gain_to) {
+    if (frames == 0) {
+        return;
+    }
+    int32_t acc = gain_from * 65536;
+    int32_t step = rampStep(gain_from, gain_to, frames);
+    size_t k = 0;
+    if (channels == 2 && frames >= 8) {
+        __m256i accv = _mm256_add_epi32(_mm256_set1_epi32(acc), _mm256_mullo_epi32(_mm256_set1_epi32(step), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+        __m256i stepv = _mm256_set1_epi32(step * 8);
+        for (; k + 8 <= frames; k += 8) {
+            __m256i g32 = _mm256_srai_epi32(accv, 16);
+            __m256i g16 = _mm256_packs_epi32(g32, g32);
+            __m256i g = _mm256_unpacklo_epi16(g16, g16);
+            __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&dst[k * 2]));
+            __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[k * 2]));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[k * 2]), _mm256_adds_epi16(d, scaleVector(s, g)));
+            accv = _mm256_add_epi32(accv, stepv);
+        }
+        acc += step * (int32_t)k;
+    }
+    rampScalar(&dst[k * channels], &src[k * channels], frames - k, channels, acc, step);
+}
+
+void mixAccumulate32(int32_t* bus, const int16_t* src, size_t samples) {
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&bus[i]));
+        __m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i])));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&bus[i]), _mm256_add_epi32(b, s));
+    }
+    mixAccumulate32Scalar(&bus[i], &src[i], samples - i);
+}
+
+void mixAccumulatePan32(int32_t* bus, const int16_t* src, size_t frames, int16_t left_from, int16_t left_to, int16_t right_from, int16_t right_to) {
+    if (frames == 0) {
+        return;
+    }
+    int32_t acc_l = left_from * 65536;
+    int32_t acc_r = right_from * 65536;
+    int32_t step_l = rampStep(left_from, left_to, frames);
+    int32_t step_r = rampStep(right_from, right_to, frames);
+    size_t k = 0;
+    if (frames >= 4) {
+        __m256i stepv = _mm256_setr_epi32(step_l, step_r, step_l, step_r, step_l, step_r, step_l, step_r);
+        __m256i accv = _mm256_add_epi32(_mm256_setr_epi32(acc_l, acc_r, acc_l, acc_r, acc_l, acc_r, acc_l, acc_r),
+                                        _mm256_mullo_epi32(stepv, _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3)));
+        stepv = _mm256_slli_epi32(stepv, 2);
+        for (; k + 4 <= frames; k += 4) {
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&bus[k * 2]));
+            __m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[k * 2])));
+            __m256i p = _mm256_srai_epi32(_mm256_mullo_epi32(s, _mm256_srai_epi32(accv, 16)), 14);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&bus[k * 2]), _mm256_add_epi32(b, p));
+            accv = _mm256_add_epi32(accv, stepv);
+        }
+        acc_l += step_l * (int32_t)k;
+        acc_r += step_r * (int32_t)k;
+    }
+    accumulatePanScalar(&bus[k * 2], &src[k * 2], frames - k, acc_l, step_l, acc_r, step_r);
+}
+
+static inline __m256i limitVector(__m256i b, __m256i g) {
+    // (bus * gain) >> 14 without a 64-bit product
+    __m256i hi = _mm256_mullo_epi32(_mm256_srai_epi32(b, 14), g);
+    __m256i lo = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_and_si256(b, _mm256_set1_epi32(0x3FFF)), g), 14);
+    __m256i x = _mm256_add_epi32(hi, lo);
+    __m256i a = _mm256_abs_epi32(x);
+    __m256i t = _mm256_min_epi32(_mm256_max_epi32(_mm256_sub_epi32(a, _mm256_set1_epi32(kLimitKnee)), _mm256_setzero_si256()), _mm256_set1_epi32(kLimitRange));
+    __m256i y = _mm256_sub_epi32(a, _mm256_srai_epi32(_mm256_mullo_epi32(t, t), 15));
+    return _mm256_sign_epi32(y, x);
+}
+
+void mixLimit16(int16_t* dst, const int32_t* bus, size_t samples, int16_t gain) {
+    __m256i g = _mm256_set1_epi32(gain);
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        __m256i y0 = limitVector(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&bus[i])), g);
+        __m256i y1 = limitVector(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&bus[i + 8])), g);
+        // packs works per 128-bit lane, so restore the sample order
+        __m256i y = _mm256_permute4x64_epi64(_mm256_packs_epi32(y0, y1), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i]), y);
+    }
+    mixLimit16Scalar(&dst[i], &bus[i], samples - i, gain);
+}
+
+#elif defined(MIX_KERNEL_SSE2)
+
+const char* getMixKernelName() {
+    return "sse2";
+}
+
+static inline __m128i scaleVector(__m128i s, __m128i g) {
+    __m128i lo = _mm_mullo_epi16(s, g);
+    __m128i hi = _mm_mulhi_epi16(s, g);
+    __m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 14);
+    __m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 14);
+    return _mm_packs_epi32(p0, p1);
+}
+
+void mixSaturate16(int16_t* dst, const int16_t* src, size_t samples) {
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dst[i]));
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i]), _mm_adds_epi16(d, s));
+    }
+    mixSaturate16Scalar(&dst[i], &src[i], samples - i);
+}
+
+void mixGain16(int16_t* dst, const int16_t* src, size_t samples, int16_t gain) {
+    __m128i g = _mm_set1_epi16(gain);
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dst[i]));
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i]), _mm_adds_epi16(d, scaleVector(s, g)));
+    }
+    mixGain16Scalar(&dst[i], &src[i], samples - i, gain);
+}
+
+void mixRamp16(int16_t* dst, const int16_t* src, size_t frames, int channels, int16_t gain_from, int16_t gain_to) {
+    if (frames == 0) {
+        return;
+    }
+    int32_t acc = gain_from * 65536;
+    int32_t step = rampStep(gain_from, gain_to, frames);
+    size_t k = 0;
+    if (channels == 2 && frames >= 4) {
+        __m128i accv = _mm_setr_epi32(acc, acc + step, acc + step * 2, acc + step * 3);
+        __m128i stepv = _mm_set1_epi32(step * 4);
+        for (; k + 4 <= frames; k += 4) {
+            __m128i g32 = _mm_srai_epi32(accv, 16);
+            __m128i g16 = _mm_packs_epi32(g32, g32);
+            __m128i g = _mm_unpacklo_epi16(g16, g16);
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dst[k * 2]));
+            __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[k * 2]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[k * 2]), _mm_adds_epi16(d, scaleVector(s, g)));
+            accv = _mm_add_epi32(accv, stepv);
+        }
+        acc += step * (int32_t)k;
+    }
+    rampScalar(&dst[k * channels], &src[k * channels], frames - k, channels, acc, step);
+}
+
+void mixAccumulate32(int32_t* bus, const int16_t* src, size_t samples) {
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
+        __m128i s0 = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i s1 = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&bus[i]));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&bus[i + 4]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&bus[i]), _mm_add_epi32(b0, s0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&bus[i + 4]), _mm_add_epi32(b1, s1));
+    }
+    mixAccumulate32Scalar(&bus[i], &src[i], samples - i);
+}
+
+void mixAccumulatePan32(int32_t* bus, const int16_t* src, size_t frames, int16_t left_from, int16_t left_to, int16_t right_from, int16_t right_to) {
+    if (frames == 0) {
+        return;
+    }
+    int32_t acc_l = left_from * 65536;
+    int32_t acc_r = right_from * 65536;
+    int32_t step_l = rampStep(left_from, left_to, frames);
+    int32_t step_r = rampStep(right_from, right_to, frames);
+    size_t k = 0;
+    if (frames >= 4) {
+        __m128i acc0 = _mm_setr_epi32(acc_l, acc_r, acc_l + step_l, acc_r + step_r);
+        __m128i acc1 = _mm_setr_epi32(acc_l + step_l * 2, acc_r + step_r * 2, acc_l + step_l * 3, acc_r + step_r * 3);
+        __m128i stepv = _mm_setr_epi32(step_l * 4, step_r * 4, step_l * 4, step_r * 4);
+        for (; k + 4 <= frames; k += 4) {
+            // gains of 4 frames in the sample order: L0 R0 L1 R1 L2 R2 L3 R3
+            __m128i g = _mm_packs_epi32(_mm_srai_epi32(acc0, 16), _mm_srai_epi32(acc1, 16));
+            __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[k * 2]));
+            __m128i lo = _mm_mullo_epi16(s, g);
+            __m128i hi = _mm_mulhi_epi16(s, g);
+            __m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 14);
+            __m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 14);
+            __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&bus[k * 2]));
+            __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&bus[k * 2 + 4]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&bus[k * 2]), _mm_add_epi32(b0, p0));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&bus[k * 2 + 4]), _mm_add_epi32(b1, p1));
+            acc0 = _mm_add_epi32(acc0, stepv);
+            acc1 = _mm_add_epi32(acc1, stepv);
+        }
+        acc_l += step_l * (int32_t)k;
+        acc_r += step_r * (int32_t)k;
+    }
+    accumulatePanScalar(&bus[k * 2], &src[k * 2], frames - k, acc_l, step_l, acc_r, step_r);
+}
+
+static inline __m128i limitVector(__m128i b, __m128i g) {
+    // SSE2 has no 32-bit multiply, so split the bus into (b >> 14) and (b & 0x3FFF);
+    // both halves fit in 16 bits and _mm_madd_epi16 with (gain, 0) pairs multiplies them as 32-bit lanes
+    __m128i hi = _mm_madd_epi16(_mm_srai_epi32(b, 14), g);
+    __m128i lo = _mm_srai_epi32(_mm_madd_epi16(_mm_and_si128(b, _mm_set1_epi32(0x3FFF)), g), 14);
+    __m128i x = _mm_add_epi32(hi, lo);
+    __m128i sign = _mm_srai_epi32(x, 31);
+    __m128i a = _mm_sub_epi32(_mm_xor_si128(x, sign), sign);
+    __m128i t = _mm_sub_epi32(a, _mm_set1_epi32(kLimitKnee));
+    t = _mm_andnot_si128(_mm_srai_epi32(t, 31), t);
+    __m128i over = _mm_cmpgt_epi32(t, _mm_set1_epi32(kLimitRange));
+    t = _mm_or_si128(_mm_andnot_si128(over, t), _mm_and_si128(over, _mm_set1_epi32(kLimitRange)));
+    __m128i y = _mm_sub_epi32(a, _mm_srai_epi32(_mm_madd_epi16(t, t), 15));
+    return _mm_sub_epi32(_mm_xor_si128(y, sign), sign);
+}
+
+void mixLimit16(int16_t* dst, const int32_t* bus, size_t samples, int16_t gain) {
+    __m128i g = _mm_set1_epi32((uint16_t)gain);
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m128i y0 = limitVector(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&bus[i])), g);
+        __m128i y1 = limitVector(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&bus[i + 4])), g);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i]), _mm_packs_epi32(y0, y1));
+    }
+    mixLimit16Scalar(&dst[i], &bus[i], samples - i, gain);
+}
+
+#elif defined(MIX_KERNEL_DSP)
+
+const char* getMixKernelName() {
+    return "dsp";
+}
+
+void mixSaturate16(int16_t* dst, const int16_t* src, size_t samples) {
+    size_t i = 0;
+    for (; i + 2 <= samples; i += 2) {
+        *((uint32_t*)&dst[i]) = __QADD16(*((uint32_t*)&dst[i]), *((uint32_t*)&src[i]));
+    }
+    mixSaturate16Scalar(&dst[i], &src[i], samples - i);
+}
+
+void mixGain16(int16_t* dst, const int16_t* src, size_t samples, int16_t gain) {
+    for (size_t i = 0; i < samples; i++) {
+        dst[i] = __SSAT(dst[i] + __SSAT(((int32_t)src[i] * gain) >> 14, 16), 16);
+    }
+}
+
+void mixRamp16(int16_t* dst, const int16_t* src, size_t frames, int channels, int16_t gain_from, int16_t gain_to) {
+    mixRamp16Scalar(dst, src, frames, channels, gain_from, gain_to);
+}
+
+void mixAccumulate32(int32_t* bus, const int16_t* src, size_t samples) {
+    mixAccumulate32Scalar(bus, src, samples);
+}
+
+void mixAccumulatePan32(int32_t* bus, const int16_t* src, size_t frames, int16_t left_from, int16_t left_to, int16_t right_from, int16_t right_to) {
+    mixAccumulatePan32Scalar(bus, src, frames, left_from, left_to, right_from, right_to);
+}
+
+void mixLimit16(int16_t* dst, const int32_t* bus, size_t samples, int16_t gain) {
+    mixLimit16Scalar(dst, bus, samples, gain);
+}
+
+#else  // MIX_KERNEL_SCALAR
+
+const char* getMixKernelName() {
+    return "scalar";
+}
+
+void mixSaturate16(int16_t* dst, const int16_t* src, size_t samples) {
+    mixSaturate16Scalar(dst, src, samples);
+}
+
+void mixGain16(int16_t* dst, const int16_t* src, size_t samples, int16_t gain) {
+    mixGain16Scalar(dst, src, samples, gain);
+}
+
+void mixRamp16(int16_t* dst, const int16_t* src, size_t frames, int channels, int16_t gain_from, int16_t gain_to) {
+    mixRamp16Scalar(dst, src, frames, channels, gain_from, gain_to);
+}
+
+void mixAccumulate32(int32_t* bus, const int16_t* src, size_t samples) {
+    mixAccumulate32Scalar(bus, src, samples);
+}
+
+void mixAccumulatePan32(int32_t* bus, const int16_t* src, size_t frames, int16_t left_from, int16_t left_to, int16_t right_from, int16_t right_to) {
+    mixAccumulatePan32Scalar(bus, src, frames, left_from, left_to, right_from, right_to);
+}
+
+void mixLimit16(int16_t* dst, const int32_t* bus, size_t samples, int16_t gain) {
+    mixLimit16Scalar(dst, bus, samples, gain);
+}
+
+#endif
+
+// one dot product per output frame: the taps of both channels are summed in vector lanes
+#if defined(MIX_KERNEL_AVX2) || defined(MIX_KERNEL_SSE2)
+
+// L0 R0 L1 R1 L2 R2 L3 R3 -> L0 L1 R0 R1 L2 L3 R2 R3, so that _mm_madd_epi16() sums a pair of taps per channel
+static inline __m128i pairChannels(__m128i v) {
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 1, 2, 0));
+    return _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+uint32_t mixResample16(int16_t* dst, const int16_t* src, size_t frames, uint32_t pos, uint32_t step, const int16_t* table, int taps) {
+    if (taps != 2 && taps != 4 && taps != 8) {
+        return mixResample16Scalar(dst, src, frames, pos, step, table, taps);
+    }
+    const __m128i round = _mm_set1_epi32(kResampleRound);
+    for (size_t k = 0; k < frames; k++) {
+        const int16_t* s = &src[(pos >> 16) * 2];
+        const int16_t* c = &table[((pos >> (16 - MIX_RESAMPLE_PHASE_BITS)) & kResamplePhaseMask) * taps];
+        __m128i acc;
+        if (taps == 2) {
+            int32_t c01 = 0;
+            memcpy(&c01, c, sizeof(c01));
+            // [L, R, 0, 0]
+            acc = _mm_madd_epi16(pairChannels(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s))), _mm_set1_epi32(c01));
+        } else {
+            // c0 c1 c2 c3 (c4 c5 c6 c7) -> c0 c1 c0 c1 c2 c3 c2 c3 (c4 c5 c4 c5 c6 c7 c6 c7)
+            __m128i cv = (taps == 4) ? _mm_loadl_epi64(reinterpret_cast<const __m128i*>(c)) : _mm_loadu_si128(reinterpret_cast<const __m128i*>(c));
+            acc = _mm_madd_epi16(pairChannels(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s))), _mm_unpacklo_epi32(cv, cv));
+            if (taps == 8) {
+                __m128i hi = _mm_madd_epi16(pairChannels(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&s[8]))), _mm_unpackhi_epi32(cv, cv));
+                acc = _mm_add_epi32(acc, hi);
+            }
+            // [L01, R01, L23, R23] -> [L, R, ...]
+            acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+        }
+        acc = _mm_srai_epi32(_mm_add_epi32(acc, round), 14);
+        int32_t lr = _mm_cvtsi128_si32(_mm_packs_epi32(acc, acc));
+        memcpy(dst, &lr, sizeof(lr));
+        dst += 2;
+        pos += step;
+    }
+    return pos;
+}
+
+#elif defined(MIX_KERNEL_NEON)
+
+uint32_t mixResample16(int16_t* dst, const int16_t* src, size_t frames, uint32_t pos, uint32_t step, const int16_t* table, int taps) {
+    if (taps != 4 && taps != 8) {
+        return mixResample16Scalar(dst, src, frames, pos, step, table, taps);
+    }
+    for (size_t k = 0; k < frames; k++) {
+        const int16_t* s = &src[(pos >> 16) * 2];
+        const int16_t* c = &table[((pos >> (16 - MIX_RESAMPLE_PHASE_BITS)) & kResamplePhaseMask) * taps];
+        int16x4x2_t v = vld2_s16(s);
+        int16x4_t cv = vld1_s16(c);
+        int32x4_t l = vmull_s16(v.val[0], cv);
+        int32x4_t r = vmull_s16(v.val[1], cv);
+        if (taps == 8) {
+            v = vld2_s16(&s[8]);
+            cv = vld1_s16(&c[4]);
+            l = vmlal_s16(l, v.val[0], cv);
+            r = vmlal_s16(r, v.val[1], cv);
+        }
+        int32x2_t sum = vpadd_s32(vpadd_s32(vget_low_s32(l), vget_high_s32(l)), vpadd_s32(vget_low_s32(r), vget_high_s32(r)));
+        // rounding shift with saturation, the same as the scalar code
+        int16x4_t out = vqrshrn_n_s32(vcombine_s32(sum, sum), 14);
+        vst1_lane_s32(reinterpret_cast<int32_t*>(dst), vreinterpret_s32_s16(out), 0);
+        dst += 2;
+        pos += step;
+    }
+    return pos;
+}
+
+#elif defined(MIX_KERNEL_DSP)
+
+uint32_t mixResample16(int16_t* dst, const int16_t* src, size_t frames, uint32_t pos, uint32_t step, const int16_t* table, int taps) {
+    if ((taps & 1) != 0) {
+        return mixResample16Scalar(dst, src, frames, pos, step, table, taps);
+    }
+    for (size_t k = 0; k < frames; k++) {
+        // a stereo frame is one word (R << 16 | L), a pair of coefficients is one word (c1 << 16 | c0)
+        const uint32_t* s = (const uint32_t*)&src[(pos >> 16) * 2];
+        const uint32_t* c = (const uint32_t*)&table[((pos >> (16 - MIX_RESAMPLE_PHASE_BITS)) & kResamplePhaseMask) * taps];
+        int32_t l = kResampleRound;
+        int32_t r = kResampleRound;
+        for (int j = 0; j < taps; j += 2) {
+            l = __SMLAD(__PKHBT(s[j], s[j + 1], 16), c[j / 2], l);
+            r = __SMLAD(__PKHTB(s[j + 1], s[j], 16), c[j / 2], r);
+        }
+        dst[0] = __SSAT(l >> 14, 16);
+        dst[1] = __SSAT(r >> 14, 16);
+        dst += 2;
+        pos += step;
+    }
+    return pos;
+}
+
+#else  // MIX_KERNEL_HELIUM, MIX_KERNEL_SCALAR
+
+uint32_t mixResample16(int16_t* dst, const int16_t* src, size_t frames, uint32_t pos, uint32_t step, const int16_t* table, int taps) {
+    return mixResample16Scalar(dst, src, frames, pos, step, table, taps);
+}
+
+#endif
+
+void mixAccumulateRamp32(int32_t* bus, const int16_t* src, size_t frames, int channels, int16_t gain_from, int16_t gain_to) {
+    if (channels == 2) {
+        mixAccumulatePan32(bus, src, frames, gain_from, gain_to, gain_from, gain_to);
+    } else {
+        mixAccumulateRamp32Scalar(bus, src, frames, channels, gain_from, gain_to);
+    }
+}
+
+#if defined(MIX_KERNEL_AVX2) || defined(MIX_KERNEL_SSE2)
+
+void mixUpmix16(int16_t* dst, const int16_t* src, size_t frames) {
+    size_t k = 0;
+    for (; k + 8 <= frames; k += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[k]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[k * 2]), _mm_unpacklo_epi16(v, v));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[k * 2 + 8]), _mm_unpackhi_epi16(v, v));
+    }
+    mixUpmix16Scalar(&dst[k * 2], &src[k], frames - k);
+}
+
+#elif defined(MIX_KERNEL_NEON)
+
+void mixUpmix16(int16_t* dst, const int16_t* src, size_t frames) {
+    size_t k = 0;
+    for (; k + 8 <= frames; k += 8) {
+        int16x8x2_t v;
+        v.val[0] = vld1q_s16(&src[k]);
+        v.val[1] = v.val[0];
+        vst2q_s16(&dst[k * 2], v);
+    }
+    mixUpmix16Scalar(&dst[k * 2], &src[k], frames - k);
+}
+
+#elif defined(MIX_KERNEL_DSP)
+
+void mixUpmix16(int16_t* dst, const int16_t* src, size_t frames) {
+    size_t k = 0;
+    if (((uintptr_t)src & 3) == 0 && ((uintptr_t)dst & 3) == 0) {
+        // two mono samples are one word (s1 << 16 | s0), a stereo frame is one word
+        const uint32_t* s = (const uint32_t*)src;
+        uint32_t* d = (uint32_t*)dst;
+        for (; k + 2 <= frames; k += 2) {
+            uint32_t w = s[k / 2];
+            d[k + 0] = __PKHBT(w, w, 16);
+            d[k + 1] = __PKHTB(w, w, 16);
+        }
+    }
+    mixUpmix16Scalar(&dst[k * 2], &src[k], frames - k);
+}
+
+#else  // MIX_KERNEL_HELIUM, MIX_KERNEL_SCALAR
+
+void mixUpmix16(int16_t* dst, const int16_t* src, size_t frames) {
+    mixUpmix16Scalar(dst, src, frames);
+}
+
+#endif
+
+// the dither draws one value per sample in order, so the conversions stay scalar on every backend
+void mixConvert24(int16_t* dst, const uint8_t* src, size_t frames, int channels, uint32_t* dither) {
+    for (size_t k = 0; k < frames; k++) {
+        for (int c = 0; c < channels; c++) {
+            // sign extension through the top byte of a 32bit word
+            int32_t x = (int32_t)(((uint32_t)src[0] << 8) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 24)) >> 8;
+            dst[c] = dither24(x, dither);
+            src += 3;
+        }
+        dst[1] = (channels == 1) ? dst[0] : dst[1];
+        dst += 2;
+    }
+}
+
+void mixConvertFloat(int16_t* dst, const uint8_t* src, size_t frames, int channels, uint32_t* dither) {
+    for (size_t k = 0; k < frames; k++) {
+        for (int c = 0; c < channels; c++) {
+            float f = 0.0f;
+            memcpy(&f, src, sizeof(f));
+            // clamped before the conversion to int, which is undefined out of range; NaN fails both comparisons
+            f = (f > 2.0f) ? 2.0f : ((f < -2.0f) ? -2.0f : ((f == f) ? f : 0.0f));
+            dst[c] = dither24((int32_t)(f * kFloatTo24), dither);
+            src += sizeof(f);
+        }
+        dst[1] = (channels == 1) ? dst[0] : dst[1];
+        dst += 2;
+    }
+}
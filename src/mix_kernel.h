@@ -0,0 +1,202 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+/**
+ * @file mix_kernel.h
+ */
+#ifndef MIX_KERNEL_H_
+#define MIX_KERNEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief @~japanese ゲイン 1.0 を表す値です。ゲインは Q14 形式(16384 = 1.0, 最大 32767 = 約 2.0)で指定します。
+ */
+static const int16_t MIX_GAIN_UNITY = 0x4000;
+
+/**
+ * @brief @~japanese 音声データを飽和加算します。
+ * @details @~japanese dst[i] = sat16(dst[i] + src[i])
+ * @param[in,out] dst mixing buffer
+ * @param[in] src source PCM
+ * @param[in] samples number of samples (not frames)
+ */
+void mixSaturate16(int16_t* dst, const int16_t* src, size_t samples);
+
+/**
+ * @brief @~japanese 音声データにゲインを掛けて飽和加算します。
+ * @details @~japanese dst[i] = sat16(dst[i] + sat16((src[i] * gain) >> 14))
+ * @param[in,out] dst mixing buffer
+ * @param[in] src source PCM
+ * @param[in] samples number of samples (not frames)
+ * @param[in] gain Q14 gain
+ */
+void mixGain16(int16_t* dst, const int16_t* src, size_t samples, int16_t gain);
+
+/**
+ * @brief @~japanese 音声データにフレーム単位で直線的に変化するゲインを掛けて飽和加算します。フェードイン・フェードアウトに使います。
+ * @details @~japanese k番目のフレームのゲインは gain_from + (gain_to - gain_from) * k / frames (Q16 で累積) です。
+ * @param[in,out] dst mixing buffer
+ * @param[in] src source PCM (interleaved)
+ * @param[in] frames number of frames
+ * @param[in] channels number of channels per frame
+ * @param[in] gain_from Q14 gain of the first frame
+ * @param[in] gain_to Q14 gain after the last frame
+ */
+void mixRamp16(int16_t* dst, const int16_t* src, size_t frames, int channels, int16_t gain_from, int16_t gain_to);
+
+/**
+ * @brief @~japanese 音声データを32bitのミックスバスに加算します。
+ * @details @~japanese bus[i] += src[i] (飽和しません)
+ * @param[in,out] bus mixing bus
+ * @param[in] src source PCM
+ * @param[in] samples number of samples (not frames)
+ */
+void mixAccumulate32(int32_t* bus, const int16_t* src, size_t samples);
+
+/**
+ * @brief @~japanese 音声データにフレーム単位で直線的に変化するゲインを掛けて32bitのミックスバスに加算します。
+ * @details @~japanese bus[i] += (src[i] * gain) >> 14 (飽和しません)。ゲインの変化は mixRamp16() と同じです。
+ * @param[in,out] bus mixing bus
+ * @param[in] src source PCM (interleaved)
+ * @param[in] frames number of frames
+ * @param[in] channels number of channels per frame
+ * @param[in] gain_from Q14 gain of the first frame
+ * @param[in] gain_to Q14 gain after the last frame
+ */
+void mixAccumulateRamp32(int32_t* bus, const int16_t* src, size_t frames, int channels, int16_t gain_from, int16_t gain_to);
+
+/**
+ * @brief @~japanese ステレオの音声データに左右別々に直線的に変化するゲインを掛けて32bitのミックスバスに加算します。パンに使います。
+ * @details @~japanese 左右それぞれのゲインの変化は mixRamp16() と同じです。
+ * @param[in,out] bus mixing bus
+ * @param[in] src source PCM (interleaved, 2 channels)
+ * @param[in] frames number of frames
+ * @param[in] left_from Q14 gain of the first frame (left)
+ * @param[in] left_to Q14 gain after the last frame (left)
+ * @param[in] right_from Q14 gain of the first frame (right)
+ * @param[in] right_to Q14 gain after the last frame (right)
+ */
+void mixAccumulatePan32(int32_t* bus, const int16_t* src, size_t frames, int16_t left_from, int16_t left_to, int16_t right_from, int16_t right_to);
+
+/**
+ * @brief @~japanese ミックスバスにマスターゲインを掛け、ソフトクリップして16bitに変換します。
+ * @details @~japanese x = (bus[i] * gain) >> 14 の絶対値が 24575 以下ならそのまま出力し、
+ * それを超える範囲は 32767 に滑らかに近づく2次曲線 y = |x| - (t * t >> 15) (t = min(|x| - 24575, 16384)) で圧縮します。
+ * 先読みを必要としないので遅延は増えません。bus の絶対値は 2^29 未満である必要があります。
+ * @param[out] dst output PCM
+ * @param[in] bus mixing bus
+ * @param[in] samples number of samples (not frames)
+ * @param[in] gain Q14 master gain
+ */
+void mixLimit16(int16_t* dst, const int32_t* bus, size_t samples, int16_t gain);
+
+/**
+ * @brief @~japanese mixResample16() の係数表の位相の分割数を表すビット数です。
+ */
+static const int MIX_RESAMPLE_PHASE_BITS = 8;
+
+/**
+ * @brief @~japanese ステレオの音声データを係数表の補間フィルタでリサンプルします。
+ * @details @~japanese k番目の出力フレームの位置 p = pos + step * k (Q16) に対して、 src の (p >> 16) フレーム目から taps フレームに
+ * table の (p >> (16 - MIX_RESAMPLE_PHASE_BITS)) の下位 MIX_RESAMPLE_PHASE_BITS ビット番目の係数 (Q14) を掛けて足し、丸めて飽和させます。
+ * src には最後の出力フレームの位置から taps フレームのデータが必要です。
+ * @param[out] dst output PCM (interleaved, 2 channels)
+ * @param[in] src source PCM (interleaved, 2 channels)
+ * @param[in] frames number of output frames
+ * @param[in] pos Q16 position of the first output frame in src
+ * @param[in] step Q16 source frames per output frame
+ * @param[in] table Q14 coefficients, taps per phase, 4-byte aligned
+ * @param[in] taps number of taps per phase (2, 4 and 8 are vectorized)
+ * @return Q16 position of the output frame following the last one
+ */
+uint32_t mixResample16(int16_t* dst, const int16_t* src, size_t frames, uint32_t pos, uint32_t step, const int16_t* table, int taps);
+
+/**
+ * @brief @~japanese モノラルの音声データをステレオに変換します。
+ * @details @~japanese dst[2k] = dst[2k + 1] = src[k]
+ * @param[out] dst output PCM (interleaved, 2 channels)
+ * @param[in] src source PCM (1 channel)
+ * @param[in] frames number of frames
+ */
+void mixUpmix16(int16_t* dst, const int16_t* src, size_t frames);
+
+/**
+ * @brief @~japanese 24bitの音声データを、三角分布のディザを加えて16bitのステレオに変換します。
+ * @details @~japanese dst = sat16((x + d + 128) >> 8) (x は符号拡張した24bitの値、 d は -255 から 255 の三角分布の乱数) です。
+ * 1チャンネルの場合は左右に同じ値を出力します。乱数は dither の状態から生成して、 dither を更新します。
+ * @param[out] dst output PCM (interleaved, 2 channels)
+ * @param[in] src source PCM (little endian, packed 3 bytes per sample, interleaved)
+ * @param[in] frames number of frames
+ * @param[in] channels number of channels of src (1 or 2)
+ * @param[in,out] dither dither state
+ */
+void mixConvert24(int16_t* dst, const uint8_t* src, size_t frames, int channels, uint32_t* dither);
+
+/**
+ * @brief @~japanese 32bit浮動小数点数の音声データを、三角分布のディザを加えて16bitのステレオに変換します。
+ * @details @~japanese 1.0 を 32768 として24bitの値に変換してから、 mixConvert24() と同じディザを加えます。NaN は 0 になります。
+ * @param[out] dst output PCM (interleaved, 2 channels)
+ * @param[in] src source PCM (little endian IEEE 754 single, interleaved, no alignment required)
+ * @param[in] frames number of frames
+ * @param[in] channels number of channels of src (1 or 2)
+ * @param[in,out] dither dither state
+ */
+void mixConvertFloat(int16_t* dst, const uint8_t* src, size_t frames, int channels, uint32_t* dither);
+
+/**
+ * @brief @~japanese mixSaturate16() のスカラー実装です。SIMD実装の検証に使います。
+ */
+void mixSaturate16Scalar(int16_t* dst, const int16_t* src, size_t samples);
+
+/**
+ * @brief @~japanese mixGain16() のスカラー実装です。SIMD実装の検証に使います。
+ */
+void mixGain16Scalar(int16_t* dst, const int16_t* src, size_t samples, int16_t gain);
+
+/**
+ * @brief @~japanese mixRamp16() のスカラー実装です。SIMD実装の検証に使います。
+ */
+void mixRamp16Scalar(int16_t* dst, const int16_t* src, size_t frames, int channels, int16_t gain_from, int16_t gain_to);
+
+/**
+ * @brief @~japanese mixAccumulate32() のスカラー実装です。SIMD実装の検証に使います。
+ */
+void mixAccumulate32Scalar(int32_t* bus, const int16_t* src, size_t samples);
+
+/**
+ * @brief @~japanese mixAccumulateRamp32() のスカラー実装です。SIMD実装の検証に使います。
+ */
+void mixAccumulateRamp32Scalar(int32_t* bus, const int16_t* src, size_t frames, int channels, int16_t gain_from, int16_t gain_to);
+
+/**
+ * @brief @~japanese mixAccumulatePan32() のスカラー実装です。SIMD実装の検証に使います。
+ */
+void mixAccumulatePan32Scalar(int32_t* bus, const int16_t* src, size_t frames, int16_t left_from, int16_t left_to, int16_t right_from, int16_t right_to);
+
+/**
+ * @brief @~japanese mixLimit16() のスカラー実装です。SIMD実装の検証に使います。
+ */
+void mixLimit16Scalar(int16_t* dst, const int32_t* bus, size_t samples, int16_t gain);
+
+/**
+ * @brief @~japanese mixResample16() のスカラー実装です。SIMD実装の検証に使います。
+ */
+uint32_t mixResample16Scalar(int16_t* dst, const int16_t* src, size_t frames, uint32_t pos, uint32_t step, const int16_t* table, int taps);
+
+/**
+ * @brief @~japanese mixUpmix16() のスカラー実装です。SIMD実装の検証に使います。
+ */
+void mixUpmix16Scalar(int16_t* dst, const int16_t* src, size_t frames);
+
+/**
+ * @brief @~japanese コンパイル時に選択されたミキシングカーネルの名前を取得します。
+ * @return "helium", "neon", "avx2", "sse2", "dsp" or "scalar"
+ */
+const char* getMixKernelName();
+
+#endif  // MIX_KERNEL_H_
@@ -0,0 +1,88 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <gtest/gtest.h>
+
+#include "EnvelopeGenerator.h"
+
+TEST(EnvelopeGenerator, Linear) {
+    EnvelopeGenerator env;
+    env.setup(240, 480, EnvelopeGenerator::kCurveLinear);
+    EXPECT_EQ(env.getPhase(), EnvelopeGenerator::kPhaseIdle);
+    env.start();
+    EXPECT_EQ(env.getPhase(), EnvelopeGenerator::kPhaseAttack);
+    EXPECT_EQ(env.getLevel(), 0);
+    EXPECT_NEAR(env.advance(120), EnvelopeGenerator::kLevelMax / 2, 64);
+    EXPECT_EQ(env.advance(120), EnvelopeGenerator::kLevelMax);
+    EXPECT_EQ(env.getPhase(), EnvelopeGenerator::kPhaseSustain);
+    EXPECT_EQ(env.advance(1000), EnvelopeGenerator::kLevelMax);
+
+    env.release();
+    EXPECT_EQ(env.getPhase(), EnvelopeGenerator::kPhaseRelease);
+    EXPECT_NEAR(env.advance(240), EnvelopeGenerator::kLevelMax / 2, 64);
+    EXPECT_FALSE(env.isDone());
+    EXPECT_EQ(env.advance(240), 0);
+    EXPECT_TRUE(env.isDone());
+}
+
+TEST(EnvelopeGenerator, Exponential) {
+    EnvelopeGenerator env;
+    env.setup(640, 640, EnvelopeGenerator::kCurveExponential);
+    env.start();
+    // the attack rises fast
+    int16_t prev = env.getLevel();
+    int16_t first = env.advance(10);
+    EXPECT_GT(first, EnvelopeGenerator::kLevelMax / 16);
+    for (int i = 1; i < 64; i++) {
+        int16_t level = env.advance(10);
+        EXPECT_GE(level, prev);
+        prev = level;
+    }
+    EXPECT_EQ(env.getPhase(), EnvelopeGenerator::kPhaseSustain);
+
+    // the release falls fast and leaves a tail
+    env.release();
+    EXPECT_LT(env.advance(320), EnvelopeGenerator::kLevelMax / 8);
+    EXPECT_GT(env.getLevel(), 0);
+    EXPECT_EQ(env.advance(320), 0);
+    EXPECT_TRUE(env.isDone());
+}
+
+TEST(EnvelopeGenerator, ReleaseDuringAttack) {
+    EnvelopeGenerator env;
+    env.setup(480, 240, EnvelopeGenerator::kCurveLinear);
+    env.start();
+    int16_t level = env.advance(240);
+    env.release();
+    EXPECT_EQ(env.getLevel(), level);
+    EXPECT_NEAR(env.advance(120), level / 2, 64);
+    // a second release does not restart it
+    env.release();
+    EXPECT_EQ(env.advance(120), 0);
+    EXPECT_TRUE(env.isDone());
+}
+
+TEST(EnvelopeGenerator, ShortenRelease) {
+    EnvelopeGenerator env;
+    env.setup(0, 4800, EnvelopeGenerator::kCurveLinear);
+    env.start();
+    env.setRelease(240);
+    env.release();
+    EXPECT_NEAR(env.advance(120), EnvelopeGenerator::kLevelMax / 2, 64);
+    EXPECT_EQ(env.advance(120), 0);
+    EXPECT_TRUE(env.isDone());
+}
+
+TEST(EnvelopeGenerator, ZeroLength) {
+    EnvelopeGenerator env;
+    env.setup(0, 0, EnvelopeGenerator::kCurveExponential);
+    env.start();
+    EXPECT_EQ(env.getPhase(), EnvelopeGenerator::kPhaseSustain);
+    EXPECT_EQ(env.getLevel(), EnvelopeGenerator::kLevelMax);
+    env.release();
+    EXPECT_TRUE(env.isDone());
+    EXPECT_EQ(env.getLevel(), 0);
+}
@@ -0,0 +1,132 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <stdint.h>
+
+#include "gtest/gtest.h"
+
+#include <Arduino.h>
+#include <File.h>
+
+#include "FilePool.h"
+
+static void create_counter(const String& file_path) {
+    uint8_t data[256];
+    for (int i = 0; i < 256; i++) {
+        data[i] = (uint8_t)i;
+    }
+    registerDummyFile(file_path, data, sizeof(data));
+}
+
+TEST(FilePool, Reuse) {
+    create_counter("testdata/FilePool/a.raw");
+    FilePool pool(4);
+    File* a = pool.acquire("testdata/FilePool/a.raw");
+    ASSERT_NE(a, nullptr);
+    EXPECT_EQ(pool.getOpenCount(), 1U);
+    EXPECT_EQ(pool.getHitCount(), 0U);
+    pool.release(a);
+    EXPECT_EQ(pool.getHandleCount(), 1);
+
+    File* b = pool.acquire("testdata/FilePool/a.raw");
+    EXPECT_EQ(b, a);
+    EXPECT_EQ(pool.getOpenCount(), 1U);
+    EXPECT_EQ(pool.getHitCount(), 1U);
+    pool.release(b);
+
+    pool.resetCounters();
+    EXPECT_EQ(pool.getOpenCount(), 0U);
+    EXPECT_EQ(pool.getHitCount(), 0U);
+}
+
+TEST(FilePool, IndependentCursors) {
+    create_counter("testdata/FilePool/a.raw");
+    FilePool pool(4);
+    File* a = pool.acquire("testdata/FilePool/a.raw");
+    File* b = pool.acquire("testdata/FilePool/a.raw");
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    EXPECT_NE(a, b);
+    EXPECT_EQ(pool.getOpenCount(), 2U);
+    a->seek(10);
+    b->seek(100);
+    EXPECT_EQ(a->read(), 10);
+    EXPECT_EQ(b->read(), 100);
+    EXPECT_EQ(a->read(), 11);
+    pool.release(a);
+    pool.release(b);
+}
+
+TEST(FilePool, EvictLeastRecentlyUsed) {
+    create_counter("testdata/FilePool/a.raw");
+    create_counter("testdata/FilePool/b.raw");
+    create_counter("testdata/FilePool/c.raw");
+    FilePool pool(2);
+    pool.release(pool.acquire("testdata/FilePool/a.raw"));
+    pool.release(pool.acquire("testdata/FilePool/b.raw"));
+    pool.release(pool.acquire("testdata/FilePool/a.raw"));
+    EXPECT_EQ(pool.getEvictionCount(), 0U);
+
+    // b is the least recently used
+    pool.release(pool.acquire("testdata/FilePool/c.raw"));
+    EXPECT_EQ(pool.getEvictionCount(), 1U);
+    EXPECT_EQ(pool.getHandleCount(), 2);
+    pool.release(pool.acquire("testdata/FilePool/a.raw"));
+    EXPECT_EQ(pool.getHitCount(), 2U);
+    pool.release(pool.acquire("testdata/FilePool/b.raw"));
+    EXPECT_EQ(pool.getOpenCount(), 4U);
+    EXPECT_EQ(pool.getEvictionCount(), 2U);
+}
+
+TEST(FilePool, InUseIsNotEvicted) {
+    create_counter("testdata/FilePool/a.raw");
+    create_counter("testdata/FilePool/b.raw");
+    FilePool pool(1);
+    File* a = pool.acquire("testdata/FilePool/a.raw");
+    File* b = pool.acquire("testdata/FilePool/b.raw");
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    EXPECT_EQ(pool.getHandleCount(), 2);
+    EXPECT_EQ(pool.getEvictionCount(), 0U);
+    EXPECT_EQ(a->read(), 0);
+    pool.release(a);
+    EXPECT_EQ(pool.getEvictionCount(), 1U);
+    EXPECT_EQ(pool.getHandleCount(), 1);
+    pool.release(b);
+    pool.clear();
+    EXPECT_EQ(pool.getHandleCount(), 0);
+}
+
+TEST(FilePool, AllInUse) {
+    create_counter("testdata/FilePool/a.raw");
+    create_counter("testdata/FilePool/b.raw");
+    create_counter("testdata/FilePool/c.raw");
+    FilePool pool(1, 2);
+    File* a = pool.acquire("testdata/FilePool/a.raw");
+    File* b = pool.acquire("testdata/FilePool/b.raw");
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    EXPECT_EQ(pool.acquire("testdata/FilePool/c.raw"), nullptr);
+    EXPECT_EQ(pool.getOpenCount(), 2U);
+
+    // a released handle is closed and its slot opens the next file
+    pool.release(a);
+    File* c = pool.acquire("testdata/FilePool/c.raw");
+    EXPECT_EQ(c, a);
+    EXPECT_EQ(c->read(), 0);
+    EXPECT_EQ(pool.getHandleCount(), 2);
+    pool.release(b);
+    pool.release(c);
+    EXPECT_EQ(pool.getHandleCount(), 1);
+}
+
+TEST(FilePool, OpenError) {
+    FilePool pool;
+    EXPECT_EQ(pool.acquire("testdata/FilePool/missing.raw"), nullptr);
+    EXPECT_EQ(pool.getOpenCount(), 0U);
+    EXPECT_EQ(pool.getHandleCount(), 0);
+    pool.release(nullptr);
+}
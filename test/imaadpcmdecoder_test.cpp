@@ -0,0 +1,212 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <Arduino.h>
+#include <File.h>
+
+#include "ImaAdpcmDecoder.h"
+
+static const int kSteps[89] = {7,     8,     9,     10,    11,    12,    13,    14,    16,    17,    19,    21,    23,    25,    28,
+                               31,    34,    37,    41,    45,    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+                               130,   143,   157,   173,   190,   209,   230,   253,   279,   307,   337,   371,   408,   449,   494,
+                               544,   598,   658,   724,   796,   876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+                               2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,  5894,  6484,  7132,  7845,  8630,
+                               9493,  10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+// reference decoder after the IMA ADPCM recommendation, one whole block at a time
+static int ref_step(int* predictor, int* index, int nibble) {
+    int step = kSteps[*index];
+    int diff = (step >> 3) + ((nibble & 4) ? step : 0) + ((nibble & 2) ? (step >> 1) : 0) + ((nibble & 1) ? (step >> 2) : 0);
+    *predictor += (nibble & 8) ? -diff : diff;
+    *predictor = (*predictor > 32767) ? 32767 : ((*predictor < -32768) ? -32768 : *predictor);
+    static const int kAdjust[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+    *index += kAdjust[nibble & 7];
+    *index = (*index > 88) ? 88 : ((*index < 0) ? 0 : *index);
+    return *predictor;
+}
+
+static std::vector<int16_t> ref_decode(const std::vector<uint8_t>& data, int channels, int block_align) {
+    std::vector<int16_t> out;
+    for (size_t offset = 0; offset < data.size(); offset += block_align) {
+        size_t size = (data.size() - offset < (size_t)block_align) ? data.size() - offset : block_align;
+        const uint8_t* block = &data[offset];
+        int groups = (int)(size - 4 * channels) / (4 * channels);
+        std::vector<std::vector<int16_t>> samples(channels);
+        int predictor[2];
+        int index[2];
+        for (int c = 0; c < channels; c++) {
+            predictor[c] = (int16_t)(block[4 * c] | (block[4 * c + 1] << 8));
+            index[c] = (block[4 * c + 2] > 88) ? 88 : block[4 * c + 2];
+            samples[c].push_back(predictor[c]);
+        }
+        const uint8_t* p = &block[4 * channels];
+        for (int g = 0; g < groups; g++) {
+            for (int c = 0; c < channels; c++) {
+                for (int b = 0; b < 4; b++) {
+                    samples[c].push_back(ref_step(&predictor[c], &index[c], *p & 0x0F));
+                    samples[c].push_back(ref_step(&predictor[c], &index[c], *p >> 4));
+                    p++;
+                }
+            }
+        }
+        for (size_t i = 0; i < samples[0].size(); i++) {
+            out.push_back(samples[0][i]);
+            out.push_back(samples[channels - 1][i]);
+        }
+    }
+    return out;
+}
+
+// random nibbles behind valid headers; any nibble sequence is a valid stream
+static std::vector<uint8_t> create_blocks(int channels, int block_align, size_t size, unsigned int seed) {
+    srand(seed);
+    std::vector<uint8_t> data(size);
+    for (auto& e : data) {
+        e = (uint8_t)rand();
+    }
+    for (size_t offset = 0; offset < size; offset += block_align) {
+        for (int c = 0; c < channels && offset + 4 * c + 3 < size; c++) {
+            data[offset + 4 * c + 2] = (uint8_t)(rand() % 89);
+            data[offset + 4 * c + 3] = 0;
+        }
+    }
+    return data;
+}
+
+static SampleFormat create_format(int channels, int block_align, uint32_t data_offset, uint32_t data_size) {
+    SampleFormat format;
+    format.codec = SampleFormat::kCodecImaAdpcm;
+    format.channels = (uint8_t)channels;
+    format.block_align = (uint16_t)block_align;
+    format.frames_per_block = ImaAdpcmDecoder::getFramesPerBlock(channels, block_align);
+    format.data_offset = data_offset;
+    format.data_size = data_size;
+    return format;
+}
+
+TEST(ImaAdpcmDecoder, FramesPerBlock) {
+    EXPECT_EQ(ImaAdpcmDecoder::getFramesPerBlock(1, 1024), 2041U);
+    EXPECT_EQ(ImaAdpcmDecoder::getFramesPerBlock(2, 2048), 2041U);
+    EXPECT_EQ(ImaAdpcmDecoder::getFramesPerBlock(1, 36), 65U);
+    EXPECT_EQ(ImaAdpcmDecoder::getFramesPerBlock(2, 8), 0U);
+    EXPECT_EQ(ImaAdpcmDecoder::getFramesPerBlock(2, 12), 0U);
+    EXPECT_EQ(ImaAdpcmDecoder::getFramesPerBlock(3, 1024), 0U);
+    EXPECT_EQ(ImaAdpcmDecoder::getFramesPerBlock(0, 1024), 0U);
+}
+
+static void expect_blocks_match(int channels, int block_align) {
+    std::vector<uint8_t> data = create_blocks(channels, block_align, block_align * 8, 1234 + channels);
+    std::vector<int16_t> expected = ref_decode(data, channels, block_align);
+    std::vector<int16_t> actual;
+    ImaAdpcmDecoder decoder;
+    for (size_t offset = 0; offset < data.size(); offset += block_align) {
+        ASSERT_TRUE(decoder.start(&data[offset], block_align, channels));
+        EXPECT_EQ(decoder.getFrameCount(), ImaAdpcmDecoder::getFramesPerBlock(channels, block_align));
+        int16_t frames[7 * 2];
+        size_t n = 0;
+        while ((n = decoder.decode(frames, 7)) > 0) {
+            actual.insert(actual.end(), frames, frames + n * 2);
+        }
+        EXPECT_EQ(decoder.getPosition(), decoder.getFrameCount());
+    }
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        ASSERT_EQ(actual[i], expected[i]) << "sample " << i;
+    }
+}
+
+TEST(ImaAdpcmDecoder, MonoMatchesReference) {
+    expect_blocks_match(1, 1024);
+}
+
+TEST(ImaAdpcmDecoder, StereoMatchesReference) {
+    expect_blocks_match(2, 2048);
+}
+
+TEST(ImaAdpcmDecoder, Saturates) {
+    // the largest step, all positive then all negative nibbles
+    uint8_t block[4 + 8] = {0x00, 0x7F, 88, 0, 0x77, 0x77, 0x77, 0x77, 0xFF, 0xFF, 0xFF, 0xFF};
+    ImaAdpcmDecoder decoder;
+    ASSERT_TRUE(decoder.start(block, sizeof(block), 1));
+    int16_t frames[17 * 2];
+    ASSERT_EQ(decoder.decode(frames, 17), 17U);
+    EXPECT_EQ(frames[8 * 2], 32767);
+    EXPECT_EQ(frames[16 * 2], -32768);
+    EXPECT_EQ(frames[16 * 2], frames[16 * 2 + 1]);  // mono is duplicated
+    EXPECT_FALSE(decoder.start(block, 3, 1));
+    EXPECT_FALSE(decoder.start(block, sizeof(block), 3));
+}
+
+TEST(ImaAdpcmDecoder, ReadFromFile) {
+    const int kChannels = 2;
+    const int kBlockAlign = 72;  // 65 frames
+    const uint32_t kDataOffset = 60;
+    std::vector<uint8_t> data = create_blocks(kChannels, kBlockAlign, kBlockAlign * 5, 99);
+    std::vector<int16_t> expected = ref_decode(data, kChannels, kBlockAlign);
+    std::vector<uint8_t> content(kDataOffset, 0xEE);
+    content.insert(content.end(), data.begin(), data.end());
+    registerDummyFile("testdata/ImaAdpcmDecoder/read.wav", content.data(), content.size());
+
+    File file("testdata/ImaAdpcmDecoder/read.wav");
+    SampleFormat format = create_format(kChannels, kBlockAlign, kDataOffset, data.size());
+    std::vector<uint8_t> buffer(kBlockAlign);
+    ImaAdpcmDecoder decoder;
+    decoder.setBlockBuffer(buffer.data(), buffer.size());
+
+    // chunks of 20 frames continue the block in the buffer, one read per block
+    std::vector<int16_t> actual(expected.size() + 2);
+    uint32_t frame = 0;
+    size_t n = 0;
+    while ((n = decoder.read(&file, format, frame, &actual[frame * 2], 20)) > 0) {
+        EXPECT_LE(n, 20U);
+        frame += n;
+    }
+    EXPECT_EQ(frame * 2, expected.size());
+    actual.resize(expected.size());
+    EXPECT_EQ(actual, expected);
+    EXPECT_EQ(decoder.getBlockReadCount(), 5U);
+
+    // a seek backwards into the block reloads it, a seek forward decodes on
+    int16_t frames[2];
+    ASSERT_EQ(decoder.read(&file, format, 100, frames, 1), 1U);
+    EXPECT_EQ(frames[0], expected[200]);
+    ASSERT_EQ(decoder.read(&file, format, 110, frames, 1), 1U);
+    EXPECT_EQ(frames[1], expected[221]);
+    EXPECT_EQ(decoder.getBlockReadCount(), 6U);
+    ASSERT_EQ(decoder.read(&file, format, 60, frames, 1), 1U);
+    EXPECT_EQ(frames[0], expected[120]);
+    EXPECT_EQ(decoder.getBlockReadCount(), 7U);
+    file.close();
+}
+
+TEST(ImaAdpcmDecoder, ShortLastBlock) {
+    const int kChannels = 1;
+    const int kBlockAlign = 36;  // 65 frames
+    // the last block ends after its header and one group
+    std::vector<uint8_t> data = create_blocks(kChannels, kBlockAlign, kBlockAlign * 2 + 8, 7);
+    std::vector<int16_t> expected = ref_decode(data, kChannels, kBlockAlign);
+    ASSERT_EQ(expected.size(), (size_t)(65 * 2 + 9) * 2);
+    registerDummyFile("testdata/ImaAdpcmDecoder/short.wav", data.data(), data.size());
+
+    File file("testdata/ImaAdpcmDecoder/short.wav");
+    SampleFormat format = create_format(kChannels, kBlockAlign, 0, data.size());
+    std::vector<uint8_t> buffer(kBlockAlign);
+    ImaAdpcmDecoder decoder;
+    decoder.setBlockBuffer(buffer.data(), buffer.size());
+    int16_t frames[16 * 2];
+    ASSERT_EQ(decoder.read(&file, format, 130, frames, 16), 9U);
+    EXPECT_EQ(frames[8 * 2], expected[138 * 2]);
+    EXPECT_EQ(decoder.read(&file, format, 139, frames, 16), 0U);
+    EXPECT_EQ(decoder.read(&file, format, 200, frames, 16), 0U);
+    file.close();
+}
@@ -0,0 +1,104 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <gtest/gtest.h>
+
+#include "LatencyController.h"
+
+static const uint32_t kFrameUs = 5000;
+static const int kMaxFrames = 25;
+
+TEST(LatencyController, Default) {
+    LatencyController controller(kFrameUs, kMaxFrames);
+    EXPECT_EQ(controller.getPreloadFrames(), 3);
+    EXPECT_EQ(controller.getRefillFrames(), 10);
+    EXPECT_EQ(controller.getTargetLatency(), 15);
+}
+
+TEST(LatencyController, Underrun) {
+    LatencyController controller(kFrameUs, kMaxFrames);
+    controller.update(0, 0);
+    controller.update(1, 10);
+    EXPECT_EQ(controller.getPreloadFrames(), 4);
+    EXPECT_EQ(controller.getRefillFrames(), 12);
+    // no change without new underruns within the cooldown
+    controller.update(1, 20);
+    EXPECT_EQ(controller.getPreloadFrames(), 4);
+    controller.update(5, 30);
+    EXPECT_EQ(controller.getPreloadFrames(), 5);
+}
+
+TEST(LatencyController, Cooldown) {
+    LatencyController controller(kFrameUs, kMaxFrames);
+    controller.update(0, 0);
+    controller.update(0, LatencyController::kCooldownFrames);
+    EXPECT_EQ(controller.getPreloadFrames(), 2);
+    controller.update(0, LatencyController::kCooldownFrames * 2);
+    EXPECT_EQ(controller.getPreloadFrames(), 1);
+    controller.update(0, LatencyController::kCooldownFrames * 3);
+    EXPECT_EQ(controller.getPreloadFrames(), 1);
+
+    // an underrun doubles the time before the next try
+    uint32_t now = LatencyController::kCooldownFrames * 3;
+    controller.update(1, now);
+    EXPECT_EQ(controller.getPreloadFrames(), 2);
+    controller.update(1, now + LatencyController::kCooldownFrames);
+    EXPECT_EQ(controller.getPreloadFrames(), 2);
+    controller.update(1, now + LatencyController::kCooldownFrames * 2);
+    EXPECT_EQ(controller.getPreloadFrames(), 1);
+}
+
+TEST(LatencyController, ReadJitter) {
+    LatencyController controller(kFrameUs, kMaxFrames);
+    controller.reportRead(100);
+    EXPECT_EQ(controller.getPreloadFrames(), 3);
+    controller.reportRead(12000);
+    EXPECT_EQ(controller.getPeakReadTime(), 12000U);
+    EXPECT_EQ(controller.getPreloadFrames(), 4);
+
+    // the peak decays with fast reads
+    for (int i = 0; i < 200; i++) {
+        controller.reportRead(100);
+    }
+    EXPECT_LT(controller.getPeakReadTime(), 5000U);
+    EXPECT_EQ(controller.getPreloadFrames(), 3);
+
+    // never exceeds the cache
+    controller.reportRead(1000000);
+    EXPECT_EQ(controller.getPreloadFrames(), kMaxFrames - 1);
+    EXPECT_EQ(controller.getRefillFrames(), kMaxFrames);
+}
+
+TEST(LatencyController, PeakDecaysToZero) {
+    LatencyController controller(kFrameUs, kMaxFrames);
+    controller.reportRead(12000);
+    for (int i = 0; i < 1000; i++) {
+        controller.reportRead(0);
+    }
+    EXPECT_EQ(controller.getPeakReadTime(), 0U);
+
+    // a peak below 64 us does not stay either
+    controller.reportRead(63);
+    for (int i = 0; i < 64; i++) {
+        controller.reportRead(0);
+    }
+    EXPECT_EQ(controller.getPeakReadTime(), 0U);
+}
+
+TEST(LatencyController, TargetLatency) {
+    LatencyController controller(kFrameUs, kMaxFrames);
+    EXPECT_TRUE(controller.setTargetLatency(7));
+    EXPECT_EQ(controller.getPreloadFrames(), 2);
+    EXPECT_EQ(controller.getTargetLatency(), 10);
+    controller.update(0, 0);
+    controller.update(1, 10);
+    EXPECT_EQ(controller.getPreloadFrames(), 2);
+    EXPECT_TRUE(controller.setTargetLatency(1000));
+    EXPECT_EQ(controller.getPreloadFrames(), kMaxFrames - 1);
+    EXPECT_FALSE(controller.setTargetLatency(-1));
+    EXPECT_TRUE(controller.setTargetLatency(0));
+    EXPECT_EQ(controller.getPreloadFrames(), 4);
+}
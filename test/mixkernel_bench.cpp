@@ -0,0 +1,87 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+
+#include <gtest/gtest.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "mix_kernel.h"
+
+static const size_t kFrames = 240;
+static const int kChannels = 2;
+static const int kIterations = 20000;
+
+struct BenchResult {
+    double ns;
+    double cycles;
+};
+
+static uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+template <typename F>
+static BenchResult measure(F func) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_cycles = readCycles();
+    for (int i = 0; i < kIterations; i++) {
+        func();
+    }
+    uint64_t cycles = readCycles() - start_cycles;
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+    return BenchResult{(double)elapsed.count() / kIterations, (double)cycles / kIterations};
+}
+
+static void report(const char* name, const BenchResult& scalar, const BenchResult& simd) {
+    printf("[ mix_kernel ] %-10s scalar %8.1f ns (%8.1f cycles) / %-6s %8.1f ns (%8.1f cycles) per frame of %d samples\n", name, scalar.ns, scalar.cycles,
+           getMixKernelName(), simd.ns, simd.cycles, (int)kFrames);
+}
+
+TEST(MixKernelBench, CyclesPerFrame) {
+    static int16_t dst[kFrames * kChannels];
+    static int16_t src[kFrames * kChannels];
+    for (size_t i = 0; i < kFrames * kChannels; i++) {
+        src[i] = (int16_t)((i * 97) & 0x3FFF);
+        dst[i] = 0;
+    }
+    const size_t samples = kFrames * kChannels;
+
+    report("saturate", measure([&]() { mixSaturate16Scalar(dst, src, samples); }), measure([&]() { mixSaturate16(dst, src, samples); }));
+    report("gain", measure([&]() { mixGain16Scalar(dst, src, samples, 0x3000); }), measure([&]() { mixGain16(dst, src, samples, 0x3000); }));
+    report("ramp", measure([&]() { mixRamp16Scalar(dst, src, kFrames, kChannels, 0, MIX_GAIN_UNITY); }),
+           measure([&]() { mixRamp16(dst, src, kFrames, kChannels, 0, MIX_GAIN_UNITY); }));
+
+    static int32_t bus[kFrames * kChannels];
+    for (size_t i = 0; i < kFrames * kChannels; i++) {
+        bus[i] = (int32_t)(i * 977) - 200000;
+    }
+    report("acc32", measure([&]() { mixAccumulate32Scalar(bus, src, samples); }), measure([&]() { mixAccumulate32(bus, src, samples); }));
+    report("accramp32", measure([&]() { mixAccumulateRamp32Scalar(bus, src, kFrames, kChannels, 0, MIX_GAIN_UNITY); }),
+           measure([&]() { mixAccumulateRamp32(bus, src, kFrames, kChannels, 0, MIX_GAIN_UNITY); }));
+    report("limit", measure([&]() { mixLimit16Scalar(dst, bus, samples, 0x3000); }), measure([&]() { mixLimit16(dst, bus, samples, 0x3000); }));
+    // a mono source: half of src is upmixed to a whole frame
+    report("upmix", measure([&]() { mixUpmix16Scalar(dst, src, kFrames); }), measure([&]() { mixUpmix16(dst, src, kFrames); }));
+
+    // a whole tone up through the 4 taps table of the cubic interpolation
+    static int16_t table[4 << MIX_RESAMPLE_PHASE_BITS];
+    for (int i = 0; i < (4 << MIX_RESAMPLE_PHASE_BITS); i++) {
+        table[i] = (int16_t)((i % 4 == 1 || i % 4 == 2) ? 0x2000 : 0);
+    }
+    static int16_t wide[(kFrames * 2 + 4) * kChannels];
+    report("resample", measure([&]() { mixResample16Scalar(dst, wide, kFrames, 0, 0x11F6C, table, 4); }),
+           measure([&]() { mixResample16(dst, wide, kFrames, 0, 0x11F6C, table, 4); }));
+}
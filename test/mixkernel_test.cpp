@@ -0,0 +1,356 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mix_kernel.h"
+
+class MixKernelTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+#if defined(__AVX2__) && defined(__GNUC__)
+        if (!__builtin_cpu_supports("avx2")) {
+            GTEST_SKIP() << "AVX2 is not supported on this CPU";
+        }
+#endif
+        srand(1234);
+    }
+
+    static std::vector<int16_t> random(size_t n, int range = 65536) {
+        std::vector<int16_t> v(n);
+        for (auto& e : v) {
+            e = (int16_t)((rand() % range) - (range / 2));
+        }
+        return v;
+    }
+};
+
+TEST_F(MixKernelTest, Name) {
+    printf("mix kernel: %s\n", getMixKernelName());
+    EXPECT_NE(getMixKernelName(), nullptr);
+}
+
+TEST_F(MixKernelTest, SaturateKnownValues) {
+    int16_t dst[4] = {32000, -32000, 100, -1};
+    const int16_t src[4] = {1000, -1000, -50, 1};
+    mixSaturate16(dst, src, 4);
+    EXPECT_EQ(dst[0], 32767);
+    EXPECT_EQ(dst[1], -32768);
+    EXPECT_EQ(dst[2], 50);
+    EXPECT_EQ(dst[3], 0);
+}
+
+TEST_F(MixKernelTest, SaturateBitExact) {
+    for (size_t n : {0, 1, 7, 8, 15, 16, 17, 31, 480, 481}) {
+        auto src = random(n);
+        auto expected = random(n);
+        auto actual = expected;
+        mixSaturate16Scalar(expected.data(), src.data(), n);
+        mixSaturate16(actual.data(), src.data(), n);
+        EXPECT_EQ(actual, expected) << "samples=" << n;
+    }
+}
+
+TEST_F(MixKernelTest, GainKnownValues) {
+    int16_t dst[4] = {0, 0, 0, 32767};
+    const int16_t src[4] = {1000, -1000, 32767, 32767};
+    mixGain16(dst, src, 4, MIX_GAIN_UNITY / 2);
+    EXPECT_EQ(dst[0], 500);
+    EXPECT_EQ(dst[1], -500);
+    EXPECT_EQ(dst[2], 16383);
+    EXPECT_EQ(dst[3], 32767);
+}
+
+TEST_F(MixKernelTest, GainBitExact) {
+    const int16_t kGains[] = {0, 1, 0x1000, MIX_GAIN_UNITY, 0x5A82, 0x7FFF, -0x4000};
+    for (int16_t gain : kGains) {
+        for (size_t n : {1, 9, 16, 33, 480}) {
+            auto src = random(n);
+            auto expected = random(n);
+            auto actual = expected;
+            mixGain16Scalar(expected.data(), src.data(), n, gain);
+            mixGain16(actual.data(), src.data(), n, gain);
+            EXPECT_EQ(actual, expected) << "samples=" << n << ", gain=" << gain;
+        }
+    }
+}
+
+TEST_F(MixKernelTest, RampKnownValues) {
+    int16_t dst[8] = {};
+    const int16_t src[8] = {1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000};
+    mixRamp16(dst, src, 4, 2, 0, MIX_GAIN_UNITY);
+    const int16_t expected[8] = {0, 0, 250, 250, 500, 500, 750, 750};
+    for (int i = 0; i < 8; i++) {
+        EXPECT_EQ(dst[i], expected[i]) << "i=" << i;
+    }
+}
+
+TEST_F(MixKernelTest, RampBitExact) {
+    const int16_t kRamps[][2] = {{0, MIX_GAIN_UNITY}, {MIX_GAIN_UNITY, 0}, {0x1234, 0x7FFF}, {0x7FFF, 0}, {100, 100}};
+    for (const auto& ramp : kRamps) {
+        for (int channels : {1, 2}) {
+            for (size_t frames : {1, 3, 4, 7, 8, 9, 17, 240}) {
+                auto src = random(frames * channels);
+                auto expected = random(frames * channels);
+                auto actual = expected;
+                mixRamp16Scalar(expected.data(), src.data(), frames, channels, ramp[0], ramp[1]);
+                mixRamp16(actual.data(), src.data(), frames, channels, ramp[0], ramp[1]);
+                EXPECT_EQ(actual, expected) << "frames=" << frames << ", channels=" << channels << ", ramp=" << ramp[0] << "->" << ramp[1];
+            }
+        }
+    }
+}
+
+TEST_F(MixKernelTest, AccumulateKnownValues) {
+    int32_t bus[4] = {32767, -32768, 100, 0};
+    const int16_t src[4] = {32767, -32768, -50, 1};
+    mixAccumulate32(bus, src, 4);
+    EXPECT_EQ(bus[0], 65534);
+    EXPECT_EQ(bus[1], -65536);
+    EXPECT_EQ(bus[2], 50);
+    EXPECT_EQ(bus[3], 1);
+}
+
+TEST_F(MixKernelTest, AccumulateBitExact) {
+    for (size_t n : {0, 1, 7, 8, 15, 16, 17, 31, 480, 481}) {
+        auto src = random(n);
+        std::vector<int32_t> expected(n, 100000);
+        auto actual = expected;
+        mixAccumulate32Scalar(expected.data(), src.data(), n);
+        mixAccumulate32(actual.data(), src.data(), n);
+        EXPECT_EQ(actual, expected) << "samples=" << n;
+    }
+}
+
+TEST_F(MixKernelTest, AccumulateRampBitExact) {
+    const int16_t kRamps[][2] = {{0, MIX_GAIN_UNITY}, {MIX_GAIN_UNITY, 0}, {0x1234, 0x7FFF}, {0x7FFF, 0}, {MIX_GAIN_UNITY, MIX_GAIN_UNITY}};
+    for (const auto& ramp : kRamps) {
+        for (int channels : {1, 2}) {
+            for (size_t frames : {1, 3, 4, 7, 8, 9, 17, 240}) {
+                auto src = random(frames * channels);
+                std::vector<int32_t> expected(frames * channels, -70000);
+                auto actual = expected;
+                mixAccumulateRamp32Scalar(expected.data(), src.data(), frames, channels, ramp[0], ramp[1]);
+                mixAccumulateRamp32(actual.data(), src.data(), frames, channels, ramp[0], ramp[1]);
+                EXPECT_EQ(actual, expected) << "frames=" << frames << ", channels=" << channels << ", ramp=" << ramp[0] << "->" << ramp[1];
+            }
+        }
+    }
+}
+
+TEST_F(MixKernelTest, LimitKnownValues) {
+    // below the knee the signal passes through, above it the curve approaches full scale smoothly
+    const int32_t bus[8] = {0, 24575, -24575, 30000, -30000, 40959, 48000, -1000000};
+    int16_t dst[8] = {};
+    mixLimit16(dst, bus, 8, MIX_GAIN_UNITY);
+    const int16_t expected[8] = {0, 24575, -24575, 29102, -29102, 32767, 32767, -32768};
+    for (int i = 0; i < 8; i++) {
+        EXPECT_EQ(dst[i], expected[i]) << "i=" << i;
+    }
+    // the master gain is applied before the curve
+    const int32_t loud[2] = {48000, -48000};
+    mixLimit16(dst, loud, 2, MIX_GAIN_UNITY / 2);
+    EXPECT_EQ(dst[0], 24000);
+    EXPECT_EQ(dst[1], -24000);
+}
+
+TEST_F(MixKernelTest, LimitIsMonotonic) {
+    std::vector<int32_t> bus(70000);
+    for (size_t i = 0; i < bus.size(); i++) {
+        bus[i] = (int32_t)i;
+    }
+    std::vector<int16_t> dst(bus.size());
+    mixLimit16(dst.data(), bus.data(), bus.size(), MIX_GAIN_UNITY);
+    for (size_t i = 1; i < dst.size(); i++) {
+        ASSERT_LE(dst[i - 1], dst[i]) << "i=" << i;
+    }
+    EXPECT_EQ(dst.back(), 32767);
+}
+
+TEST_F(MixKernelTest, LimitBitExact) {
+    const int16_t kGains[] = {0, 1, 0x1000, MIX_GAIN_UNITY, 0x5A82, 0x7FFF, -0x4000};
+    for (int16_t gain : kGains) {
+        for (size_t n : {1, 7, 8, 16, 33, 480}) {
+            std::vector<int32_t> bus(n);
+            for (auto& e : bus) {
+                // up to 64 full-scale voices
+                e = (rand() % (64 * 65536)) - (32 * 65536);
+            }
+            std::vector<int16_t> expected(n);
+            std::vector<int16_t> actual(n);
+            mixLimit16Scalar(expected.data(), bus.data(), n, gain);
+            mixLimit16(actual.data(), bus.data(), n, gain);
+            EXPECT_EQ(actual, expected) << "samples=" << n << ", gain=" << gain;
+        }
+    }
+}
+
+TEST_F(MixKernelTest, AccumulatePanKnownValues) {
+    int32_t bus[8] = {};
+    const int16_t src[8] = {1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000};
+    mixAccumulatePan32(bus, src, 4, 0, MIX_GAIN_UNITY, MIX_GAIN_UNITY, MIX_GAIN_UNITY / 2);
+    const int32_t expected[8] = {0, 1000, 250, 875, 500, 750, 750, 625};
+    for (int i = 0; i < 8; i++) {
+        EXPECT_EQ(bus[i], expected[i]) << "i=" << i;
+    }
+}
+
+TEST_F(MixKernelTest, AccumulatePanBitExact) {
+    const int16_t kPans[][4] = {{0, MIX_GAIN_UNITY, MIX_GAIN_UNITY, 0}, {0x5A82, 0x5A82, 0x5A82, 0x5A82}, {0x7FFF, 0, 0x1234, 0x7FFF}, {0, 0, 0x4000, 0x4000}};
+    for (const auto& pan : kPans) {
+        for (size_t frames : {1, 3, 4, 5, 7, 8, 9, 17, 240}) {
+            auto src = random(frames * 2);
+            std::vector<int32_t> expected(frames * 2, 12345);
+            auto actual = expected;
+            mixAccumulatePan32Scalar(expected.data(), src.data(), frames, pan[0], pan[1], pan[2], pan[3]);
+            mixAccumulatePan32(actual.data(), src.data(), frames, pan[0], pan[1], pan[2], pan[3]);
+            EXPECT_EQ(actual, expected) << "frames=" << frames << ", pan=" << pan[0] << "->" << pan[1] << "," << pan[2] << "->" << pan[3];
+        }
+    }
+}
+
+TEST_F(MixKernelTest, ResampleKnownValues) {
+    // linear taps at phase 0 and 1/2: the first frame, then the midpoint of the first two
+    std::vector<int16_t> coefs(2 << MIX_RESAMPLE_PHASE_BITS, 0);
+    coefs[0] = 0x4000;
+    coefs[(1 << (MIX_RESAMPLE_PHASE_BITS - 1)) * 2 + 0] = 0x2000;
+    coefs[(1 << (MIX_RESAMPLE_PHASE_BITS - 1)) * 2 + 1] = 0x2000;
+    const int16_t src[6] = {1000, -1000, 3000, 32767, 0, 0};
+    int16_t dst[4] = {};
+    uint32_t pos = mixResample16(dst, src, 2, 0, 0x8000, coefs.data(), 2);
+    EXPECT_EQ(pos, 0x10000U);
+    EXPECT_EQ(dst[0], 1000);
+    EXPECT_EQ(dst[1], -1000);
+    EXPECT_EQ(dst[2], 2000);
+    EXPECT_EQ(dst[3], 15884);
+}
+
+TEST_F(MixKernelTest, ResampleBitExact) {
+    const uint32_t kSteps[] = {0x1000, 0xC000, 0x10000, 0x1F3A5, 0x40000};
+    for (int taps : {2, 4, 8}) {
+        // large coefficients to exercise the saturation
+        auto table = random(taps << MIX_RESAMPLE_PHASE_BITS);
+        for (uint32_t step : kSteps) {
+            for (size_t frames : {1, 2, 3, 7, 8, 9, 240}) {
+                uint32_t pos = (uint32_t)(rand() & 0x3FFFF);
+                size_t src_frames = (size_t)((pos + (uint64_t)step * (frames - 1)) >> 16) + taps;
+                auto src = random(src_frames * 2);
+                std::vector<int16_t> expected(frames * 2, 0x1234);
+                auto actual = expected;
+                uint32_t expected_pos = mixResample16Scalar(expected.data(), src.data(), frames, pos, step, table.data(), taps);
+                uint32_t actual_pos = mixResample16(actual.data(), src.data(), frames, pos, step, table.data(), taps);
+                EXPECT_EQ(actual_pos, expected_pos);
+                EXPECT_EQ(actual, expected) << "taps=" << taps << ", step=" << step << ", frames=" << frames << ", pos=" << pos;
+            }
+        }
+    }
+}
+
+TEST_F(MixKernelTest, UpmixKnownValues) {
+    const int16_t src[3] = {1000, -32768, 32767};
+    int16_t dst[6] = {};
+    mixUpmix16(dst, src, 3);
+    const int16_t expected[6] = {1000, 1000, -32768, -32768, 32767, 32767};
+    EXPECT_EQ(memcmp(dst, expected, sizeof(dst)), 0);
+}
+
+TEST_F(MixKernelTest, UpmixBitExact) {
+    for (size_t n : {0, 1, 7, 8, 15, 16, 17, 31, 240, 241}) {
+        // an odd source offset misaligns the SIMD loads
+        auto src = random(n + 1);
+        std::vector<int16_t> expected(n * 2, 0x1234);
+        auto actual = expected;
+        mixUpmix16Scalar(expected.data(), &src[1], n);
+        mixUpmix16(actual.data(), &src[1], n);
+        EXPECT_EQ(actual, expected) << "frames=" << n;
+    }
+}
+
+static void put24(std::vector<uint8_t>* dst, int32_t value) {
+    dst->push_back((uint8_t)(value >> 0));
+    dst->push_back((uint8_t)(value >> 8));
+    dst->push_back((uint8_t)(value >> 16));
+}
+
+static void putFloat(std::vector<uint8_t>* dst, float value) {
+    uint8_t bytes[sizeof(value)];
+    memcpy(bytes, &value, sizeof(value));
+    dst->insert(dst->end(), bytes, bytes + sizeof(value));
+}
+
+TEST_F(MixKernelTest, Convert24WithinOneLsb) {
+    const int kFrames = 1000;
+    std::vector<int32_t> values;
+    std::vector<uint8_t> src;
+    for (int i = 0; i < kFrames * 2; i++) {
+        int32_t value = (i < 4) ? ((i % 2) ? -8388608 : 8388607) : ((rand() % 16777216) - 8388608);
+        values.push_back(value);
+        put24(&src, value);
+    }
+    std::vector<int16_t> dst(kFrames * 2);
+    uint32_t dither = 0;
+    mixConvert24(dst.data(), src.data(), kFrames, 2, &dither);
+    for (int i = 0; i < kFrames * 2; i++) {
+        int32_t expected = (values[i] + 128) >> 8;
+        expected = (expected > 32767) ? 32767 : expected;
+        EXPECT_LE(abs(dst[i] - expected), 1) << "sample " << i << ", value " << values[i];
+    }
+
+    // the same state gives the same output
+    std::vector<int16_t> again(kFrames * 2);
+    dither = 0;
+    mixConvert24(again.data(), src.data(), kFrames, 2, &dither);
+    EXPECT_EQ(again, dst);
+}
+
+TEST_F(MixKernelTest, Convert24DitherIsUnbiased) {
+    // silence stays around zero, and half an LSB averages to half an LSB instead of truncating
+    const int kFrames = 20000;
+    for (int32_t value : {0, 128, -384}) {
+        std::vector<uint8_t> src;
+        for (int i = 0; i < kFrames; i++) {
+            put24(&src, value);
+        }
+        std::vector<int16_t> dst(kFrames * 2);
+        uint32_t dither = 1;
+        mixConvert24(dst.data(), src.data(), kFrames, 1, &dither);
+        double sum = 0;
+        for (int i = 0; i < kFrames; i++) {
+            EXPECT_EQ(dst[i * 2], dst[i * 2 + 1]);  // mono is duplicated
+            sum += dst[i * 2];
+        }
+        EXPECT_NEAR(sum / kFrames, value / 256.0, 0.05) << "value " << value;
+    }
+}
+
+TEST_F(MixKernelTest, ConvertFloatKnownValues) {
+    std::vector<uint8_t> src;
+    const float kValues[] = {0.5f, -0.25f, 1.5f, -3.0f};
+    for (float e : kValues) {
+        putFloat(&src, e);
+    }
+    int16_t dst[4] = {};
+    uint32_t dither = 0;
+    mixConvertFloat(dst, src.data(), 2, 2, &dither);
+    EXPECT_NEAR(dst[0], 16384, 1);
+    EXPECT_NEAR(dst[1], -8192, 1);
+    EXPECT_EQ(dst[2], 32767);
+    EXPECT_EQ(dst[3], -32768);
+    std::vector<uint8_t> special;
+    putFloat(&special, NAN);
+    putFloat(&special, INFINITY);
+    mixConvertFloat(dst, special.data(), 2, 1, &dither);
+    EXPECT_NEAR(dst[0], 0, 1);
+    EXPECT_EQ(dst[0], dst[1]);
+    EXPECT_EQ(dst[2], 32767);
+}
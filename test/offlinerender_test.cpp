@@ -0,0 +1,115 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <vector>
+
+#include <Arduino.h>
+
+#include <File.h>
+
+#include "PcmWriter.h"
+#include "ScoreSrc.h"
+#include "SFZSink.h"
+#include "WavReader.h"
+#include "WavWriter.h"
+
+static const int kSampleRate = 48000;
+static const int kSampleCount = 240;
+static const int16_t kLevel = 2000;
+
+static void createTone(const String& path, int frames) {
+    std::vector<int16_t> pcm(frames * 2, kLevel);
+    registerDummyFile(path, reinterpret_cast<const uint8_t*>(pcm.data()), pcm.size() * sizeof(int16_t));
+}
+
+static void createScore(const String& path) {
+    const uint8_t smf_data[] = {0x4D, 0x54, 0x68, 0x64,                    // "MThd"
+                                0x00, 0x00, 0x00, 0x06,                    // length = 6
+                                0x00, 0x00,                                // format = 0
+                                0x00, 0x01,                                // tracks = 1
+                                0x00, 0x60,                                // division = 96
+                                0x4D, 0x54, 0x72, 0x6B,                    // "MTrk"
+                                0x00, 0x00, 0x00, 0x12,                    // length = 18
+                                0x00, 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20,  // [     0] Set Tempo (500,000[us])
+                                0x60, 0x90, 0x3C, 0x7F,                    // [    96] Note On (n=1, k=60, v=127)
+                                0x60, 0x3C, 0x00,                          // [    96] Note On (n=1, k=60, v=0)
+                                0x00, 0xFF, 0x2F, 0x00};                   // [     0] End of Track
+    registerDummyFile(path, smf_data, sizeof(smf_data));
+}
+
+// bounces ScoreSrc -> SFZSink into a WAV file, driving the score by the virtual sample clock
+TEST(OfflineRender, BounceScore) {
+    const char kWavPath[] = "offlinerender_bounce.wav";
+    createTone("testdata/OfflineRender/tone.raw", kSampleRate * 2);
+    registerDummyFile("testdata/OfflineRender/tone.sfz", (const uint8_t*)"<region> sample=tone.raw\n", 25);
+    createScore("testdata/OfflineRender/score.mid");
+
+    File file(kWavPath, FILE_WRITE);
+    ASSERT_TRUE(static_cast<bool>(file));
+    WavWriter writer(file, kSampleRate, 16, 2);
+    ASSERT_TRUE(writer.begin());
+
+    SFZSink sink("testdata/OfflineRender/tone.sfz");
+    sink.setPcmWriter(&writer);
+    ScoreSrc src("testdata/OfflineRender/score.mid", sink);
+    setTime(0);
+    ASSERT_TRUE(src.begin());
+    ASSERT_TRUE(src.setParam(ScoreSrc::PARAMID_STATUS, ScoreSrc::PLAY));
+
+    auto start = std::chrono::steady_clock::now();
+    const uint64_t kMaxFrames = kSampleRate * 3 / kSampleCount;
+    const uint64_t kTailFrames = kSampleRate / 4 / kSampleCount;
+    uint64_t frames = 0;
+    uint64_t end_frame = 0;
+    while (frames < kMaxFrames) {
+        setTime(frames * kSampleCount * 1000 / kSampleRate);
+        if (src.getParam(ScoreFilter::PARAMID_STATUS) != ScoreFilter::END) {
+            src.update();
+            end_frame = frames;
+        } else if (frames < end_frame + kTailFrames) {
+            // let the released voice fade out
+            sink.update();
+        } else {
+            break;
+        }
+        frames = writer.getPcmSize() / (kSampleCount * 4);
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    EXPECT_TRUE(writer.end());
+    file.close();
+
+    // the score ends with the last note off at 1.0 s of virtual time, much faster than real time
+    double rendered = (double)frames * kSampleCount / kSampleRate;
+    EXPECT_NEAR((double)end_frame * kSampleCount / kSampleRate, 1.0, 0.02);
+    EXPECT_LT(elapsed, rendered);
+    printf("rendered %.3f s in %.3f s (x%.1f)\n", rendered, elapsed, rendered / elapsed);
+
+    File result(kWavPath);
+    ASSERT_TRUE(static_cast<bool>(result));
+    WavReader reader(result);
+    ASSERT_TRUE(reader.isWaveFile());
+    ASSERT_EQ(reader.getPcmSize(), frames * kSampleCount * 4);
+    ASSERT_GT(frames, (uint64_t)kSampleRate * 5 / 4 / kSampleCount);
+    std::vector<int16_t> pcm(reader.getPcmSize() / sizeof(int16_t));
+    result.seek(reader.getPcmOffset());
+    result.read(pcm.data(), reader.getPcmSize());
+    result.close();
+    remove(kWavPath);
+
+    // silence, then the note from 0.5 s to 1.0 s, then silence
+    auto at = [&](double sec) { return pcm[(size_t)(sec * kSampleRate) * 2]; };
+    EXPECT_EQ(at(0.25), 0);
+    EXPECT_EQ(at(0.75), kLevel);
+    EXPECT_EQ(at(1.25), 0);
+    size_t first = 0;
+    while (first < pcm.size() && pcm[first] == 0) {
+        first++;
+    }
+    EXPECT_NEAR((double)first / 2 / kSampleRate, 0.5, 0.02);
+}
@@ -0,0 +1,57 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <stdio.h>
+
+#include <chrono>
+
+#include <gtest/gtest.h>
+
+#include <Arduino.h>
+
+#include <OutputMixer.h>
+
+#include "PcmRenderer.h"
+
+static const int kSampleCount = 240;
+static const size_t kFrameSize = kSampleCount * 2 * 2;
+static const int kBenchFrames = 2000;
+
+static double measureRender(int active_voices) {
+    OutputMixer *mixer = OutputMixer::getInstance();
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize * 4, PcmRenderer::kMaxChannel);
+    renderer.begin();
+    mixer->clear();
+
+    int16_t frame[kSampleCount * 2];
+    for (int i = 0; i < kSampleCount * 2; i++) {
+        frame[i] = (int16_t)((i * 37) & 0x0FFF);
+    }
+    for (int i = 0; i < active_voices; i++) {
+        renderer.allocateChannel();
+    }
+
+    std::chrono::nanoseconds elapsed(0);
+    for (int n = 0; n < kBenchFrames; n++) {
+        for (int ch = 0; ch < active_voices; ch++) {
+            renderer.write(ch, frame, sizeof(frame));
+        }
+        auto start = std::chrono::steady_clock::now();
+        bool ok = renderer.render();
+        elapsed += std::chrono::steady_clock::now() - start;
+        EXPECT_TRUE(ok);
+        mixer->clear();
+    }
+    return (double)elapsed.count() / kBenchFrames;
+}
+
+TEST(PcmRendererBench, RenderPerFrame) {
+    const int kVoices[] = {4, 16, 32, 64};
+    for (int voices : kVoices) {
+        double ns = measureRender(voices);
+        printf("[ PcmRenderer ] render(): %2d voices, %10.1f ns/frame (%d frames)\n", voices, ns, kBenchFrames);
+    }
+}
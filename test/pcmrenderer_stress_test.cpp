@@ -0,0 +1,210 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <atomic>
+#include <chrono>
+
+#include <Arduino.h>
+
+#include <OutputMixer.h>
+
+#include "PcmRenderer.h"
+
+static const int kSampleCount = 240;
+static const size_t kFrameSize = kSampleCount * 2 * 2;
+static const int16_t kLevel = 1000;
+
+struct RingContext {
+    PcmRenderer *renderer;
+    int ch;
+    uint32_t words;
+    uint32_t errors;
+};
+
+static void *ringProducer(void *arg) {
+    RingContext *ctx = static_cast<RingContext *>(arg);
+    uint32_t seq = 0;
+    uint32_t chunk[kSampleCount];
+    for (size_t n = 1; seq < ctx->words; n = (n % kSampleCount) + 1) {
+        size_t count = (n < ctx->words - seq) ? n : ctx->words - seq;
+        while (ctx->renderer->getWritableSize(ctx->ch) < count * sizeof(uint32_t)) {
+            sched_yield();
+        }
+        for (size_t i = 0; i < count; i++) {
+            chunk[i] = seq + i;
+        }
+        ctx->renderer->write(ctx->ch, chunk, count * sizeof(uint32_t));
+        seq += count;
+    }
+    return nullptr;
+}
+
+static void *ringConsumer(void *arg) {
+    RingContext *ctx = static_cast<RingContext *>(arg);
+    uint32_t seq = 0;
+    uint32_t chunk[kSampleCount];
+    for (size_t n = kSampleCount; seq < ctx->words; n = (n > 1) ? n - 1 : kSampleCount) {
+        size_t count = (n < ctx->words - seq) ? n : ctx->words - seq;
+        size_t readable = ctx->renderer->getReadableSize(ctx->ch) / sizeof(uint32_t);
+        count = (count < readable) ? count : readable;
+        if (count == 0) {
+            sched_yield();
+            continue;
+        }
+        ctx->renderer->read(ctx->ch, chunk, count * sizeof(uint32_t));
+        for (size_t i = 0; i < count; i++) {
+            if (chunk[i] != seq + i) {
+                ctx->errors++;
+            }
+        }
+        seq += count;
+    }
+    return nullptr;
+}
+
+TEST(PcmRendererStress, SpscRing) {
+    // an odd capacity makes the wrap-around position move on every lap
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize + 4, 1);
+    RingContext ctx = {&renderer, renderer.allocateChannel(), 200000, 0};
+    ASSERT_EQ(ctx.ch, 0);
+
+    pthread_t producer, consumer;
+    ASSERT_EQ(pthread_create(&consumer, nullptr, ringConsumer, &ctx), 0);
+    ASSERT_EQ(pthread_create(&producer, nullptr, ringProducer, &ctx), 0);
+    pthread_join(producer, nullptr);
+    pthread_join(consumer, nullptr);
+
+    EXPECT_EQ(ctx.errors, 0U);
+    EXPECT_EQ(renderer.getReadableSize(ctx.ch), 0U);
+}
+
+struct MixerContext {
+    PcmRenderer *renderer;
+    std::atomic<bool> running;
+    int peak;
+    std::atomic<int> frames;
+    std::atomic<int64_t> level;
+};
+
+static void *checkOutput(void *arg, AsSendDataOutputMixer *data) {
+    MixerContext *ctx = static_cast<MixerContext *>(arg);
+    const int16_t *pcm = static_cast<const int16_t *>(data->pcm.mh.getPa());
+    int64_t level = 0;
+    for (uint32_t i = 0; pcm != nullptr && i < data->pcm.size / sizeof(int16_t); i++) {
+        int v = (pcm[i] < 0) ? -pcm[i] : pcm[i];
+        ctx->peak = (ctx->peak < v) ? v : ctx->peak;
+        level += v;
+    }
+    ctx->level += level;
+    ctx->frames++;
+    return nullptr;
+}
+
+static void *mixerThread(void *arg) {
+    // plays the role of the OutputMixer callback context
+    MixerContext *ctx = static_cast<MixerContext *>(arg);
+    OutputMixer *mixer = OutputMixer::getInstance();
+    while (ctx->running.load()) {
+        mixer->flush(1);
+        ctx->renderer->render();
+        sched_yield();
+    }
+    return nullptr;
+}
+
+TEST(PcmRendererStress, AllocateWhileRendering) {
+    const int kChannels = 8;
+    OutputMixer *mixer = OutputMixer::getInstance();
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize * 3, kChannels);
+    renderer.begin();
+
+    MixerContext ctx;
+    ctx.renderer = &renderer;
+    ctx.running.store(true);
+    ctx.peak = 0;
+    ctx.frames = 0;
+    ctx.level = 0;
+    mixer->setOutputHandler(checkOutput, &ctx);
+
+    pthread_t consumer;
+    ASSERT_EQ(pthread_create(&consumer, nullptr, mixerThread, &ctx), 0);
+
+    // producer: keep allocating, feeding and releasing channels
+    int16_t frame[kSampleCount * 2];
+    for (size_t i = 0; i < sizeof(frame) / sizeof(frame[0]); i++) {
+        frame[i] = kLevel;
+    }
+    int channels[kChannels];
+    for (int i = 0; i < kChannels; i++) {
+        channels[i] = -1;
+    }
+    int allocated = 0;
+    for (int loop = 0; loop < 20000; loop++) {
+        int slot = loop % kChannels;
+        if (channels[slot] < 0) {
+            channels[slot] = renderer.allocateChannel();
+            allocated += (channels[slot] >= 0) ? 1 : 0;
+        } else if ((loop / kChannels) % 5 == slot % 5) {
+            renderer.deallocateChannel(channels[slot]);
+            channels[slot] = -1;
+        } else if (renderer.getWritableSize(channels[slot]) >= sizeof(frame)) {
+            renderer.write(channels[slot], frame, sizeof(frame));
+        }
+        if (slot == 0) {
+            sched_yield();
+        }
+    }
+    for (int i = 0; i < kChannels; i++) {
+        renderer.deallocateChannel(channels[i]);
+    }
+
+    // every channel must drain and return to the producer
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (renderer.getActiveChannelCount() > 0 && std::chrono::steady_clock::now() < deadline) {
+        sched_yield();
+    }
+    EXPECT_EQ(renderer.getActiveChannelCount(), 0);
+
+    // the first samples committed to a new channel must be heard, not dropped as if it were released
+    int missed = 0;
+    deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    for (int loop = 0; loop < 2000 && renderer.getActiveChannelCount() == 0; loop++) {
+        int ch = renderer.allocateChannel();
+        ASSERT_GE(ch, 0);
+        int64_t level = ctx.level.load();
+        renderer.write(ch, frame, sizeof(frame));
+        while (renderer.getReadableSize(ch) > 0 && std::chrono::steady_clock::now() < deadline) {
+            sched_yield();
+        }
+        // wait until the frame mixed above has been passed to the output handler
+        for (int frames = ctx.frames.load(); ctx.frames.load() < frames + 2 && std::chrono::steady_clock::now() < deadline;) {
+            sched_yield();
+        }
+        missed += (ctx.level.load() == level) ? 1 : 0;
+        renderer.deallocateChannel(ch);
+        while (renderer.getActiveChannelCount() > 0 && std::chrono::steady_clock::now() < deadline) {
+            sched_yield();
+        }
+    }
+    ctx.running.store(false);
+    pthread_join(consumer, nullptr);
+    mixer->setOutputHandler(nullptr, nullptr);
+    mixer->clear();
+
+    EXPECT_GT(allocated, kChannels);
+    EXPECT_GT(ctx.frames.load(), 0);
+    EXPECT_EQ(missed, 0);
+    EXPECT_LE(ctx.peak, kLevel * kChannels);
+    EXPECT_EQ(renderer.getActiveChannelCount(), 0);
+    for (int i = 0; i < kChannels; i++) {
+        EXPECT_EQ(renderer.allocateChannel(), i);
+    }
+}
@@ -0,0 +1,432 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <Arduino.h>
+
+#include <File.h>
+#include <OutputMixer.h>
+
+#include "PcmRenderer.h"
+#include "PcmWriter.h"
+#include "mix_kernel.h"
+
+static const int kSampleCount = 240;
+static const size_t kFrameSize = kSampleCount * 2 * 2;
+
+TEST(PcmRenderer, AllocateChannels) {
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize * 4, 16);
+    EXPECT_EQ(renderer.getChannelCount(), 16);
+    for (int i = 0; i < 16; i++) {
+        EXPECT_EQ(renderer.allocateChannel(), i);
+    }
+    EXPECT_EQ(renderer.allocateChannel(), -1);
+    EXPECT_EQ(renderer.getActiveChannelCount(), 16);
+}
+
+TEST(PcmRenderer, ClampChannels) {
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize * 4, PcmRenderer::kMaxChannel + 1);
+    EXPECT_EQ(renderer.getChannelCount(), PcmRenderer::kMaxChannel);
+}
+
+TEST(PcmRenderer, ReleaseChannel) {
+    OutputMixer *mixer = OutputMixer::getInstance();
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize * 4, 8);
+    renderer.begin();
+    mixer->clear();
+
+    int16_t frame[kSampleCount * 2] = {};
+    int ch = renderer.allocateChannel();
+    ASSERT_GE(ch, 0);
+    EXPECT_EQ(renderer.write(ch, frame, sizeof(frame)), sizeof(frame));
+    EXPECT_EQ(renderer.getActiveChannelCount(), 1);
+    renderer.deallocateChannel(ch);
+    EXPECT_TRUE(renderer.render());
+    mixer->clear();
+    EXPECT_EQ(renderer.getActiveChannelCount(), 0);
+    EXPECT_EQ(renderer.allocateChannel(), ch);
+}
+
+TEST(PcmRenderer, WriteRegionWrapsAround) {
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize + 4, 1);
+    int ch = renderer.allocateChannel();
+    ASSERT_EQ(ch, 0);
+
+    // move the write position close to the end of the ring
+    uint8_t head[kFrameSize - 8] = {};
+    uint8_t sink[kFrameSize] = {};
+    EXPECT_EQ(renderer.write(ch, head, sizeof(head)), sizeof(head));
+    EXPECT_EQ(renderer.read(ch, sink, sizeof(head)), sizeof(head));
+
+    uint8_t *ptr1 = nullptr;
+    uint8_t *ptr2 = nullptr;
+    size_t len1 = 0;
+    size_t len2 = 0;
+    EXPECT_EQ(renderer.acquireWriteRegion(ch, &ptr1, &len1, &ptr2, &len2), kFrameSize + 3);
+    EXPECT_EQ(len1, 12U);
+    EXPECT_EQ(len2, kFrameSize - 9);
+    for (size_t i = 0; i < 16; i++) {
+        uint8_t *p = (i < len1) ? &ptr1[i] : &ptr2[i - len1];
+        *p = (uint8_t)i;
+    }
+    EXPECT_EQ(renderer.commitWrite(ch, 16), 16U);
+    EXPECT_EQ(renderer.getReadableSize(ch), 16U);
+    EXPECT_EQ(renderer.read(ch, sink, 16), 16U);
+    for (size_t i = 0; i < 16; i++) {
+        EXPECT_EQ(sink[i], (uint8_t)i);
+    }
+    EXPECT_EQ(renderer.commitWrite(ch, kFrameSize + 4), 0U);
+}
+
+TEST(PcmRenderer, ZeroCopyStreaming) {
+    static uint8_t content[kFrameSize * 3];
+    for (size_t i = 0; i < sizeof(content); i++) {
+        content[i] = (uint8_t)(i * 7);
+    }
+    registerDummyFile("/zerocopy.raw", content, sizeof(content));
+
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize * 4, 1);
+    int ch = renderer.allocateChannel();
+    ASSERT_EQ(ch, 0);
+
+    // the streaming path reads from the file into the ring buffer directly
+    File file("/zerocopy.raw");
+    while (file.position() < file.size()) {
+        uint8_t *ptr1 = nullptr;
+        uint8_t *ptr2 = nullptr;
+        size_t len1 = 0;
+        size_t len2 = 0;
+        ASSERT_GE(renderer.acquireWriteRegion(ch, &ptr1, &len1, &ptr2, &len2), kFrameSize);
+        size_t size1 = (kFrameSize < len1) ? kFrameSize : len1;
+        size_t n = file.read(ptr1, size1);
+        if (size1 < kFrameSize) {
+            n += file.read(ptr2, kFrameSize - size1);
+        }
+        EXPECT_EQ(renderer.commitWrite(ch, n), kFrameSize);
+    }
+    file.close();
+
+    // nothing went through an intermediate copy, and the data is not altered by the fade-in
+    EXPECT_EQ(renderer.getCommittedSize(), sizeof(content));
+    EXPECT_EQ(renderer.getCopiedSize(), 0U);
+    uint8_t sink[sizeof(content)];
+    EXPECT_EQ(renderer.read(ch, sink, sizeof(sink)), sizeof(sink));
+    EXPECT_EQ(memcmp(sink, content, sizeof(content)), 0);
+
+    // write() copies once, straight into the ring buffer
+    EXPECT_EQ(renderer.write(ch, content, kFrameSize), kFrameSize);
+    EXPECT_EQ(renderer.getCommittedSize(), sizeof(content) + kFrameSize);
+    EXPECT_EQ(renderer.getCopiedSize(), kFrameSize);
+}
+
+static void *captureFrame(void *arg, AsSendDataOutputMixer *data) {
+    std::vector<int16_t> *frames = static_cast<std::vector<int16_t> *>(arg);
+    const int16_t *pcm = static_cast<const int16_t *>(data->pcm.mh.getPa());
+    frames->insert(frames->end(), pcm, pcm + data->pcm.size / sizeof(int16_t));
+    return nullptr;
+}
+
+TEST(PcmRenderer, FadeInAtMixTime) {
+    OutputMixer *mixer = OutputMixer::getInstance();
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize * 4, 1);
+    renderer.begin();
+    mixer->clear();
+
+    int16_t frame[kSampleCount * 2];
+    for (int i = 0; i < kSampleCount * 2; i++) {
+        frame[i] = 1000;
+    }
+    int ch = renderer.allocateChannel();
+    ASSERT_EQ(renderer.write(ch, frame, sizeof(frame)), sizeof(frame));
+    ASSERT_EQ(renderer.write(ch, frame, sizeof(frame)), sizeof(frame));
+    EXPECT_TRUE(renderer.render());
+    EXPECT_TRUE(renderer.render());
+
+    std::vector<int16_t> out;
+    mixer->setOutputHandler(captureFrame, &out);
+    mixer->flush(2);
+    mixer->setOutputHandler(nullptr, nullptr);
+    mixer->clear();
+
+    ASSERT_EQ(out.size(), (size_t)kSampleCount * 2 * 2);
+    // the first block ramps up from silence, both channels of a frame with the same gain
+    EXPECT_EQ(out[0], 0);
+    EXPECT_EQ(out[1], 0);
+    for (int i = 1; i < kSampleCount; i++) {
+        EXPECT_LE(out[i * 2 - 2], out[i * 2]);
+        EXPECT_EQ(out[i * 2], out[i * 2 + 1]);
+    }
+    EXPECT_GT(out[kSampleCount * 2 - 2], 990);
+    // then unity gain
+    for (int i = kSampleCount * 2; i < kSampleCount * 4; i++) {
+        EXPECT_EQ(out[i], 1000);
+    }
+}
+
+// renders two frames of constant voices and returns the second one (the first one fades in)
+static std::vector<int16_t> renderConstantVoices(const std::vector<int16_t> &levels, int16_t master_gain) {
+    OutputMixer *mixer = OutputMixer::getInstance();
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize * 4, 8);
+    renderer.begin();
+    renderer.setMasterGain(master_gain);
+    mixer->clear();
+
+    for (int16_t level : levels) {
+        int16_t frame[kSampleCount * 2];
+        for (int i = 0; i < kSampleCount * 2; i++) {
+            frame[i] = level;
+        }
+        int ch = renderer.allocateChannel();
+        renderer.write(ch, frame, sizeof(frame));
+        renderer.write(ch, frame, sizeof(frame));
+    }
+    renderer.render();
+    renderer.render();
+
+    std::vector<int16_t> out;
+    mixer->setOutputHandler(captureFrame, &out);
+    mixer->flush(2);
+    mixer->setOutputHandler(nullptr, nullptr);
+    mixer->clear();
+    if (out.size() < (size_t)kSampleCount * 2 * 2) {
+        return std::vector<int16_t>();
+    }
+    return std::vector<int16_t>(out.begin() + kSampleCount * 2, out.begin() + kSampleCount * 2 * 2);
+}
+
+TEST(PcmRenderer, MixBusGolden) {
+    struct {
+        std::vector<int16_t> levels;
+        int16_t master_gain;
+        int16_t expected;
+    } kGolden[] = {
+        {{12000, 12000}, MIX_GAIN_UNITY, 24000},                 // below the knee: exact sum
+        {{10000, 10000, 10000}, MIX_GAIN_UNITY, 29102},          // soft knee
+        {{12000, 12000, 12000, 12000}, MIX_GAIN_UNITY, 32767},   // limited
+        {{12000, 12000, 12000, 12000}, MIX_GAIN_UNITY / 2, 24000},  // master gain before the limiter
+        {{-30000, -30000, 30000}, MIX_GAIN_UNITY, -29102},       // no clipping of intermediate sums
+        {{30000, -30000, -30000}, MIX_GAIN_UNITY, -29102},       // independent of the voice order
+    };
+    for (const auto &golden : kGolden) {
+        std::vector<int16_t> out = renderConstantVoices(golden.levels, golden.master_gain);
+        ASSERT_EQ(out.size(), (size_t)kSampleCount * 2);
+        for (int16_t v : out) {
+            ASSERT_EQ(v, golden.expected) << "voices=" << golden.levels.size() << ", first=" << golden.levels[0];
+        }
+    }
+}
+
+TEST(PcmRenderer, ChannelGainRamp) {
+    OutputMixer *mixer = OutputMixer::getInstance();
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize * 4, 1);
+    renderer.begin();
+    mixer->clear();
+
+    int16_t frame[kSampleCount * 2];
+    for (int i = 0; i < kSampleCount * 2; i++) {
+        frame[i] = 1000;
+    }
+    int ch = renderer.allocateChannel();
+    for (int i = 0; i < 3; i++) {
+        renderer.write(ch, frame, sizeof(frame));
+    }
+    renderer.render();
+    renderer.setChannelGain(ch, MIX_GAIN_UNITY / 2, 0);
+    renderer.render();
+    renderer.render();
+
+    std::vector<int16_t> out;
+    mixer->setOutputHandler(captureFrame, &out);
+    mixer->flush(3);
+    mixer->setOutputHandler(nullptr, nullptr);
+    mixer->clear();
+    ASSERT_EQ(out.size(), (size_t)kSampleCount * 2 * 3);
+
+    // the second frame ramps from unity to the new gain without a step
+    const int16_t *ramp = &out[kSampleCount * 2];
+    EXPECT_GT(ramp[0], 990);
+    EXPECT_GT(ramp[1], 990);
+    for (int i = 2; i < kSampleCount * 2; i++) {
+        EXPECT_LE(ramp[i], ramp[i - 2]);
+        EXPECT_LE(ramp[i - 2] - ramp[i], 10);
+    }
+    // then left = 0.5, right = 0
+    for (int i = kSampleCount * 4; i < kSampleCount * 6; i += 2) {
+        EXPECT_EQ(out[i], 500);
+        EXPECT_EQ(out[i + 1], 0);
+    }
+}
+
+TEST(PcmRenderer, UnderrunCount) {
+    OutputMixer *mixer = OutputMixer::getInstance();
+    mixer->clear();
+    static int16_t out[kSampleCount * 2 * 4];
+    PcmBufferWriter writer(out, sizeof(out));
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize * 4, 2);
+    renderer.begin(&writer);
+
+    int16_t frame[kSampleCount * 2];
+    for (int i = 0; i < kSampleCount * 2; i++) {
+        frame[i] = 1000;
+    }
+    int ch0 = renderer.allocateChannel();
+    int ch1 = renderer.allocateChannel();
+    renderer.write(ch0, frame, sizeof(frame));
+    renderer.write(ch1, frame, sizeof(frame) / 2);
+
+    // an ending channel does not shorten the frame of the others
+    renderer.deallocateChannel(ch1);
+    EXPECT_TRUE(renderer.render());
+    EXPECT_EQ(renderer.getUnderrunCount(), 0U);
+    EXPECT_GT(out[kSampleCount * 2 - 1], 900);
+
+    // a playing channel without data is an underrun
+    EXPECT_TRUE(renderer.render());
+    EXPECT_EQ(renderer.getUnderrunCount(), 1U);
+
+    // no playing channel is not
+    renderer.deallocateChannel(ch0);
+    EXPECT_TRUE(renderer.render());
+    EXPECT_EQ(renderer.getUnderrunCount(), 1U);
+}
+
+TEST(PcmRenderer, LongRelease) {
+    OutputMixer *mixer = OutputMixer::getInstance();
+    mixer->clear();
+    static int16_t out[kSampleCount * 2 * 8];
+    PcmBufferWriter writer(out, sizeof(out));
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize * 8, 1);
+    renderer.begin(&writer);
+
+    int16_t frame[kSampleCount * 2];
+    for (int i = 0; i < kSampleCount * 2; i++) {
+        frame[i] = 1000;
+    }
+    // one frame of attack and four frames of release
+    int ch = renderer.allocateChannel(-1, 20);
+    for (int i = 0; i < 6; i++) {
+        renderer.write(ch, frame, sizeof(frame));
+    }
+    EXPECT_TRUE(renderer.render());
+    EXPECT_EQ(out[kSampleCount * 2 - 2], 995);
+
+    renderer.deallocateChannel(ch);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_TRUE(renderer.render());
+        EXPECT_EQ(renderer.getActiveChannelCount(), 1);
+    }
+    EXPECT_TRUE(renderer.render());
+    EXPECT_EQ(renderer.getActiveChannelCount(), 0);
+    EXPECT_EQ(renderer.allocateChannel(), 0);
+
+    // the level falls linearly over the four frames
+    EXPECT_NEAR(out[kSampleCount * 2 * 1], 1000, 2);
+    EXPECT_NEAR(out[kSampleCount * 2 * 2], 750, 2);
+    EXPECT_NEAR(out[kSampleCount * 2 * 3], 500, 2);
+    EXPECT_NEAR(out[kSampleCount * 2 * 4], 250, 2);
+    EXPECT_NEAR(out[kSampleCount * 2 * 5 - 2], 0, 2);
+}
+
+TEST(PcmRenderer, KeepsOutputAfterDummyFrames) {
+    // begin() sends dummy frames, and their responses must not be taken for a full output queue
+    OutputMixer *mixer = OutputMixer::getInstance();
+    mixer->clear();
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize * 4, 1);
+    renderer.begin();
+
+    // half a frame: every frame from now on is an underrun, sent only while the output queue runs short
+    int16_t half[kSampleCount];
+    for (int i = 0; i < kSampleCount; i++) {
+        half[i] = 1000;
+    }
+    int ch = renderer.allocateChannel();
+    renderer.write(ch, half, sizeof(half));
+    mixer->flush(3);
+    EXPECT_GT(renderer.getRenderedSamples(), 0U);
+    EXPECT_GT(renderer.getUnderrunCount(), 0U);
+    renderer.deallocateChannel(ch);
+    mixer->clear();
+}
+
+TEST(PcmRenderer, ReleaseBeforeFirstBlock) {
+    OutputMixer *mixer = OutputMixer::getInstance();
+    mixer->clear();
+    static int16_t out[kSampleCount * 2 * 8];
+    PcmBufferWriter writer(out, sizeof(out));
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize * 8, 1);
+    renderer.begin(&writer);
+
+    int16_t frame[kSampleCount * 2];
+    for (int i = 0; i < kSampleCount * 2; i++) {
+        frame[i] = 1000;
+    }
+    // note-on and note-off within one frame
+    int ch = renderer.allocateChannel();
+    for (int i = 0; i < 3; i++) {
+        renderer.write(ch, frame, sizeof(frame));
+    }
+    renderer.deallocateChannel(ch);
+    for (int i = 0; i < 3 && renderer.getActiveChannelCount() > 0; i++) {
+        EXPECT_TRUE(renderer.render());
+    }
+    EXPECT_EQ(renderer.getActiveChannelCount(), 0);
+
+    // the attack is heard in the first block and released in the next one
+    EXPECT_EQ(out[0], 0);
+    EXPECT_GT(out[kSampleCount * 2 - 2], 990);
+    EXPECT_GT(out[kSampleCount * 2], 0);
+    EXPECT_LT(out[kSampleCount * 2 * 2 - 2], 10);
+}
+
+TEST(PcmRenderer, OfflineRender) {
+    OutputMixer *mixer = OutputMixer::getInstance();
+    mixer->clear();
+    static int16_t out[kSampleCount * 2 * 4];
+    PcmBufferWriter writer(out, sizeof(out));
+    PcmRenderer renderer(48000, 16, 2, kSampleCount, kFrameSize * 4, 2);
+    renderer.begin(&writer);
+
+    int16_t frame[kSampleCount * 2];
+    for (int i = 0; i < kSampleCount * 2; i++) {
+        frame[i] = 1000;
+    }
+    int ch = renderer.allocateChannel();
+    renderer.write(ch, frame, sizeof(frame));
+    renderer.write(ch, frame, sizeof(frame));
+
+    // the virtual clock advances one frame per render() without waiting for OutputMixer
+    EXPECT_EQ(renderer.getRenderedSamples(), 0U);
+    EXPECT_TRUE(renderer.render());
+    EXPECT_TRUE(renderer.render());
+    EXPECT_EQ(renderer.getRenderedSamples(), (uint64_t)kSampleCount * 2);
+    EXPECT_EQ(writer.getSize(), kFrameSize * 2);
+    EXPECT_EQ(out[0], 0);
+    for (int i = kSampleCount * 2; i < kSampleCount * 4; i++) {
+        EXPECT_EQ(out[i], 1000);
+    }
+
+    // underflow is filled with silence instead of waiting
+    renderer.deallocateChannel(ch);
+    EXPECT_TRUE(renderer.render());
+    EXPECT_EQ(renderer.getActiveChannelCount(), 0);
+    for (int i = kSampleCount * 4; i < kSampleCount * 6; i++) {
+        EXPECT_EQ(out[i], 0);
+    }
+
+    // a full writer fails the render
+    EXPECT_TRUE(renderer.render());
+    EXPECT_FALSE(renderer.render());
+
+    // nothing goes to OutputMixer
+    std::vector<int16_t> sent;
+    mixer->setOutputHandler(captureFrame, &sent);
+    mixer->flush();
+    mixer->setOutputHandler(nullptr, nullptr);
+    EXPECT_TRUE(sent.empty());
+}
@@ -0,0 +1,151 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Resampler.h"
+
+static std::vector<int16_t> create_ramp(size_t frames) {
+    std::vector<int16_t> data(frames * 2);
+    for (size_t i = 0; i < frames; i++) {
+        data[i * 2 + 0] = (int16_t)(i * 100);
+        data[i * 2 + 1] = (int16_t)(-(int)i * 50);
+    }
+    return data;
+}
+
+// feeds src in chunks of at most chunk frames and reads everything out
+static std::vector<int16_t> resample(Resampler* rs, const std::vector<int16_t>& src, size_t chunk, size_t out_chunk) {
+    std::vector<int16_t> out;
+    std::vector<int16_t> buf(out_chunk * 2);
+    size_t written = 0;
+    size_t frames = src.size() / 2;
+    bool flushed = false;
+    while (true) {
+        size_t ret = rs->read(buf.data(), out_chunk);
+        out.insert(out.end(), buf.begin(), buf.begin() + ret * 2);
+        if (ret == out_chunk) {
+            continue;
+        }
+        if (written < frames) {
+            size_t writable = 0;
+            int16_t* dst = rs->getWritePointer(&writable);
+            size_t n = (frames - written < chunk) ? frames - written : chunk;
+            n = (n < writable) ? n : writable;
+            memcpy(dst, &src[written * 2], n * 2 * sizeof(int16_t));
+            rs->commitWrite(n);
+            written += n;
+        } else if (!flushed) {
+            rs->flush();
+            flushed = true;
+        } else {
+            break;
+        }
+    }
+    return out;
+}
+
+TEST(Resampler, ConvertCentsToStep) {
+    EXPECT_EQ(Resampler::convertCentsToStep(0), Resampler::kUnityStep);
+    EXPECT_EQ(Resampler::convertCentsToStep(1200), 0x20000U);
+    EXPECT_EQ(Resampler::convertCentsToStep(-1200), 0x8000U);
+    EXPECT_NEAR((double)Resampler::convertCentsToStep(700), 0x10000 * 1.4983, 8.0);
+    EXPECT_EQ(Resampler::convertCentsToStep(100000), Resampler::kMaxStep);
+    EXPECT_EQ(Resampler::convertCentsToStep(-100000), Resampler::kMinStep);
+}
+
+TEST(Resampler, UnityStepReproducesInput) {
+    std::vector<int16_t> src = create_ramp(1000);
+    for (int interpolation = 0; interpolation <= Resampler::kInterpolationMax; interpolation++) {
+        Resampler rs;
+        rs.reset(Resampler::kUnityStep, (Resampler::Interpolation)interpolation);
+        std::vector<int16_t> out = resample(&rs, src, 100, 240);
+        EXPECT_EQ(out, src) << "interpolation=" << interpolation;
+    }
+}
+
+TEST(Resampler, OctaveUpHalvesLength) {
+    std::vector<int16_t> src = create_ramp(1000);
+    for (int interpolation = 0; interpolation <= Resampler::kInterpolationMax; interpolation++) {
+        Resampler rs;
+        rs.reset(Resampler::convertCentsToStep(1200), (Resampler::Interpolation)interpolation);
+        std::vector<int16_t> out = resample(&rs, src, 100, 240);
+        ASSERT_EQ(out.size(), src.size() / 2) << "interpolation=" << interpolation;
+        // every other input frame, at the integer positions
+        for (size_t i = 0; i < out.size() / 2; i++) {
+            EXPECT_EQ(out[i * 2], src[i * 4]) << "interpolation=" << interpolation << ", i=" << i;
+        }
+    }
+}
+
+TEST(Resampler, OctaveDownInterpolates) {
+    std::vector<int16_t> src = create_ramp(100);
+    Resampler rs;
+    rs.reset(Resampler::convertCentsToStep(-1200), Resampler::kInterpolationLinear);
+    std::vector<int16_t> out = resample(&rs, src, 100, 240);
+    ASSERT_EQ(out.size(), src.size() * 2);
+    // the midpoints of the ramp
+    for (size_t i = 0; i + 1 < src.size() / 2; i++) {
+        EXPECT_EQ(out[i * 4 + 0], src[i * 2]);
+        EXPECT_EQ(out[i * 4 + 2], (src[i * 2] + src[i * 2 + 2]) / 2);
+    }
+}
+
+TEST(Resampler, ConstantLevelIsKept) {
+    std::vector<int16_t> src(2000 * 2, 10000);
+    for (int interpolation = 0; interpolation <= Resampler::kInterpolationMax; interpolation++) {
+        Resampler rs;
+        rs.reset(Resampler::convertCentsToStep(350), (Resampler::Interpolation)interpolation);
+        std::vector<int16_t> out = resample(&rs, src, 256, 240);
+        // away from the silence at both ends
+        for (size_t i = 8 * 2; i + 8 * 2 < out.size(); i++) {
+            EXPECT_EQ(out[i], 10000) << "interpolation=" << interpolation << ", i=" << i;
+        }
+    }
+}
+
+TEST(Resampler, ChunkedInputMatches) {
+    srand(1234);
+    std::vector<int16_t> src(3000 * 2);
+    for (auto& e : src) {
+        e = (int16_t)((rand() % 65536) - 32768);
+    }
+    uint32_t step = Resampler::convertCentsToStep(-530);
+    for (int interpolation = 0; interpolation <= Resampler::kInterpolationMax; interpolation++) {
+        Resampler whole;
+        whole.reset(step, (Resampler::Interpolation)interpolation);
+        std::vector<int16_t> expected = resample(&whole, src, Resampler::kBufferFrames, 240);
+        for (size_t chunk : {1, 7, 64}) {
+            Resampler rs;
+            rs.reset(step, (Resampler::Interpolation)interpolation);
+            EXPECT_EQ(resample(&rs, src, chunk, 13), expected) << "interpolation=" << interpolation << ", chunk=" << chunk;
+        }
+    }
+}
+
+TEST(Resampler, RequiredFrames) {
+    Resampler rs;
+    rs.reset(0x20000, Resampler::kInterpolationCubic);
+    EXPECT_EQ(rs.getRequiredFrames(0), 0U);
+    // 1 frame of silence is already in front of the first frame
+    size_t required = rs.getRequiredFrames(240);
+    EXPECT_EQ(required, 478U + 4U - 1U);
+    size_t writable = 0;
+    int16_t* dst = rs.getWritePointer(&writable);
+    ASSERT_GE(writable, 100U);
+    memset(dst, 0, 100 * 2 * sizeof(int16_t));
+    rs.commitWrite(100);
+    int16_t out[240 * 2];
+    size_t ret = rs.read(out, 240);
+    EXPECT_EQ(ret, 49U);
+    EXPECT_EQ(rs.getRequiredFrames(240 - ret), required - 100);
+}
@@ -0,0 +1,79 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <stdint.h>
+
+#include "gtest/gtest.h"
+
+#include <Arduino.h>
+#include <File.h>
+
+#include "SampleHeadCache.h"
+
+static void create_counter(const String& file_path, int size) {
+    std::vector<uint8_t> data(size);
+    for (int i = 0; i < size; i++) {
+        data[i] = (uint8_t)i;
+    }
+    registerDummyFile(file_path, data.data(), size);
+}
+
+TEST(SampleHeadCache, Disabled) {
+    create_counter("testdata/SampleHeadCache/a.raw", 1024);
+    SampleHeadCache cache;
+    EXPECT_EQ(cache.getBudget(), 0U);
+    EXPECT_LT(cache.load("testdata/SampleHeadCache/a.raw", 0, 16), 0);
+    EXPECT_EQ(cache.getEntryCount(), 0);
+}
+
+TEST(SampleHeadCache, LoadAndShare) {
+    create_counter("testdata/SampleHeadCache/a.raw", 1024);
+    SampleHeadCache cache;
+    cache.setBudget(256);
+
+    int a = cache.load("testdata/SampleHeadCache/a.raw", 0, 64);
+    int b = cache.load("testdata/SampleHeadCache/a.raw", 100, 64);
+    ASSERT_GE(a, 0);
+    ASSERT_GE(b, 0);
+    EXPECT_NE(a, b);
+    EXPECT_EQ(cache.getSize(a), 64U);
+    EXPECT_EQ(cache.getData(a)[0], 0);
+    EXPECT_EQ(cache.getData(a)[63], 63);
+    EXPECT_EQ(cache.getData(b)[0], 100);
+
+    // same file and offset share the entry
+    EXPECT_EQ(cache.load("testdata/SampleHeadCache/a.raw", 100, 32), b);
+    EXPECT_EQ(cache.getEntryCount(), 2);
+    EXPECT_EQ(cache.getUsedSize(), 128U);
+
+    cache.clear();
+    EXPECT_EQ(cache.getEntryCount(), 0);
+    EXPECT_EQ(cache.getUsedSize(), 0U);
+    EXPECT_EQ(cache.getBudget(), 256U);
+}
+
+TEST(SampleHeadCache, Budget) {
+    create_counter("testdata/SampleHeadCache/a.raw", 1024);
+    SampleHeadCache cache;
+    cache.setBudget(100);
+    EXPECT_GE(cache.load("testdata/SampleHeadCache/a.raw", 0, 64), 0);
+    EXPECT_LT(cache.load("testdata/SampleHeadCache/a.raw", 64, 64), 0);
+    EXPECT_GE(cache.load("testdata/SampleHeadCache/a.raw", 64, 36), 0);
+    EXPECT_EQ(cache.getUsedSize(), 100U);
+}
+
+TEST(SampleHeadCache, ShortFile) {
+    create_counter("testdata/SampleHeadCache/short.raw", 40);
+    SampleHeadCache cache;
+    cache.setBudget(256);
+    int id = cache.load("testdata/SampleHeadCache/short.raw", 8, 64);
+    ASSERT_GE(id, 0);
+    EXPECT_EQ(cache.getSize(id), 32U);
+    EXPECT_EQ(cache.getData(id)[0], 8);
+    EXPECT_LT(cache.load("testdata/SampleHeadCache/missing.raw", 0, 16), 0);
+    EXPECT_EQ(cache.getData(-1), nullptr);
+    EXPECT_EQ(cache.getSize(5), 0U);
+}
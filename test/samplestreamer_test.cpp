@@ -0,0 +1,323 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <Arduino.h>
+#include <File.h>
+
+#include "SampleStreamer.h"
+
+static std::vector<uint8_t> create_counter(const String& file_path, size_t size) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (uint8_t)(i * 7 + i / 256);
+    }
+    registerDummyFile(file_path, data.data(), (int)data.size());
+    return data;
+}
+
+TEST(SampleStreamer, ReadInline) {
+    std::vector<uint8_t> data = create_counter("testdata/SampleStreamer/a.raw", 10000);
+    File file("testdata/SampleStreamer/a.raw");
+    SampleStreamer streamer(2, 1000);
+    ASSERT_TRUE(streamer.begin(false));
+    EXPECT_FALSE(streamer.isBackground());
+    ASSERT_TRUE(streamer.open(0, &file, 100, 100, 10000, false));
+
+    std::vector<uint8_t> out;
+    uint8_t buf[960];
+    size_t size = 0;
+    while ((size = streamer.read(0, buf, sizeof(buf))) > 0) {
+        out.insert(out.end(), buf, buf + size);
+    }
+    ASSERT_EQ(out.size(), 9900U);
+    EXPECT_TRUE(std::equal(out.begin(), out.end(), data.begin() + 100));
+    EXPECT_EQ(streamer.getReadCount(), 10U);
+    EXPECT_EQ(streamer.getStarveCount(), 0U);
+    uint32_t peak_us = 0;
+    EXPECT_TRUE(streamer.takePeakReadTime(&peak_us));
+    EXPECT_FALSE(streamer.takePeakReadTime(&peak_us));
+    streamer.close(0);
+    EXPECT_EQ(streamer.read(0, buf, sizeof(buf)), 0U);
+}
+
+TEST(SampleStreamer, Loop) {
+    std::vector<uint8_t> data = create_counter("testdata/SampleStreamer/a.raw", 10000);
+    File file("testdata/SampleStreamer/a.raw");
+    SampleStreamer streamer(1, 1000);
+    ASSERT_TRUE(streamer.begin(false));
+    // start in front of the loop, then repeat 2000 to 3500
+    ASSERT_TRUE(streamer.open(0, &file, 1000, 2000, 3500, true));
+
+    std::vector<uint8_t> expected(data.begin() + 1000, data.begin() + 3500);
+    for (int i = 0; i < 3; i++) {
+        expected.insert(expected.end(), data.begin() + 2000, data.begin() + 3500);
+    }
+    std::vector<uint8_t> out(expected.size());
+    EXPECT_EQ(streamer.read(0, out.data(), out.size()), out.size());
+    EXPECT_EQ(out, expected);
+}
+
+TEST(SampleStreamer, DeadlineOrder) {
+    create_counter("testdata/SampleStreamer/a.raw", 10000);
+    File file0("testdata/SampleStreamer/a.raw");
+    File file1("testdata/SampleStreamer/a.raw");
+    File file2("testdata/SampleStreamer/a.raw");
+    SampleStreamer streamer(3, 1000);
+    ASSERT_TRUE(streamer.begin(false));
+    ASSERT_TRUE(streamer.open(0, &file0, 0, 0, 10000, false));
+    ASSERT_TRUE(streamer.open(1, &file1, 0, 0, 10000, false));
+    ASSERT_TRUE(streamer.open(2, &file2, 0, 0, 10000, false));
+    streamer.setQueuedSize(0, 3000);
+    streamer.setQueuedSize(1, 500);
+    streamer.setQueuedSize(2, 1500);
+
+    // voice 1 runs dry first; after one chunk it ties voice 2 at 1500 bytes and the lower slot wins
+    ASSERT_TRUE(streamer.service());
+    EXPECT_EQ(streamer.getAvailable(1), 1000U);
+    ASSERT_TRUE(streamer.service());
+    EXPECT_EQ(streamer.getAvailable(1), 2000U);
+    ASSERT_TRUE(streamer.service());
+    EXPECT_EQ(streamer.getAvailable(2), 1000U);
+    EXPECT_EQ(streamer.getAvailable(0), 0U);
+    ASSERT_TRUE(streamer.service());
+    EXPECT_EQ(streamer.getAvailable(2), 2000U);
+    ASSERT_TRUE(streamer.service());
+    EXPECT_EQ(streamer.getAvailable(0), 1000U);
+    ASSERT_TRUE(streamer.service());
+    EXPECT_EQ(streamer.getAvailable(0), 2000U);
+
+    // both chunks of every voice are filled
+    EXPECT_FALSE(streamer.service());
+    uint8_t buf[1000];
+    EXPECT_EQ(streamer.read(2, buf, sizeof(buf)), sizeof(buf));
+    ASSERT_TRUE(streamer.service());
+    EXPECT_EQ(streamer.getAvailable(2), 2000U);
+}
+
+TEST(SampleStreamer, BackgroundDoesNotBlock) {
+    std::vector<uint8_t> data = create_counter("testdata/SampleStreamer/b.raw", 40000);
+    File file("testdata/SampleStreamer/b.raw");
+    SampleStreamer streamer(1, 4000);
+    ASSERT_TRUE(streamer.begin(true));
+    EXPECT_TRUE(streamer.isBackground());
+
+    // every read of the storage stalls for 20 ms
+    setDummyReadLatency(20000);
+    ASSERT_TRUE(streamer.open(0, &file, 0, 0, 40000, false));
+
+    std::vector<uint8_t> out;
+    uint8_t buf[960];
+    auto start = std::chrono::steady_clock::now();
+    auto longest = std::chrono::steady_clock::duration::zero();
+    while (out.size() < data.size() && std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+        auto t0 = std::chrono::steady_clock::now();
+        size_t size = streamer.read(0, buf, sizeof(buf));
+        auto elapsed = std::chrono::steady_clock::now() - t0;
+        longest = (elapsed > longest) ? elapsed : longest;
+        out.insert(out.end(), buf, buf + size);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    setDummyReadLatency(0);
+    streamer.close(0);
+    streamer.end();
+
+    ASSERT_EQ(out.size(), data.size());
+    EXPECT_EQ(out, data);
+    // the main loop only waits for the lock, never for the storage
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(longest).count(), 10);
+    EXPECT_GT(streamer.getStarveCount(), 0U);
+}
+
+static SampleFormat create_format(SampleFormat::Codec codec, int channels, int bytes_per_sample, uint32_t data_offset, uint32_t data_size) {
+    SampleFormat format;
+    format.codec = codec;
+    format.channels = (uint8_t)channels;
+    format.block_align = (uint16_t)(channels * bytes_per_sample);
+    format.frames_per_block = 1;
+    format.data_offset = data_offset;
+    format.data_size = data_size;
+    format.sample_rate = 48000;
+    return format;
+}
+
+TEST(SampleStreamer, ConvertMono) {
+    // 16bit mono behind a 44 bytes header; positions are in converted 16bit, 2ch frames
+    const uint32_t kDataOffset = 44;
+    const uint32_t kFrames = 2500;
+    std::vector<uint8_t> data = create_counter("testdata/SampleStreamer/mono.wav", kDataOffset + kFrames * 2);
+    const int16_t* mono = (const int16_t*)&data[kDataOffset];
+    SampleFormat format = create_format(SampleFormat::kCodecPcm, 1, 2, kDataOffset, kFrames * 2);
+    File file("testdata/SampleStreamer/mono.wav");
+    SampleStreamer streamer(1, 1000);
+    ASSERT_TRUE(streamer.begin(false));
+    ASSERT_TRUE(streamer.open(0, &file, 100 * 4, 1000 * 4, 2500 * 4, true, &format));
+
+    std::vector<int16_t> expected;
+    for (uint32_t i = 100; i < 2500; i++) {
+        expected.push_back(mono[i]);
+        expected.push_back(mono[i]);
+    }
+    for (int n = 0; n < 2; n++) {
+        for (uint32_t i = 1000; i < 2500; i++) {
+            expected.push_back(mono[i]);
+            expected.push_back(mono[i]);
+        }
+    }
+    std::vector<int16_t> out(expected.size());
+    size_t done = 0;
+    while (done < out.size() * 2) {
+        // reads of an odd frame count, which split the file frames of a chunk
+        size_t size = (out.size() * 2 - done < 956) ? out.size() * 2 - done : 956;
+        size_t n = streamer.read(0, (uint8_t*)out.data() + done, size);
+        ASSERT_EQ(n, size);
+        done += n;
+    }
+    EXPECT_EQ(out, expected);
+    // a chunk holds 500 file frames, twice as many as of the converted frames
+    EXPECT_EQ(streamer.getReadCount(), 5U + 3U * 2U);
+    file.close();
+}
+
+TEST(SampleStreamer, Convert24Background) {
+    const uint32_t kFrames = 3000;
+    std::vector<uint8_t> data = create_counter("testdata/SampleStreamer/24bit.wav", kFrames * 6);
+    SampleFormat format = create_format(SampleFormat::kCodecPcm24, 2, 3, 0, kFrames * 6);
+    File file("testdata/SampleStreamer/24bit.wav");
+    SampleStreamer streamer(1, 1200);
+    ASSERT_TRUE(streamer.begin(true));
+    ASSERT_TRUE(streamer.open(0, &file, 0, 0, kFrames * 4, false, &format));
+
+    std::vector<int16_t> out(kFrames * 2);
+    size_t done = 0;
+    for (int retry = 0; done < out.size() * 2 && retry < 1000; retry++) {
+        done += streamer.read(0, (uint8_t*)out.data() + done, out.size() * 2 - done);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    ASSERT_EQ(done, out.size() * 2);
+    for (size_t i = 0; i < out.size(); i++) {
+        int32_t x = (int32_t)(((uint32_t)data[i * 3] << 8) | ((uint32_t)data[i * 3 + 1] << 16) | ((uint32_t)data[i * 3 + 2] << 24)) >> 8;
+        int32_t expected = (x + 128) >> 8;
+        expected = (expected > 32767) ? 32767 : expected;
+        int32_t diff = out[i] - expected;
+        ASSERT_LE(abs(diff), 1) << "sample " << i;
+    }
+    EXPECT_EQ(streamer.getAvailable(0), 0U);
+    streamer.end();
+    file.close();
+}
+
+TEST(SampleStreamer, SectorAlignedReads) {
+    // the data starts behind a 44 bytes header, as in a WAV file
+    std::vector<uint8_t> data = create_counter("testdata/SampleStreamer/aligned.wav", 44 + 40000);
+    File file("testdata/SampleStreamer/aligned.wav");
+    SampleStreamer streamer(1);
+    EXPECT_EQ(streamer.getChunkSize(), SampleStreamer::kDefaultChunkSize);
+    streamer.setChunkSize(8192);
+    EXPECT_EQ(streamer.getChunkSize(), 8192U);
+    ASSERT_TRUE(streamer.begin(false));
+    ASSERT_TRUE(streamer.open(0, &file, 44, 44, 44 + 40000, false));
+
+    resetDummyIoStats();
+    std::vector<uint8_t> out(40000);
+    uint8_t* dst = out.data();
+    size_t size = 0;
+    while ((size = streamer.read(0, dst, 960)) > 0) {
+        dst += size;
+    }
+    EXPECT_EQ(dst, out.data() + out.size());
+    EXPECT_TRUE(std::equal(out.begin(), out.end(), data.begin() + 44));
+
+    // only the first read is short and starts off a sector, then each read is exactly one chunk of whole sectors
+    DummyIoStats stats = getDummyIoStats();
+    EXPECT_EQ(stats.read_calls, 5U);
+    EXPECT_EQ(stats.read_calls, streamer.getReadCount());
+    EXPECT_EQ(stats.read_bytes, 40000U);
+    EXPECT_EQ(stats.unaligned_reads, 1U);
+    EXPECT_EQ(stats.sectors, (44U + 40000U + 511U) / 512U);
+    file.close();
+}
+
+TEST(SampleStreamer, SharedChunks) {
+    // 8 streams of one file, each started 1000 bytes after the previous one and read in turns
+    const int kSlots = 8;
+    const uint32_t kSize = 44 + 40000;
+    std::vector<uint8_t> data = create_counter("testdata/SampleStreamer/shared.wav", kSize);
+    File files[kSlots];
+    SampleStreamer streamer(kSlots, 4096);
+    ASSERT_TRUE(streamer.begin(false));
+    resetDummyIoStats();
+    std::vector<std::vector<uint8_t>> out(kSlots);
+    for (int i = 0; i < kSlots; i++) {
+        files[i] = File("testdata/SampleStreamer/shared.wav");
+        ASSERT_TRUE(streamer.open(i, &files[i], 44, 44, kSize, false, nullptr, 3));
+        for (int j = 0; j < i; j++) {
+            uint8_t buf[1000];
+            size_t size = streamer.read(j, buf, sizeof(buf));
+            out[j].insert(out[j].end(), buf, buf + size);
+        }
+    }
+    bool done = false;
+    while (!done) {
+        done = true;
+        for (int i = 0; i < kSlots; i++) {
+            uint8_t buf[960];
+            size_t size = streamer.read(i, buf, sizeof(buf));
+            out[i].insert(out[i].end(), buf, buf + size);
+            done = done && (size == 0);
+        }
+    }
+    for (int i = 0; i < kSlots; i++) {
+        ASSERT_EQ(out[i].size(), 40000U) << "slot " << i;
+        EXPECT_TRUE(std::equal(out[i].begin(), out[i].end(), data.begin() + 44)) << "slot " << i;
+    }
+
+    // the file is read once, the other streams share its chunks
+    DummyIoStats stats = getDummyIoStats();
+    EXPECT_EQ(stats.read_bytes, 40000U);
+    EXPECT_EQ(stats.read_calls, streamer.getReadCount());
+    EXPECT_EQ(streamer.getReadCount(), 10U);
+    EXPECT_EQ(streamer.getShareCount(), 10U * (kSlots - 1));
+
+    // streams of other sources or without one do not share
+    streamer.close(0);
+    streamer.close(1);
+    ASSERT_TRUE(streamer.open(0, &files[0], 44, 44, kSize, false, nullptr, 4));
+    ASSERT_TRUE(streamer.open(1, &files[1], 44, 44, kSize, false));
+    uint8_t buf[960];
+    EXPECT_EQ(streamer.read(0, buf, sizeof(buf)), sizeof(buf));
+    EXPECT_EQ(streamer.read(1, buf, sizeof(buf)), sizeof(buf));
+    EXPECT_EQ(streamer.getReadCount(), 12U);
+    for (auto& e : files) {
+        e.close();
+    }
+}
+
+TEST(SampleStreamer, CloseWhileReading) {
+    create_counter("testdata/SampleStreamer/b.raw", 40000);
+    SampleStreamer streamer(4, 4000);
+    ASSERT_TRUE(streamer.begin(true));
+    setDummyReadLatency(2000);
+    File files[4];
+    for (int i = 0; i < 20; i++) {
+        files[i % 4] = File("testdata/SampleStreamer/b.raw");
+        ASSERT_TRUE(streamer.open(i % 4, &files[i % 4], 0, 0, 40000, true));
+        std::this_thread::sleep_for(std::chrono::microseconds(500 * (i % 5)));
+        // the file can be closed as soon as close() returns
+        streamer.close(i % 4);
+        files[i % 4].close();
+    }
+    setDummyReadLatency(0);
+    streamer.end();
+}
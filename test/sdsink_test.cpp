@@ -4,9 +4,14 @@
  * Copyright 2022 Sony Semiconductor Solutions Corporation
  */
 
+#include <stdint.h>
+
+#include <vector>
+
 #include <gtest/gtest.h>
 
 #include <Arduino.h>
+#include <File.h>
 
 #include "SDSink.h"
 
@@ -24,3 +29,73 @@ TEST(SDSink, test) {
     sink.update();
     sink.update();
 }
+
+static void putLE(std::vector<uint8_t>* data, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        data->push_back((uint8_t)(value >> (i * 8)));
+    }
+}
+
+// 48kHz, 16bit PCM WAV file of the given number of channels
+static void registerWav(const String& path, uint16_t channels, uint32_t data_size) {
+    std::vector<uint8_t> wav;
+    wav.insert(wav.end(), {'R', 'I', 'F', 'F'});
+    putLE(&wav, 4 + 24 + 8 + data_size, 4);
+    wav.insert(wav.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+    putLE(&wav, 16, 4);
+    putLE(&wav, 1, 2);
+    putLE(&wav, channels, 2);
+    putLE(&wav, 48000, 4);
+    putLE(&wav, 48000 * 2 * channels, 4);
+    putLE(&wav, 2 * channels, 2);
+    putLE(&wav, 16, 2);
+    wav.insert(wav.end(), {'d', 'a', 't', 'a'});
+    putLE(&wav, data_size, 4);
+    for (uint32_t i = 0; i < data_size; i++) {
+        wav.push_back((uint8_t)i);
+    }
+    registerDummyFile(path, wav.data(), wav.size());
+}
+
+// note on and a few updates of a 48kHz, 16bit, 2ch WAV file, counting the reads of the sound data
+static DummyIoStats playAndCount(const String& path, size_t read_size) {
+    registerWav(path, 2, 48000 * 4);
+
+    const SDSink::Item items[] = {{60, path}};
+    SDSink sink(items, 1);
+    sink.setReadSize(read_size);
+    sink.begin();
+    resetDummyIoStats();
+    sink.sendNoteOn(60, 100, 1);
+    for (int i = 0; i < 10; i++) {
+        sink.update();
+    }
+    return getDummyIoStats();
+}
+
+TEST(SDSink, CoalescedReads) {
+    // 512 bytes a read is the finest the sink goes, and reads from the 44 bytes header on start at a sector after the first
+    DummyIoStats fine = playAndCount("testdata/SDSink/fine.wav", 512);
+    DummyIoStats coalesced = playAndCount("testdata/SDSink/coalesced.wav", SDSink::kDefaultReadSize);
+    EXPECT_GT(coalesced.read_bytes, 0U);
+    EXPECT_EQ(coalesced.unaligned_reads, 1U);
+    EXPECT_EQ(fine.unaligned_reads, 1U);
+    EXPECT_LE(coalesced.read_calls, (coalesced.read_bytes + SDSink::kDefaultReadSize - 1) / SDSink::kDefaultReadSize + 1);
+    EXPECT_LT(coalesced.read_calls * 4, fine.read_calls);
+}
+
+TEST(SDSink, UnsupportedFormat) {
+    // a mono file is left out on begin(), and its note on must not start a playback
+    registerWav("testdata/SDSink/mono.wav", 1, 48000 * 2);
+    const SDSink::Item items[] = {{60, "testdata/SDSink/mono.wav"}};
+    SDSink sink(items, 1);
+    sink.begin();
+    resetDummyIoStats();
+    EXPECT_FALSE(sink.sendNoteOn(60, 100, 1));
+    for (int i = 0; i < 10; i++) {
+        sink.update();
+    }
+    DummyIoStats stats = getDummyIoStats();
+    EXPECT_EQ(stats.open_calls, 0U);
+    EXPECT_EQ(stats.read_calls, 0U);
+}
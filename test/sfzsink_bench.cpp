@@ -0,0 +1,275 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <malloc.h>
+#include <stdio.h>
+
+#include <chrono>
+
+#include <gtest/gtest.h>
+
+#include <Arduino.h>
+
+#include "ImaAdpcmDecoder.h"
+#include "SFZSink.h"
+
+static const int kKeys = 125;
+static const int kVelocityLayers = 40;
+static const int kBenchRounds = 20;
+static const int kLoadRegions = 1000;
+static const int kLoadSamples = 50;
+static const int kParseRounds = 20000;
+static const int kDecodeRounds = 2000;
+
+// 125 keys x 40 velocity layers = 5000 regions, like a multi-sampled piano
+static void createLargeSfz(const String& path, const String& sample_path = "testdata/SFZSink/bench.raw") {
+    static const char kSample[] = "0123456789abcdef";
+    registerDummyFile(sample_path, reinterpret_cast<const uint8_t*>(kSample), sizeof(kSample) - 1);
+    String text = "";
+    for (int key = 0; key < kKeys; key++) {
+        for (int layer = 0; layer < kVelocityLayers; layer++) {
+            int lovel = 1 + layer * 3;
+            int hivel = (layer == kVelocityLayers - 1) ? 127 : lovel + 2;
+            char line[96];
+            snprintf(line, sizeof(line), "<region> sample=bench.raw key=%d lovel=%d hivel=%d\n", key, lovel, hivel);
+            text += line;
+        }
+    }
+    registerDummyFile(path, reinterpret_cast<const uint8_t*>(text.c_str()), text.length());
+}
+
+template <typename F>
+static double measureLookup(F lookup) {
+    int checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < kBenchRounds; n++) {
+        for (int note = 0; note < kKeys; note++) {
+            for (int velocity = 1; velocity <= 127; velocity += 7) {
+                checksum += lookup(note, velocity);
+            }
+        }
+    }
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_NE(checksum, 0);
+    return (double)elapsed.count() / (kBenchRounds * kKeys * ((127 + 6) / 7));
+}
+
+TEST(SFZSinkBench, RegionLookup) {
+    createLargeSfz("testdata/SFZSink/bench.sfz");
+    SFZSink sink("testdata/SFZSink/bench.sfz");
+    sink.begin();
+    ASSERT_EQ(sink.getNumberOfRegions(), (size_t)(kKeys * kVelocityLayers));
+
+    double scan = measureLookup([&](uint8_t note, uint8_t velocity) { return sink.scanRegion(note, velocity, 1); });
+    double index = measureLookup([&](uint8_t note, uint8_t velocity) { return sink.findRegion(note, velocity, 1); });
+    printf("[ SFZSink ] %d regions: scan %10.1f ns/note-on, index %10.1f ns/note-on\n", (int)sink.getNumberOfRegions(), scan, index);
+    for (int note = 0; note < kKeys; note++) {
+        for (int velocity = 1; velocity <= 127; velocity++) {
+            EXPECT_EQ(sink.findRegion(note, velocity, 1), sink.scanRegion(note, velocity, 1));
+        }
+    }
+}
+
+// a sample every half octave spanning 6 keys at full velocity, plus an accent layer over all keys,
+// like a sparsely sampled instrument; kKeySplits articulations select it with key switches
+static const int kKeySplits = 8;
+static void createKeySpanSfz(const String& path) {
+    static const char kSample[] = "0123456789abcdef";
+    registerDummyFile("testdata/SFZSink/bench.raw", reinterpret_cast<const uint8_t*>(kSample), sizeof(kSample) - 1);
+    String text = "<control> sw_lokey=0 sw_hikey=7\n";
+    for (int split = 0; split < kKeySplits; split++) {
+        char line[128];
+        snprintf(line, sizeof(line), "<group> sw_last=%d\n", split);
+        text += line;
+        for (int key = 12; key < 120; key += 6) {
+            snprintf(line, sizeof(line), "<region> sample=bench.raw lokey=%d hikey=%d pitch_keycenter=%d\n", key, key + 5, key + 3);
+            text += line;
+        }
+        snprintf(line, sizeof(line), "<region> sample=bench.raw lokey=12 hikey=127 lovel=100 hivel=127\n");
+        text += line;
+    }
+    registerDummyFile(path, reinterpret_cast<const uint8_t*>(text.c_str()), text.length());
+}
+
+TEST(SFZSinkBench, RegionLookupKeySpan) {
+    createKeySpanSfz("testdata/SFZSink/bench_keyspan.sfz");
+    SFZSink sink("testdata/SFZSink/bench_keyspan.sfz");
+    sink.begin();
+    ASSERT_EQ(sink.getNumberOfRegions(), (size_t)(kKeySplits * (18 + 1)));
+    // the last key switch, so the scan passes the regions of the other splits
+    sink.sendNoteOn(kKeySplits - 1, 100, 1);
+    sink.sendNoteOff(kKeySplits - 1, 0, 1);
+
+    double scan = measureLookup([&](uint8_t note, uint8_t velocity) { return sink.scanRegion(note, velocity, 1) + 1; });
+    double index = measureLookup([&](uint8_t note, uint8_t velocity) { return sink.findRegion(note, velocity, 1) + 1; });
+    printf("[ SFZSink ] %d full-velocity regions: scan %10.1f ns/note-on, index %10.1f ns/note-on\n", (int)sink.getNumberOfRegions(), scan,
+           index);
+    for (int note = 0; note <= 127; note++) {
+        for (int velocity = 1; velocity <= 127; velocity++) {
+            EXPECT_EQ(sink.findRegion(note, velocity, 1), sink.scanRegion(note, velocity, 1));
+        }
+    }
+}
+
+// kLoadRegions regions spread over the given number of WAV files
+static void createLayeredSfz(const String& path, int samples) {
+    static const uint8_t kWav[] = {'R', 'I', 'F', 'F', 44, 0, 0, 0, 'W', 'A', 'V', 'E',  // RIFF
+                                   'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 2, 0,  // fmt, PCM, 2ch
+                                   0x80, 0xBB, 0, 0, 0x00, 0xEE, 0x02, 0, 4, 0, 16, 0,  // 48000Hz, 16bit
+                                   'd', 'a', 't', 'a', 8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    String text = "";
+    for (int i = 0; i < samples; i++) {
+        char sample[64];
+        snprintf(sample, sizeof(sample), "testdata/SFZSink/load%04d.wav", i);
+        registerDummyFile(sample, kWav, sizeof(kWav));
+    }
+    for (int i = 0; i < kLoadRegions; i++) {
+        char line[96];
+        snprintf(line, sizeof(line), "<region> sample=load%04d.wav key=%d lovel=%d hivel=%d\n", i % samples, i % 128, 1 + (i / 128) * 8,
+                 8 + (i / 128) * 8);
+        text += line;
+    }
+    registerDummyFile(path, reinterpret_cast<const uint8_t*>(text.c_str()), text.length());
+}
+
+static double measureLoad(const String& path, DummyIoStats* io) {
+    resetDummyIoStats();
+    auto start = std::chrono::steady_clock::now();
+    SFZSink sink(path);
+    sink.begin();
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+    *io = getDummyIoStats();
+    EXPECT_EQ(sink.getNumberOfRegions(), (size_t)kLoadRegions);
+    EXPECT_EQ(sink.getRegion(0)->pcm_offset, 44U);
+    return (double)elapsed.count() / 1000000.0;
+}
+
+TEST(SFZSinkBench, LoadTime) {
+    createLayeredSfz("testdata/SFZSink/load_shared.sfz", kLoadSamples);
+    createLayeredSfz("testdata/SFZSink/load_unique.sfz", kLoadRegions);
+    DummyIoStats shared_io, unique_io;
+    double shared = measureLoad("testdata/SFZSink/load_shared.sfz", &shared_io);
+    double unique = measureLoad("testdata/SFZSink/load_unique.sfz", &unique_io);
+    printf("[ SFZSink ] %d regions: %d samples %8.2f ms, %d samples %8.2f ms\n", kLoadRegions, kLoadSamples, shared, kLoadRegions, unique);
+    // each sample is parsed once, however many regions refer to it
+    EXPECT_LT(shared_io.open_calls, unique_io.open_calls);
+    EXPECT_LT(shared_io.byte_reads, unique_io.byte_reads);
+}
+
+static double measureBegin(const String& path, bool use_cache, bool* loaded_from_cache) {
+    auto start = std::chrono::steady_clock::now();
+    SFZSink sink(path);
+    sink.setInstrumentCache(use_cache);
+    sink.begin();
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(sink.getNumberOfRegions(), (size_t)(kKeys * kVelocityLayers));
+    *loaded_from_cache = sink.isLoadedFromCache();
+    return (double)elapsed.count() / 1000000.0;
+}
+
+TEST(SFZSinkBench, InstrumentCache) {
+    // the cache is written next to the sfz, so use the working directory
+    createLargeSfz("sfzsink_bench.sfz", "bench.raw");
+    remove("sfzsink_bench.sfz.bin");
+    bool loaded = false;
+    double parse = measureBegin("sfzsink_bench.sfz", false, &loaded);
+    measureBegin("sfzsink_bench.sfz", true, &loaded);
+    EXPECT_FALSE(loaded);
+    double cached = measureBegin("sfzsink_bench.sfz", true, &loaded);
+    EXPECT_TRUE(loaded);
+    printf("[ SFZSink ] %d regions: parse %8.2f ms, cache %8.2f ms\n", kKeys * kVelocityLayers, parse, cached);
+    remove("sfzsink_bench.sfz.bin");
+}
+
+TEST(SFZSinkBench, OpcodeDispatch) {
+    // a typical mix of opcodes; the names near the end of the table cost the most with a linear search
+    static const char* kOpcodes[][2] = {
+        {"lokey", "60"},      {"hikey", "c5"},         {"lovel", "1"},       {"hivel", "127"},       {"key", "61"},
+        {"volume", "-6.5"},   {"pan", "20"},           {"amp_veltrack", "80"}, {"ampeg_release", "0.25"}, {"loop_mode", "loop_continuous"},
+        {"loop_start", "10"}, {"loop_end", "1000"},    {"offset", "100"},    {"sw_last", "24"},      {"hicc32", "10"},
+        {"unknown", "1"},
+    };
+    const int kOpcodeCount = sizeof(kOpcodes) / sizeof(kOpcodes[0]);
+    std::vector<String> names;
+    std::vector<String> values;
+    for (int i = 0; i < kOpcodeCount; i++) {
+        names.push_back(kOpcodes[i][0]);
+        values.push_back(kOpcodes[i][1]);
+    }
+
+    SFZSink sink("testdata/SFZSink/dispatch.sfz");
+    sink.startSfz();
+    sink.startHeader("region");
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < kParseRounds; n++) {
+        for (int i = 0; i < kOpcodeCount; i++) {
+            sink.opcode(names[i], values[i]);
+        }
+    }
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+    double per_second = (double)kParseRounds * kOpcodeCount * 1e9 / elapsed.count();
+    printf("[ SFZSink ] opcode dispatch: %10.0f opcodes/s\n", per_second);
+    EXPECT_GT(per_second, 0);
+}
+
+// heap in use, including large blocks served by mmap
+static size_t getHeapUsage() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+TEST(SFZSinkBench, RegionMemory) {
+    // distinct sample paths per key, as in a multi-sampled piano
+    static const char kSample[] = "0123456789abcdef";
+    String text = "";
+    for (int key = 0; key < kKeys; key++) {
+        char sample[64];
+        snprintf(sample, sizeof(sample), "testdata/SFZSink/memory/piano_key%03d_layered.raw", key);
+        registerDummyFile(sample, reinterpret_cast<const uint8_t*>(kSample), sizeof(kSample) - 1);
+        for (int layer = 0; layer < kVelocityLayers; layer++) {
+            int lovel = 1 + layer * 3;
+            int hivel = (layer == kVelocityLayers - 1) ? 127 : lovel + 2;
+            char line[128];
+            snprintf(line, sizeof(line), "<region> sample=memory/piano_key%03d_layered.raw key=%d lovel=%d hivel=%d\n", key, key, lovel, hivel);
+            text += line;
+        }
+    }
+    registerDummyFile("testdata/SFZSink/memory.sfz", reinterpret_cast<const uint8_t*>(text.c_str()), text.length());
+
+    SFZSink sink("testdata/SFZSink/memory.sfz");
+    size_t before = getHeapUsage();
+    sink.begin();
+    size_t after = getHeapUsage();
+    ASSERT_EQ(sink.getNumberOfRegions(), (size_t)(kKeys * kVelocityLayers));
+    printf("[ SFZSink ] sizeof(Region) = %d bytes, heap %d bytes for %d regions (%d bytes/region)\n", (int)sizeof(SFZSink::Region),
+           (int)(after - before), (int)sink.getNumberOfRegions(), (int)((after - before) / sink.getNumberOfRegions()));
+}
+
+TEST(SFZSinkBench, AdpcmDecode) {
+    // a stereo block of 2041 frames, as written by common encoders
+    const int kBlockAlign = 2048;
+    static uint8_t block[kBlockAlign];
+    for (int i = 0; i < kBlockAlign; i++) {
+        block[i] = (uint8_t)(i * 37 + 11);
+    }
+    block[2] = block[6] = 40;
+    block[3] = block[7] = 0;
+    uint32_t frames = ImaAdpcmDecoder::getFramesPerBlock(2, kBlockAlign);
+    static int16_t out[2041 * 2];
+    ImaAdpcmDecoder decoder;
+    int checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < kDecodeRounds; n++) {
+        decoder.start(block, kBlockAlign, 2);
+        decoder.decode(out, frames);
+        checksum += out[n % frames];
+    }
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+    double ns = (double)elapsed.count() / ((double)kDecodeRounds * frames);
+    printf("[ SFZSink ] IMA ADPCM decode %6.2f ns/frame (%d voices of 48 kHz per core), %.2f storage bytes/frame instead of 4\n", ns,
+           (int)(1e9 / (ns * 48000)), (double)kBlockAlign / frames);
+    EXPECT_NE(checksum, 0);
+}
@@ -9,18 +9,64 @@
 #include <stdlib.h>
 #include <sys/time.h>
 
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <vector>
+
 #include "gtest/gtest.h"
 
 #include <Arduino.h>
 
 #include <OutputMixer.h>
+#include <Storage.h>
 
+#include "ImaAdpcmDecoder.h"
+#include "PcmWriter.h"
 #include "SFZSink.h"
+#include "VoiceStealer.h"
+#include "WavReader.h"
 
 static void create_file(const String& file_path, const String& text) {
     registerDummyFile(file_path, (uint8_t*)text.c_str(), text.length());
 }
 
+// counts the heap allocations of this process while g_count_allocations is set
+static std::atomic<bool> g_count_allocations(false);
+static std::atomic<uint32_t> g_allocations(0);
+
+void* operator new(size_t size) {
+    if (g_count_allocations) {
+        g_allocations++;
+    }
+    void* ptr = malloc((size > 0) ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t /*size*/) noexcept {
+    free(ptr);
+}
+
 class SfzTest : public ::testing::Test {
 public:
 protected:
@@ -1188,7 +1234,7 @@ TEST_F(SfzTest, verify_sample1) {
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 1);
     if (sfz_test.getNumberOfRegions() >= 1) {
         const String default_sample = "";
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/guitar_c4_ff.wav");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/guitar_c4_ff.wav");
     }
 }
 
@@ -1210,7 +1256,7 @@ TEST_F(SfzTest, verify_sample2) {
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 1);
     if (sfz_test.getNumberOfRegions() >= 1) {
         const String default_sample = "";
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/dog kick.ogg");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/dog kick.ogg");
     }
 }
 
@@ -1231,7 +1277,7 @@ TEST_F(SfzTest, verify_sample3) {
 
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 1);
     if (sfz_test.getNumberOfRegions() >= 1) {
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/out of tune trombone (redundant).wav");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/out of tune trombone (redundant).wav");
     }
 }
 
@@ -1252,7 +1298,7 @@ TEST_F(SfzTest, verify_sample4) {
 
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 1);
     if (sfz_test.getNumberOfRegions() >= 1) {
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/staccatto_snare.ogg");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/staccatto_snare.ogg");
     }
 }
 
@@ -1273,7 +1319,7 @@ TEST_F(SfzTest, verify_sample5) {
 
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 1);
     if (sfz_test.getNumberOfRegions() >= 1) {
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/dog      kick.ogg");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/dog      kick.ogg");
     }
 }
 
@@ -1294,7 +1340,7 @@ TEST_F(SfzTest, verify_sample6) {
 
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 1);
     if (sfz_test.getNumberOfRegions() >= 1) {
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/dog　kick.ogg");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/dog　kick.ogg");
     }
 }
 
@@ -1315,7 +1361,7 @@ TEST_F(SfzTest, verify_sample7) {
 
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 1);
     if (sfz_test.getNumberOfRegions() >= 1) {
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/てすと.wav");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/てすと.wav");
     }
 }
 
@@ -1336,7 +1382,7 @@ TEST_F(SfzTest, verify_sample8) {
 
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 1);
     if (sfz_test.getNumberOfRegions() >= 1) {
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/guitar=c4_ff.wav");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/guitar=c4_ff.wav");
     }
 }
 
@@ -1562,8 +1608,8 @@ TEST_F(SfzTest, include) {
 
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 2);
     if (sfz_test.getNumberOfRegions() >= 2) {
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/test1_space.raw");
-        EXPECT_EQ(sfz_test.getRegion(1)->sample, "testdata/SFZSink/test2_tab.raw");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/test1_space.raw");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(1)->sample_id), "testdata/SFZSink/test2_tab.raw");
     }
 }
 
@@ -1587,7 +1633,7 @@ TEST_F(SfzTest, define1) {
 
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 1);
     if (sfz_test.getNumberOfRegions() >= 1) {
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/$AAtest1_spacedef1.raw");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/$AAtest1_spacedef1.raw");
     }
 }
 
@@ -1610,7 +1656,7 @@ TEST_F(SfzTest, define2) {
 
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 1);
     if (sfz_test.getNumberOfRegions() >= 1) {
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/test2.raw");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/test2.raw");
     }
 }
 
@@ -1633,7 +1679,7 @@ TEST_F(SfzTest, define3) {
 
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 1);
     if (sfz_test.getNumberOfRegions() >= 1) {
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/$ERR1test3.raw");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/$ERR1test3.raw");
     }
 }
 
@@ -1656,7 +1702,7 @@ TEST_F(SfzTest, define4) {
 
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 1);
     if (sfz_test.getNumberOfRegions() >= 1) {
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/ERR2test4.raw");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/ERR2test4.raw");
     }
 }
 
@@ -1679,7 +1725,7 @@ TEST_F(SfzTest, define5) {
 
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 1);
     if (sfz_test.getNumberOfRegions() >= 1) {
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/$TEST5test5.raw");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/$TEST5test5.raw");
     }
 }
 
@@ -1702,7 +1748,7 @@ TEST_F(SfzTest, define6) {
 
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 1);
     if (sfz_test.getNumberOfRegions() >= 1) {
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/$TEST6test6.raw");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/$TEST6test6.raw");
     }
 }
 
@@ -1725,7 +1771,7 @@ TEST_F(SfzTest, define7) {
 
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 1);
     if (sfz_test.getNumberOfRegions() >= 1) {
-        EXPECT_EQ(sfz_test.getRegion(0)->sample, "testdata/SFZSink/$test7.raw");
+        EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/$test7.raw");
     }
 }
 
@@ -1962,3 +2008,1221 @@ TEST_F(SfzTest, sw_default11) {
     sfz_test.begin();
     EXPECT_EQ(sfz_test.getNumberOfRegions(), 0);
 }
+
+TEST_F(SfzTest, region_gain_default) {
+    create_file("testdata/SFZSink/region_gain_default.sfz",
+                "<region> sample=test.raw\n"
+                "");
+    SFZSink sfz_test = SFZSink("testdata/SFZSink/region_gain_default.sfz");
+    sfz_test.begin();
+
+    ASSERT_EQ(sfz_test.getNumberOfRegions(), 1);
+    EXPECT_EQ(sfz_test.getRegion(0)->gain, 16384);
+    EXPECT_EQ(sfz_test.getRegion(0)->pan, 0);
+    EXPECT_EQ(sfz_test.getRegion(0)->amp_veltrack, 100);
+}
+
+TEST_F(SfzTest, region_gain_opcodes) {
+    create_file("testdata/SFZSink/region_gain_opcodes.sfz",
+                "<group> volume=-6.0206 pan=-50 amp_veltrack=0\n"
+                "<region> sample=test.raw\n"
+                "<region> sample=test.raw volume=6 pan=100 amp_veltrack=-100\n"
+                "<region> sample=test.raw volume=-144\n"
+                "");
+    SFZSink sfz_test = SFZSink("testdata/SFZSink/region_gain_opcodes.sfz");
+    sfz_test.begin();
+
+    ASSERT_EQ(sfz_test.getNumberOfRegions(), 3);
+    EXPECT_EQ(sfz_test.getRegion(0)->gain, 8192);
+    EXPECT_EQ(sfz_test.getRegion(0)->pan, -50);
+    EXPECT_EQ(sfz_test.getRegion(0)->amp_veltrack, 0);
+    EXPECT_EQ(sfz_test.getRegion(1)->gain, 32690);
+    EXPECT_EQ(sfz_test.getRegion(1)->pan, 100);
+    EXPECT_EQ(sfz_test.getRegion(1)->amp_veltrack, -100);
+    EXPECT_EQ(sfz_test.getRegion(2)->gain, 0);
+}
+
+TEST_F(SfzTest, region_gain_out_of_range) {
+    create_file("testdata/SFZSink/region_gain_out_of_range.sfz",
+                "<region> sample=test.raw volume=7\n"
+                "<region> sample=test.raw pan=-101\n"
+                "<region> sample=test.raw amp_veltrack=101\n"
+                "");
+    SFZSink sfz_test = SFZSink("testdata/SFZSink/region_gain_out_of_range.sfz");
+    sfz_test.begin();
+
+    EXPECT_EQ(sfz_test.getNumberOfRegions(), 0);
+}
+
+static void create_tone(const String& file_path, int16_t level) {
+    std::vector<int16_t> pcm(4800 * 2, level);
+    registerDummyFile(file_path, reinterpret_cast<const uint8_t*>(pcm.data()), pcm.size() * sizeof(int16_t));
+}
+
+// plays three notes with polyphony 2 and returns the last rendered frame
+static std::vector<int16_t> renderStolenVoices(int policy, uint8_t velocity_a, uint8_t velocity_b, uint32_t* stolen, uint32_t* dropped,
+                                               int steal_reserve = SFZSink::kStealReserve) {
+    create_tone("testdata/SFZSink/steal_a.raw", 100);
+    create_tone("testdata/SFZSink/steal_b.raw", 200);
+    create_tone("testdata/SFZSink/steal_c.raw", 400);
+    create_file("testdata/SFZSink/steal.sfz",
+                "<group> loop_mode=loop_continuous\n"
+                "<region> sample=steal_a.raw key=60\n"
+                "<region> sample=steal_b.raw key=62\n"
+                "<region> sample=steal_c.raw key=64\n"
+                "");
+    static int16_t out[240 * 2 * 8];
+    PcmBufferWriter writer(out, sizeof(out));
+    SFZSink sink("testdata/SFZSink/steal.sfz", 2, steal_reserve);
+    sink.setPcmWriter(&writer);
+    sink.begin();
+    EXPECT_TRUE(sink.setParam(Filter::PARAMID_VOICE_STEALING, policy));
+
+    sink.sendNoteOn(60, velocity_a, 1);
+    sink.sendNoteOn(62, velocity_b, 1);
+    sink.update();
+    sink.update();
+    sink.sendNoteOn(64, 127, 1);
+    for (int i = 0; i < 6; i++) {
+        sink.update();
+    }
+    *stolen = sink.getParam(Filter::PARAMID_STOLEN_VOICES);
+    *dropped = sink.getParam(Filter::PARAMID_DROPPED_VOICES);
+    return std::vector<int16_t>(&out[240 * 2 * 7], &out[240 * 2 * 8]);
+}
+
+TEST_F(SfzTest, steal_oldest) {
+    uint32_t stolen = 0;
+    uint32_t dropped = 0;
+    std::vector<int16_t> out = renderStolenVoices(VoiceStealer::kStealOldest, 127, 127, &stolen, &dropped);
+    EXPECT_EQ(stolen, 1U);
+    EXPECT_EQ(dropped, 0U);
+    for (int16_t v : out) {
+        ASSERT_EQ(v, 200 + 400);
+    }
+}
+
+TEST_F(SfzTest, note_off_oldest_first) {
+    // the same note twice on one channel, told apart by their velocity layers
+    create_tone("testdata/SFZSink/fifo_a.raw", 100);
+    create_tone("testdata/SFZSink/fifo_b.raw", 200);
+    create_file("testdata/SFZSink/fifo.sfz",
+                "<group> loop_mode=loop_continuous amp_veltrack=0\n"
+                "<region> sample=fifo_a.raw key=60 hivel=63\n"
+                "<region> sample=fifo_b.raw key=60 lovel=64\n"
+                "");
+    static int16_t out[240 * 2 * 8];
+    PcmBufferWriter writer(out, sizeof(out));
+    SFZSink sink("testdata/SFZSink/fifo.sfz", 4);
+    sink.setPcmWriter(&writer);
+    sink.begin();
+
+    sink.sendNoteOn(60, 32, 1);
+    sink.update();
+    sink.sendNoteOn(60, 100, 1);
+    sink.update();
+    sink.sendNoteOff(60, 0, 1);
+    for (int i = 0; i < 6; i++) {
+        sink.update();
+    }
+    // the first note-on is released, the second one keeps playing
+    for (int i = 240 * 2 * 7; i < 240 * 2 * 8; i++) {
+        ASSERT_EQ(out[i], 200);
+    }
+}
+
+TEST_F(SfzTest, steal_quietest) {
+    uint32_t stolen = 0;
+    uint32_t dropped = 0;
+    std::vector<int16_t> out = renderStolenVoices(VoiceStealer::kStealQuietest, 127, 64, &stolen, &dropped);
+    EXPECT_EQ(stolen, 1U);
+    EXPECT_EQ(dropped, 0U);
+    for (int16_t v : out) {
+        ASSERT_EQ(v, 100 + 400);
+    }
+}
+
+TEST_F(SfzTest, steal_none) {
+    uint32_t stolen = 0;
+    uint32_t dropped = 0;
+    std::vector<int16_t> out = renderStolenVoices(VoiceStealer::kStealNone, 127, 127, &stolen, &dropped);
+    EXPECT_EQ(stolen, 0U);
+    EXPECT_EQ(dropped, 1U);
+    for (int16_t v : out) {
+        ASSERT_EQ(v, 100 + 200);
+    }
+}
+
+TEST_F(SfzTest, steal_without_reserve) {
+    // no channel for the new note until a victim has faded out, so the victim keeps playing
+    uint32_t stolen = 0;
+    uint32_t dropped = 0;
+    std::vector<int16_t> out = renderStolenVoices(VoiceStealer::kStealOldest, 127, 127, &stolen, &dropped, 0);
+    EXPECT_EQ(stolen, 0U);
+    EXPECT_EQ(dropped, 1U);
+    for (int16_t v : out) {
+        ASSERT_EQ(v, 100 + 200);
+    }
+}
+
+TEST_F(SfzTest, steal_counters) {
+    create_file("testdata/SFZSink/steal_counters.sfz",
+                "<region> sample=test.raw\n"
+                "");
+    SFZSink sink("testdata/SFZSink/steal_counters.sfz", 1);
+    EXPECT_TRUE(sink.isAvailable(Filter::PARAMID_VOICE_STEALING));
+    EXPECT_TRUE(sink.isAvailable(Filter::PARAMID_STOLEN_VOICES));
+    EXPECT_TRUE(sink.isAvailable(Filter::PARAMID_DROPPED_VOICES));
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_VOICE_STEALING), VoiceStealer::kStealOldest);
+    EXPECT_FALSE(sink.setParam(Filter::PARAMID_VOICE_STEALING, VoiceStealer::kPolicyMax + 1));
+    EXPECT_FALSE(sink.setParam(Filter::PARAMID_STOLEN_VOICES, 1));
+    EXPECT_TRUE(sink.setParam(Filter::PARAMID_STOLEN_VOICES, 0));
+}
+
+TEST_F(SfzTest, latency_params) {
+    create_tone("testdata/SFZSink/latency.raw", 100);
+    create_file("testdata/SFZSink/latency.sfz",
+                "<region> sample=latency.raw loop_mode=loop_continuous\n"
+                "");
+    static int16_t out[240 * 2 * 4];
+    PcmBufferWriter writer(out, sizeof(out));
+    SFZSink sink("testdata/SFZSink/latency.sfz");
+    sink.setPcmWriter(&writer);
+    sink.begin();
+    EXPECT_TRUE(sink.isAvailable(Filter::PARAMID_TARGET_LATENCY));
+    EXPECT_TRUE(sink.isAvailable(Filter::PARAMID_BUFFER_FILL));
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_TARGET_LATENCY), 15);
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_BUFFER_FILL), 0);
+
+    // a note starts with the preload only
+    sink.sendNoteOn(60, 127, 1);
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_BUFFER_FILL), 15);
+
+    // a shorter target applies to the next note, and the fill reports the least buffered voice
+    EXPECT_TRUE(sink.setParam(Filter::PARAMID_TARGET_LATENCY, 5));
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_TARGET_LATENCY), 5);
+    sink.sendNoteOn(62, 127, 1);
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_BUFFER_FILL), 5);
+
+    // update() refills (preload * 2 + 4 frames) and renders one frame
+    sink.update();
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_BUFFER_FILL), 30);
+
+    EXPECT_FALSE(sink.setParam(Filter::PARAMID_TARGET_LATENCY, -1));
+    EXPECT_TRUE(sink.setParam(Filter::PARAMID_TARGET_LATENCY, 0));
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_TARGET_LATENCY), 15);
+}
+
+TEST_F(SfzTest, region_envelope_opcodes) {
+    create_file("testdata/SFZSink/region_envelope_opcodes.sfz",
+                "<group> ampeg_release=0.5\n"
+                "<region> sample=test.raw\n"
+                "<region> sample=test.raw ampeg_attack=0.01 ampeg_release=0\n"
+                "<region> sample=test.raw ampeg_release=101\n"
+                "");
+    SFZSink sfz_test = SFZSink("testdata/SFZSink/region_envelope_opcodes.sfz");
+    sfz_test.begin();
+
+    ASSERT_EQ(sfz_test.getNumberOfRegions(), 2);
+    EXPECT_EQ(sfz_test.getRegion(0)->ampeg_attack, -1);
+    EXPECT_EQ(sfz_test.getRegion(0)->ampeg_release, 500);
+    EXPECT_EQ(sfz_test.getRegion(1)->ampeg_attack, 10);
+    EXPECT_EQ(sfz_test.getRegion(1)->ampeg_release, 0);
+}
+
+TEST_F(SfzTest, region_index_matches_scan) {
+    create_file("testdata/SFZSink/region_index.sfz",
+                "<region> sample=test.raw key=60 hivel=63\n"
+                "<region> sample=test.raw lokey=58 hikey=62 lovel=64 hivel=100\n"
+                "<region> sample=test.raw lokey=0 hikey=127 sw_last=24\n"
+                "<region> sample=test.raw key=61 lochan=2 hichan=2\n"
+                "<region> sample=test.raw lokey=40 hikey=80 lovel=90\n"
+                "<region> sample=test.raw key=72 loprog=1 hiprog=1\n"
+                "<region> sample=test.raw lokey=0 hikey=127\n"
+                "");
+    SFZSink sfz_test = SFZSink("testdata/SFZSink/region_index.sfz");
+    sfz_test.begin();
+    ASSERT_EQ(sfz_test.getNumberOfRegions(), 7);
+
+    for (int sw = 0; sw < 2; sw++) {
+        sfz_test.setParam(SFZSink::PARAMID_SW_LAST, sw == 0 ? 24 : INVALID_NOTE_NUMBER);
+        for (int channel = 1; channel <= 2; channel++) {
+            for (int note = 0; note <= 127; note++) {
+                for (int velocity = 1; velocity <= 127; velocity++) {
+                    ASSERT_EQ(sfz_test.findRegion(note, velocity, channel), sfz_test.scanRegion(note, velocity, channel))
+                        << "sw=" << sw << " channel=" << channel << " note=" << note << " velocity=" << velocity;
+                }
+            }
+        }
+    }
+    sfz_test.setParam(SFZSink::PARAMID_SW_LAST, INVALID_NOTE_NUMBER);
+    EXPECT_EQ(sfz_test.findRegion(60, 10, 1), 0);
+    EXPECT_EQ(sfz_test.findRegion(60, 70, 1), 1);
+    EXPECT_EQ(sfz_test.findRegion(61, 10, 2), 3);
+    EXPECT_EQ(sfz_test.findRegion(60, 120, 1), 4);
+    EXPECT_EQ(sfz_test.findRegion(72, 10, 1), 6);
+    sfz_test.sendProgramChange(1, 1);
+    EXPECT_EQ(sfz_test.findRegion(72, 10, 1), 5);
+}
+
+TEST_F(SfzTest, region_index_no_match) {
+    create_file("testdata/SFZSink/region_index_no_match.sfz",
+                "<region> sample=test.raw key=60\n"
+                "");
+    SFZSink sfz_test = SFZSink("testdata/SFZSink/region_index_no_match.sfz");
+    sfz_test.begin();
+    EXPECT_EQ(sfz_test.findRegion(61, 100, 1), -1);
+    EXPECT_FALSE(sfz_test.sendNoteOn(61, 100, 1));
+}
+
+// renders a looped ramp and returns the output
+static std::vector<int16_t> renderHeadCache(size_t budget, SFZSink::Region* region, bool background = false, uint32_t* head_size = nullptr) {
+    std::vector<int16_t> pcm(4800 * 2);
+    for (size_t i = 0; i < pcm.size(); i++) {
+        pcm[i] = (int16_t)(i * 7);
+    }
+    registerDummyFile("testdata/SFZSink/head.raw", reinterpret_cast<const uint8_t*>(pcm.data()), pcm.size() * sizeof(int16_t));
+    create_file("testdata/SFZSink/head.sfz",
+                "<region> sample=head.raw key=60 offset=100 loop_mode=loop_continuous loop_start=200 loop_end=1000\n"
+                "<region> sample=head.raw key=62 offset=100\n"
+                "");
+    static int16_t out[240 * 2 * 40];
+    memset(out, 0, sizeof(out));
+    PcmBufferWriter writer(out, sizeof(out));
+    SFZSink sink("testdata/SFZSink/head.sfz");
+    sink.setPcmWriter(&writer);
+    sink.setHeadCache(budget, 20);
+    sink.setBackgroundStreaming(background);
+    sink.begin();
+    *region = *sink.getRegion(0);
+    EXPECT_EQ(sink.getRegion(1)->head_id, region->head_id);
+    if (head_size != nullptr) {
+        *head_size = sink.getHeadSize(region);
+    }
+
+    sink.sendNoteOn(60, 127, 1);
+    for (int i = 0; i < 40; i++) {
+        if (background) {
+            // give the I/O thread a frame time to refill
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        sink.update();
+    }
+    return std::vector<int16_t>(&out[0], &out[240 * 2 * 40]);
+}
+
+TEST_F(SfzTest, head_cache_matches_stream) {
+    SFZSink::Region streamed;
+    SFZSink::Region cached;
+    std::vector<int16_t> expected = renderHeadCache(0, &streamed);
+    uint32_t head_size = 0;
+    std::vector<int16_t> actual = renderHeadCache(64 * 1024, &cached, false, &head_size);
+    EXPECT_LT(streamed.head_id, 0);
+    EXPECT_GE(cached.head_id, 0);
+    // 20 ms of blocks would pass the loop end (inclusive)
+    EXPECT_EQ(head_size, (1000U + 1 - 100U) * 4);
+    EXPECT_EQ(expected, actual);
+}
+
+TEST_F(SfzTest, head_cache_over_budget) {
+    SFZSink::Region region;
+    std::vector<int16_t> expected = renderHeadCache(0, &region);
+    std::vector<int16_t> actual = renderHeadCache(16, &region);
+    EXPECT_LT(region.head_id, 0);
+    EXPECT_EQ(expected, actual);
+}
+
+TEST_F(SfzTest, background_streaming) {
+    SFZSink::Region region;
+    std::vector<int16_t> expected = renderHeadCache(64 * 1024, &region);
+    std::vector<int16_t> actual = renderHeadCache(64 * 1024, &region, true);
+    EXPECT_EQ(expected, actual);
+}
+
+// renders short drum hits and returns the output
+static std::vector<int16_t> renderShortHits(size_t budget, size_t* buffer_size, DummyIoStats* stats) {
+    std::vector<int16_t> pcm(300 * 2);
+    for (size_t i = 0; i < pcm.size(); i++) {
+        pcm[i] = (int16_t)(i * 11);
+    }
+    registerDummyFile("testdata/SFZSink/hit.raw", reinterpret_cast<const uint8_t*>(pcm.data()), pcm.size() * sizeof(int16_t));
+    create_file("testdata/SFZSink/short_hits.sfz",
+                "<region> sample=hit.raw key=36 loop_mode=one_shot\n"
+                "<region> sample=hit.raw key=38 offset=50\n"
+                "");
+    static int16_t out[240 * 2 * 8];
+    memset(out, 0, sizeof(out));
+    PcmBufferWriter writer(out, sizeof(out));
+    SFZSink sink("testdata/SFZSink/short_hits.sfz");
+    sink.setPcmWriter(&writer);
+    sink.setHeadCache(budget, 20);
+    sink.begin();
+    *buffer_size = sink.getStreamBufferSize();
+
+    resetDummyIoStats();
+    sink.sendNoteOn(36, 127, 1);
+    sink.sendNoteOn(38, 127, 1);
+    for (int i = 0; i < 8; i++) {
+        sink.update();
+    }
+    *stats = getDummyIoStats();
+    return std::vector<int16_t>(&out[0], &out[240 * 2 * 8]);
+}
+
+TEST_F(SfzTest, head_cache_no_stream_buffers) {
+    size_t streamed_size = 0;
+    size_t cached_size = 0;
+    DummyIoStats streamed;
+    DummyIoStats cached;
+    std::vector<int16_t> expected = renderShortHits(0, &streamed_size, &streamed);
+    std::vector<int16_t> actual = renderShortHits(64 * 1024, &cached_size, &cached);
+    EXPECT_GT(streamed_size, 0U);
+    EXPECT_GT(streamed.read_calls, 0U);
+    // every hit plays from RAM, so no file is opened or read and no I/O buffer is allocated
+    EXPECT_EQ(cached_size, 0U);
+    EXPECT_EQ(cached.open_calls, 0U);
+    EXPECT_EQ(cached.read_calls, 0U);
+    EXPECT_EQ(expected, actual);
+}
+
+TEST_F(SfzTest, choke_rules) {
+    create_tone("testdata/SFZSink/hat.raw", 100);
+    create_file("testdata/SFZSink/choke_rules.sfz",
+                "<region> sample=hat.raw key=40\n"
+                "<group> group=1 off_by=2\n"
+                "<region> sample=hat.raw key=41\n"
+                "<region> sample=hat.raw key=42\n"
+                "<group> group=2\n"
+                "<region> sample=hat.raw key=43\n"
+                "<region> sample=hat.raw key=44 off_by=1\n"
+                "<region> sample=hat.raw key=45 group=1 off_by=2\n"
+                "");
+    SFZSink sink("testdata/SFZSink/choke_rules.sfz");
+    sink.begin();
+    ASSERT_EQ(sink.getNumberOfRegions(), 6);
+    EXPECT_EQ(sink.getRegion(0)->choke_id, 0);
+    EXPECT_NE(sink.getRegion(1)->choke_id, 0);
+    EXPECT_EQ(sink.getRegion(2)->choke_id, sink.getRegion(1)->choke_id);
+    EXPECT_NE(sink.getRegion(3)->choke_id, 0);
+    EXPECT_NE(sink.getRegion(3)->choke_id, sink.getRegion(1)->choke_id);
+    EXPECT_NE(sink.getRegion(4)->choke_id, sink.getRegion(3)->choke_id);
+    EXPECT_EQ(sink.getRegion(5)->choke_id, sink.getRegion(1)->choke_id);
+}
+
+// plays an open hat, then a closed hat after 4 frames, and returns the rendered frames
+static std::vector<int16_t> renderChoke(const String& sfz_path, const char* open_opcodes, uint32_t* choked) {
+    create_tone("testdata/SFZSink/open_hat.raw", 8000);
+    create_tone("testdata/SFZSink/closed_hat.raw", 0);
+    create_file(sfz_path, String("<region> sample=open_hat.raw key=46 loop_mode=one_shot ampeg_release=1 ") + open_opcodes +
+                              "\n"
+                              "<region> sample=closed_hat.raw key=42 group=2 loop_mode=one_shot\n");
+    static int16_t out[240 * 2 * 12];
+    memset(out, 0, sizeof(out));
+    PcmBufferWriter writer(out, sizeof(out));
+    SFZSink sink(sfz_path);
+    sink.setPcmWriter(&writer);
+    sink.begin();
+    sink.sendNoteOn(46, 127, 1);
+    for (int i = 0; i < 12; i++) {
+        if (i == 4) {
+            sink.sendNoteOn(42, 127, 1);
+        }
+        sink.update();
+    }
+    *choked = sink.getParam(Filter::PARAMID_CHOKED_VOICES);
+    EXPECT_TRUE(sink.setParam(Filter::PARAMID_CHOKED_VOICES, 0));
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_CHOKED_VOICES), 0);
+    return std::vector<int16_t>(&out[0], &out[240 * 2 * 12]);
+}
+
+static int16_t peakOfFrame(const std::vector<int16_t>& pcm, int frame) {
+    int16_t peak = 0;
+    for (int i = frame * 240 * 2; i < (frame + 1) * 240 * 2; i++) {
+        peak = (abs(pcm[i]) > peak) ? abs(pcm[i]) : peak;
+    }
+    return peak;
+}
+
+TEST_F(SfzTest, choke_open_hat) {
+    uint32_t choked = 0;
+    std::vector<int16_t> ringing = renderChoke("testdata/SFZSink/choke_none.sfz", "group=1", &choked);
+    EXPECT_EQ(choked, 0U);
+    std::vector<int16_t> choked_pcm = renderChoke("testdata/SFZSink/choke_off_by.sfz", "group=1 off_by=2", &choked);
+    EXPECT_EQ(choked, 1U);
+
+    // the open hat keeps ringing without off_by, and fades out within a few frames with it
+    EXPECT_GT(peakOfFrame(ringing, 11), 0);
+    EXPECT_GT(peakOfFrame(choked_pcm, 3), 0);
+    EXPECT_EQ(peakOfFrame(choked_pcm, 11), 0);
+    int first_silent = -1;
+    for (int i = 0; i < 12 && first_silent < 0; i++) {
+        first_silent = (peakOfFrame(choked_pcm, i) == 0) ? i : -1;
+    }
+    EXPECT_GE(first_silent, 4);
+    EXPECT_LE(first_silent, 8);
+}
+
+TEST_F(SfzTest, choke_roll) {
+    create_tone("testdata/SFZSink/roll_hat.raw", 100);
+    create_file("testdata/SFZSink/choke_roll.sfz",
+                "<region> sample=roll_hat.raw key=42 group=1 off_by=1 loop_mode=one_shot\n"
+                "");
+    static int16_t out[240 * 2 * 64];
+    PcmBufferWriter writer(out, sizeof(out));
+    SFZSink sink("testdata/SFZSink/choke_roll.sfz", 4);
+    sink.setPcmWriter(&writer);
+    sink.begin();
+    // each hit chokes the previous one, so the roll never needs to steal a voice
+    for (int i = 0; i < 32; i++) {
+        EXPECT_TRUE(sink.sendNoteOn(42, 127, 1));
+        sink.update();
+        sink.update();
+    }
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_CHOKED_VOICES), 31);
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_STOLEN_VOICES), 0);
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_DROPPED_VOICES), 0);
+}
+
+TEST_F(SfzTest, file_pool_params) {
+    create_tone("testdata/SFZSink/roll.raw", 100);
+    create_file("testdata/SFZSink/roll.sfz",
+                "<region> sample=roll.raw key=36\n"
+                "");
+    static int16_t out[240 * 2 * 8];
+    PcmBufferWriter writer(out, sizeof(out));
+    SFZSink sink("testdata/SFZSink/roll.sfz");
+    sink.setPcmWriter(&writer);
+    sink.begin();
+    EXPECT_TRUE(sink.isAvailable(Filter::PARAMID_FILE_OPENS));
+    EXPECT_TRUE(sink.isAvailable(Filter::PARAMID_FILE_HITS));
+    EXPECT_TRUE(sink.isAvailable(Filter::PARAMID_FILE_EVICTIONS));
+
+    // a roll on one sample opens the file once
+    for (int i = 0; i < 4; i++) {
+        sink.sendNoteOn(36, 127, 1);
+        sink.update();
+        sink.sendNoteOff(36, 0, 1);
+        sink.update();
+        sink.update();
+    }
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_FILE_OPENS), 1);
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_FILE_HITS), 3);
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_FILE_EVICTIONS), 0);
+
+    EXPECT_FALSE(sink.setParam(Filter::PARAMID_FILE_HITS, 1));
+    EXPECT_TRUE(sink.setParam(Filter::PARAMID_FILE_HITS, 0));
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_FILE_OPENS), 0);
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_FILE_HITS), 0);
+}
+
+TEST_F(SfzTest, sample_info_shared) {
+    create_tone("testdata/SFZSink/layer_a.raw", 100);
+    create_tone("testdata/SFZSink/layer_b.raw", 200);
+    create_file("testdata/SFZSink/sample_info_shared.sfz",
+                "<group> sample=layer_a.raw\n"
+                "<region> key=60 hivel=63\n"
+                "<region> key=60 lovel=64\n"
+                "<region> sample=layer_b.raw key=61 hivel=63\n"
+                "<region> sample=layer_b.raw key=61 lovel=64\n"
+                "<region> sample=missing.raw key=62\n"
+                "<region> sample=missing.raw key=63\n"
+                "");
+    SFZSink sfz_test = SFZSink("testdata/SFZSink/sample_info_shared.sfz");
+    sfz_test.begin();
+
+    ASSERT_EQ(sfz_test.getNumberOfRegions(), 4);
+    EXPECT_EQ(sfz_test.getNumberOfSamples(), 3);
+    for (size_t i = 0; i < sfz_test.getNumberOfRegions(); i++) {
+        EXPECT_EQ(sfz_test.getRegion(i)->pcm_offset, 0);
+        EXPECT_EQ(sfz_test.getRegion(i)->pcm_size, 4800 * 2 * sizeof(int16_t));
+    }
+    EXPECT_EQ(sfz_test.getRegion(0)->sample_id, sfz_test.getRegion(1)->sample_id);
+    EXPECT_EQ(sfz_test.getRegion(2)->sample_id, sfz_test.getRegion(3)->sample_id);
+    EXPECT_NE(sfz_test.getRegion(0)->sample_id, sfz_test.getRegion(2)->sample_id);
+    EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(0)->sample_id), "testdata/SFZSink/layer_a.raw");
+    EXPECT_EQ(sfz_test.getSamplePath(sfz_test.getRegion(2)->sample_id), "testdata/SFZSink/layer_b.raw");
+    EXPECT_EQ(sfz_test.getSamplePath(SFZSink::kNoSample), "");
+    EXPECT_LE(sizeof(SFZSink::Region), 64U);
+}
+
+static void expect_same_regions(SFZSink* expected, SFZSink* actual) {
+    ASSERT_EQ(actual->getNumberOfRegions(), expected->getNumberOfRegions());
+    for (size_t i = 0; i < expected->getNumberOfRegions(); i++) {
+        const SFZSink::Region* e = expected->getRegion(i);
+        const SFZSink::Region* a = actual->getRegion(i);
+        EXPECT_EQ(actual->getSamplePath(a->sample_id), expected->getSamplePath(e->sample_id));
+        EXPECT_EQ(a->choke_id, e->choke_id);
+        EXPECT_EQ(a->lokey, e->lokey);
+        EXPECT_EQ(a->hikey, e->hikey);
+        EXPECT_EQ(a->pitch_keycenter, e->pitch_keycenter);
+        EXPECT_EQ(a->tune, e->tune);
+        EXPECT_EQ(a->lovel, e->lovel);
+        EXPECT_EQ(a->hivel, e->hivel);
+        EXPECT_EQ(a->sw_last, e->sw_last);
+        EXPECT_EQ(a->gain, e->gain);
+        EXPECT_EQ(a->pan, e->pan);
+        EXPECT_EQ(a->ampeg_release, e->ampeg_release);
+        EXPECT_EQ(a->offset, e->offset);
+        EXPECT_EQ(a->end, e->end);
+        EXPECT_EQ(a->loop_mode, e->loop_mode);
+        EXPECT_EQ(a->loop_start, e->loop_start);
+        EXPECT_EQ(a->loop_end, e->loop_end);
+        EXPECT_EQ(a->silence, e->silence);
+    }
+    EXPECT_EQ(actual->getParam(SFZSink::PARAMID_SW_LAST), expected->getParam(SFZSink::PARAMID_SW_LAST));
+    EXPECT_EQ(actual->getParam(SFZSink::PARAMID_SW_LOKEY), expected->getParam(SFZSink::PARAMID_SW_LOKEY));
+    EXPECT_EQ(actual->getParam(SFZSink::PARAMID_SW_HIKEY), expected->getParam(SFZSink::PARAMID_SW_HIKEY));
+    EXPECT_EQ(actual->findRegion(61, 100, 1), expected->findRegion(61, 100, 1));
+}
+
+TEST_F(SfzTest, instrument_cache) {
+    const char kCachePath[] = "sfzsink_cache.sfz.bin";
+    remove(kCachePath);
+    create_tone("sfzsink_cache_a.raw", 100);
+    create_tone("sfzsink_cache_b.raw", 200);
+    create_file("sfzsink_cache_inc.sfz", "<region> sample=sfzsink_cache_b.raw key=62 end=-1\n");
+    create_file("sfzsink_cache.sfz",
+                "<control> sw_lokey=24 sw_hikey=25 sw_default=24\n"
+                "<group> sw_last=24 ampeg_release=0.25\n"
+                "<region> sample=sfzsink_cache_a.raw lokey=60 hikey=61 hivel=63 volume=-6 pan=20 pitch_keycenter=62 transpose=-1 tune=25\n"
+                "<region> sample=sfzsink_cache_a.raw lokey=60 hikey=61 lovel=64 offset=100 loop_mode=loop_continuous loop_end=2000 group=3 off_by=4\n"
+                "#include \"sfzsink_cache_inc.sfz\"\n"
+                "");
+
+    SFZSink parsed("sfzsink_cache.sfz");
+    parsed.setInstrumentCache(true);
+    parsed.begin();
+    EXPECT_FALSE(parsed.isLoadedFromCache());
+    ASSERT_EQ(parsed.getNumberOfRegions(), 3);
+    ASSERT_TRUE(Storage.exists(kCachePath));
+
+    SFZSink cached("sfzsink_cache.sfz");
+    cached.setInstrumentCache(true);
+    cached.begin();
+    EXPECT_TRUE(cached.isLoadedFromCache());
+    expect_same_regions(&parsed, &cached);
+
+    // a changed include invalidates the cache
+    create_file("sfzsink_cache_inc.sfz", "<region> sample=sfzsink_cache_b.raw key=63 end=-1\n");
+    SFZSink reparsed("sfzsink_cache.sfz");
+    reparsed.setInstrumentCache(true);
+    reparsed.begin();
+    EXPECT_FALSE(reparsed.isLoadedFromCache());
+    ASSERT_EQ(reparsed.getNumberOfRegions(), 3);
+    EXPECT_EQ(reparsed.getRegion(2)->lokey, 63);
+
+    SFZSink recached("sfzsink_cache.sfz");
+    recached.setInstrumentCache(true);
+    recached.begin();
+    EXPECT_TRUE(recached.isLoadedFromCache());
+    expect_same_regions(&reparsed, &recached);
+
+    // a replaced sample invalidates the cache too
+    create_tone("sfzsink_cache_b.raw", 300);
+    SFZSink resampled("sfzsink_cache.sfz");
+    resampled.setInstrumentCache(true);
+    resampled.begin();
+    EXPECT_FALSE(resampled.isLoadedFromCache());
+    ASSERT_EQ(resampled.getNumberOfRegions(), 3);
+
+    // disabled by default
+    SFZSink uncached("sfzsink_cache.sfz");
+    uncached.begin();
+    EXPECT_FALSE(uncached.isLoadedFromCache());
+    remove(kCachePath);
+}
+
+TEST_F(SfzTest, instrument_cache_broken) {
+    const char kCachePath[] = "sfzsink_cache_broken.sfz.bin";
+    create_tone("sfzsink_cache_a.raw", 100);
+    create_file("sfzsink_cache_broken.sfz", "<region> sample=sfzsink_cache_a.raw key=60\n");
+    {
+        File file(kCachePath, FILE_WRITE);
+        ASSERT_TRUE(static_cast<bool>(file));
+        file.write(reinterpret_cast<const uint8_t*>("SFZC\x01\x00\x00"), 7);
+        file.close();
+    }
+
+    SFZSink sink("sfzsink_cache_broken.sfz");
+    sink.setInstrumentCache(true);
+    sink.begin();
+    EXPECT_FALSE(sink.isLoadedFromCache());
+    EXPECT_EQ(sink.getNumberOfRegions(), 1);
+
+    SFZSink cached("sfzsink_cache_broken.sfz");
+    cached.setInstrumentCache(true);
+    cached.begin();
+    EXPECT_TRUE(cached.isLoadedFromCache());
+    EXPECT_EQ(cached.getNumberOfRegions(), 1);
+    remove(kCachePath);
+}
+
+TEST_F(SfzTest, voice_slab_no_allocation) {
+    // more sample files than the FilePool keeps open, so that handles are evicted and reused while counting
+    const int kSamples = FilePool::kDefaultCapacity + 4;
+    String sfz = "";
+    for (int i = 0; i < kSamples; i++) {
+        char line[96];
+        snprintf(line, sizeof(line), "testdata/SFZSink/slab_%02d.raw", i);
+        create_tone(line, 100 + i * 10);
+        snprintf(line, sizeof(line), "<region> sample=slab_%02d.raw key=%d loop_mode=loop_continuous\n", i, 60 + i);
+        sfz += line;
+    }
+    sfz += "<region> sample=slab_00.raw lokey=72 hikey=77 loop_mode=one_shot\n";
+    sfz += "<region> sample=slab_01.raw lokey=78 hikey=83 group=1 off_by=1 loop_mode=one_shot\n";
+    create_file("testdata/SFZSink/slab.sfz", sfz);
+    static int16_t out[240 * 2 * 8];
+    PcmBufferWriter writer(out, sizeof(out));
+    SFZSink sink("testdata/SFZSink/slab.sfz", 4);
+    sink.setPcmWriter(&writer);
+    sink.begin();
+
+    // a fixed pseudo-random burst of note-on, note-off and update
+    uint32_t seed = 12345;
+    auto burst = [&](int notes) {
+        for (int i = 0; i < notes; i++) {
+            seed = seed * 1103515245 + 12345;
+            uint8_t note = 60 + (seed >> 16) % 24;
+            // a playing one_shot holds its channel, so each region has its own
+            uint8_t channel = (note < 72) ? 1 : (note < 78) ? 2 : 3;
+            if ((seed >> 8) % 4 == 0) {
+                sink.sendNoteOff(note, 0, channel);
+            } else {
+                sink.sendNoteOn(note, 1 + (seed >> 4) % 127, channel);
+            }
+            if (i % 3 == 0) {
+                writer.rewind();
+                sink.update();
+            }
+        }
+    };
+    g_allocations = 0;
+    g_count_allocations = true;
+    burst(10000);
+    g_count_allocations = false;
+    EXPECT_EQ(g_allocations, 0U);
+    EXPECT_GT(sink.getParam(Filter::PARAMID_FILE_EVICTIONS), 0);
+    EXPECT_GT(sink.getParam(Filter::PARAMID_STOLEN_VOICES), 0);
+    EXPECT_GT(sink.getParam(Filter::PARAMID_CHOKED_VOICES), 0);
+}
+
+TEST_F(SfzTest, pitch_opcodes) {
+    create_file("testdata/SFZSink/pitch_opcodes.sfz",
+                "<region> sample=test.raw lokey=48 hikey=72\n"
+                "<region> sample=test.raw lokey=48 hikey=72 pitch_keycenter=60 transpose=-2 tune=-50\n"
+                "<region> sample=test.raw key=64 tune=100\n"
+                "<group> transpose=12\n"
+                "<region> sample=test.raw key=c4 pitch_keycenter=d4\n"
+                "");
+    SFZSink sfz_test = SFZSink("testdata/SFZSink/pitch_opcodes.sfz");
+    sfz_test.begin();
+
+    ASSERT_EQ(sfz_test.getNumberOfRegions(), 4);
+    EXPECT_EQ(sfz_test.getRegion(0)->pitch_keycenter, SFZSink::kNoPitchKeycenter);
+    EXPECT_EQ(sfz_test.getRegion(0)->tune, 0);
+    EXPECT_EQ(sfz_test.getRegion(1)->pitch_keycenter, 60);
+    EXPECT_EQ(sfz_test.getRegion(1)->tune, -250);
+    // key also sets the pitch_keycenter
+    EXPECT_EQ(sfz_test.getRegion(2)->pitch_keycenter, 64);
+    EXPECT_EQ(sfz_test.getRegion(2)->tune, 100);
+    EXPECT_EQ(sfz_test.getRegion(3)->lokey, 60);
+    EXPECT_EQ(sfz_test.getRegion(3)->pitch_keycenter, 62);
+    EXPECT_EQ(sfz_test.getRegion(3)->tune, 1200);
+}
+
+TEST_F(SfzTest, pitch_opcodes_out_of_range) {
+    create_file("testdata/SFZSink/pitch_opcodes_out_of_range.sfz",
+                "<region> sample=test.raw pitch_keycenter=128\n"
+                "<region> sample=test.raw transpose=-128\n"
+                "<region> sample=test.raw tune=101\n"
+                "");
+    SFZSink sfz_test = SFZSink("testdata/SFZSink/pitch_opcodes_out_of_range.sfz");
+    sfz_test.begin();
+
+    EXPECT_EQ(sfz_test.getNumberOfRegions(), 0);
+}
+
+// the ramp played by renderPitch()
+static int16_t pitchRamp(size_t frame) {
+    return (int16_t)(1000 + frame * 5);
+}
+
+// plays a note on a ramp sample and returns the rendered frames
+static std::vector<int16_t> renderPitch(const String& sfz_path, const char* opcodes, uint8_t note, int interpolation = -1) {
+    std::vector<int16_t> pcm(4800 * 2);
+    for (size_t i = 0; i < pcm.size(); i++) {
+        pcm[i] = pitchRamp(i / 2);
+    }
+    registerDummyFile("testdata/SFZSink/pitch.raw", reinterpret_cast<const uint8_t*>(pcm.data()), pcm.size() * sizeof(int16_t));
+    create_file(sfz_path, String("<region> sample=pitch.raw lokey=36 hikey=84 ") + opcodes + "\n");
+    static int16_t out[240 * 2 * 48];
+    memset(out, 0, sizeof(out));
+    PcmBufferWriter writer(out, sizeof(out));
+    SFZSink sink(sfz_path);
+    sink.setPcmWriter(&writer);
+    sink.begin();
+    if (interpolation >= 0) {
+        EXPECT_TRUE(sink.setParam(Filter::PARAMID_INTERPOLATION, interpolation));
+    }
+    sink.sendNoteOn(note, 127, 1);
+    for (int i = 0; i < 48; i++) {
+        sink.update();
+    }
+    return std::vector<int16_t>(&out[0], &out[240 * 2 * 48]);
+}
+
+// frames up to the last sounding one
+static size_t measureLength(const std::vector<int16_t>& pcm) {
+    size_t frames = pcm.size() / 2;
+    while (frames > 0 && pcm[(frames - 1) * 2] == 0) {
+        frames--;
+    }
+    return frames;
+}
+
+TEST_F(SfzTest, pitch_keycenter_unity) {
+    // without a pitch_keycenter every key plays the sample as it is
+    std::vector<int16_t> expected = renderPitch("testdata/SFZSink/pitch_none.sfz", "", 72);
+    EXPECT_EQ(measureLength(expected), 4800U);
+    // between the fade in of the first frame and the fade out at the end
+    for (size_t i = 240; i < 4800 - 240; i++) {
+        ASSERT_EQ(expected[i * 2], pitchRamp(i)) << "i=" << i;
+        ASSERT_EQ(expected[i * 2 + 1], pitchRamp(i)) << "i=" << i;
+    }
+    std::vector<int16_t> actual = renderPitch("testdata/SFZSink/pitch_unity.sfz", "pitch_keycenter=72", 72);
+    EXPECT_EQ(expected, actual);
+    // the cents cancel out
+    actual = renderPitch("testdata/SFZSink/pitch_cancel.sfz", "pitch_keycenter=71 tune=-100", 72);
+    EXPECT_EQ(expected, actual);
+}
+
+TEST_F(SfzTest, pitch_octave_up) {
+    for (int interpolation = 0; interpolation <= Resampler::kInterpolationMax; interpolation++) {
+        std::vector<int16_t> actual = renderPitch("testdata/SFZSink/pitch_up.sfz", "pitch_keycenter=60", 72, interpolation);
+        // the sample is read twice as fast
+        EXPECT_EQ(measureLength(actual), 2400U) << "interpolation=" << interpolation;
+        // every other frame of the ramp
+        for (size_t i = 240; i < 2400 - 240; i++) {
+            ASSERT_EQ(actual[i * 2], pitchRamp(i * 2)) << "interpolation=" << interpolation << ", i=" << i;
+        }
+    }
+    // transpose goes the same way
+    std::vector<int16_t> transposed = renderPitch("testdata/SFZSink/pitch_transpose.sfz", "pitch_keycenter=72 transpose=12", 72);
+    EXPECT_EQ(measureLength(transposed), 2400U);
+}
+
+TEST_F(SfzTest, pitch_octave_down) {
+    std::vector<int16_t> actual = renderPitch("testdata/SFZSink/pitch_down.sfz", "pitch_keycenter=60", 48, Resampler::kInterpolationLinear);
+    // the sample is read half as fast
+    EXPECT_EQ(measureLength(actual), 9600U);
+    // the ramp and the midpoints of the ramp
+    for (size_t i = 240; i < 9600 - 240; i += 2) {
+        ASSERT_EQ(actual[i * 2], pitchRamp(i / 2)) << "i=" << i;
+        ASSERT_EQ(actual[i * 2 + 2], (pitchRamp(i / 2) + pitchRamp(i / 2 + 1) + 1) / 2) << "i=" << i;
+    }
+}
+
+TEST_F(SfzTest, interpolation_param) {
+    SFZSink sink("testdata/SFZSink/pitch_none.sfz");
+    EXPECT_TRUE(sink.isAvailable(Filter::PARAMID_INTERPOLATION));
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_INTERPOLATION), Resampler::kInterpolationCubic);
+    EXPECT_TRUE(sink.setParam(Filter::PARAMID_INTERPOLATION, Resampler::kInterpolationSinc));
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_INTERPOLATION), Resampler::kInterpolationSinc);
+    EXPECT_FALSE(sink.setParam(Filter::PARAMID_INTERPOLATION, -1));
+    EXPECT_FALSE(sink.setParam(Filter::PARAMID_INTERPOLATION, Resampler::kInterpolationMax + 1));
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_INTERPOLATION), Resampler::kInterpolationSinc);
+}
+
+static void putLE(std::vector<uint8_t>* data, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        data->push_back((uint8_t)(value >> (i * 8)));
+    }
+}
+
+// an IMA ADPCM WAV file of random nibbles, and the same sound decoded to a raw PCM file
+static void create_adpcm(const String& wav_path, const String& raw_path, int channels, uint32_t frames) {
+    const int kBlockAlign = 36 * channels;  // 65 frames
+    const uint32_t kFramesPerBlock = ImaAdpcmDecoder::getFramesPerBlock(channels, kBlockAlign);
+    uint32_t blocks = (frames + kFramesPerBlock - 1) / kFramesPerBlock;
+    std::vector<uint8_t> data(blocks * kBlockAlign);
+    srand(frames);
+    for (auto& e : data) {
+        e = (uint8_t)rand();
+    }
+    std::vector<int16_t> pcm(blocks * kFramesPerBlock * 2);
+    for (uint32_t i = 0; i < blocks; i++) {
+        for (int c = 0; c < channels; c++) {
+            data[i * kBlockAlign + 4 * c + 2] = (uint8_t)(rand() % 89);
+            data[i * kBlockAlign + 4 * c + 3] = 0;
+        }
+        ImaAdpcmDecoder decoder;
+        ASSERT_TRUE(decoder.start(&data[i * kBlockAlign], kBlockAlign, channels));
+        ASSERT_EQ(decoder.decode(&pcm[i * kFramesPerBlock * 2], kFramesPerBlock), kFramesPerBlock);
+    }
+    // the fact chunk cuts the last block short
+    registerDummyFile(raw_path, reinterpret_cast<const uint8_t*>(pcm.data()), frames * 4);
+
+    std::vector<uint8_t> wav;
+    wav.insert(wav.end(), {'R', 'I', 'F', 'F'});
+    putLE(&wav, 4 + 28 + 12 + 8 + data.size(), 4);
+    wav.insert(wav.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+    putLE(&wav, 20, 4);
+    putLE(&wav, 0x0011, 2);  // WAVE_FORMAT_IMA_ADPCM
+    putLE(&wav, channels, 2);
+    putLE(&wav, 48000, 4);
+    putLE(&wav, 48000 * kBlockAlign / kFramesPerBlock, 4);
+    putLE(&wav, kBlockAlign, 2);
+    putLE(&wav, 4, 2);
+    putLE(&wav, 2, 2);
+    putLE(&wav, kFramesPerBlock, 2);
+    wav.insert(wav.end(), {'f', 'a', 'c', 't'});
+    putLE(&wav, 4, 4);
+    putLE(&wav, frames, 4);
+    wav.insert(wav.end(), {'d', 'a', 't', 'a'});
+    putLE(&wav, data.size(), 4);
+    wav.insert(wav.end(), data.begin(), data.end());
+    registerDummyFile(wav_path, wav.data(), wav.size());
+}
+
+// plays a looped and a one-shot region of the sample
+static std::vector<int16_t> renderAdpcm(const String& sfz_path, const String& sample, size_t budget, bool background, bool cache = false,
+                                        bool* loaded_from_cache = nullptr) {
+    create_file(sfz_path, "<region> sample=" + sample +
+                              " key=60 offset=100 loop_mode=loop_continuous loop_start=300 loop_end=1000\n"
+                              "<region> sample=" +
+                              sample + " key=62 offset=50\n");
+    static int16_t out[240 * 2 * 40];
+    memset(out, 0, sizeof(out));
+    PcmBufferWriter writer(out, sizeof(out));
+    SFZSink sink(sfz_path);
+    sink.setPcmWriter(&writer);
+    sink.setHeadCache(budget, 20);
+    sink.setBackgroundStreaming(background);
+    sink.setInstrumentCache(cache);
+    sink.begin();
+    if (loaded_from_cache != nullptr) {
+        *loaded_from_cache = sink.isLoadedFromCache();
+    }
+    sink.sendNoteOn(60, 127, 1);
+    sink.sendNoteOn(62, 127, 1);
+    for (int i = 0; i < 40; i++) {
+        if (background) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        sink.update();
+    }
+    return std::vector<int16_t>(&out[0], &out[240 * 2 * 40]);
+}
+
+TEST_F(SfzTest, adpcm_region) {
+    create_adpcm("testdata/SFZSink/adpcm_region.wav", "testdata/SFZSink/adpcm_region.raw", 2, 4800);
+    File file("testdata/SFZSink/adpcm_region.wav");
+    WavReader wav(file);
+    EXPECT_TRUE(wav.isWaveFile());
+    EXPECT_EQ(wav.getSampleFormat().codec, SampleFormat::kCodecImaAdpcm);
+    EXPECT_EQ(wav.getSampleFormat().frames_per_block, 65U);
+    EXPECT_EQ(wav.getFrameCount(), 4800U);
+    file.close();
+
+    create_file("testdata/SFZSink/adpcm_region.sfz", "<region> sample=adpcm_region.wav key=60 offset=10 loop_start=20 loop_end=29\n");
+    SFZSink sink("testdata/SFZSink/adpcm_region.sfz");
+    sink.begin();
+    // regions address the decoded frames
+    const SFZSink::Region* region = sink.getRegion(0);
+    EXPECT_EQ(region->pcm_offset, 0U);
+    EXPECT_EQ(region->pcm_size, 4800U * 4);
+    EXPECT_EQ(region->offset, 10U * 4);
+    EXPECT_EQ(region->end, 4800U * 4);
+    EXPECT_EQ(region->loop_start, 20U * 4);
+    EXPECT_EQ(region->loop_end, 30U * 4);
+}
+
+TEST_F(SfzTest, adpcm_matches_pcm) {
+    create_adpcm("testdata/SFZSink/adpcm_mono.wav", "testdata/SFZSink/adpcm_mono.raw", 1, 4800);
+    create_adpcm("testdata/SFZSink/adpcm_stereo.wav", "testdata/SFZSink/adpcm_stereo.raw", 2, 4800);
+    for (const char* name : {"adpcm_mono", "adpcm_stereo"}) {
+        String sfz = String("testdata/SFZSink/") + name;
+        String wav = String(name) + ".wav";
+        std::vector<int16_t> expected = renderAdpcm(sfz + "_pcm.sfz", String(name) + ".raw", 0, false);
+        EXPECT_GT(measureLength(expected), 0U);
+        // streamed, from the head cache and from the I/O thread
+        EXPECT_EQ(expected, renderAdpcm(sfz + "_stream.sfz", wav, 0, false)) << name;
+        EXPECT_EQ(expected, renderAdpcm(sfz + "_head.sfz", wav, 64 * 1024, false)) << name;
+        EXPECT_EQ(expected, renderAdpcm(sfz + "_background.sfz", wav, 64 * 1024, true)) << name;
+    }
+}
+
+TEST_F(SfzTest, adpcm_instrument_cache) {
+    const char kCachePath[] = "sfzsink_adpcm_cache.sfz.bin";
+    remove(kCachePath);
+    create_adpcm("sfzsink_adpcm_cache.wav", "sfzsink_adpcm_cache.raw", 2, 4800);
+    std::vector<int16_t> expected = renderAdpcm("sfzsink_adpcm_nocache.sfz", "sfzsink_adpcm_cache.wav", 0, false);
+    bool loaded = true;
+    std::vector<int16_t> saved = renderAdpcm("sfzsink_adpcm_cache.sfz", "sfzsink_adpcm_cache.wav", 0, false, true, &loaded);
+    EXPECT_FALSE(loaded);
+    std::vector<int16_t> actual = renderAdpcm("sfzsink_adpcm_cache.sfz", "sfzsink_adpcm_cache.wav", 0, false, true, &loaded);
+    EXPECT_TRUE(loaded);
+    EXPECT_EQ(expected, saved);
+    EXPECT_EQ(expected, actual);
+    remove(kCachePath);
+}
+
+// a WAV file of a random sound in the given format, and the same sound as a raw 16bit, 2ch PCM file
+static void create_wav(const String& wav_path, const String& raw_path, uint16_t format_tag, int channels, int bits, uint32_t rate, uint32_t frames,
+                       bool extensible = false) {
+    std::vector<int16_t> pcm(frames * 2);
+    std::vector<uint8_t> data;
+    srand(frames + bits * 3 + channels);
+    for (uint32_t i = 0; i < frames; i++) {
+        for (int c = 0; c < channels; c++) {
+            int16_t value = (int16_t)((rand() % 60000) - 30000);
+            pcm[i * 2 + c] = value;
+            if (bits == 16) {
+                putLE(&data, (uint16_t)value, 2);
+            } else if (bits == 24) {
+                putLE(&data, (uint32_t)value << 8, 3);
+            } else {
+                float f = value / 32768.0f;
+                uint32_t u = 0;
+                memcpy(&u, &f, sizeof(u));
+                putLE(&data, u, 4);
+            }
+        }
+        pcm[i * 2 + 1] = pcm[i * 2 + channels - 1];
+    }
+    registerDummyFile(raw_path, reinterpret_cast<const uint8_t*>(pcm.data()), frames * 4);
+
+    const uint32_t fmt_size = extensible ? 40 : 16;
+    std::vector<uint8_t> wav;
+    wav.insert(wav.end(), {'R', 'I', 'F', 'F'});
+    putLE(&wav, 4 + 8 + fmt_size + 8 + data.size(), 4);
+    wav.insert(wav.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+    putLE(&wav, fmt_size, 4);
+    putLE(&wav, extensible ? 0xFFFE : format_tag, 2);
+    putLE(&wav, channels, 2);
+    putLE(&wav, rate, 4);
+    putLE(&wav, rate * channels * bits / 8, 4);
+    putLE(&wav, channels * bits / 8, 2);
+    putLE(&wav, bits, 2);
+    if (extensible) {
+        putLE(&wav, 22, 2);
+        putLE(&wav, bits, 2);
+        putLE(&wav, (channels == 1) ? 0x4 : 0x3, 4);
+        putLE(&wav, format_tag, 2);
+        wav.insert(wav.end(), {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71});
+    }
+    wav.insert(wav.end(), {'d', 'a', 't', 'a'});
+    putLE(&wav, data.size(), 4);
+    wav.insert(wav.end(), data.begin(), data.end());
+    registerDummyFile(wav_path, wav.data(), wav.size());
+}
+
+static void expect_within(const std::vector<int16_t>& expected, const std::vector<int16_t>& actual, int tolerance, const char* name) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        int diff = expected[i] - actual[i];
+        ASSERT_LE(abs(diff), tolerance) << name << " sample " << i;
+    }
+}
+
+TEST_F(SfzTest, converted_region) {
+    struct {
+        const char* name;
+        uint16_t format_tag;
+        int channels;
+        int bits;
+        bool extensible;
+        SampleFormat::Codec codec;
+    } cases[] = {
+        {"conv_mono16", 0x0001, 1, 16, false, SampleFormat::kCodecPcm},  {"conv_stereo24", 0x0001, 2, 24, false, SampleFormat::kCodecPcm24},
+        {"conv_mono24", 0x0001, 1, 24, true, SampleFormat::kCodecPcm24}, {"conv_float", 0x0003, 2, 32, false, SampleFormat::kCodecFloat},
+        {"conv_ext16", 0x0001, 2, 16, true, SampleFormat::kCodecPcm},
+    };
+    for (const auto& e : cases) {
+        String path = String("testdata/SFZSink/") + e.name;
+        create_wav(path + ".wav", path + ".raw", e.format_tag, e.channels, e.bits, 44100, 1000, e.extensible);
+        File file((path + ".wav").c_str());
+        WavReader wav(file);
+        EXPECT_TRUE(wav.isWaveFile()) << e.name;
+        SampleFormat format = wav.getSampleFormat();
+        EXPECT_EQ(format.codec, e.codec) << e.name;
+        EXPECT_EQ(format.channels, e.channels) << e.name;
+        EXPECT_EQ(format.block_align, e.channels * e.bits / 8) << e.name;
+        EXPECT_EQ(format.sample_rate, 44100U) << e.name;
+        EXPECT_EQ(wav.getFrameCount(), 1000U) << e.name;
+        file.close();
+    }
+
+    // regions address the converted frames, 16bit 2ch the file
+    create_file("testdata/SFZSink/conv_region.sfz",
+                "<region> sample=conv_mono16.wav key=60 offset=10\n"
+                "<region> sample=conv_ext16.wav key=61 offset=10\n");
+    SFZSink sink("testdata/SFZSink/conv_region.sfz");
+    sink.begin();
+    const SFZSink::Region* region = sink.getRegion(0);
+    EXPECT_EQ(region->pcm_offset, 0U);
+    EXPECT_EQ(region->pcm_size, 1000U * 4);
+    EXPECT_EQ(region->offset, 10U * 4);
+    region = sink.getRegion(1);
+    EXPECT_EQ(region->pcm_offset, 68U);
+    EXPECT_EQ(region->offset, 68U + 10U * 4);
+}
+
+TEST_F(SfzTest, converted_unsupported) {
+    // 8bit and 3 channels are read as raw 16bit 2ch PCM, as any other file
+    create_wav("testdata/SFZSink/conv_8bit.wav", "testdata/SFZSink/conv_8bit.raw", 0x0001, 2, 8, 48000, 100);
+    create_wav("testdata/SFZSink/conv_3ch.wav", "testdata/SFZSink/conv_3ch.raw", 0x0001, 3, 16, 48000, 100);
+    create_wav("testdata/SFZSink/conv_22k.wav", "testdata/SFZSink/conv_22k.raw", 0x0001, 2, 16, 22050, 100);
+    for (const char* path : {"testdata/SFZSink/conv_8bit.wav", "testdata/SFZSink/conv_3ch.wav", "testdata/SFZSink/conv_22k.wav"}) {
+        File file(path);
+        WavReader wav(file);
+        EXPECT_FALSE(wav.isWaveFile()) << path;
+        EXPECT_EQ(wav.getSampleFormat().codec, SampleFormat::kCodecPcm) << path;
+        EXPECT_EQ(wav.getSampleFormat().channels, 2) << path;
+        file.close();
+    }
+}
+
+TEST_F(SfzTest, converted_matches_pcm) {
+    create_wav("testdata/SFZSink/conv_m16.wav", "testdata/SFZSink/conv_m16.raw", 0x0001, 1, 16, 48000, 4800);
+    create_wav("testdata/SFZSink/conv_s24.wav", "testdata/SFZSink/conv_s24.raw", 0x0001, 2, 24, 48000, 4800);
+    create_wav("testdata/SFZSink/conv_m24.wav", "testdata/SFZSink/conv_m24.raw", 0x0001, 1, 24, 48000, 4800, true);
+    create_wav("testdata/SFZSink/conv_f32.wav", "testdata/SFZSink/conv_f32.raw", 0x0003, 2, 32, 48000, 4800);
+    // 16bit is upmixed as it is, the others within the dither of each of the two voices
+    struct {
+        const char* name;
+        int tolerance;
+    } cases[] = {{"conv_m16", 0}, {"conv_s24", 2}, {"conv_m24", 2}, {"conv_f32", 2}};
+    for (const auto& e : cases) {
+        String sfz = String("testdata/SFZSink/") + e.name;
+        String wav = String(e.name) + ".wav";
+        std::vector<int16_t> expected = renderAdpcm(sfz + "_pcm.sfz", String(e.name) + ".raw", 0, false);
+        EXPECT_GT(measureLength(expected), 0U);
+        // streamed, from the head cache and from the I/O thread
+        expect_within(expected, renderAdpcm(sfz + "_stream.sfz", wav, 0, false), e.tolerance, e.name);
+        expect_within(expected, renderAdpcm(sfz + "_head.sfz", wav, 64 * 1024, false), e.tolerance, e.name);
+        expect_within(expected, renderAdpcm(sfz + "_background.sfz", wav, 64 * 1024, true), e.tolerance, e.name);
+    }
+}
+
+TEST_F(SfzTest, converted_sample_rate) {
+    // 4410 frames at 44.1kHz last 4800 frames at 48kHz
+    create_wav("testdata/SFZSink/conv_44k.wav", "testdata/SFZSink/conv_44k.raw", 0x0001, 2, 16, 44100, 4410);
+    create_wav("testdata/SFZSink/conv_48k.wav", "testdata/SFZSink/conv_48k.raw", 0x0001, 2, 16, 48000, 4410);
+    for (const char* sample : {"conv_44k.wav", "conv_48k.wav"}) {
+        create_file("testdata/SFZSink/conv_rate.sfz", String("<region> sample=") + sample + " key=60\n");
+        static int16_t out[240 * 2 * 48];
+        memset(out, 0, sizeof(out));
+        PcmBufferWriter writer(out, sizeof(out));
+        SFZSink sink("testdata/SFZSink/conv_rate.sfz");
+        sink.setPcmWriter(&writer);
+        sink.begin();
+        sink.sendNoteOn(60, 127, 1);
+        for (int i = 0; i < 48; i++) {
+            sink.update();
+        }
+        size_t length = measureLength(std::vector<int16_t>(&out[0], &out[240 * 2 * 48]));
+        if (strcmp(sample, "conv_48k.wav") == 0) {
+            EXPECT_EQ(length, 4410U);
+        } else {
+            EXPECT_NEAR((double)length, 4800.0, 4.0);
+        }
+    }
+}
+
+TEST_F(SfzTest, converted_instrument_cache) {
+    const char kCachePath[] = "sfzsink_conv_cache.sfz.bin";
+    remove(kCachePath);
+    create_wav("sfzsink_conv_cache.wav", "sfzsink_conv_cache.raw", 0x0001, 1, 24, 44100, 4800);
+    std::vector<int16_t> expected = renderAdpcm("sfzsink_conv_nocache.sfz", "sfzsink_conv_cache.wav", 0, false);
+    bool loaded = true;
+    std::vector<int16_t> saved = renderAdpcm("sfzsink_conv_cache.sfz", "sfzsink_conv_cache.wav", 0, false, true, &loaded);
+    EXPECT_FALSE(loaded);
+    std::vector<int16_t> actual = renderAdpcm("sfzsink_conv_cache.sfz", "sfzsink_conv_cache.wav", 0, false, true, &loaded);
+    EXPECT_TRUE(loaded);
+    EXPECT_EQ(expected, saved);
+    EXPECT_EQ(expected, actual);
+    remove(kCachePath);
+}
+
+// plays a one-shot region of the sample with the given read size
+static std::vector<int16_t> renderReadSize(const String& sfz_path, const String& sample, size_t read_size, DummyIoStats* stats) {
+    create_file(sfz_path, "<region> sample=" + sample + " key=60 offset=100\n");
+    static int16_t out[240 * 2 * 40];
+    memset(out, 0, sizeof(out));
+    PcmBufferWriter writer(out, sizeof(out));
+    SFZSink sink(sfz_path);
+    sink.setPcmWriter(&writer);
+    if (read_size > 0) {
+        sink.setReadSize(read_size);
+    }
+    sink.begin();
+    resetDummyIoStats();
+    sink.sendNoteOn(60, 127, 1);
+    for (int i = 0; i < 40; i++) {
+        sink.update();
+    }
+    *stats = getDummyIoStats();
+    return std::vector<int16_t>(&out[0], &out[240 * 2 * 40]);
+}
+
+TEST_F(SfzTest, read_size) {
+    create_wav("testdata/SFZSink/read_size.wav", "testdata/SFZSink/read_size.raw", 0x0001, 2, 16, 48000, 9000);
+    DummyIoStats fine;
+    DummyIoStats coalesced;
+    DummyIoStats large;
+    std::vector<int16_t> expected = renderReadSize("testdata/SFZSink/read_size_fine.sfz", "read_size.wav", 1, &fine);
+    EXPECT_GT(measureLength(expected), 8000U);
+    EXPECT_EQ(expected, renderReadSize("testdata/SFZSink/read_size_default.sfz", "read_size.wav", 0, &coalesced));
+    EXPECT_EQ(expected, renderReadSize("testdata/SFZSink/read_size_large.sfz", "read_size.wav", 100000, &large));
+    EXPECT_EQ(fine.read_bytes, (9000U - 100U) * 4);
+    EXPECT_EQ(coalesced.read_bytes, fine.read_bytes);
+    EXPECT_EQ(large.read_bytes, fine.read_bytes);
+
+    // the sizes are rounded into 512 to 16384 bytes, and every read but the first starts on a sector
+    EXPECT_EQ(fine.read_calls, (44U + 9000U * 4 + 511U) / 512U - (44U + 100U * 4) / 512U);
+    EXPECT_EQ(coalesced.read_calls, 9U);
+    EXPECT_EQ(large.read_calls, 3U);
+    EXPECT_EQ(fine.unaligned_reads, 1U);
+    EXPECT_EQ(coalesced.unaligned_reads, 1U);
+    EXPECT_EQ(large.unaligned_reads, 1U);
+}
+
+// a roll of 8 notes, 15 ms apart, on one sample or on 8 copies of it
+static std::vector<int16_t> renderRoll(const String& sfz_path, bool copies, DummyIoStats* stats) {
+    String sfz;
+    for (int i = 0; i < 8; i++) {
+        sfz += String("<region> sample=") + (copies ? String("roll_") + i : String("roll_0")) + ".wav key=" + (60 + i) + "\n";
+    }
+    create_file(sfz_path, sfz);
+    static int16_t out[240 * 2 * 60];
+    memset(out, 0, sizeof(out));
+    PcmBufferWriter writer(out, sizeof(out));
+    SFZSink sink(sfz_path, 8);
+    sink.setPcmWriter(&writer);
+    sink.begin();
+    resetDummyIoStats();
+    for (int i = 0; i < 60; i++) {
+        if (i % 3 == 0 && i / 3 < 8) {
+            sink.sendNoteOn(60 + i / 3, 127, 1);
+        }
+        sink.update();
+    }
+    *stats = getDummyIoStats();
+    EXPECT_EQ(sink.getParam(Filter::PARAMID_DROPPED_VOICES), 0);
+    return std::vector<int16_t>(&out[0], &out[240 * 2 * 60]);
+}
+
+TEST_F(SfzTest, shared_streaming) {
+    for (int i = 0; i < 8; i++) {
+        create_wav(String("testdata/SFZSink/roll_") + i + ".wav", String("testdata/SFZSink/roll_") + i + ".raw", 0x0001, 2, 16, 48000, 12000);
+    }
+    DummyIoStats separate;
+    DummyIoStats shared;
+    std::vector<int16_t> expected = renderRoll("testdata/SFZSink/roll_copies.sfz", true, &separate);
+    std::vector<int16_t> actual = renderRoll("testdata/SFZSink/roll_shared.sfz", false, &shared);
+    EXPECT_EQ(expected, actual);
+    // the 8 voices each read the whole sample from their own file, but the first voice alone from a shared one
+    EXPECT_EQ(separate.read_bytes, 8U * 12000U * 4U);
+    EXPECT_EQ(shared.read_bytes, 12000U * 4U);
+}
@@ -8,6 +8,7 @@
 #define DUMMY_ARDUINO_H_
 
 #include <ctype.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -67,6 +68,7 @@ int isWhitespace(int ch);
 // Time
 
 uint64_t millis(void);
+uint64_t micros(void);
 uint64_t getTime(void);
 void setTime(uint64_t time);
 
@@ -56,4 +56,23 @@ public:
 
 void registerDummyFile(const String &path, const uint8_t *content, int size);
 
+// every File::read() sleeps for the given time to emulate a slow storage, 0 to disable
+void setDummyReadLatency(uint32_t latency_us);
+
+// I/O accounting of File::read(buf, len) and File::seek() on all files, to see the read pattern of a storage
+struct DummyIoStats {
+    uint32_t open_calls;  // files opened for reading, including copies of File
+    uint32_t byte_reads;  // File::read() of one byte, not counted in the fields below
+    uint32_t read_calls;
+    uint32_t seek_calls;
+    uint32_t read_bytes;
+    uint32_t unaligned_reads;  // reads not starting on a sector
+    uint32_t sectors;          // sectors touched by the reads, counted again when read again
+};
+
+const uint32_t kDummySectorSize = 512;
+
+DummyIoStats getDummyIoStats(void);
+void resetDummyIoStats(void);
+
 #endif  // DUMMY_FILE_H_
@@ -9,6 +9,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <mutex>
 #include <vector>
 
 #include <strings.h>
@@ -105,6 +106,11 @@ uint64_t millis(void) {
     return g_ms;
 }
 
+uint64_t micros(void) {
+    // follows the virtual clock without advancing it, so measured durations are deterministic
+    return g_ms * 1000;
+}
+
 uint64_t getTime(void) {
     return g_ms;
 }
@@ -930,6 +936,52 @@ struct DummyFile {
 
 std::vector<DummyFile> g_dummy_files;
 
+static volatile uint32_t g_read_latency_us = 0;
+
+void setDummyReadLatency(uint32_t latency_us) {
+    g_read_latency_us = latency_us;
+}
+
+static std::mutex g_io_mutex;  // the I/O thread of SampleStreamer reads too
+static DummyIoStats g_io_stats = {};
+
+static void countRead(uint32_t pos, int size) {
+    std::lock_guard<std::mutex> lock(g_io_mutex);
+    g_io_stats.read_calls++;
+    if (pos % kDummySectorSize != 0) {
+        g_io_stats.unaligned_reads++;
+    }
+    if (size > 0) {
+        g_io_stats.read_bytes += size;
+        g_io_stats.sectors += (pos + size - 1) / kDummySectorSize - pos / kDummySectorSize + 1;
+    }
+}
+
+static void countOpen(void) {
+    std::lock_guard<std::mutex> lock(g_io_mutex);
+    g_io_stats.open_calls++;
+}
+
+static void countByteRead(void) {
+    std::lock_guard<std::mutex> lock(g_io_mutex);
+    g_io_stats.byte_reads++;
+}
+
+static void countSeek(void) {
+    std::lock_guard<std::mutex> lock(g_io_mutex);
+    g_io_stats.seek_calls++;
+}
+
+DummyIoStats getDummyIoStats(void) {
+    std::lock_guard<std::mutex> lock(g_io_mutex);
+    return g_io_stats;
+}
+
+void resetDummyIoStats(void) {
+    std::lock_guard<std::mutex> lock(g_io_mutex);
+    g_io_stats = DummyIoStats();
+}
+
 void registerDummyFile(const String &path, const uint8_t *content, int size) {
     for (auto &e : g_dummy_files) {
         if (e.path == path) {
@@ -959,11 +1011,13 @@ File::File(const char *name, uint8_t mode)
             name_ = strdup(name);
             size_ = e.size;
             curpos_ = 0;
-            dummy_file_content_ = new uint8_t[e.size];
+            // from the C heap like a FILE of fopen(), so that a test counting operator new sees only the library
+            dummy_file_content_ = (uint8_t *)malloc(e.size);
             if (dummy_file_content_) {
                 memcpy(dummy_file_content_, e.content, e.size);
             }
             dummy_files_index_ = index;
+            countOpen();
             return;
         } else if (e.path.startsWith(name)) {
             is_directory_ = true;
@@ -981,6 +1035,7 @@ File::File(const char *name, uint8_t mode)
             size_ = ftell(fp_);
             fseek(fp_, 0, SEEK_SET);
             curpos_ = ftell(fp_);
+            countOpen();
         }
     } else if (mode == FILE_WRITE) {
         fp_ = fopen(name, "wb");
@@ -1012,7 +1067,7 @@ File::~File(void) {
         name_ = nullptr;
     }
     if (dummy_file_content_) {
-        delete[] dummy_file_content_;
+        free(dummy_file_content_);
         dummy_file_content_ = nullptr;
     }
 }
@@ -1030,7 +1085,7 @@ File &File::operator=(const File &lhs) {
         name_ = nullptr;
     }
     if (dummy_file_content_) {
-        delete[] dummy_file_content_;
+        free(dummy_file_content_);
         dummy_file_content_ = nullptr;
     }
 
@@ -1043,7 +1098,7 @@ File &File::operator=(const File &lhs) {
             name_ = strdup(name);
             size_ = e.size;
             curpos_ = 0;
-            dummy_file_content_ = new uint8_t[e.size];
+            dummy_file_content_ = (uint8_t *)malloc(e.size);
             if (dummy_file_content_) {
                 memcpy(dummy_file_content_, e.content, e.size);
             }
@@ -1065,6 +1120,7 @@ File &File::operator=(const File &lhs) {
             size_ = ftell(fp_);
             fseek(fp_, 0, SEEK_SET);
             curpos_ = ftell(fp_);
+            countOpen();
         }
     } else if (mode == FILE_WRITE) {
         fp_ = fopen(name, "wb");
@@ -1085,7 +1141,7 @@ size_t File::write(uint8_t val) {
         ret = fwrite(&val, sizeof(val), 1, fp_);
         if (ret >= 0) {
             curpos_ += ret;
-            size_ = curpos_;
+            size_ = (size_ < curpos_) ? curpos_ : size_;
         }
     }
     return ret;
@@ -1095,10 +1151,10 @@ size_t File::write(const uint8_t *buf, size_t len) {
     // printf("%s:%d:%s(%p,%u)\n", __FILE__, __LINE__, __func__, buf, len);
     size_t ret = 0;
     if (fp_) {
-        ret = fwrite(&buf, sizeof(buf[0]), len, fp_);
+        ret = fwrite(buf, sizeof(buf[0]), len, fp_);
         if (ret >= 0) {
             curpos_ += ret;
-            size_ = curpos_;
+            size_ = (size_ < curpos_) ? curpos_ : size_;
         }
     }
     return ret;
@@ -1111,6 +1167,7 @@ int File::read(void) {
         if (curpos_ >= size_) {
             return -1;
         }
+        countByteRead();
         return (int)((unsigned char)dummy_file_content_[curpos_++]);
     }
     uint8_t data = 0;
@@ -1118,6 +1175,7 @@ int File::read(void) {
         ret = fread(&data, sizeof(data), 1, fp_);
         if (ret >= 1) {
             curpos_ += ret;
+            countByteRead();
             return data;
         }
     }
@@ -1166,7 +1224,11 @@ void File::flush(void) {
 
 int File::read(void *buf, size_t len) {
     // printf("%s:%d:%s(%p,%u)\n", __FILE__, __LINE__, __func__, buf, len);
+    if (g_read_latency_us > 0) {
+        usleep(g_read_latency_us);
+    }
     size_t ret = -1;
+    uint32_t pos = curpos_;
     if (dummy_file_content_ != nullptr && 0 < size()) {
         if (buf == nullptr) {
             return ret;
@@ -1174,6 +1236,7 @@ int File::read(void *buf, size_t len) {
         ret = (len < (size_t)available()) ? len : available();
         memcpy(buf, dummy_file_content_ + curpos_, ret);
         curpos_ += ret;
+        countRead(pos, (int)ret);
         return ret;
     }
     if (fp_) {
@@ -1181,12 +1244,14 @@ int File::read(void *buf, size_t len) {
         if (ret >= 0) {
             curpos_ += ret;
         }
+        countRead(pos, (int)ret);
     }
     return ret;
 }
 
 boolean File::seek(uint32_t pos) {
     // printf("%s:%d:%s(%u)\n", __FILE__, __LINE__, __func__, pos);
+    countSeek();
     if (dummy_file_content_ != nullptr && 0 < size()) {
         curpos_ = (pos < size_) ? pos : size();
         return true;
@@ -1506,8 +1571,10 @@ void OutputMixer::flush(int n) {
     if ((int)queue_.size() < n) {
         n = queue_.size();
     }
-    for (int i = 0; i < n; i++) {
-        auto &e = queue_[i];
+    // dequeue first: the callbacks may send the next data and grow queue_
+    std::vector<AsSendDataOutputMixer> done(queue_.begin(), queue_.begin() + n);
+    queue_.erase(queue_.begin(), queue_.begin() + n);
+    for (auto &e : done) {
         if (handler_) {
             // printf("handler_\n");
             handler_(handler_arg_, &e);
@@ -1518,9 +1585,6 @@ void OutputMixer::flush(int n) {
         }
         e.pcm.mh.freeSeg();
     }
-    for (int i = 0; i < n; i++) {
-        queue_.erase(queue_.begin());
-    }
 }
 
 void OutputMixer::clear() {
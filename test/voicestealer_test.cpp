@@ -0,0 +1,87 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <gtest/gtest.h>
+
+#include "VoiceStealer.h"
+
+TEST(VoiceStealer, Oldest) {
+    VoiceStealer stealer;
+    EXPECT_EQ(stealer.getPolicy(), VoiceStealer::kStealOldest);
+    stealer.start(2, 60, 1, 100);
+    stealer.start(0, 62, 1, 100);
+    stealer.start(1, 64, 1, 100);
+    EXPECT_EQ(stealer.getActiveCount(), 3);
+    EXPECT_EQ(stealer.steal(65, 1), 2);
+    stealer.stop(2);
+    EXPECT_EQ(stealer.getActiveCount(), 2);
+    EXPECT_EQ(stealer.steal(65, 1), 0);
+    EXPECT_EQ(stealer.getStolenCount(), 2U);
+}
+
+TEST(VoiceStealer, Quietest) {
+    VoiceStealer stealer(VoiceStealer::kStealQuietest);
+    stealer.start(0, 60, 1, 300);
+    stealer.start(1, 62, 1, 100);
+    stealer.start(2, 64, 1, 100);
+    EXPECT_EQ(stealer.steal(65, 1), 1);
+    stealer.setLevel(2, 50);
+    EXPECT_EQ(stealer.steal(65, 1), 2);
+}
+
+TEST(VoiceStealer, SameNote) {
+    VoiceStealer stealer(VoiceStealer::kStealSameNote);
+    stealer.start(0, 60, 1, 100);
+    stealer.start(1, 62, 1, 100);
+    stealer.start(2, 62, 2, 100);
+    EXPECT_EQ(stealer.steal(62, 2), 2);
+    EXPECT_EQ(stealer.steal(62, 1), 1);
+    // falls back to the oldest voice
+    EXPECT_EQ(stealer.steal(64, 1), 0);
+}
+
+TEST(VoiceStealer, ReleasedFirst) {
+    VoiceStealer stealer(VoiceStealer::kStealReleasedFirst);
+    stealer.start(0, 60, 1, 100);
+    stealer.start(1, 62, 1, 100);
+    stealer.start(2, 64, 1, 100);
+    EXPECT_EQ(stealer.steal(65, 1), 0);
+    stealer.release(2);
+    stealer.release(1);
+    EXPECT_EQ(stealer.steal(65, 1), 1);
+    // a restarted voice is not released anymore
+    stealer.start(1, 66, 1, 100);
+    EXPECT_EQ(stealer.steal(65, 1), 2);
+}
+
+TEST(VoiceStealer, NoneAndCounters) {
+    VoiceStealer stealer;
+    EXPECT_EQ(stealer.steal(60, 1), -1);
+    EXPECT_FALSE(stealer.setPolicy(-1));
+    EXPECT_FALSE(stealer.setPolicy(VoiceStealer::kPolicyMax + 1));
+    EXPECT_TRUE(stealer.setPolicy(VoiceStealer::kStealNone));
+    stealer.start(0, 60, 1, 100);
+    EXPECT_EQ(stealer.steal(62, 1), -1);
+    stealer.drop();
+    EXPECT_EQ(stealer.getStolenCount(), 0U);
+    EXPECT_EQ(stealer.getDroppedCount(), 1U);
+    stealer.resetCounters();
+    EXPECT_EQ(stealer.getDroppedCount(), 0U);
+}
+
+TEST(VoiceStealer, Reserve) {
+    VoiceStealer stealer;
+    stealer.reserve(4);
+    EXPECT_EQ(stealer.getActiveCount(), 0);
+    EXPECT_EQ(stealer.steal(60, 1), -1);
+    stealer.start(3, 60, 1, 100);
+    stealer.start(1, 62, 1, 100);
+    EXPECT_EQ(stealer.getActiveCount(), 2);
+    EXPECT_EQ(stealer.steal(64, 1), 3);
+    // never shrinks
+    stealer.reserve(2);
+    EXPECT_EQ(stealer.steal(64, 1), 3);
+}
@@ -0,0 +1,72 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2023 Sony Semiconductor Solutions Corporation
+ */
+
+#include <gtest/gtest.h>
+
+#include <Arduino.h>
+
+#include <File.h>
+
+#include "PcmWriter.h"
+#include "WavReader.h"
+#include "WavWriter.h"
+
+TEST(WavWriter, RoundTrip) {
+    const char kPath[] = "wavwriter_roundtrip.wav";
+    int16_t pcm[480];
+    for (int i = 0; i < 480; i++) {
+        pcm[i] = (int16_t)(i * 64 - 15000);
+    }
+    {
+        File file(kPath, FILE_WRITE);
+        ASSERT_TRUE(static_cast<bool>(file));
+        WavWriter writer(file, 48000, 16, 2);
+        EXPECT_TRUE(writer.begin());
+        EXPECT_EQ(writer.write(pcm, 400), 400U);
+        EXPECT_EQ(writer.write(&pcm[200], sizeof(pcm) - 400), sizeof(pcm) - 400);
+        EXPECT_TRUE(writer.end());
+        EXPECT_EQ(writer.getPcmSize(), sizeof(pcm));
+        file.close();
+    }
+
+    File file(kPath);
+    ASSERT_TRUE(static_cast<bool>(file));
+    EXPECT_EQ(file.size(), 44 + sizeof(pcm));
+    WavReader reader(file);
+    EXPECT_TRUE(reader.isWaveFile());
+    EXPECT_EQ(reader.getPcmOffset(), 44U);
+    EXPECT_EQ(reader.getPcmSize(), sizeof(pcm));
+
+    int16_t actual[480];
+    file.seek(reader.getPcmOffset());
+    EXPECT_EQ(file.read(actual, sizeof(actual)), (int)sizeof(actual));
+    for (int i = 0; i < 480; i++) {
+        EXPECT_EQ(actual[i], pcm[i]);
+    }
+    file.close();
+    remove(kPath);
+}
+
+TEST(WavWriter, InvalidFile) {
+    File file;
+    WavWriter writer(file, 48000, 16, 2);
+    EXPECT_FALSE(writer.begin());
+    EXPECT_EQ(writer.write("abcd", 4), 0U);
+    EXPECT_FALSE(writer.end());
+}
+
+TEST(PcmBufferWriter, Capacity) {
+    uint8_t buffer[10];
+    PcmBufferWriter writer(buffer, sizeof(buffer));
+    EXPECT_EQ(writer.write("abcdef", 6), 6U);
+    EXPECT_EQ(writer.write("ghijkl", 6), 4U);
+    EXPECT_EQ(writer.getSize(), 10U);
+    EXPECT_EQ(memcmp(buffer, "abcdefghij", 10), 0);
+    writer.rewind();
+    EXPECT_EQ(writer.getSize(), 0U);
+    EXPECT_EQ(writer.write("xyz", 3), 3U);
+    EXPECT_EQ(memcmp(buffer, "xyzdefghij", 10), 0);
+}
@@ -16,6 +16,8 @@ parser = argparse.ArgumentParser(
 )
 parser.add_argument('filename', nargs='+')
 parser.add_argument('-o', '--out', default='output')
+parser.add_argument('--expand-keys', action='store_true',
+                    help='render a pitch shifted sample for every key')
 
 args = parser.parse_args()
 
@@ -138,6 +140,13 @@ def getKeyOpcodes(headers):
     return lokey, hikey, pitch_keycenter
 
 
+def hasPitchKeycenter(headers):
+    """Check if pitch_keycenter is specified directly or by key
+    """
+    return (getOpcodeValue(headers, 'pitch_keycenter') is not None or
+            getOpcodeValue(headers, 'key') is not None)
+
+
 def getOutputWavPath(sample, from_key, to_key):
     """Build path of output WAV file
     """
@@ -165,7 +174,9 @@ def parseRegion(context, region):
     default_path = context.get('default_path', '')
     sample = getOpcodeValue(headers, 'sample')
 
-    for key in range(lokey, hikey + 1):
+    # SFZSink shifts the pitch at play time, so every sample is converted once
+    keys = range(lokey, hikey + 1) if args.expand_keys else [pitch_keycenter]
+    for key in keys:
         input_path = os.path.join(parent_dir, default_path + sample)
         wav_path = getOutputWavPath(sample, pitch_keycenter, key)
         output_path = os.path.join(output_dir, default_path + wav_path)
@@ -174,10 +185,13 @@ def parseRegion(context, region):
                            OUT_FS, OUT_CHANNELS, OUT_BIT_WIDTH)
         fs = getAudioFs(input_path)
         new_region = region.cloneNode()
+        last_opcode = None
         for o in new_region.childNodes:
             if o.nodeType != sfzparser.Node.OPCODE_NODE:
                 continue
-            if o.nodeName in ['key', 'lokey', 'hikey', 'pitch_keycenter']:
+            last_opcode = o
+            if args.expand_keys and o.nodeName in ['key', 'lokey', 'hikey',
+                                                   'pitch_keycenter']:
                 o.textContent = str(key)
             if o.nodeName in ['sample']:
                 o.textContent = wav_path.replace('\\', '/')
@@ -187,6 +201,11 @@ def parseRegion(context, region):
                 if o.textContent != "-1":
                     sa = int(o.textContent)
                     o.textContent = str(int(sa * OUT_FS / fs))
+        if not args.expand_keys and not hasPitchKeycenter(headers):
+            # SFZSink keeps the pitch of the sample without pitch_keycenter
+            new_region.insertBefore(
+                sfzparser.OpcodeNode(' pitch_keycenter', str(key)),
+                last_opcode.nextSibling if last_opcode else None)
         region.parentNode.insertBefore(new_region, region)
     region.parentNode.removeChild(region)
 
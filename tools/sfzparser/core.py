@@ -76,7 +76,7 @@ class Node:
             self._children[index:index] = [newChild]
             newChild.parentNode = self
         else:
-            self.appendChlid(newChild)
+            self.appendChild(newChild)
 
     def removeChild(self, child):
         if child in self._children: